@@ -0,0 +1,516 @@
+#pragma once
+
+#include "UrlEncoder.h"
+
+#include <quicr/hex_endec.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Encodes and decodes whole files of urls/names using every core.
+namespace BulkFileProcessor
+{
+    // Size of a binary record, 16 byte big endian name plus the significant
+    // bit length of the namespace.
+    constexpr size_t Record_Size = sizeof(quicr::Name) + 1;
+
+    enum class Format
+    {
+        Text,
+        Binary
+    };
+
+    struct Options
+    {
+        Format format = Format::Text;
+        unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+        // Target size of each chunk of the input, chunks are moved to the
+        // next line (or record) boundary.
+        size_t chunk_size = 4 * 1024 * 1024;
+
+        // How many chunks may be finished but not yet written, this bounds
+        // the memory used for large inputs.
+        size_t max_pending_chunks = 64;
+    };
+
+    struct Result
+    {
+        std::uint64_t records = 0;
+        std::uint64_t failures = 0;
+        std::chrono::milliseconds elapsed{0};
+    };
+
+    // Read only view of a whole file
+    class MappedFile
+    {
+      public:
+        explicit MappedFile(const std::string& filename)
+        {
+#ifdef _WIN32
+            std::ifstream file(filename, std::ios::binary);
+            if (!file)
+                throw std::runtime_error("Error. Failed to open " + filename);
+
+            buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            view = std::string_view(buffer.data(), buffer.size());
+#else
+            fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Error. Failed to open " + filename);
+
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                close(fd);
+                throw std::runtime_error("Error. Failed to stat " + filename);
+            }
+
+            // mmap does not accept a zero length mapping
+            if (st.st_size == 0)
+                return;
+
+            void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Error. Failed to map " + filename);
+            }
+
+            // The file is read front to back by the workers
+            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            view = std::string_view(static_cast<const char*>(addr), st.st_size);
+#endif
+        }
+
+        ~MappedFile()
+        {
+#ifndef _WIN32
+            if (!view.empty())
+                munmap(const_cast<char*>(view.data()), view.size());
+            if (fd >= 0)
+                close(fd);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        std::string_view Data() const
+        {
+            return view;
+        }
+
+      private:
+        std::string_view view;
+#ifdef _WIN32
+        std::vector<char> buffer;
+#else
+        int fd = -1;
+#endif
+    };
+
+    // Appends the binary record of a namespace to out
+    inline void WriteRecord(std::string& out, const quicr::Namespace& ns)
+    {
+        std::vector<std::uint16_t> distribution = {64, 64};
+        auto words = quicr::HexEndec<sizeof(quicr::Name) * 8>::Decode(distribution, ns.name());
+
+        // Big endian so the records sort the same as the names
+        for (std::uint64_t word : words)
+            for (int shift = 56; shift >= 0; shift -= 8)
+                out.push_back(static_cast<char>((word >> shift) & 0xFF));
+
+        out.push_back(static_cast<char>(ns.length()));
+    }
+
+    // Reads a namespace from a binary record
+    inline quicr::Namespace ReadRecord(std::string_view record)
+    {
+        std::vector<std::uint64_t> words = {0, 0};
+        for (size_t i = 0; i < sizeof(quicr::Name); ++i)
+            words[i / 8] = (words[i / 8] << 8) | static_cast<std::uint8_t>(record[i]);
+
+        std::vector<std::uint16_t> distribution = {64, 64};
+        quicr::Name name = {quicr::HexEndec<sizeof(quicr::Name) * 8>::Encode(distribution, words)};
+        return quicr::Namespace(name, static_cast<std::uint8_t>(record[sizeof(quicr::Name)]));
+    }
+
+    // Appends the binary record of a url, encoded straight into its bytes.
+    // A url that fails to encode is written as a zero length record and the
+    // exception is rethrown.
+    inline void EncodeRecord(std::string& out, const UrlEncoder& encoder, std::string_view url)
+    {
+        std::array<std::byte, UrlEncoder::Wire_Bytes> wire{};
+        std::uint8_t length = 0;
+        std::exception_ptr error;
+        try
+        {
+            length = encoder.EncodeUrlTo(url, wire);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        out.append(reinterpret_cast<const char*>(wire.data()), wire.size());
+        out.push_back(static_cast<char>(length));
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Decodes the url of a binary record without building its name
+    inline std::string DecodeRecord(const UrlEncoder& encoder, std::string_view record)
+    {
+        return encoder.DecodeUrl(std::as_bytes(std::span(record.data(), UrlEncoder::Wire_Bytes)));
+    }
+
+    // Helpers of EncodeFile and DecodeFile
+    namespace detail
+    {
+        // Splits the data into chunks that end on a line boundary
+        inline std::vector<std::string_view> SplitLines(std::string_view data, size_t chunk_size)
+        {
+            std::vector<std::string_view> chunks;
+            size_t start = 0;
+            while (start < data.size())
+            {
+                size_t end = std::min(start + chunk_size, data.size());
+                if (end < data.size())
+                {
+                    end = data.find('\n', end);
+                    end = (end == std::string_view::npos) ? data.size() : end + 1;
+                }
+
+                chunks.push_back(data.substr(start, end - start));
+                start = end;
+            }
+
+            return chunks;
+        }
+
+        // Splits the data into chunks that hold whole binary records
+        inline std::vector<std::string_view> SplitRecords(std::string_view data, size_t chunk_size)
+        {
+            if (data.size() % Record_Size != 0)
+                throw std::runtime_error("Error. Binary input is not a whole number of " +
+                                         std::to_string(Record_Size) + " byte records");
+
+            chunk_size = std::max(Record_Size, chunk_size - chunk_size % Record_Size);
+
+            std::vector<std::string_view> chunks;
+            for (size_t start = 0; start < data.size(); start += chunk_size)
+                chunks.push_back(data.substr(start, chunk_size));
+
+            return chunks;
+        }
+
+        // Calls func for each line in the chunk, without the line ending
+        template <typename Func>
+        inline void ForEachLine(std::string_view chunk, Func&& func)
+        {
+            size_t start = 0;
+            while (start < chunk.size())
+            {
+                size_t end = chunk.find('\n', start);
+                if (end == std::string_view::npos)
+                    end = chunk.size();
+
+                std::string_view line = chunk.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r')
+                    line.remove_suffix(1);
+
+                func(line);
+                start = end + 1;
+            }
+        }
+
+        /*
+         * Runs process on every chunk using a pool of threads and writes the
+         * outputs in the same order as the chunks. The first exception of a
+         * worker, or of the writer, stops the rest and is rethrown once every
+         * thread has been joined.
+         */
+        template <typename Process>
+        inline void ProcessChunks(const std::vector<std::string_view>& chunks, std::ostream& out,
+                                  const Options& options, Process&& process)
+        {
+            std::vector<std::string> outputs(chunks.size());
+            std::vector<char> ready(chunks.size(), 0);
+            std::atomic<size_t> next_chunk = 0;
+            size_t written = 0;
+            std::exception_ptr error;
+            std::mutex mutex;
+            std::condition_variable cv;
+
+            // Keeps the first error and stops handing out chunks
+            auto fail = [&](std::exception_ptr e) {
+                {
+                    std::lock_guard lock(mutex);
+                    if (!error)
+                        error = e;
+                    next_chunk = chunks.size();
+                }
+                cv.notify_all();
+            };
+
+            auto worker = [&]() {
+                while (true)
+                {
+                    const size_t idx = next_chunk.fetch_add(1);
+                    if (idx >= chunks.size())
+                        return;
+
+                    // Don't run too far ahead of the writer
+                    {
+                        std::unique_lock lock(mutex);
+                        cv.wait(lock, [&] { return error || idx < written + options.max_pending_chunks; });
+                        if (error)
+                            return;
+                    }
+
+                    std::string output;
+                    try
+                    {
+                        output = process(chunks[idx]);
+                    }
+                    catch (...)
+                    {
+                        fail(std::current_exception());
+                    }
+
+                    {
+                        std::lock_guard lock(mutex);
+                        outputs[idx] = std::move(output);
+                        ready[idx] = 1;
+                    }
+                    cv.notify_all();
+                }
+            };
+
+            const unsigned int thread_count =
+                std::max(1u, std::min<unsigned int>(options.threads, static_cast<unsigned int>(chunks.size())));
+            std::vector<std::thread> workers;
+            try
+            {
+                for (unsigned int i = 0; i < thread_count; ++i)
+                    workers.emplace_back(worker);
+
+                // Write the chunks in order as they finish
+                while (written < chunks.size())
+                {
+                    std::string output;
+                    {
+                        std::unique_lock lock(mutex);
+                        cv.wait(lock, [&] { return error || ready[written] != 0; });
+                        if (error)
+                            break;
+                        output = std::move(outputs[written]);
+                    }
+
+                    out.write(output.data(), output.size());
+
+                    {
+                        std::lock_guard lock(mutex);
+                        ++written;
+                    }
+                    cv.notify_all();
+                }
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+
+            for (auto& thread : workers)
+                thread.join();
+
+            if (error)
+                std::rethrow_exception(error);
+
+            if (!out)
+                throw std::runtime_error("Error. Failed to write output");
+        }
+    } // namespace detail
+
+    /*
+     * Encodes every line of the input file into the output file. Lines that
+     * fail to encode are written as a zero length namespace so that the
+     * output stays line for line with the input.
+     */
+    inline Result EncodeFile(const UrlEncoder& encoder,
+                             const std::string& in_filename,
+                             const std::string& out_filename,
+                             const Options& options = {})
+    {
+        const auto start = std::chrono::steady_clock::now();
+        MappedFile in(in_filename);
+        std::ofstream out(out_filename, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Error. Failed to open " + out_filename);
+
+        std::atomic<std::uint64_t> records = 0;
+        std::atomic<std::uint64_t> failures = 0;
+
+        const auto chunks = detail::SplitLines(in.Data(), options.chunk_size);
+        detail::ProcessChunks(chunks, out, options, [&](std::string_view chunk) {
+            std::string output;
+            std::ostringstream text;
+            std::uint64_t chunk_records = 0;
+            std::uint64_t chunk_failures = 0;
+            detail::ForEachLine(chunk, [&](std::string_view line) {
+                ++chunk_records;
+                if (options.format == Format::Binary)
+                {
+                    try
+                    {
+                        EncodeRecord(output, encoder, line);
+                    }
+                    catch (const std::exception&)
+                    {
+                        ++chunk_failures;
+                    }
+                    return;
+                }
+
+                quicr::Namespace encoded;
+                try
+                {
+                    encoded = encoder.EncodeUrl(std::string(line));
+                }
+                catch (const std::exception&)
+                {
+                    ++chunk_failures;
+                }
+
+                text << encoded << '\n';
+            });
+
+            records += chunk_records;
+            failures += chunk_failures;
+            return options.format == Format::Binary ? output : text.str();
+        });
+
+        out.close();
+        return {records, failures,
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)};
+    }
+
+    /*
+     * Decodes every name of the input file into urls in the output file.
+     * Names that fail to decode, or have a zero length, are written as
+     * empty lines.
+     */
+    inline Result DecodeFile(const UrlEncoder& encoder,
+                             const std::string& in_filename,
+                             const std::string& out_filename,
+                             const Options& options = {})
+    {
+        const auto start = std::chrono::steady_clock::now();
+        MappedFile in(in_filename);
+        std::ofstream out(out_filename, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Error. Failed to open " + out_filename);
+
+        std::atomic<std::uint64_t> records = 0;
+        std::atomic<std::uint64_t> failures = 0;
+
+        auto decode = [&](std::span<const std::byte> code, std::uint8_t length, std::string& output,
+                          std::uint64_t& chunk_failures) {
+            try
+            {
+                if (length > 0)
+                    output += encoder.DecodeUrl(code);
+                else
+                    ++chunk_failures;
+            }
+            catch (const std::exception&)
+            {
+                ++chunk_failures;
+            }
+            output += '\n';
+        };
+
+        const auto chunks = options.format == Format::Binary
+                                ? detail::SplitRecords(in.Data(), options.chunk_size)
+                                : detail::SplitLines(in.Data(), options.chunk_size);
+        detail::ProcessChunks(chunks, out, options, [&](std::string_view chunk) {
+            std::string output;
+            std::uint64_t chunk_records = 0;
+            std::uint64_t chunk_failures = 0;
+            if (options.format == Format::Binary)
+            {
+                for (size_t offset = 0; offset < chunk.size(); offset += Record_Size)
+                {
+                    const std::string_view record = chunk.substr(offset, Record_Size);
+                    decode(std::as_bytes(std::span(record.data(), UrlEncoder::Wire_Bytes)),
+                           static_cast<std::uint8_t>(record[UrlEncoder::Wire_Bytes]), output, chunk_failures);
+                    ++chunk_records;
+                }
+            }
+            else
+            {
+                // The chunk's names are decoded as one batch. A line that
+                // isn't a name holds an empty place so the lines stay in step.
+                std::vector<quicr::Namespace> codes;
+                std::vector<bool> parsed;
+                detail::ForEachLine(chunk, [&](std::string_view line) {
+                    ++chunk_records;
+                    try
+                    {
+                        codes.emplace_back(line);
+                        parsed.push_back(codes.back().length() > 0);
+                    }
+                    catch (const std::exception&)
+                    {
+                        codes.emplace_back();
+                        parsed.push_back(false);
+                    }
+                });
+
+                std::vector<std::string> urls;
+                encoder.DecodeUrls(codes, urls);
+                for (size_t i = 0; i < urls.size(); ++i)
+                {
+                    if (!parsed[i] || urls[i].empty())
+                        ++chunk_failures;
+                    else
+                        output += urls[i];
+                    output += '\n';
+                }
+            }
+
+            records += chunk_records;
+            failures += chunk_failures;
+            return output;
+        });
+
+        out.close();
+        return {records, failures,
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)};
+    }
+} // namespace BulkFileProcessor
@@ -0,0 +1,780 @@
+#pragma once
+
+#include "UrlEncoder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Writes a header that encodes and decodes urls for a fixed set of templates
+// without a UrlEncoder. Each template gets its own match, encode and decode
+// functions with its literals, slot classes and bit offsets written in, and
+// the templates are found with switches on the bytes of their literal
+// prefixes. The urls are expected already normalized, and a template wins
+// over the others the same way it does in UrlEncoder.
+namespace CodeGenerator
+{
+    struct Options
+    {
+        // Namespace of the generated code
+        std::string name_space = "numero_uri_generated";
+
+        // Buckets of at most this many templates are tried one by one rather
+        // than switched on again
+        size_t leaf_size = 2;
+    };
+
+    struct Skipped
+    {
+        std::uint64_t pen = 0;
+        std::int16_t sub_pen = -1;
+        std::string reason;
+    };
+
+    struct Result
+    {
+        size_t templates = 0;
+
+        // Templates that are left to the UrlEncoder, urls they'd have won may
+        // then match a later template
+        std::vector<Skipped> skipped;
+    };
+
+    namespace detail
+    {
+        constexpr std::uint32_t Name_Bits = 128;
+
+        // What the generator knows of one template
+        struct Entry
+        {
+            size_t id = 0;
+            std::uint64_t pen = 0;
+            std::int16_t sub_pen = -1;
+            const UrlEncoder::url_template* temp = nullptr;
+            std::vector<UrlPattern::Step> steps;
+            UrlPattern::Prefix prefix;
+        };
+
+        // A C++ string literal of the bytes, octal escapes can't run on
+        inline std::string Quote(std::string_view bytes)
+        {
+            std::string quoted = "\"";
+            for (const char ch : bytes)
+            {
+                const auto byte = static_cast<unsigned char>(ch);
+                if (ch == '"' || ch == '\\')
+                {
+                    quoted += '\\';
+                    quoted += ch;
+                }
+                else if (byte < 0x20 || byte >= 0x7F || ch == '?')
+                {
+                    char escaped[5];
+                    std::snprintf(escaped, sizeof(escaped), "\\%03o", byte);
+                    quoted += escaped;
+                }
+                else
+                {
+                    quoted += ch;
+                }
+            }
+
+            return quoted + '"';
+        }
+
+        inline std::string Hex(std::uint64_t value)
+        {
+            char text[24];
+            std::snprintf(text, sizeof(text), "0x%llXull", static_cast<unsigned long long>(value));
+            return text;
+        }
+
+        inline std::uint64_t Mask(std::uint32_t width)
+        {
+            return width >= 64 ? ~0ull : (1ull << width) - 1;
+        }
+
+        // Expression of the width bits after offset in name.hi and name.lo
+        inline std::string Extract(std::uint32_t offset, std::uint32_t width)
+        {
+            const std::uint32_t shift = Name_Bits - offset - width;
+            std::string word;
+            if (shift >= 64)
+                word = "(name.hi >> " + std::to_string(shift - 64) + ")";
+            else if (shift + width <= 64)
+                word = "(name.lo >> " + std::to_string(shift) + ")";
+            else
+                word = "((name.hi << " + std::to_string(64 - shift) + ") | (name.lo >> " + std::to_string(shift) + "))";
+
+            return width >= 64 ? word : "(" + word + " & " + Hex(Mask(width)) + ")";
+        }
+
+        // Statements that or value into the width bits after offset
+        inline std::string Insert(std::uint32_t offset, std::uint32_t width, const std::string& value)
+        {
+            const std::uint32_t shift = Name_Bits - offset - width;
+            if (shift >= 64)
+                return "    name.hi |= " + value + " << " + std::to_string(shift - 64) + ";\n";
+            if (shift + width <= 64)
+                return "    name.lo |= " + value + " << " + std::to_string(shift) + ";\n";
+
+            return "    name.hi |= " + value + " >> " + std::to_string(64 - shift) + ";\n    name.lo |= " + value +
+                   " << " + std::to_string(shift) + ";\n";
+        }
+
+        // True when byte can be part of a slot of the given type
+        inline bool InClass(const UrlPattern::Step& step, char byte)
+        {
+            const bool digit = byte >= '0' && byte <= '9';
+            const bool hex = digit || (byte >= 'a' && byte <= 'f') || (byte >= 'A' && byte <= 'F');
+            switch (step.type)
+            {
+            case UrlPattern::Step::Type::Decimal:
+                return digit;
+            case UrlPattern::Step::Type::Number:
+                return hex || byte == 'x';
+            case UrlPattern::Step::Type::String:
+                return step.alphabet.find(byte) != std::string_view::npos;
+            default:
+                return true;
+            }
+        }
+
+        // Condition that the url holds the bytes of a text step at pos
+        inline std::string TextMatches(std::string_view text, const std::string& pos)
+        {
+            std::string condition = "url.size() - " + pos + " >= " + std::to_string(text.size());
+            size_t idx = 0;
+            while (idx < text.size())
+            {
+                size_t end = idx;
+                if (text[idx] == '\0')
+                {
+                    condition += " && detail::IsAny(url[" + pos + " + " + std::to_string(idx) + "])";
+                    idx++;
+                    continue;
+                }
+
+                while (end < text.size() && text[end] != '\0')
+                    end++;
+                condition += " && std::memcmp(url.data() + " + pos + " + " + std::to_string(idx) + ", " +
+                             Quote(text.substr(idx, end - idx)) + ", " + std::to_string(end - idx) + ") == 0";
+                idx = end;
+            }
+
+            return condition;
+        }
+
+        inline std::string StepName(size_t id, size_t step)
+        {
+            return "Match" + std::to_string(id) + "_" + std::to_string(step);
+        }
+
+        // The function matching step k onward of a template
+        inline void WriteStep(std::ostream& out, const Entry& entry, size_t k, size_t slot)
+        {
+            const std::string next = StepName(entry.id, k + 1);
+            out << "inline bool " << StepName(entry.id, k)
+                << "(std::string_view url, size_t pos, [[maybe_unused]] std::string_view* text,\n"
+                   "    [[maybe_unused]] std::uint64_t* values)\n{\n";
+
+            if (k == entry.steps.size())
+            {
+                out << "    return pos == url.size();\n}\n\n";
+                return;
+            }
+
+            const UrlPattern::Step& step = entry.steps[k];
+            auto call = [&](const std::string& pos) { return next + "(url, " + pos + ", text, values)"; };
+
+            // A slot can only end where the url does, or before a byte it
+            // can't hold, when that's what comes next
+            bool one_end = k + 1 == entry.steps.size();
+            if (k + 1 < entry.steps.size())
+            {
+                const UrlPattern::Step& after = entry.steps[k + 1];
+                one_end = after.type == UrlPattern::Step::Type::Text && after.text.front() != '\0' &&
+                          !InClass(step, after.text.front());
+            }
+
+            const std::string slot_text = "text[" + std::to_string(slot) + "]";
+            switch (step.type)
+            {
+            case UrlPattern::Step::Type::Text:
+                out << "    if (!(" << TextMatches(step.text, "pos") << "))\n        return false;\n";
+                out << "    return " << call("pos + " + std::to_string(step.text.size())) << ";\n";
+                break;
+            case UrlPattern::Step::Type::Optional_Text:
+                out << "    if (" << TextMatches(step.text, "pos") << " && "
+                    << call("pos + " + std::to_string(step.text.size())) << ")\n        return true;\n";
+                out << "    return " << call("pos") << ";\n";
+                break;
+            case UrlPattern::Step::Type::Decimal:
+            case UrlPattern::Step::Type::String:
+            {
+                const std::string is_in = step.type == UrlPattern::Step::Type::Decimal
+                                              ? "detail::IsDigit(url[end])"
+                                              : (step.char_bits == 5 ? "detail::B32(url[end]) >= 0"
+                                                                     : "detail::B64(url[end]) >= 0");
+                const std::string limit =
+                    step.type == UrlPattern::Step::Type::String ? " && end - pos < " + std::to_string(step.length) : "";
+                out << "    size_t end = pos;\n    while (end < url.size()" << limit << " && " << is_in
+                    << ")\n        end++;\n";
+                if (one_end)
+                {
+                    out << "    if (end == pos)\n        return false;\n";
+                    out << "    " << slot_text << " = url.substr(pos, end - pos);\n";
+                    out << "    return " << call("end") << ";\n";
+                }
+                else
+                {
+                    out << "    for (; end > pos; end--)\n    {\n        " << slot_text
+                        << " = url.substr(pos, end - pos);\n        if (" << call("end")
+                        << ")\n            return true;\n    }\n    return false;\n";
+                }
+                break;
+            }
+            case UrlPattern::Step::Type::Number:
+                out << "    const bool prefixed = url.size() - pos > 2 && url[pos] == '0' && (url[pos + 1] == 'x' || "
+                       "url[pos + 1] == 'd');\n";
+                if (one_end)
+                {
+                    // The longest run after the prefix, or the 0d alone
+                    out << "    size_t end = prefixed ? pos + 2 : pos;\n";
+                    out << "    while (end < url.size() && detail::IsHex(url[end]))\n        end++;\n";
+                    out << "    if (end == pos || (prefixed && end == pos + 2 && url[pos + 1] == 'x'))\n"
+                           "        return false;\n";
+                    out << "    " << slot_text << " = url.substr(pos, end - pos);\n";
+                    out << "    return " << call("end") << ";\n";
+                }
+                else
+                {
+                    // The ends in the order std::regex tries them
+                    out << "    size_t tried_above = url.size() + 1;\n";
+                    out << "    if (prefixed)\n    {\n        size_t end = pos + 2;\n"
+                           "        while (end < url.size() && detail::IsHex(url[end]))\n            end++;\n"
+                           "        for (; end > pos + 2; end--)\n        {\n            "
+                        << slot_text << " = url.substr(pos, end - pos);\n            if (" << call("end")
+                        << ")\n                return true;\n        }\n        tried_above = pos + 2;\n    }\n";
+                    out << "    size_t end = pos;\n    while (end < url.size() && detail::IsHex(url[end]))\n"
+                           "        end++;\n";
+                    out << "    for (; end > pos; end--)\n    {\n        if (end > tried_above)\n"
+                           "            continue;\n        "
+                        << slot_text << " = url.substr(pos, end - pos);\n        if (" << call("end")
+                        << ")\n            return true;\n    }\n    return false;\n";
+                }
+                break;
+            case UrlPattern::Step::Type::Enum:
+                // The names in order, as the regex alternation tries them
+                for (size_t idx = 0; idx < step.names.size(); idx++)
+                {
+                    const std::string& name = step.names[idx];
+                    out << "    if (url.size() - pos >= " << name.size() << " && std::memcmp(url.data() + pos, "
+                        << Quote(name) << ", " << name.size() << ") == 0)\n    {\n";
+                    out << "        values[" << slot << "] = " << idx << ";\n";
+                    out << "        if (" << call("pos + " + std::to_string(name.size()))
+                        << ")\n            return true;\n    }\n";
+                }
+                out << "    return false;\n";
+                break;
+            }
+
+            out << "}\n\n";
+        }
+
+        inline void WriteTemplate(std::ostream& out, const Entry& entry)
+        {
+            const auto& steps = entry.steps;
+            const auto& bits = entry.temp->bits;
+            const std::string id = std::to_string(entry.id);
+
+            out << "// PEN " << entry.pen;
+            if (entry.sub_pen >= 0)
+                out << " sub PEN " << entry.sub_pen;
+            out << ": " << entry.temp->pattern.str() << "\n\n";
+
+            // Each step calls the next, so they're written last first
+            std::vector<size_t> slots(steps.size() + 1, 0);
+            for (size_t k = 0; k < steps.size(); k++)
+            {
+                const bool is_slot = steps[k].type != UrlPattern::Step::Type::Text &&
+                                     steps[k].type != UrlPattern::Step::Type::Optional_Text;
+                slots[k + 1] = slots[k] + (is_slot ? 1 : 0);
+            }
+            for (size_t k = steps.size() + 1; k-- > 0;)
+                WriteStep(out, entry, k, slots[k]);
+
+            const size_t count = std::max<size_t>(1, bits.size());
+            out << "inline Status Encode" << id << "(std::string_view url, Name& name)\n{\n";
+            out << "    std::string_view text[" << count << "];\n";
+            out << "    std::uint64_t values[" << count << "] = {};\n";
+            out << "    if (!" << StepName(entry.id, 0) << "(url, 0, text, values))\n"
+                << "        return Status::No_Match;\n";
+
+            // Each value is checked against its bits as soon as it's read,
+            // like UrlEncoder, so the first bad value decides the status
+            std::vector<const UrlPattern::Step*> slot_steps;
+            for (const auto& step : steps)
+            {
+                if (step.type != UrlPattern::Step::Type::Text && step.type != UrlPattern::Step::Type::Optional_Text)
+                    slot_steps.push_back(&step);
+            }
+
+            for (size_t i = 0; i < std::max(slot_steps.size(), bits.size()); i++)
+            {
+                const std::string value = "values[" + std::to_string(i) + "]";
+                const std::string text = "text[" + std::to_string(i) + "]";
+                const UrlPattern::Step* step = i < slot_steps.size() ? slot_steps[i] : nullptr;
+                if (step &&
+                    (step->type == UrlPattern::Step::Type::Number || step->type == UrlPattern::Step::Type::Decimal))
+                {
+                    out << "    if (const Status status = detail::ParseValue(" << text << ", " << value
+                        << "); status != Status::Ok)\n        return status;\n";
+                }
+                else if (step && step->type == UrlPattern::Step::Type::String)
+                {
+                    out << "    " << value << " = detail::PackString(" << text << ", " << step->length << ", "
+                        << step->char_bits << ");\n";
+                }
+
+                if (i < bits.size() && bits[i] < 64)
+                    out << "    if ((" << value << " >> " << bits[i]
+                        << ") != 0)\n        return Status::Out_Of_Range;\n";
+            }
+
+            // The PEN and sub PEN are the same for every url
+            std::uint64_t hi = entry.pen << (64 - UrlEncoder::Pen_Bits);
+            std::uint32_t offset = UrlEncoder::Pen_Bits;
+            if (entry.sub_pen >= 0)
+            {
+                hi |= static_cast<std::uint64_t>(entry.sub_pen) << (64 - offset - UrlEncoder::Sub_Pen_Bits);
+                offset += UrlEncoder::Sub_Pen_Bits;
+            }
+
+            out << "    name.hi = " << Hex(hi) << ";\n    name.lo = 0;\n";
+            for (size_t i = 0; i < bits.size(); i++)
+            {
+                if (bits[i] > 0)
+                    out << Insert(offset, bits[i], "values[" + std::to_string(i) + "]");
+                offset += bits[i];
+            }
+            out << "    name.length = " << offset << ";\n    return Status::Ok;\n}\n\n";
+
+            // Decoding checks every value before writing any of the url
+            const std::span<const std::string> pieces = entry.temp->pattern.Pieces();
+            out << "inline bool Decode" << id << "(const Name& name, std::string& url)\n{\n";
+            offset = UrlEncoder::Pen_Bits + (entry.sub_pen >= 0 ? UrlEncoder::Sub_Pen_Bits : 0);
+            for (size_t i = 0; i < bits.size(); i++)
+            {
+                out << "    const std::uint64_t value" << i << " = "
+                    << (bits[i] > 0 ? Extract(offset, bits[i]) : std::string("0")) << ";\n";
+                offset += bits[i];
+
+                const UrlPattern::Step& step = *slot_steps[i];
+                if (step.type == UrlPattern::Step::Type::Enum)
+                {
+                    out << "    if (value" << i << " >= " << step.names.size() << ")\n        return false;\n";
+                }
+                else if (step.type == UrlPattern::Step::Type::String)
+                {
+                    out << "    const std::uint64_t length" << i << " = value" << i << " >> "
+                        << step.char_bits * step.length << ";\n";
+                    out << "    if (length" << i << " == 0 || length" << i << " > " << step.length
+                        << ")\n        return false;\n";
+                }
+            }
+
+            out << "    url.clear();\n";
+            for (size_t i = 0; i < pieces.size(); i++)
+            {
+                if (!pieces[i].empty())
+                    out << "    url += " << Quote(pieces[i]) << ";\n";
+                if (i >= bits.size())
+                    continue;
+
+                const UrlPattern::Step& step = *slot_steps[i];
+                const std::string value = "value" + std::to_string(i);
+                if (step.type == UrlPattern::Step::Type::Enum)
+                {
+                    out << "    {\n        static constexpr std::string_view names[] = {";
+                    for (size_t idx = 0; idx < step.names.size(); idx++)
+                        out << (idx ? ", " : "") << Quote(step.names[idx]);
+                    out << "};\n        url += names[" << value << "];\n    }\n";
+                }
+                else if (step.type == UrlPattern::Step::Type::String)
+                {
+                    out << "    detail::AppendString(url, " << value << ", length" << i << ", " << step.length << ", "
+                        << step.char_bits << ");\n";
+                }
+                else
+                {
+                    out << "    detail::AppendNumber(url, " << value << ");\n";
+                }
+            }
+            out << "    return true;\n}\n\n";
+        }
+
+        // Switches on a byte of the literal prefixes until few enough
+        // templates are left, then tries those in order
+        inline void WriteDispatch(std::ostream& out,
+                                  const std::vector<const Entry*>& entries,
+                                  const Options& opts,
+                                  const std::string& indent)
+        {
+            auto fixed_at = [](const Entry& entry, size_t pos) {
+                return pos < entry.prefix.bytes.size() && !((entry.prefix.wildcards >> pos) & 1);
+            };
+
+            // The byte that leaves the fewest templates in its biggest case
+            size_t best_pos = 0;
+            size_t best_size = entries.size();
+            if (entries.size() > opts.leaf_size)
+            {
+                size_t longest = 0;
+                for (const Entry* entry : entries)
+                    longest = std::max(longest, entry->prefix.bytes.size());
+
+                for (size_t pos = 0; pos < longest; pos++)
+                {
+                    std::map<char, size_t> counts;
+                    size_t anywhere = 0;
+                    for (const Entry* entry : entries)
+                    {
+                        if (fixed_at(*entry, pos))
+                            counts[entry->prefix.bytes[pos]]++;
+                        else
+                            anywhere++;
+                    }
+
+                    size_t biggest = anywhere;
+                    for (const auto& [byte, count] : counts)
+                        biggest = std::max(biggest, count + anywhere);
+
+                    if (counts.size() > 1 && biggest < best_size)
+                    {
+                        best_pos = pos;
+                        best_size = biggest;
+                    }
+                }
+            }
+
+            std::vector<const Entry*> anywhere;
+            if (best_size < entries.size())
+            {
+                // Each case keeps the templates in order with the ones that
+                // don't fix this byte
+                std::map<unsigned char, std::vector<const Entry*>> cases;
+                for (const Entry* entry : entries)
+                {
+                    if (fixed_at(*entry, best_pos))
+                        cases[static_cast<unsigned char>(entry->prefix.bytes[best_pos])];
+                }
+                for (const Entry* entry : entries)
+                {
+                    if (!fixed_at(*entry, best_pos))
+                    {
+                        anywhere.push_back(entry);
+                        for (auto& [byte, list] : cases)
+                            list.push_back(entry);
+                    }
+                    else
+                    {
+                        cases[static_cast<unsigned char>(entry->prefix.bytes[best_pos])].push_back(entry);
+                    }
+                }
+
+                out << indent << "if (url.size() > " << best_pos << ")\n" << indent << "{\n";
+                out << indent << "    switch (static_cast<unsigned char>(url[" << best_pos << "]))\n";
+                out << indent << "    {\n";
+                for (const auto& [byte, list] : cases)
+                {
+                    out << indent << "    case " << static_cast<unsigned int>(byte) << ":";
+                    if (byte > 0x20 && byte < 0x7F)
+                        out << " // " << static_cast<char>(byte);
+                    out << "\n" << indent << "    {\n";
+                    WriteDispatch(out, list, opts, indent + "        ");
+                    out << indent << "    }\n";
+                }
+                out << indent << "    default:\n" << indent << "        break;\n";
+                out << indent << "    }\n" << indent << "}\n";
+            }
+            else
+            {
+                anywhere = entries;
+            }
+
+            // The first template a url matches decides, even if it fails on
+            // a value
+            for (const Entry* entry : anywhere)
+            {
+                out << indent << "if (const Status status = Encode" << entry->id
+                    << "(url, name); status != Status::No_Match)\n";
+                out << indent << "    return status;\n";
+            }
+            out << indent << "return Status::No_Match;\n";
+        }
+
+        constexpr std::string_view Preamble = R"(
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace @NAMESPACE@
+{
+// A 128 bit name, the PEN in the top bits of hi
+struct Name
+{
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    // The significant bits, from the top
+    std::uint8_t length = 0;
+};
+
+enum class Status : std::uint8_t
+{
+    Ok,
+
+    // No template matches the url
+    No_Match,
+
+    // A template matches, but a value isn't a number it can read
+    Bad_Value,
+
+    // A value doesn't fit in its bits
+    Out_Of_Range
+};
+
+namespace detail
+{
+inline bool IsDigit(char ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+inline bool IsHex(char ch)
+{
+    return IsDigit(ch) || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+}
+
+// '.' matches anything but a line terminator
+inline bool IsAny(char ch)
+{
+    return ch != '\n' && ch != '\r';
+}
+
+constexpr std::string_view B32_Chars = "abcdefghijklmnopqrstuvwxyz234567";
+constexpr std::string_view B64_Chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+inline int B32(char ch)
+{
+    if (ch >= 'a' && ch <= 'z')
+        return ch - 'a';
+    if (ch >= '2' && ch <= '7')
+        return ch - '2' + 26;
+    return -1;
+}
+
+inline int B64(char ch)
+{
+    if (ch >= 'A' && ch <= 'Z')
+        return ch - 'A';
+    if (ch >= 'a' && ch <= 'z')
+        return ch - 'a' + 26;
+    if (ch >= '0' && ch <= '9')
+        return ch - '0' + 52;
+    if (ch == '-')
+        return 62;
+    if (ch == '_')
+        return 63;
+    return -1;
+}
+
+// A number with an optional 0x, 0b or 0d in front
+inline Status ParseValue(std::string_view text, std::uint64_t& value)
+{
+    int base = 10;
+    size_t offset = 0;
+    if (text.size() > 1 && text[0] == '0' && (text[1] == 'x' || text[1] == 'b' || text[1] == 'd'))
+    {
+        base = text[1] == 'x' ? 16 : text[1] == 'b' ? 2 : 10;
+        offset = 2;
+    }
+
+    value = 0;
+    const auto [end, error] = std::from_chars(text.data() + offset, text.data() + text.size(), value, base);
+    if (error == std::errc::result_out_of_range)
+        return Status::Out_Of_Range;
+    if (error != std::errc() || end != text.data() + text.size())
+        return Status::Bad_Value;
+    return Status::Ok;
+}
+
+// The length, then each character from the left, unused ones left zero
+inline std::uint64_t PackString(std::string_view text, size_t length, unsigned int bits)
+{
+    std::uint64_t value = text.size();
+    for (size_t idx = 0; idx < length; idx++)
+    {
+        const int code = idx >= text.size() ? 0 : bits == 5 ? B32(text[idx]) : B64(text[idx]);
+        value = (value << bits) | static_cast<std::uint64_t>(code);
+    }
+    return value;
+}
+
+inline void AppendString(std::string& url, std::uint64_t value, std::uint64_t used, size_t length, unsigned int bits)
+{
+    const std::string_view chars = bits == 5 ? B32_Chars : B64_Chars;
+    for (size_t idx = 0; idx < used; idx++)
+        url += chars[(value >> (bits * (length - 1 - idx))) & ((1u << bits) - 1)];
+}
+
+inline void AppendNumber(std::string& url, std::uint64_t value)
+{
+    char digits[20];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    url.append(digits, result.ptr);
+}
+} // namespace detail
+
+)";
+    } // namespace detail
+
+    /*
+     *  CodeGenerator::Generate
+     *
+     *  Description:
+     *      Writes the header for the templates of an encoder
+     *
+     *  Parameters:
+     *      encoder [in]
+     *          The templates
+     *      out [out]
+     *          The header
+     *      opts [in]
+     *          The namespace and how far to switch
+     *
+     *  Returns:
+     *      Result - The templates written and the ones skipped, those with
+     *          a query or a regex of their own
+     */
+    inline Result Generate(const UrlEncoder& encoder, std::ostream& out, const Options& opts = {})
+    {
+        Result result;
+        std::vector<detail::Entry> entries;
+        for (const auto& [pen, subs] : encoder.GetTemplates())
+        {
+            for (const auto& [sub_pen, temp] : subs)
+            {
+                detail::Entry entry;
+                entry.id = entries.size();
+                entry.pen = pen;
+                entry.sub_pen = sub_pen;
+                entry.temp = &temp;
+
+                std::uint32_t used = UrlEncoder::Pen_Bits + (sub_pen >= 0 ? UrlEncoder::Sub_Pen_Bits : 0);
+                for (const auto width : temp.bits)
+                    used += width;
+
+                size_t slots = 0;
+                const bool described = temp.pattern.Steps(entry.steps);
+                for (const auto& step : entry.steps)
+                    slots += step.type != UrlPattern::Step::Type::Text &&
+                             step.type != UrlPattern::Step::Type::Optional_Text;
+
+                if (!described)
+                    result.skipped.push_back({pen, sub_pen, "has a query or a regex of its own"});
+                else if (slots != temp.bits.size())
+                    result.skipped.push_back({pen, sub_pen, "has a different number of values and bit widths"});
+                else if (used > detail::Name_Bits)
+                    result.skipped.push_back({pen, sub_pen, "needs more than 128 bits"});
+                else
+                {
+                    entry.prefix = temp.pattern.LiteralPrefix();
+                    entries.push_back(std::move(entry));
+                }
+            }
+        }
+
+        out << "// Generated by numero_uri codegen from " << entries.size() << " templates, do not edit.\n";
+        for (const auto& skipped : result.skipped)
+        {
+            out << "// Skipped PEN " << skipped.pen;
+            if (skipped.sub_pen >= 0)
+                out << " sub PEN " << skipped.sub_pen;
+            out << ", it " << skipped.reason << "\n";
+        }
+
+        std::string preamble(detail::Preamble);
+        preamble.replace(preamble.find("@NAMESPACE@"), 11, opts.name_space);
+        out << preamble;
+
+        for (const auto& entry : entries)
+            detail::WriteTemplate(out, entry);
+
+        // Encode switches on the literal prefixes, decode on the PEN
+        std::vector<const detail::Entry*> order;
+        for (const auto& entry : entries)
+            order.push_back(&entry);
+
+        out << "// Encodes a normalized url with the first template it matches\n";
+        out << "inline Status Encode([[maybe_unused]] std::string_view url, [[maybe_unused]] Name& name)\n{\n";
+        detail::WriteDispatch(out, order, opts, "    ");
+        out << "}\n\n";
+
+        out << "// Decodes a name, false when no template has its PEN and sub PEN or a value is bad\n";
+        out << "inline bool Decode(const Name& name, [[maybe_unused]] std::string& url)\n{\n";
+        out << "    const std::uint64_t sub_pen = (name.hi >> " << 64 - UrlEncoder::Pen_Bits - UrlEncoder::Sub_Pen_Bits
+            << ") & 0xFF;\n";
+        out << "    (void)sub_pen;\n";
+        out << "    switch (name.hi >> " << 64 - UrlEncoder::Pen_Bits << ")\n    {\n";
+        for (size_t i = 0; i < entries.size();)
+        {
+            size_t end = i;
+            while (end < entries.size() && entries[end].pen == entries[i].pen)
+                end++;
+
+            // A template without a sub PEN is used whatever the sub PEN is,
+            // so a PEN whose one was skipped isn't decoded
+            const bool skipped_any =
+                std::any_of(result.skipped.begin(), result.skipped.end(), [&](const Skipped& skip) {
+                    return skip.pen == entries[i].pen && skip.sub_pen < 0;
+                });
+            if (skipped_any)
+            {
+                i = end;
+                continue;
+            }
+
+            out << "    case " << entries[i].pen << ":\n";
+            if (entries[i].sub_pen < 0)
+            {
+                out << "        return Decode" << entries[i].id << "(name, url);\n";
+            }
+            else
+            {
+                out << "        switch (sub_pen)\n        {\n";
+                for (size_t j = i; j < end; j++)
+                    out << "        case " << entries[j].sub_pen << ":\n            return Decode" << entries[j].id
+                        << "(name, url);\n";
+                out << "        default:\n            return false;\n        }\n";
+            }
+            i = end;
+        }
+        out << "    default:\n        return false;\n    }\n}\n} // namespace " << opts.name_space << "\n";
+
+        result.templates = entries.size();
+        return result;
+    }
+} // namespace CodeGenerator
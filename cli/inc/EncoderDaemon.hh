@@ -0,0 +1,644 @@
+#pragma once
+
+#include "BulkFileProcessor.hh"
+#include "UrlEncoder.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Keeps a loaded UrlEncoder resident behind a unix domain socket.
+ *
+ * Every message is a frame of
+ *      length  [4 bytes big endian]    Size of the rest of the frame
+ *      type    [1 byte]                Request operation or response status
+ *      id      [4 bytes big endian]    Chosen by the client, echoed back
+ *      payload [length - 5 bytes]
+ *
+ * Encode requests carry the url and are answered with a binary record (see
+ * BulkFileProcessor::Record_Size). Decode requests carry a binary record and
+ * are answered with the url. Errors are answered with the error message.
+ * Clients may pipeline requests, responses can arrive in any order.
+ */
+namespace EncoderDaemon
+{
+    enum Type : std::uint8_t
+    {
+        Encode_Request = 1,
+        Decode_Request = 2,
+        Ok_Response = 128,
+        Error_Response = 129
+    };
+
+    constexpr size_t Header_Size = 9;
+    constexpr size_t Max_Frame_Size = 64 * 1024;
+
+    // Stop reading from a connection while it has this many requests queued
+    constexpr size_t Max_Pending_Per_Connection = 1024;
+
+    struct Frame
+    {
+        std::uint8_t type;
+        std::uint32_t id;
+        std::string payload;
+    };
+
+    inline void WriteFrame(std::string& out, std::uint8_t type, std::uint32_t id, std::string_view payload)
+    {
+        const std::uint32_t length = static_cast<std::uint32_t>(payload.size() + Header_Size - 4);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<char>((length >> shift) & 0xFF));
+        out.push_back(static_cast<char>(type));
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back(static_cast<char>((id >> shift) & 0xFF));
+        out.append(payload);
+    }
+
+    // Pulls one frame off the front of buffer, returns false if it's not all
+    // there yet.
+    inline bool ReadFrame(const std::string& buffer, size_t& offset, Frame& frame)
+    {
+        auto read_u32 = [&](size_t at) {
+            std::uint32_t value = 0;
+            for (size_t i = 0; i < 4; i++)
+                value = (value << 8) | static_cast<std::uint8_t>(buffer[at + i]);
+            return value;
+        };
+
+        if (buffer.size() - offset < Header_Size)
+            return false;
+
+        const std::uint32_t length = read_u32(offset);
+        if (length < Header_Size - 4 || length > Max_Frame_Size)
+            throw std::runtime_error("Error. Invalid frame length " + std::to_string(length));
+
+        if (buffer.size() - offset < length + 4)
+            return false;
+
+        frame.type = static_cast<std::uint8_t>(buffer[offset + 4]);
+        frame.id = read_u32(offset + 5);
+        frame.payload.assign(buffer, offset + Header_Size, length + 4 - Header_Size);
+        offset += length + 4;
+        return true;
+    }
+
+    // Runs a request against the encoder and builds the response frame
+    inline std::string HandleRequest(const UrlEncoder& encoder, const Frame& request)
+    {
+        std::string response;
+        try
+        {
+            if (request.type == Encode_Request)
+            {
+                std::string record;
+                BulkFileProcessor::EncodeRecord(record, encoder, request.payload);
+                WriteFrame(response, Ok_Response, request.id, record);
+            }
+            else if (request.type == Decode_Request)
+            {
+                if (request.payload.size() != BulkFileProcessor::Record_Size)
+                    throw std::invalid_argument("Error. Decode request is not a binary record");
+
+                WriteFrame(response, Ok_Response, request.id,
+                           BulkFileProcessor::DecodeRecord(encoder, request.payload));
+            }
+            else
+            {
+                throw std::invalid_argument("Error. Unknown request type " + std::to_string(request.type));
+            }
+        }
+        catch (const std::exception& ex)
+        {
+            response.clear();
+            WriteFrame(response, Error_Response, request.id, ex.what());
+        }
+
+        return response;
+    }
+
+    namespace detail
+    {
+        inline void SetNonBlocking(int fd)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+
+        inline sockaddr_un SocketAddress(const std::string& path)
+        {
+            sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                throw std::invalid_argument("Error. Socket path is too long " + path);
+
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            return addr;
+        }
+
+        // Sends on a stream socket without raising SIGPIPE when the peer has
+        // gone, that comes back as EPIPE instead
+        inline ssize_t Send(int fd, std::string_view data)
+        {
+            return send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        }
+    } // namespace detail
+
+    class Server
+    {
+      public:
+        /*
+         * Server::Server
+         *
+         * Description:
+         *      Binds the socket, any stale socket file at the path is removed.
+         *
+         * Parameters:
+         *      get_encoder [in]
+         *          Returns the encoder to use for a request. Called once per
+         *          request so the encoder can be swapped while serving.
+         *      socket_path [in]
+         *          The path of the unix domain socket
+         *      workers [in]
+         *          Number of threads that run the encoder
+         */
+        Server(std::function<std::shared_ptr<const UrlEncoder>()> get_encoder,
+               const std::string& socket_path,
+               unsigned int workers)
+            : get_encoder(std::move(get_encoder)), socket_path(socket_path)
+        {
+            listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0)
+                throw std::runtime_error(std::string("Error. Failed to create socket: ") + std::strerror(errno));
+
+            try
+            {
+                sockaddr_un addr = detail::SocketAddress(socket_path);
+                unlink(socket_path.c_str());
+                if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+                    listen(listen_fd, 128) != 0)
+                    throw std::runtime_error("Error. Failed to listen on " + socket_path + ": " + std::strerror(errno));
+                detail::SetNonBlocking(listen_fd);
+
+                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if (epoll_fd < 0)
+                    throw std::runtime_error(std::string("Error. Failed to create epoll: ") + std::strerror(errno));
+
+                wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (wake_fd < 0)
+                    throw std::runtime_error(std::string("Error. Failed to create eventfd: ") + std::strerror(errno));
+
+                if (!Watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD) || !Watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD))
+                    throw std::runtime_error(std::string("Error. Failed to watch the socket: ") + std::strerror(errno));
+            }
+            catch (...)
+            {
+                if (wake_fd >= 0)
+                    close(wake_fd);
+                if (epoll_fd >= 0)
+                    close(epoll_fd);
+                close(listen_fd);
+                throw;
+            }
+
+            for (unsigned int i = 0; i < std::max(1u, workers); i++)
+                worker_threads.emplace_back(&Server::Worker, this);
+        }
+
+        ~Server()
+        {
+            Stop();
+            {
+                std::lock_guard lock(jobs_mutex);
+            }
+            jobs_cv.notify_all();
+            for (auto& thread : worker_threads)
+                thread.join();
+
+            for (auto& [fd, conn] : connections)
+                close(fd);
+
+            close(wake_fd);
+            close(epoll_fd);
+            close(listen_fd);
+            unlink(socket_path.c_str());
+        }
+
+        Server(const Server&) = delete;
+        Server& operator=(const Server&) = delete;
+
+        /*
+         * Server::Run
+         *
+         * Description:
+         *      Runs the event loop until Stop is called.
+         */
+        void Run()
+        {
+            epoll_event events[64];
+            while (!stopping)
+            {
+                int count = epoll_wait(epoll_fd, events, 64, -1);
+                if (count < 0 && errno != EINTR)
+                    throw std::runtime_error("Error. epoll_wait failed");
+
+                for (int i = 0; i < count; i++)
+                {
+                    const int fd = events[i].data.fd;
+                    if (fd == listen_fd)
+                        Accept();
+                    else if (fd == wake_fd)
+                        DeliverResponses();
+                    else
+                        Service(fd, events[i].events);
+                }
+            }
+        }
+
+        // Safe to call from any thread, or a signal handler
+        void Stop()
+        {
+            stopping = true;
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto res = write(wake_fd, &one, sizeof(one));
+        }
+
+      private:
+        struct Connection
+        {
+            // Tells a connection from an earlier one that had the same fd
+            std::uint64_t serial = 0;
+            std::string in;
+            std::string out;
+            size_t pending = 0;
+            bool reading = true;
+        };
+
+        struct Job
+        {
+            int fd;
+            std::uint64_t serial;
+            Frame request;
+        };
+
+        struct Response
+        {
+            int fd;
+            std::uint64_t serial;
+            std::string frame;
+        };
+
+        // Returns false, with errno set, if epoll refused the fd
+        bool Watch(int fd, std::uint32_t events, int op)
+        {
+            epoll_event ev = {};
+            ev.events = events;
+            ev.data.fd = fd;
+            return epoll_ctl(epoll_fd, op, fd, &ev) == 0;
+        }
+
+        // A connection that can't be watched any more is closed, since it
+        // would never be serviced again
+        void UpdateInterest(int fd, const Connection& conn)
+        {
+            std::uint32_t events = 0;
+            if (conn.reading)
+                events |= EPOLLIN;
+            if (!conn.out.empty())
+                events |= EPOLLOUT;
+            if (!Watch(fd, events, EPOLL_CTL_MOD))
+                CloseConnection(fd);
+        }
+
+        void Accept()
+        {
+            while (true)
+            {
+                int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                    return;
+
+                if (!Watch(fd, EPOLLIN, EPOLL_CTL_ADD))
+                {
+                    close(fd);
+                    continue;
+                }
+                connections[fd].serial = ++last_serial;
+            }
+        }
+
+        void CloseConnection(int fd)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections.erase(fd);
+        }
+
+        void Service(int fd, std::uint32_t events)
+        {
+            auto found = connections.find(fd);
+            if (found == connections.end())
+                return;
+            Connection& conn = found->second;
+
+            if (events & (EPOLLERR | EPOLLHUP))
+            {
+                CloseConnection(fd);
+                return;
+            }
+
+            if (events & EPOLLIN)
+            {
+                char buf[16 * 1024];
+                ssize_t len;
+                while ((len = read(fd, buf, sizeof(buf))) > 0)
+                    conn.in.append(buf, len);
+
+                if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+                {
+                    CloseConnection(fd);
+                    return;
+                }
+
+                size_t offset = 0;
+                std::vector<Job> new_jobs;
+                try
+                {
+                    Frame frame;
+                    while (ReadFrame(conn.in, offset, frame))
+                        new_jobs.push_back({fd, conn.serial, std::move(frame)});
+                }
+                catch (const std::exception&)
+                {
+                    // The stream can't be trusted after a bad frame
+                    CloseConnection(fd);
+                    return;
+                }
+                conn.in.erase(0, offset);
+
+                if (!new_jobs.empty())
+                {
+                    conn.pending += new_jobs.size();
+                    {
+                        std::lock_guard lock(jobs_mutex);
+                        for (auto& job : new_jobs)
+                            jobs.push_back(std::move(job));
+                    }
+                    jobs_cv.notify_all();
+                }
+
+                conn.reading = conn.pending < Max_Pending_Per_Connection;
+            }
+
+            if (!Flush(fd, conn))
+                return;
+
+            UpdateInterest(fd, conn);
+        }
+
+        // Writes as much of the connection's output as possible, returns false
+        // if the connection was closed. A peer that went away mid reply shows
+        // up as EPIPE and just closes the connection.
+        bool Flush(int fd, Connection& conn)
+        {
+            while (!conn.out.empty())
+            {
+                ssize_t len = detail::Send(fd, conn.out);
+                if (len < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                        break;
+
+                    CloseConnection(fd);
+                    return false;
+                }
+
+                conn.out.erase(0, len);
+            }
+
+            return true;
+        }
+
+        void DeliverResponses()
+        {
+            std::uint64_t count;
+            [[maybe_unused]] auto res = read(wake_fd, &count, sizeof(count));
+
+            std::vector<Response> ready;
+            {
+                std::lock_guard lock(responses_mutex);
+                ready.swap(responses);
+            }
+
+            std::vector<int> touched;
+            for (auto& response : ready)
+            {
+                // The connection may have closed while the job was running,
+                // and its fd been reused by a new one
+                auto found = connections.find(response.fd);
+                if (found == connections.end() || found->second.serial != response.serial)
+                    continue;
+
+                found->second.out += response.frame;
+                found->second.pending--;
+                touched.push_back(response.fd);
+            }
+
+            for (int fd : touched)
+            {
+                auto found = connections.find(fd);
+                if (found == connections.end())
+                    continue;
+
+                Connection& conn = found->second;
+                if (!Flush(fd, conn))
+                    continue;
+
+                conn.reading = conn.pending < Max_Pending_Per_Connection;
+                UpdateInterest(fd, conn);
+            }
+        }
+
+        void Worker()
+        {
+            std::vector<Job> batch;
+            std::vector<Response> done;
+            while (true)
+            {
+                {
+                    std::unique_lock lock(jobs_mutex);
+                    jobs_cv.wait(lock, [&] { return stopping || !jobs.empty(); });
+                    if (stopping)
+                        return;
+
+                    // Take a few at a time to cut down on the locking
+                    while (!jobs.empty() && batch.size() < 64)
+                    {
+                        batch.push_back(std::move(jobs.front()));
+                        jobs.pop_front();
+                    }
+                }
+
+                std::shared_ptr<const UrlEncoder> encoder = get_encoder();
+                for (const auto& job : batch)
+                    done.push_back({job.fd, job.serial, HandleRequest(*encoder, job.request)});
+                batch.clear();
+
+                {
+                    std::lock_guard lock(responses_mutex);
+                    for (auto& response : done)
+                        responses.push_back(std::move(response));
+                }
+                done.clear();
+
+                std::uint64_t one = 1;
+                [[maybe_unused]] auto res = write(wake_fd, &one, sizeof(one));
+            }
+        }
+
+        std::function<std::shared_ptr<const UrlEncoder>()> get_encoder;
+        std::string socket_path;
+
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        int wake_fd = -1;
+        std::atomic<bool> stopping = false;
+
+        // Only touched by the event loop
+        std::map<int, Connection> connections;
+        std::uint64_t last_serial = 0;
+
+        std::mutex jobs_mutex;
+        std::condition_variable jobs_cv;
+        std::deque<Job> jobs;
+
+        std::mutex responses_mutex;
+        std::vector<Response> responses;
+
+        std::vector<std::thread> worker_threads;
+    };
+
+    class Client
+    {
+      public:
+        explicit Client(const std::string& socket_path)
+        {
+            fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_un addr = detail::SocketAddress(socket_path);
+            if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            {
+                if (fd >= 0)
+                    close(fd);
+                throw std::runtime_error("Error. Failed to connect to " + socket_path + ": " + std::strerror(errno));
+            }
+        }
+
+        ~Client()
+        {
+            close(fd);
+        }
+
+        Client(const Client&) = delete;
+        Client& operator=(const Client&) = delete;
+
+        /*
+         * Client::Call
+         *
+         * Description:
+         *      Sends all of the requests pipelined, keeping at most window
+         *      requests in flight.
+         *
+         * Returns:
+         *      The responses in the same order as the requests
+         */
+        std::vector<Frame> Call(const std::vector<Frame>& requests, size_t window = 256)
+        {
+            std::vector<Frame> results(requests.size());
+            size_t sent = 0;
+            size_t received = 0;
+            std::string out;
+            while (received < requests.size())
+            {
+                // Top up the pipeline
+                out.clear();
+                while (sent < requests.size() && sent - received < window)
+                {
+                    WriteFrame(out, requests[sent].type, static_cast<std::uint32_t>(sent), requests[sent].payload);
+                    sent++;
+                }
+                SendAll(out);
+
+                // Wait for at least one response
+                Frame frame;
+                size_t offset = 0;
+                while (!ReadFrame(in, offset, frame))
+                    Receive();
+
+                do
+                {
+                    if (frame.id >= results.size())
+                        throw std::runtime_error("Error. Unexpected response id " + std::to_string(frame.id));
+
+                    results[frame.id] = std::move(frame);
+                    received++;
+                } while (ReadFrame(in, offset, frame));
+                in.erase(0, offset);
+            }
+
+            return results;
+        }
+
+      private:
+        void SendAll(std::string_view data)
+        {
+            while (!data.empty())
+            {
+                ssize_t len = detail::Send(fd, data);
+                if (len < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    if (errno == EPIPE)
+                        throw std::runtime_error("Error. Connection closed by the server");
+                    throw std::runtime_error("Error. Failed to send request");
+                }
+                data.remove_prefix(len);
+            }
+        }
+
+        void Receive()
+        {
+            char buf[16 * 1024];
+            ssize_t len = read(fd, buf, sizeof(buf));
+            if (len <= 0)
+            {
+                if (len < 0 && errno == EINTR)
+                    return;
+                throw std::runtime_error("Error. Connection closed by the server");
+            }
+            in.append(buf, len);
+        }
+
+        int fd = -1;
+        std::string in;
+    };
+} // namespace EncoderDaemon
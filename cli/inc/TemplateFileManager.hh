@@ -2,10 +2,19 @@
 
 #include <vector>
 #include <string>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <exception>
 #include <sstream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
 #include <curl/curl.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include "UrlEncoder.h"
 
 #include "nlohmann/json.hpp"
@@ -23,14 +32,81 @@ namespace TemplateFileManager
             stream->write(buf, count);
             return count;
         }
+
+#ifdef __linux__
+        // Flushes a file or directory to disk, throwing when it can't
+        void sync_path(const std::string &path, int flags)
+        {
+            const int fd = open(path.c_str(), flags | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("Error. Failed to open " + path + ": " + std::strerror(errno));
+
+            const int result = fsync(fd);
+            const int error = errno;
+            close(fd);
+            if (result != 0)
+                throw std::runtime_error("Error. Failed to sync " + path + ": " + std::strerror(error));
+        }
+#endif
+    }
+
+    // Writes a file next to filename then renames it over filename, so a
+    // reader such as TemplateWatcher never sees half of it. On Linux the
+    // file and then its directory are synced, so the new file survives a
+    // crash, and a failed sync throws.
+    void WriteAtomically(const std::string &filename,
+                         const std::function<void(std::ostream &)> &write)
+    {
+#ifdef __linux__
+        const std::string temp_name = filename + ".tmp." + std::to_string(getpid());
+#else
+        const std::string temp_name = filename + ".tmp";
+#endif
+        try
+        {
+            std::ofstream file;
+            file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+            file.open(temp_name, std::ios::binary | std::ios::trunc);
+            write(file);
+            file.close();
+
+#ifdef __linux__
+            // On disk before the rename makes it the template file
+            sync_path(temp_name, O_RDONLY);
+#endif
+
+            std::filesystem::rename(temp_name, filename);
+        }
+        catch (...)
+        {
+            std::error_code ec;
+            std::filesystem::remove(temp_name, ec);
+            throw;
+        }
+
+#ifdef __linux__
+        // The rename is only durable once the directory entry is
+        const std::filesystem::path parent = std::filesystem::path(filename).parent_path();
+        sync_path(parent.empty() ? "." : parent.string(), O_RDONLY | O_DIRECTORY);
+#endif
     }
 
     void SaveTemplates(const std::string &filename,
                        const json &templates)
     {
-        std::ofstream file(filename);
-        file << std::setw(4) << templates << std::endl;
-        file.close();
+        WriteAtomically(filename, [&](std::ostream &file) {
+            file << std::setw(4) << templates << std::endl;
+        });
+    }
+
+    // Streams the templates to the file without building their json
+    void SaveTemplates(const std::string &filename,
+                       const UrlEncoder &encoder)
+    {
+        WriteAtomically(filename, [&](std::ostream &file) {
+            encoder.TemplatesToJson(file, 4);
+            file << '\n';
+        });
     }
 
     json LoadTemplatesFromFile(const std::string &filename)
@@ -1,14 +1,63 @@
+#include "BulkFileProcessor.hh"
+#include "CodeGenerator.hh"
 #include "ConfigurationManager.hh"
+#ifdef __linux__
+#include "EncoderDaemon.hh"
+#include <SharedTemplateStore.h>
+#include <TemplateWatcher.h>
+#endif
 #include "TemplateFileManager.hh"
 #include <UrlEncoder.h>
 
 #include <nlohmann/json.hpp>
 
+#include <csignal>
+#include <fstream>
 #include <iostream>
 #include <string>
 
 using json = nlohmann::json;
 
+// Reads the optional flags of encode-file and decode-file
+BulkFileProcessor::Options ParseBulkOptions(int argc, char** argv, int first)
+{
+    BulkFileProcessor::Options options;
+    for (int idx = first; idx < argc; idx++)
+    {
+        if (strcmp(argv[idx], "--binary") == 0)
+            options.format = BulkFileProcessor::Format::Binary;
+        else if (strcmp(argv[idx], "--threads") == 0 && idx + 1 < argc)
+            options.threads = std::max(1u, static_cast<unsigned int>(std::stoul(argv[++idx])));
+        else
+            throw std::invalid_argument(std::string("Unknown option ") + argv[idx]);
+    }
+
+    return options;
+}
+
+#ifdef __linux__
+EncoderDaemon::Server* running_server = nullptr;
+
+void StopServer(int)
+{
+    if (running_server)
+        running_server->Stop();
+}
+
+// Reads the value of --name from the arguments
+std::string GetOption(int argc, char** argv, const std::string& name, const std::string& default_value = "")
+{
+    for (int idx = 2; idx + 1 < argc; idx++)
+        if (name == argv[idx])
+            return argv[idx + 1];
+
+    if (default_value.empty())
+        throw std::invalid_argument("Missing required option " + name);
+
+    return default_value;
+}
+#endif
+
 int main(int argc, char** argv)
 try
 {
@@ -29,8 +78,17 @@ try
     // Get the template file from the configuration file
     std::string template_file = ConfigurationManager::GetTemplateFilePath();
 
-    json data = TemplateFileManager::LoadTemplatesFromFile(template_file);
-    encoder.TemplatesFromJson(data);
+    // The client talks to a server that already has the templates loaded,
+    // the server loads them itself so it can reload them, and codegen is
+    // given its own
+    json data;
+    if (strcmp(argv[1], "client") != 0 && strcmp(argv[1], "serve") != 0 && strcmp(argv[1], "codegen") != 0)
+    {
+        // A command uses a few templates at most, the rest needn't compile
+        encoder.SetCompileMode(UrlEncoder::compile_mode::lazy);
+        data = TemplateFileManager::LoadTemplatesFromFile(template_file);
+        encoder.TemplatesFromJson(data);
+    }
     if (strcmp(argv[1], "encode") == 0)
     {
         // encode test - https://webex.com/1/meeting1234/user3213
@@ -43,6 +101,145 @@ try
         std::string decoded = encoder.DecodeUrl(std::string_view(argv[2]));
         std::cout << decoded << "\n";
     }
+    else if (strcmp(argv[1], "encode-file") == 0 || strcmp(argv[1], "decode-file") == 0)
+    {
+        if (argc < 4)
+        {
+            std::cout << argv[1] << " requires an input and output file\n";
+            return 1;
+        }
+
+        // encode-file urls.txt names.bin --binary
+        BulkFileProcessor::Options options = ParseBulkOptions(argc, argv, 4);
+        BulkFileProcessor::Result result = strcmp(argv[1], "encode-file") == 0
+                                               ? BulkFileProcessor::EncodeFile(encoder, argv[2], argv[3], options)
+                                               : BulkFileProcessor::DecodeFile(encoder, argv[2], argv[3], options);
+        std::cout << "Processed " << result.records << " records (" << result.failures << " failed) in "
+                  << result.elapsed.count() << "ms\n";
+    }
+#ifdef __linux__
+    else if (strcmp(argv[1], "serve") == 0)
+    {
+        // serve --socket /tmp/numero_uri.sock [--threads 4]
+        // The templates are reloaded whenever the template file changes,
+        // requests already running finish with the old ones
+        TemplateWatcher watcher(template_file, TemplateWatcher::options(), [](const TemplateWatcher::reload_status& status) {
+            if (status.ok)
+                std::cout << "Loaded " << status.templates << " templates in " << status.elapsed.count() << "us"
+                          << std::endl;
+            else
+                std::cerr << status.error << std::endl;
+        });
+
+        EncoderDaemon::Server server([&] { return watcher.Get(); }, GetOption(argc, argv, "--socket"),
+                                     std::stoul(GetOption(argc, argv, "--threads", "4")));
+
+        running_server = &server;
+        std::signal(SIGINT, StopServer);
+        std::signal(SIGTERM, StopServer);
+
+        std::cout << "Serving " << watcher.Get()->TemplateCount() << " templates from " << template_file
+                  << std::endl;
+        server.Run();
+        running_server = nullptr;
+    }
+    else if (strcmp(argv[1], "client") == 0)
+    {
+        // client --socket /tmp/numero_uri.sock encode <url>... (or - to read stdin)
+        int idx = 2;
+        while (idx < argc && strncmp(argv[idx], "--", 2) == 0)
+            idx += 2;
+
+        if (idx >= argc)
+            throw std::invalid_argument("client requires encode or decode");
+
+        const bool encode = strcmp(argv[idx], "encode") == 0;
+        if (!encode && strcmp(argv[idx], "decode") != 0)
+            throw std::invalid_argument(std::string("Unknown client operation ") + argv[idx]);
+
+        std::vector<std::string> values(argv + idx + 1, argv + argc);
+        if (values.empty() || (values.size() == 1 && values[0] == "-"))
+        {
+            values.clear();
+            for (std::string line; std::getline(std::cin, line);)
+                values.push_back(line);
+        }
+
+        std::vector<EncoderDaemon::Frame> requests;
+        for (const auto& value : values)
+        {
+            std::string payload = value;
+            if (!encode)
+            {
+                payload.clear();
+                BulkFileProcessor::WriteRecord(payload, quicr::Namespace(std::string_view(value)));
+            }
+            requests.push_back({encode ? EncoderDaemon::Encode_Request : EncoderDaemon::Decode_Request, 0, payload});
+        }
+
+        EncoderDaemon::Client client(GetOption(argc, argv, "--socket"));
+        int failures = 0;
+        for (const auto& response : client.Call(requests))
+        {
+            if (response.type != EncoderDaemon::Ok_Response)
+            {
+                std::cout << response.payload << "\n";
+                failures++;
+            }
+            else if (encode)
+                std::cout << BulkFileProcessor::ReadRecord(response.payload) << "\n";
+            else
+                std::cout << response.payload << "\n";
+        }
+
+        return failures == 0 ? 0 : 1;
+    }
+    else if (strcmp(argv[1], "publish") == 0)
+    {
+        // publish [--name /numero_uri]
+        // Workers map the segment with SharedTemplateReader and pick up
+        // each publish without reading the template file
+        const std::string name = GetOption(argc, argv, "--name", "/numero_uri");
+        SharedTemplateStore store(name);
+        const std::uint64_t generation = store.Publish(encoder);
+        std::cout << "Published " << encoder.TemplateCount(true) << " templates to " << name << " as generation "
+                  << generation << "\n";
+    }
+#endif
+    else if (strcmp(argv[1], "codegen") == 0)
+    {
+        // codegen templates.json -o encoder.hpp [--namespace name]
+        std::string output;
+        CodeGenerator::Options options;
+        for (int idx = 3; idx < argc; idx++)
+        {
+            if (strcmp(argv[idx], "-o") == 0 && idx + 1 < argc)
+                output = argv[++idx];
+            else if (strcmp(argv[idx], "--namespace") == 0 && idx + 1 < argc)
+                options.name_space = argv[++idx];
+            else
+                throw std::invalid_argument(std::string("Unknown option ") + argv[idx]);
+        }
+
+        if (argc < 3 || output.empty())
+        {
+            std::cout << "codegen requires a template file and -o <header>\n";
+            return 1;
+        }
+
+        encoder.TemplatesFromJson(TemplateFileManager::LoadTemplatesFromFile(argv[2]));
+
+        std::ofstream file(output, std::ios::binary | std::ios::trunc);
+        const CodeGenerator::Result result = CodeGenerator::Generate(encoder, file, options);
+        file.close();
+        if (!file)
+            throw std::runtime_error("Error. Failed to write " + output);
+
+        for (const auto& skipped : result.skipped)
+            std::cerr << "Skipped PEN " << skipped.pen << " sub PEN " << skipped.sub_pen << ", it " << skipped.reason
+                      << "\n";
+        std::cout << "Generated " << result.templates << " templates into " << output << "\n";
+    }
     else if (strcmp(argv[1], "template-file") == 0)
     {
         ConfigurationManager::UpdateConfigFile(argv[1], argv[2]);
@@ -54,8 +251,7 @@ try
         // Get templates from http using curl
         data = TemplateFileManager::LoadTemplatesFromHttp(argv[2]);
         encoder.AddTemplate(data);
-        data = encoder.TemplatesToJson();
-        TemplateFileManager::SaveTemplates(template_file, data);
+        TemplateFileManager::SaveTemplates(template_file, encoder);
         std::cout << "Added templates from http" << std::endl;
     }
     else if (strcmp(argv[1], "add-template") == 0)
@@ -63,8 +259,7 @@ try
         encoder.AddTemplate(std::string(argv[2]));
 
         // Save the template file
-        data = encoder.TemplatesToJson();
-        TemplateFileManager::SaveTemplates(template_file, data);
+        TemplateFileManager::SaveTemplates(template_file, encoder);
         std::cout << "Added template.\n";
     }
     else if (strcmp(argv[1], "remove-template") == 0)
@@ -74,12 +269,13 @@ try
             throw UrlEncoderException("Failed to remove template from list");
 
         // Save the template file
-        TemplateFileManager::SaveTemplates(template_file, encoder.TemplatesToJson());
+        TemplateFileManager::SaveTemplates(template_file, encoder);
         std::cout << "Template with PEN " << pen << " has been removed.\n";
     }
     else if (strcmp(argv[1], "show-templates") == 0)
     {
-        std::cout << std::setw(4) << encoder.TemplatesToJson() << std::endl;
+        encoder.TemplatesToJson(std::cout, 4);
+        std::cout << std::endl;
     }
     else
     {
@@ -0,0 +1,106 @@
+/*
+ *  LiteralPool.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Interns strings into one contiguous buffer, so text repeated across
+ *      templates such as "^https://webex.com" or "/meeting" is stored once
+ *      and referenced by a small id.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class LiteralPool
+{
+  public:
+    using Id = std::uint32_t;
+
+    // Where the text of an id is in the pool's bytes
+    struct Entry
+    {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+
+    explicit LiteralPool(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /*
+     *  LiteralPool::LiteralPool
+     *
+     *  Description:
+     *      Makes a read only pool over text and entries kept elsewhere, such
+     *      as a template image mapped from shared memory
+     *
+     *  Parameters:
+     *      text [in]
+     *          The bytes the entries point into
+     *      table [in]
+     *          The entry of each id, each within text
+     *
+     *  Comments:
+     *      Both have to outlive the pool. Intern throws std::logic_error.
+     */
+    LiteralPool(std::string_view text, std::span<const Entry> table);
+
+    // The views point into the pool's own vectors or the external text
+    LiteralPool(const LiteralPool&) = delete;
+    LiteralPool& operator=(const LiteralPool&) = delete;
+
+    /*
+     *  LiteralPool::Intern
+     *
+     *  Description:
+     *      Adds text to the pool unless it's already there
+     *
+     *  Parameters:
+     *      text [in]
+     *          The text to add
+     *
+     *  Returns:
+     *      Id of the text, the same for equal text
+     *
+     *  Comments:
+     *      Views from View may be invalidated.
+     */
+    Id Intern(std::string_view text);
+
+    // Text of an id, valid until the next Intern or Clear
+    std::string_view View(Id id) const
+    {
+        const Entry& entry = entry_view[id];
+        return {text_view.data() + entry.offset, entry.length};
+    }
+
+    // Number of distinct literals
+    size_t Size() const;
+
+    // Bytes used by the text, the entries and the index
+    size_t MemoryUsage() const;
+
+    void Clear();
+
+  private:
+    std::pmr::vector<char> bytes;
+    std::pmr::vector<Entry> entries;
+
+    // What View reads, the vectors above unless the pool is read only
+    std::string_view text_view;
+    std::span<const Entry> entry_view;
+    bool read_only = false;
+
+    // Hash of the text to the ids with that hash
+    std::pmr::unordered_multimap<std::size_t, Id> index;
+};
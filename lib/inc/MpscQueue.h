@@ -0,0 +1,107 @@
+/*
+ *  MpscQueue.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Bounded lock free queue for many producers and one consumer. Each
+ *      cell carries a sequence number that says whether it's free for the
+ *      producer at that position or ready for the consumer, so producers
+ *      only contend on the tail and never wait on each other.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+template <typename T>
+class MpscQueue
+{
+  public:
+    // The capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+        : mask(std::bit_ceil(capacity < 2 ? size_t{2} : capacity) - 1), cells(new Cell[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; i++)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    size_t Capacity() const
+    {
+        return mask + 1;
+    }
+
+    // Any thread. Returns false, leaving value alone, when the queue is full.
+    bool TryPush(T&& value)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only
+    bool TryPop(T& value)
+    {
+        Cell& cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+            return false;
+
+        value = std::move(cell.value);
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    // Consumer thread only
+    bool Empty() const
+    {
+        return cells[head & mask].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+
+  private:
+    struct alignas(64) Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+
+    alignas(64) std::atomic<size_t> tail = 0;
+    alignas(64) size_t head = 0;
+};
@@ -0,0 +1,202 @@
+/*
+ *  SharedTemplateStore.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Shares one set of templates between processes through POSIX shared
+ *      memory. A publisher writes the templates as an image from
+ *      UrlEncoder::TemplatesToImage into a segment of its own for each
+ *      generation, and readers map it read only and encode from it in place
+ *      with a TemplateImage. Every reader of a generation uses the same
+ *      physical copy of the literals, chunk lists, bit widths and dispatch
+ *      table, and holds only a pointer per template and the patterns of the
+ *      templates it has used.
+ *
+ *      A small segment under the store's name holds the generation of the
+ *      last publish. The image of generation g is in the segment of the
+ *      name followed by ".g", and is never written again once published.
+ *      A publish writes the new image, makes it the current generation
+ *      with one atomic store, and then removes the name of the previous
+ *      image, so readers that still use it keep their mapping and no reader
+ *      ever sees an image being written. Readers never block the publisher,
+ *      and checking for a new publish is one atomic load. An image is
+ *      checked as it's mapped, see TemplateImage.
+ *
+ *  Portability Issues:
+ *      Uses shm_open and mmap, POSIX only. The image uses the byte order of
+ *      the machine, so the processes have to be on the same host.
+ */
+
+#pragma once
+
+#include <TemplateImage.h>
+#include <UrlEncoder.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+class SharedTemplateStore
+{
+  public:
+    /*
+     *  SharedTemplateStore::SharedTemplateStore
+     *
+     *  Description:
+     *      Opens the segment to publish to, creating it if it doesn't exist
+     *
+     *  Parameters:
+     *      name [in]
+     *          Name of the segment, such as /numero_uri. A leading '/' is
+     *          added when it's missing.
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Only one publisher may write a segment at a time. Throws
+     *      UrlEncoderException when the segment can't be opened or mapped.
+     */
+    explicit SharedTemplateStore(const std::string& name);
+
+    // Unmaps the segment, which stays for the readers with the last image,
+    // see Remove
+    ~SharedTemplateStore();
+
+    SharedTemplateStore(const SharedTemplateStore&) = delete;
+    SharedTemplateStore& operator=(const SharedTemplateStore&) = delete;
+
+    /*
+     *  SharedTemplateStore::Publish
+     *
+     *  Description:
+     *      Writes the templates of an encoder as the next generation
+     *
+     *  Parameters:
+     *      encoder [in]
+     *          The templates to publish
+     *
+     *  Returns:
+     *      std::uint64_t - Generation of the published templates
+     *
+     *  Comments:
+     *      Throws UrlEncoderException when the image segment can't be made,
+     *      the last generation stays current.
+     */
+    std::uint64_t Publish(const UrlEncoder& encoder);
+
+    // Generation of the last publish, 0 before the first
+    std::uint64_t Generation() const;
+
+    // Removes the segment name and that of the last image, mappings that
+    // are open stay valid
+    static bool Remove(const std::string& name);
+
+  private:
+    friend class SharedTemplateReader;
+
+    // The whole of the segment under the store's name
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+
+        // Of the last publish, 0 before the first
+        std::atomic<std::uint64_t> generation;
+    };
+
+    static std::string SegmentName(const std::string& name);
+
+    // Name of the segment holding the image of a generation
+    static std::string ImageName(const std::string& segment, std::uint64_t generation);
+
+    std::string name;
+    int fd = -1;
+    Header* header = nullptr;
+
+    // Reused for each publish
+    std::string image;
+};
+
+class SharedTemplateReader
+{
+  public:
+    /*
+     *  SharedTemplateReader::SharedTemplateReader
+     *
+     *  Description:
+     *      Maps a segment read only and the image of its last publish
+     *
+     *  Parameters:
+     *      name [in]
+     *          Name the segment was published under
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Throws UrlEncoderException when the segment doesn't exist or
+     *      isn't a template store. Nothing published yet loads no templates.
+     */
+    explicit SharedTemplateReader(const std::string& name);
+
+    ~SharedTemplateReader();
+
+    SharedTemplateReader(const SharedTemplateReader&) = delete;
+    SharedTemplateReader& operator=(const SharedTemplateReader&) = delete;
+
+    /*
+     *  SharedTemplateReader::Get
+     *
+     *  Description:
+     *      Gets the templates last loaded, safe to call from any thread
+     *
+     *  Returns:
+     *      std::shared_ptr<const TemplateImage> - Keeps its image mapped,
+     *          so it stays valid after a refresh
+     */
+    std::shared_ptr<const TemplateImage> Get() const;
+
+    /*
+     *  SharedTemplateReader::Refresh
+     *
+     *  Description:
+     *      Maps the image of a newer generation if one has been published,
+     *      safe to call from any thread. Costs one atomic load when nothing
+     *      changed, so it can be called before each batch of work.
+     *
+     *  Returns:
+     *      bool - True if new templates were swapped in
+     *
+     *  Comments:
+     *      Gives up and returns false if publishes keep replacing the image
+     *      before it can be opened. Throws UrlEncoderException when the image
+     *      is malformed, the current templates are kept.
+     */
+    bool Refresh();
+
+    // Generation of the templates Get returns
+    std::uint64_t Generation() const;
+
+  private:
+    using Header = SharedTemplateStore::Header;
+
+    std::string segment;
+    int fd = -1;
+
+    // Mapped once and never moved, so Refresh can check it without a lock
+    const Header* header = nullptr;
+
+    std::atomic<std::shared_ptr<const TemplateImage>> current;
+
+    // Generation of the last image tried, and of the last loaded
+    std::atomic<std::uint64_t> tried = 0;
+    std::atomic<std::uint64_t> generation = 0;
+
+    // Refreshes are serialized
+    std::mutex refresh_mutex;
+};
@@ -0,0 +1,219 @@
+/*
+ *  TemplateImage.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Encodes and decodes with the templates of an image written by
+ *      UrlEncoder::TemplatesToImage, in place. The image holds offsets and
+ *      indices rather than pointers, so it works wherever it's mapped, and
+ *      processes mapping the same image share one copy of the literals,
+ *      chunk lists, bit widths and dispatch table.
+ *
+ *      After a header the image has these sections, each starting on a
+ *      multiple of 8 bytes:
+ *          - a LiteralPool::Entry for each literal id
+ *          - the text of the literals
+ *          - the templates, sorted by PEN and then sub PEN
+ *          - the chunk references of the templates
+ *          - the bit widths of the templates
+ *          - the prefix shapes, longest first
+ *          - the buckets of each shape, sorted by their key
+ *          - the candidates of each bucket, template indices in order
+ *          - the keys of the buckets, as long as their shape's prefix
+ *
+ *      The shapes and buckets are those TemplateIndex would build, so a url
+ *      tries the same templates in the same order. What a process holds on
+ *      its own is a pointer per template, and a pattern for each template
+ *      it has tried, built on first use with the decode plan after it.
+ *
+ *  Portability Issues:
+ *      The image uses the byte order of the machine.
+ */
+
+#pragma once
+
+#include <UrlEncoder.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+class TemplateImage
+{
+  public:
+    // A template as it's stored in the image
+    struct Template
+    {
+        std::uint64_t pen;
+        std::int16_t sub_pen;
+        std::span<const std::uint32_t> bits;
+        std::span<const std::uint32_t> chunks;
+    };
+
+    // An image without templates
+    TemplateImage();
+
+    /*
+     *  TemplateImage::TemplateImage
+     *
+     *  Description:
+     *      Checks an image and uses it where it is
+     *
+     *  Parameters:
+     *      image [in]
+     *          The image, starting on a multiple of 8 bytes. It must not
+     *          change while this uses it.
+     *      owner [in]
+     *          Held until this is destroyed, such as the mapping the image
+     *          is in
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Throws UrlEncoderException when the image is malformed. Every
+     *      chunk has to parse as its kind and every template needs a bit
+     *      width for each value.
+     */
+    explicit TemplateImage(std::string_view image, std::shared_ptr<const void> owner = {});
+
+    ~TemplateImage();
+
+    TemplateImage(const TemplateImage&) = delete;
+    TemplateImage& operator=(const TemplateImage&) = delete;
+
+    /*
+     *  TemplateImage::Write
+     *
+     *  Description:
+     *      Writes templates as an image
+     *
+     *  Parameters:
+     *      literals [in]
+     *          The pool the templates' chunks are interned in
+     *      templates [in]
+     *          The templates
+     *      image [out]
+     *          The image is appended to it
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Offsets are from the start of the image, which has to be copied
+     *      to a multiple of 8 bytes when it's appended after other data.
+     */
+    static void Write(const LiteralPool& literals,
+                      const UrlEncoder::pen_template_map& templates,
+                      std::string& image);
+
+    // The same as UrlEncoder's, without normalizing the url or the metrics
+    quicr::Namespace EncodeUrl(std::string_view url) const;
+    bool TryEncodeUrl(std::string_view url, quicr::Namespace& name) const;
+    std::string DecodeUrl(const quicr::Namespace& code) const;
+
+    // Number of PENs, or of templates when count_sub_pen is true
+    std::uint64_t TemplateCount(const bool count_sub_pen = true) const;
+
+    // The templates in order, for loading them into a UrlEncoder
+    Template At(size_t idx) const;
+
+    // The text of the literals the chunks of At refer to
+    size_t LiteralCount() const;
+    std::string_view Literal(LiteralPool::Id id) const;
+
+    // Bytes of the image, shared by whoever maps it
+    size_t ImageSize() const;
+
+    // Bytes this process holds on its own, the pattern table and the
+    // patterns built so far, not counting their decode plans
+    size_t MemoryUsage() const;
+
+  private:
+    struct Header
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t literal_count;
+        std::uint32_t text_size;
+        std::uint32_t template_count;
+        std::uint32_t chunk_count;
+        std::uint32_t bit_count;
+        std::uint32_t shape_count;
+        std::uint32_t bucket_count;
+        std::uint32_t candidate_count;
+        std::uint32_t key_size;
+        std::uint32_t reserved;
+    };
+
+    struct TemplateEntry
+    {
+        std::uint64_t pen;
+        std::int16_t sub_pen;
+        std::uint16_t reserved;
+        std::uint32_t chunk_begin;
+        std::uint32_t chunk_count;
+        std::uint32_t bit_begin;
+        std::uint32_t bit_count;
+        std::uint32_t reserved2;
+    };
+
+    // Templates whose prefixes have the same length and wildcards, see
+    // TemplateIndex. The key of its bucket i is at key_begin + i * length.
+    struct ShapeEntry
+    {
+        std::uint64_t wildcards;
+        std::uint32_t length;
+        std::uint32_t bucket_begin;
+        std::uint32_t bucket_count;
+        std::uint32_t key_begin;
+    };
+
+    struct BucketEntry
+    {
+        std::uint32_t candidate_begin;
+        std::uint32_t candidate_count;
+    };
+
+    // Where each section starts, worked out from the counts in the header
+    struct Layout;
+
+    // Finds the first template the url matches, as TemplateIndex::Find does
+    bool Find(std::string_view url,
+              std::span<std::string_view> captures,
+              std::span<std::uint8_t> names,
+              size_t& found,
+              size_t& count) const;
+
+    // The pattern of a template, built the first time it's needed. Patterns
+    // that need std::regex are compiled then.
+    const UrlPattern& Pattern(size_t idx) const;
+
+    // Index of the template a decoded PEN and sub PEN select, throws if
+    // there's none
+    size_t FindTemplate(std::uint64_t pen, std::uint8_t sub_pen, bool& uses_sub_pen) const;
+
+    std::string_view KeyOf(const ShapeEntry& shape, size_t bucket) const;
+
+    std::string_view image;
+    std::shared_ptr<const void> owner;
+
+    std::span<const TemplateEntry> templates;
+    std::span<const std::uint32_t> chunks;
+    std::span<const std::uint32_t> bits;
+    std::span<const ShapeEntry> shapes;
+    std::span<const BucketEntry> buckets;
+    std::span<const std::uint32_t> candidates;
+    std::string_view keys;
+
+    // A read only pool over the literals of the image
+    std::shared_ptr<LiteralPool> literals;
+
+    // Set once by the first Pattern of each template
+    std::unique_ptr<std::atomic<const UrlPattern*>[]> patterns;
+};
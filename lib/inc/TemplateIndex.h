@@ -0,0 +1,208 @@
+/*
+ *  TemplateIndex.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Finds the template for a url without trying every template. Templates
+ *      are bucketed by the literal prefix of their pattern, so a url is only
+ *      matched against the templates whose prefix it starts with, plus those
+ *      without a usable prefix.
+ *
+ *      When several templates match, the one that comes first in the
+ *      pen_template_map wins, as it always has.
+ *
+ *      In adaptive mode each bucket counts the hits of its templates and,
+ *      every Reorder_Hits hits, works out a new order to try them in with
+ *      the hottest first. A template only moves ahead of an earlier one that
+ *      UrlPattern::Disjoint proves no url matches both of, so the winner
+ *      doesn't change. Finds read the order under a sequence count and scan
+ *      the bucket again if it changed underneath them.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <UrlEncoder.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class TemplateIndex
+{
+  public:
+    struct Match
+    {
+        std::uint64_t pen = 0;
+        std::int16_t sub_pen = -1;
+        const UrlEncoder::url_template* temp = nullptr;
+
+        // Number of values captured, which may be more than were stored
+        size_t captures = 0;
+    };
+
+    explicit TemplateIndex(std::pmr::memory_resource* resource);
+
+    // The template must stay where it is until it's removed
+    void Insert(std::uint64_t pen, std::int16_t sub_pen, const UrlEncoder::url_template& temp);
+    void Remove(std::uint64_t pen, std::int16_t sub_pen, const UrlEncoder::url_template& temp);
+    void Clear();
+
+    /*
+     *  TemplateIndex::Find
+     *
+     *  Description:
+     *      Finds the first template the whole url matches
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to match
+     *      captures [out]
+     *          The text of each value in the url
+     *      names [out]
+     *          The index of the name each enum slot matched, see
+     *          UrlPattern::Match
+     *      match [out]
+     *          The template that matched
+     *
+     *  Returns:
+     *      True if a template matched
+     */
+    bool Find(std::string_view url,
+              std::span<std::string_view> captures,
+              std::span<std::uint8_t> names,
+              Match& match) const;
+
+    // Number of prefix shapes and buckets, for the memory report
+    size_t BucketCount() const;
+
+    // Hits a bucket takes between working out its order again
+    static constexpr std::uint32_t Reorder_Hits = 1024;
+
+    // Bigger buckets are always tried in priority order
+    static constexpr size_t Max_Adaptive = 64;
+
+    // Turns the adaptive order on or off, counts start again from zero
+    void SetAdaptive(bool enabled);
+
+    bool GetAdaptive() const
+    {
+        return adaptive;
+    }
+
+    // Number of times a bucket's order has changed
+    std::uint64_t ReorderCount() const
+    {
+        return reorders.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct Candidate
+    {
+        std::uint64_t pen;
+        std::int16_t sub_pen;
+        const UrlEncoder::url_template* temp;
+
+        bool Before(const Candidate& other) const
+        {
+            return pen < other.pen || (pen == other.pen && sub_pen < other.sub_pen);
+        }
+
+        // A template matched with std::regex is compiled on its first use,
+        // which throws if it isn't a valid regex
+        bool Match(std::string_view url,
+                   std::span<std::string_view> captures,
+                   size_t& count,
+                   std::span<std::uint8_t> names) const
+        {
+            if (!temp->pattern.Native())
+                UrlEncoder::CompileTemplate(pen, sub_pen, temp->pattern);
+            return temp->pattern.Match(url, captures, count, names);
+        }
+    };
+
+    struct StringHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view str) const
+        {
+            return std::hash<std::string_view>{}(str);
+        }
+    };
+
+    // The order a bucket is tried in, changed by whichever Find crosses
+    // Reorder_Hits while the others keep using it. Allocated with new since
+    // Finds write to it, and the index's resource may not be thread safe.
+    struct ProbeOrder
+    {
+        explicit ProbeOrder(size_t count);
+
+        // Hits of each candidate, in priority order
+        std::unique_ptr<std::atomic<std::uint32_t>[]> hits;
+        std::atomic<std::uint32_t> since_reorder = 0;
+
+        // Two orders, the one in use is picked by the low bit of version
+        std::unique_ptr<std::atomic<std::uint8_t>[]> orders[2];
+        std::atomic<std::uint32_t> version = 0;
+        std::atomic<bool> reordering = false;
+
+        // Bit j of overlaps[i] is set when candidates i and j may match the
+        // same url, so the later of them can't be tried first
+        std::vector<std::uint64_t> overlaps;
+    };
+
+    struct Bucket
+    {
+        explicit Bucket(std::pmr::memory_resource* resource) : candidates(resource)
+        {
+        }
+
+        // In priority order
+        std::pmr::vector<Candidate> candidates;
+
+        // Set in adaptive mode for buckets of 2 to Max_Adaptive candidates
+        std::unique_ptr<ProbeOrder> order;
+    };
+
+    // Templates whose prefixes have the same length and wildcards
+    struct Shape
+    {
+        size_t length;
+        std::uint64_t wildcards;
+        std::pmr::unordered_map<std::pmr::string, Bucket, StringHash, std::equal_to<>> buckets;
+    };
+
+    Bucket* FindBucket(const UrlPattern::Prefix& prefix);
+
+    // Makes or drops the probe order of a bucket whose candidates changed
+    void ResetOrder(Bucket& bucket);
+
+    // Finds the first match of an adaptive bucket that beats best
+    const Candidate* FindIn(const Bucket& bucket,
+                            std::string_view url,
+                            std::span<std::string_view> scratch,
+                            std::span<std::uint8_t> scratch_names,
+                            const Candidate* best,
+                            size_t& count) const;
+
+    // Works out the order of a bucket from its hits, if no other Find is
+    void Reorder(const Bucket& bucket) const;
+
+    std::pmr::memory_resource* resource;
+    bool adaptive = false;
+    mutable std::atomic<std::uint64_t> reorders = 0;
+
+    // Longest prefixes first, they have the fewest candidates
+    std::pmr::vector<Shape> shapes;
+};
@@ -0,0 +1,145 @@
+/*
+ *  TemplateWatcher.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Keeps a UrlEncoder loaded from a template file and reloads it when the
+ *      file changes. The new templates are loaded into a new UrlEncoder on a
+ *      background thread and swapped in atomically, callers that already got
+ *      the old one keep using it until they let it go.
+ *
+ *      A file that fails to load is reported and the current templates are
+ *      kept. So is the watcher thread failing to wait for changes, after
+ *      which only Reload loads the file.
+ *
+ *  Portability Issues:
+ *      Uses inotify, Linux only.
+ */
+
+#pragma once
+
+#include <UrlEncoder.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class TemplateWatcher
+{
+  public:
+    struct options
+    {
+        // Wait for the file to be quiet this long before reloading, so a
+        // file written in several steps is only loaded once
+        std::chrono::milliseconds debounce{100};
+
+        // Compile mode of the UrlEncoders that are loaded
+        UrlEncoder::compile_mode mode = UrlEncoder::compile_mode::eager;
+    };
+
+    struct reload_status
+    {
+        bool ok = false;
+
+        // Incremented on every successful load
+        std::uint64_t generation = 0;
+
+        std::uint64_t templates = 0;
+        std::chrono::microseconds elapsed{0};
+
+        // Why the load failed, empty when it didn't
+        std::string error;
+    };
+
+    using callback = std::function<void(const reload_status& status)>;
+
+    /*
+     *  TemplateWatcher::TemplateWatcher
+     *
+     *  Description:
+     *      Loads the template file and starts watching it
+     *
+     *  Parameters:
+     *      path [in]
+     *          The template json file, such as the one from
+     *          ConfigurationManager::GetTemplateFilePath
+     *      opts [in]
+     *          Debounce and compile mode
+     *      on_reload [in]
+     *          Called after each load attempt, on the thread that made it.
+     *          That's the watcher thread for changes to the file, and the
+     *          caller's thread for the first load and for Reload. Calls
+     *          from the two threads may run at the same time.
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Throws UrlEncoderException when the file can't be watched or the
+     *      first load fails.
+     */
+    TemplateWatcher(const std::string& path, const options& opts, callback on_reload = nullptr);
+
+    // Watches with the default options
+    explicit TemplateWatcher(const std::string& path);
+
+    ~TemplateWatcher();
+
+    TemplateWatcher(const TemplateWatcher&) = delete;
+    TemplateWatcher& operator=(const TemplateWatcher&) = delete;
+
+    /*
+     *  TemplateWatcher::Get
+     *
+     *  Description:
+     *      Gets the current templates, safe to call from any thread
+     *
+     *  Returns:
+     *      std::shared_ptr<const UrlEncoder> - Stays valid after a reload
+     */
+    std::shared_ptr<const UrlEncoder> Get() const;
+
+    /*
+     *  TemplateWatcher::Reload
+     *
+     *  Description:
+     *      Loads the file now on the calling thread, as if it changed.
+     *      on_reload is called on this thread too.
+     *
+     *  Returns:
+     *      reload_status - Whether the new templates were swapped in
+     */
+    reload_status Reload();
+
+    // Status of the last load attempt
+    reload_status LastStatus() const;
+
+  private:
+    void Watch();
+
+    // Reports that the watcher thread can't wait for changes any more, the
+    // current templates are kept but the file is no longer reloaded
+    void StopWatching(const std::string& reason);
+
+    std::string path;
+    options opts;
+    callback on_reload;
+
+    std::atomic<std::shared_ptr<const UrlEncoder>> current;
+
+    // Loads are serialized, Reload may race the watcher thread
+    mutable std::mutex load_mutex;
+    reload_status last_status;
+
+    int inotify_fd = -1;
+    int watch_fd = -1;
+    int wake_fd = -1;
+    std::thread watcher;
+};
@@ -16,8 +16,23 @@
 
 #include <quicr/namespace.h>
 
+#include <LiteralPool.h>
+#include <UrlNormalizer.h>
+#include <UrlPrefilter.h>
+#include <UrlPattern.h>
+
+#ifdef NUMERO_URI_ENABLE_METRICS
+#include <UrlEncoderMetrics.h>
+#endif
+
+#include <array>
+#include <cstddef>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
 #include <regex>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -27,6 +42,8 @@
 
 using json = nlohmann::json;
 
+class TemplateIndex;
+
 struct UrlEncoderException : public std::runtime_error
 {
     using std::runtime_error::runtime_error;
@@ -50,21 +67,91 @@ struct UrlEncoderOutOfRangeException : public std::runtime_error
 class UrlEncoder
 {
   public:
-    // Structure to describe a url template
-    typedef struct
+    // Structure to describe a url template. It allocates from the memory
+    // resource of the map it's in, and the literals of its pattern are
+    // interned in the pool of the UrlEncoder. Copies intern their own, so
+    // they stay valid after the UrlEncoder changes or goes away.
+    struct url_template
+    {
+        using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+        url_template(allocator_type alloc = {}) : pattern(alloc), bits(alloc)
+        {
+        }
+
+        url_template(const url_template& other, allocator_type alloc = {})
+            : pattern(other.pattern, alloc), bits(other.bits, alloc)
+        {
+        }
+
+        url_template(url_template&& other, allocator_type alloc)
+            : pattern(std::move(other.pattern), alloc), bits(std::move(other.bits), alloc)
+        {
+        }
+
+        url_template(url_template&&) = default;
+        url_template& operator=(const url_template&) = default;
+        url_template& operator=(url_template&&) = default;
+
+        // The regex of the template
+        std::string url() const
+        {
+            return pattern.str();
+        }
+
+        UrlPattern pattern;
+        std::pmr::vector<std::uint32_t> bits;
+    };
+
+    // Memory used by the templates, compared to keeping a string per url
+    struct memory_report
     {
-        std::string url;
-        std::vector<std::uint32_t> bits;
-    } url_template;
+        std::uint64_t templates = 0;
+
+        // Bytes the urls took when each template kept its own string
+        std::uint64_t flat_url_bytes = 0;
+
+        // Bytes of the chunk lists, the literal pool and the dispatch index
+        std::uint64_t pattern_bytes = 0;
+        std::uint64_t pool_bytes = 0;
+        std::uint64_t pool_literals = 0;
+        std::uint64_t index_buckets = 0;
+
+        // Templates whose regex and decode plan have been built
+        std::uint64_t compiled_templates = 0;
 
-    typedef std::map<std::int16_t, url_template> template_map;
+        // Bytes of the bit widths, the same either way
+        std::uint64_t bits_bytes = 0;
+
+        double BytesPerTemplateBefore() const;
+        double BytesPerTemplateAfter() const;
+
+        json ToJson() const;
+    };
+
+    typedef std::pmr::map<std::int16_t, url_template> template_map;
 
     // Alias for url templates
-    typedef std::map<std::uint64_t, template_map> pen_template_map;
+    typedef std::pmr::map<std::uint64_t, template_map> pen_template_map;
+
+    // When the regex and decode plan of a template are built. Lazy defers
+    // them to the first encode or decode that uses the template, so loading
+    // many templates only stores and indexes them.
+    enum class compile_mode
+    {
+        eager,
+        lazy
+    };
 
     static constexpr std::uint16_t Pen_Bits = 24;
     static constexpr std::uint16_t Sub_Pen_Bits = 8;
 
+    // Bytes of a name on the wire, see EncodeUrlTo
+    static constexpr size_t Wire_Bytes = 16;
+
+    // Width of the names made by EncodeUrl64
+    static constexpr std::uint16_t Name64_Bits = 64;
+
     /*
      *  UrlEncoder::UrlEncoder
      *
@@ -80,6 +167,26 @@ class UrlEncoder
      */
     UrlEncoder();
 
+    /*
+     *  UrlEncoder::UrlEncoder
+     *
+     *  Description:
+     *       Initializes an empty UrlEncoder that allocates its templates from
+     *       the given memory resource
+     *
+     *  Parameters:
+     *      resource [in]
+     *          Memory resource for the templates, which must outlive the
+     *          UrlEncoder
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      The other constructors allocate from a pool owned by the
+     *      UrlEncoder, which Clear and the destructor free in one step.
+     */
+    explicit UrlEncoder(std::pmr::memory_resource* resource);
+
     /*
      *  UrlEncoder::UrlEncoder
      *
@@ -150,6 +257,21 @@ class UrlEncoder
      */
     UrlEncoder(const json& init_templates);
 
+    // A copy rebuilds the templates in a pool of its own, with the same
+    // settings and empty metrics
+    UrlEncoder(const UrlEncoder& other);
+
+    // Takes the pool along, so the encoder moved from can only be destroyed
+    UrlEncoder(UrlEncoder&&);
+
+    // Assignment keeps the memory resource of this encoder, like the
+    // std::pmr containers. A move takes the templates over when both use
+    // the same resource, otherwise it rebuilds them in this one and clears
+    // the other encoder.
+    UrlEncoder& operator=(const UrlEncoder& other);
+    UrlEncoder& operator=(UrlEncoder&& other);
+    ~UrlEncoder();
+
     /*
      *  UrlEncoder::EncodeUrl
      *
@@ -169,6 +291,30 @@ class UrlEncoder
      */
     quicr::Namespace EncodeUrl(const std::string& url) const;
 
+    /*
+     *  UrlEncoder::TryEncodeUrl
+     *
+     *  Description:
+     *      Encodes a url like EncodeUrl, but returns false rather than
+     *      throwing when no template matches it. Most urls that match
+     *      nothing are turned away by the prefilter without trying any
+     *      template.
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to be encoded
+     *      name [out]
+     *          The encoding, only set when a template matches
+     *
+     *  Returns:
+     *      bool - True if the url was encoded
+     *
+     *  Comments:
+     *      A url that matches but has a value too big for its slot still
+     *      throws UrlEncoderOutOfRangeException.
+     */
+    bool TryEncodeUrl(std::string_view url, quicr::Namespace& name) const;
+
     /*
      *  UrlEncoder::DecodeUrl
      *
@@ -191,7 +337,88 @@ class UrlEncoder
      *  Comments:
      *      Note: rep can be sym, hex, dec, bin.
      */
-    std::string DecodeUrl(const quicr::Namespace& code);
+    std::string DecodeUrl(const quicr::Namespace& code) const;
+
+    /*
+     *  UrlEncoder::EncodeUrlTo
+     *
+     *  Description:
+     *      Encodes a url straight into the 16 big endian bytes of its name,
+     *      without building a quicr::Name
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to be encoded
+     *      out [out]
+     *          The name, only written when the url encodes
+     *
+     *  Returns:
+     *      std::uint8_t - The significant bits of the name, the length of
+     *          the namespace EncodeUrl returns
+     */
+    std::uint8_t EncodeUrlTo(std::string_view url, std::span<std::byte, Wire_Bytes> out) const;
+
+    /*
+     *  UrlEncoder::DecodeUrl
+     *
+     *  Description:
+     *      Decodes a name from its big endian bytes, as written by EncodeUrlTo
+     *
+     *  Parameters:
+     *      wire [in]
+     *          At least Wire_Bytes bytes, any after them are ignored
+     *
+     *  Returns:
+     *      std::string - The decoded url
+     */
+    std::string DecodeUrl(std::span<const std::byte> wire) const;
+
+    /*
+     *  UrlEncoder::DecodeUrls
+     *
+     *  Description:
+     *      Decodes a batch of names. The names are grouped by PEN and sub
+     *      PEN, so each template is looked up once per group, and a group's
+     *      values are unpacked one field at a time across all its names.
+     *
+     *  Parameters:
+     *      codes [in]
+     *          The names to decode
+     *      urls [out]
+     *          Resized to the number of names, the url of each name in the
+     *          same order, or empty for a name that doesn't decode
+     *
+     *  Returns:
+     *      size_t - The number of names that didn't decode
+     *
+     *  Comments:
+     *      Built with AVX2, the fields of four names are unpacked at once.
+     */
+    size_t DecodeUrls(std::span<const quicr::Namespace> codes, std::vector<std::string>& urls) const;
+
+    /*
+     *  UrlEncoder::EncodeUrl64
+     *
+     *  Description:
+     *      Encodes a url into a 64 bit name, for templates whose PEN, sub PEN
+     *      and values fit in 64 bits. The layout is the same as EncodeUrl,
+     *      so the result is the top 64 bits of its name.
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to be encoded
+     *
+     *  Returns:
+     *      std::uint64_t - The encoding
+     *
+     *  Comments:
+     *      Throws UrlEncoderOutOfRangeException if the matching template
+     *      needs more than 64 bits.
+     */
+    std::uint64_t EncodeUrl64(const std::string& url) const;
+
+    // Decodes a name made by EncodeUrl64
+    std::string DecodeUrl64(const std::uint64_t code) const;
 
     /*
      *  UrlEncoder::AddTemplate
@@ -205,6 +432,13 @@ class UrlEncoder
      *          Ex. https://webex.com<int24=777>/meeting<int53>
      *      - Additionally surround a portion of url to make it optional.
      *              Ex. https://!{www.}!webex.com<int24=777>/meeting<int16>
+     *      - A query of key=<intxx> parameters matches them in any order.
+     *          Other parameters are rejected unless it ends with &*.
+     *              Ex. https://webex.com<pen=777>/join?room=<int16>&user=<int16>&*
+     *      - <enum:a|b|c> matches one of the names, encoded as its index.
+     *      - <strN:b32> or <strN:b64> matches up to N characters of base32
+     *          or url safe base64, packed 5 or 6 bits each after the length.
+     *              Ex. https://webex.com<pen=777>/token/<str6:b32>
      *
      *  Parameters:
      *      new_template [in]
@@ -271,6 +505,10 @@ class UrlEncoder
      *  Returns:
      *
      *  Comments:
+     *      In compile_mode::eager a url that isn't a valid regex throws
+     *      UrlEncoderException and none of the templates are added. In
+     *      compile_mode::lazy it throws from the first encode or decode
+     *      that uses it.
      */
     void AddTemplate(const json& new_templates, const bool overwrite = false);
 
@@ -325,6 +563,27 @@ class UrlEncoder
      */
     json TemplatesToJson() const;
 
+    /*
+     *  UrlEncoder::TemplatesToJson
+     *
+     *  Description:
+     *      Writes the templates to a stream as json, without building the
+     *      json object or copying the templates
+     *
+     *  Parameters:
+     *      out [in]
+     *          Stream the json is written to, a buffer at a time
+     *      indent [in]
+     *          Spaces per level, -1 for no line breaks. The text is the same
+     *          as dumping TemplatesToJson() with this indent.
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      No templates are written as [] rather than null.
+     */
+    void TemplatesToJson(std::ostream& out, int indent = -1) const;
+
     /*
      *  UrlEncoder::TemplatesFromJson
      *
@@ -343,6 +602,47 @@ class UrlEncoder
      */
     void TemplatesFromJson(const json& data);
 
+    /*
+     *  UrlEncoder::TemplatesToImage
+     *
+     *  Description:
+     *      Writes the templates as a flat binary image, their literals and
+     *      chunk lists as they are in memory, so they load without parsing
+     *      any json or regex. The image also holds the dispatch table, so a
+     *      TemplateImage can encode with it in place.
+     *
+     *  Parameters:
+     *      image [out]
+     *          The image is appended to it
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      The image uses the byte order of the machine, it's meant for other
+     *      processes on the same host, see SharedTemplateStore. Its layout is
+     *      described in TemplateImage.h.
+     */
+    void TemplatesToImage(std::string& image) const;
+
+    /*
+     *  UrlEncoder::TemplatesFromImage
+     *
+     *  Description:
+     *      Loads templates from an image written by TemplatesToImage
+     *
+     *  Parameters:
+     *      image [in]
+     *          The image, not used after this returns
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Clears the current templates. Throws UrlEncoderException when the
+     *      image is malformed, leaving no templates. Every chunk has to parse
+     *      as its kind and every template needs a bit width for each value.
+     */
+    void TemplatesFromImage(std::string_view image);
+
     /*
      *  UrlEncoder::Clear
      *
@@ -354,6 +654,8 @@ class UrlEncoder
      *  Returns:
      *
      *  Comments:
+     *      When the UrlEncoder owns its memory pool, the whole pool is
+     *      released.
      */
     void Clear();
 
@@ -390,7 +692,120 @@ class UrlEncoder
 
     std::uint64_t TemplateCount(const bool count_sub_pen = true) const;
 
+    // Memory resource the templates are allocated from
+    std::pmr::memory_resource* GetMemoryResource() const;
+
+    /*
+     *  UrlEncoder::SetCompileMode
+     *
+     *  Description:
+     *      Sets whether templates added from now on are compiled when they're
+     *      added or on first use
+     *
+     *  Parameters:
+     *      mode [in]
+     *          compile_mode::eager, the default, or compile_mode::lazy
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Compiling on first use is thread safe, concurrent encodes and
+     *      decodes of a cold template build it once.
+     */
+    void SetCompileMode(const compile_mode mode);
+
+    compile_mode GetCompileMode() const;
+
+    /*
+     *  UrlEncoder::SetNormalization
+     *
+     *  Description:
+     *      Sets how urls are normalized before EncodeUrl matches them, so one
+     *      template covers https://WebEx.com/meeting1/ and
+     *      https://webex.com//meeting%31
+     *
+     *  Parameters:
+     *      opts [in]
+     *          The normalizations to do, none by default
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Templates are not normalized, write them in the normalized form.
+     *      DecodeUrl returns the url in the template's form.
+     */
+    void SetNormalization(const UrlNormalizer::options& opts);
+
+    UrlNormalizer::options GetNormalization() const;
+
+    /*
+     *  UrlEncoder::SetAdaptiveOrder
+     *
+     *  Description:
+     *      Sets whether EncodeUrl counts the hits of each template and tries
+     *      the templates that share a literal prefix hottest first, instead
+     *      of in PEN order
+     *
+     *  Parameters:
+     *      enabled [in]
+     *          Off by default
+     *
+     *  Returns:
+     *
+     *  Comments:
+     *      Every url still encodes with the same template, see TemplateIndex.h.
+     */
+    void SetAdaptiveOrder(const bool enabled);
+
+    bool GetAdaptiveOrder() const;
+
+    // Times the adaptive order has changed the order of a prefix's templates
+    std::uint64_t ReorderCount() const;
+
+    /*
+     *  UrlEncoder::GetMemoryReport
+     *
+     *  Description:
+     *      Measures the memory held by the templates, and what the urls would
+     *      take if each template kept its own string
+     *
+     *  Parameters:
+     *
+     *  Returns:
+     *      UrlEncoder::memory_report - Byte counts of the templates
+     *
+     *  Comments:
+     *      Counts the containers' capacity, not the overhead of the memory
+     *      resource.
+     */
+    memory_report GetMemoryReport() const;
+
+#ifdef NUMERO_URI_ENABLE_METRICS
+    /*
+     *  UrlEncoder::GetMetrics
+     *
+     *  Description:
+     *      Gets the hit counts of each template, the rejections and the encode
+     *      and decode latencies so far
+     *
+     *  Returns:
+     *      UrlEncoderMetrics::Snapshot - Totals over every thread
+     *
+     *  Comments:
+     *      Only available when built with NUMERO_URI_ENABLE_METRICS
+     */
+    UrlEncoderMetrics::Snapshot GetMetrics() const;
+
+    // GetMetrics as json, in the same style as TemplatesToJson
+    json MetricsToJson() const;
+
+    void ResetMetrics() const;
+#endif
+
   private:
+    friend class TemplateImage;
+    friend class TemplateIndex;
+
     /*
      *  UrlEncoder::PraseJson
      *
@@ -406,8 +821,104 @@ class UrlEncoder
      *
      *  Comments:
      */
-    pen_template_map ParseJson(const json& data) const;
+    pen_template_map ParseJson(const json& data);
+
+    // What a url matched and its values, everything EncodeUrl does before
+    // packing the name
+    struct matched_url
+    {
+        std::uint64_t pen = 0;
+        std::int16_t sub_pen = -1;
+        const url_template* temp = nullptr;
+
+        // The first count are the template's values, on the stack so a
+        // match doesn't allocate
+        std::array<std::uint64_t, UrlPattern::Max_Slots> values;
+        size_t count = 0;
+    };
+
+    // Matches a url, false when no template matches it
+    bool MatchUrl(std::string_view url, matched_url& matched) const;
+
+    // Writes the name of a matched url
+    quicr::Namespace PackName(const matched_url& matched) const;
+
+    // Writes the name of a PEN, sub PEN and values, each in its bits
+    static quicr::Namespace PackName(std::uint64_t pen,
+                                     std::int16_t sub_pen,
+                                     std::span<const std::uint32_t> bits,
+                                     std::span<const std::uint64_t> values);
+
+    // Parses a url value which may be prefixed with 0x, 0b or 0d for its base
+    static std::uint64_t ParseValue(std::string_view str);
+
+    // The template a decoded PEN and sub PEN select, throws if there's none
+    const url_template* FindTemplate(const std::uint64_t pen, const std::uint8_t sub_pen, bool& uses_sub_pen) const;
+
+    /*
+     *  UrlEncoder::AddQuery
+     *
+     *  Description:
+     *      Adds the regex of a template's query when it's only key=<intN>
+     *      parameters joined by &, optionally ending with &* to allow others
+     *
+     *  Parameters:
+     *      query [in]
+     *          The template after the '?'
+     *      url [out]
+     *          The regex of the template, the query regex is appended to it
+     *      bits [out]
+     *          The bits of each parameter are appended to it
+     *
+     *  Returns:
+     *      bool - False, changing nothing, when the query isn't in that form
+     */
+    static bool AddQuery(std::string_view query, std::string& url, std::pmr::vector<std::uint32_t>& bits);
+
+    // Compiles a template's pattern, a regex std::regex rejects is thrown as
+    // a UrlEncoderException naming the PEN and sub PEN
+    static void CompileTemplate(std::uint64_t pen, std::int16_t sub_pen, const UrlPattern& pattern);
+
+    // Keep the dispatch index and the literal pool in step with the map
+    void IndexTemplate(std::uint64_t pen, std::int16_t sub_pen, const url_template& temp);
+    void UnindexTemplate(std::uint64_t pen, std::int16_t sub_pen, const url_template& temp);
+    void UnindexTemplates(std::uint64_t pen, const template_map& sub_templates);
+
+    // Rebuilds the literal pool once most of it belongs to removed templates
+    void CompactLiterals();
+
+    // Adds the settings and templates of another encoder, interning its
+    // literals in this pool
+    void CopyFrom(const UrlEncoder& other);
 
     /* Variables */
+
+    // Set when the UrlEncoder owns its memory resource. Declared before the
+    // templates so it's destroyed after them.
+    std::unique_ptr<std::pmr::unsynchronized_pool_resource> pool;
+
+    // Literals of the template urls. Shared with the patterns, so they
+    // still point at it after the UrlEncoder moves.
+    std::shared_ptr<LiteralPool> literals;
+
+    // Chunk references dropped since the pool was last rebuilt
+    size_t live_chunks = 0;
+    size_t dead_chunks = 0;
+
+    compile_mode mode = compile_mode::eager;
+
+    UrlNormalizer::options normalization;
+
+    bool adaptive_order = false;
+
+    // Built from every template indexed since it was last cleared
+    UrlPrefilter prefilter;
+
     pen_template_map templates;
+
+    std::unique_ptr<TemplateIndex> index;
+
+#ifdef NUMERO_URI_ENABLE_METRICS
+    mutable UrlEncoderMetrics metrics;
+#endif
 };
@@ -0,0 +1,174 @@
+/*
+ *  UrlEncoderMetrics.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Counters and latency histograms for the UrlEncoder hot paths. Each
+ *      thread counts into its own cache line padded block, so recording is
+ *      a plain load and store with no contention, and a snapshot sums the
+ *      blocks of every thread.
+ *
+ *      The UrlEncoder only records when built with NUMERO_URI_ENABLE_METRICS,
+ *      otherwise its hooks compile to nothing.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <UrlPrefilter.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+class UrlEncoderMetrics
+{
+  public:
+    // Bucket i counts latencies of [2^(i-1), 2^i) ns, bucket 0 is 0 ns
+    static constexpr size_t Histogram_Buckets = 64;
+
+    struct Histogram
+    {
+        std::array<std::uint64_t, Histogram_Buckets> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t total_ns = 0;
+
+        // Upper bound of the bucket holding the percentile, pct in [0, 100]
+        std::uint64_t Percentile(double pct) const;
+
+        nlohmann::json ToJson() const;
+    };
+
+    struct TemplateCounters
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t out_of_range = 0;
+    };
+
+    struct Snapshot
+    {
+        // Keyed by PEN and sub PEN, -1 when the template has no sub PEN
+        std::map<std::pair<std::uint64_t, std::int16_t>, TemplateCounters> templates;
+
+        // Urls that matched no template
+        std::uint64_t no_match = 0;
+
+        // Of those, the ones the prefilter turned away before any template
+        // was tried, by the check that failed
+        std::uint64_t rejected_length = 0;
+        std::uint64_t rejected_prefix = 0;
+        std::uint64_t rejected_authority = 0;
+
+        Histogram encode_latency;
+        Histogram decode_latency;
+
+        nlohmann::json ToJson() const;
+    };
+
+    enum class Operation
+    {
+        Encode,
+        Decode
+    };
+
+    // Records the latency of an operation when it goes out of scope
+    class Timer
+    {
+      public:
+        Timer(UrlEncoderMetrics& metrics, Operation operation)
+            : metrics(metrics), operation(operation), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~Timer()
+        {
+            metrics.RecordLatency(operation, std::chrono::steady_clock::now() - start);
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+      private:
+        UrlEncoderMetrics& metrics;
+        const Operation operation;
+        const std::chrono::steady_clock::time_point start;
+    };
+
+    UrlEncoderMetrics();
+
+    // A copy starts with its own empty counters, they belong to the
+    // encoder that did the work
+    UrlEncoderMetrics(const UrlEncoderMetrics&);
+    UrlEncoderMetrics& operator=(const UrlEncoderMetrics&);
+
+    ~UrlEncoderMetrics();
+
+    void RecordHit(std::uint64_t pen, std::int16_t sub_pen);
+    void RecordOutOfRange(std::uint64_t pen, std::int16_t sub_pen);
+    void RecordNoMatch();
+    void RecordRejected(UrlPrefilter::Verdict verdict);
+    void RecordLatency(Operation operation, std::chrono::nanoseconds latency);
+
+    /*
+     *  UrlEncoderMetrics::GetSnapshot
+     *
+     *  Description:
+     *      Sums the counters of every thread
+     *
+     *  Returns:
+     *      The totals so far
+     *
+     *  Comments:
+     *      Safe to call while other threads are recording, their latest
+     *      counts may or may not be included.
+     */
+    Snapshot GetSnapshot() const;
+
+    // Zeroes the counters. Counts recorded at the same time may be lost.
+    void Reset();
+
+  private:
+    struct alignas(64) PaddedCounters
+    {
+        std::atomic<std::uint64_t> hits = 0;
+        std::atomic<std::uint64_t> out_of_range = 0;
+    };
+
+    struct alignas(64) ThreadBlock
+    {
+        std::atomic<std::uint64_t> no_match = 0;
+
+        // Indexed by UrlPrefilter::Verdict
+        std::array<std::atomic<std::uint64_t>, 4> rejected{};
+        std::array<std::array<std::atomic<std::uint64_t>, Histogram_Buckets>, 2> latency{};
+        std::array<std::atomic<std::uint64_t>, 2> total_ns{};
+
+        // Only the owning thread inserts, under the mutex so a snapshot can
+        // walk the map. The owner looks up without it.
+        std::unordered_map<std::uint64_t, std::unique_ptr<PaddedCounters>> templates;
+        mutable std::mutex templates_mutex;
+    };
+
+    ThreadBlock& Local();
+    PaddedCounters& LocalTemplate(std::uint64_t pen, std::int16_t sub_pen);
+
+    // Identifies this instance in the per thread caches, never reused
+    const std::uint64_t id;
+
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+    mutable std::mutex blocks_mutex;
+};
@@ -0,0 +1,205 @@
+/*
+ *  UrlEncoderService.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Runs encodes and decodes on its own worker threads, so the threads
+ *      that submit them don't pay for template matching. Each worker has a
+ *      bounded lock free queue. A worker takes what's queued in batches and
+ *      uses one UrlEncoder for the whole batch.
+ *
+ *      Results are passed to a completion callback on the worker thread, or
+ *      through a future. A full service rejects new jobs rather than block
+ *      the caller.
+ *
+ *  Portability Issues:
+ *      Core pinning is only done on Linux.
+ */
+
+#pragma once
+
+#include <MpscQueue.h>
+#include <UrlEncoder.h>
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct UrlEncoderServiceFullException : public std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+class UrlEncoderService
+{
+  public:
+    struct options
+    {
+        // Zero uses one worker per core
+        unsigned int workers = 0;
+
+        // Jobs each worker can have queued, rounded up to a power of two
+        size_t queue_capacity = 1024;
+
+        // Most jobs a worker takes from its queue at once
+        size_t batch_size = 64;
+
+        // Worker i is pinned to cpus[i % cpus.size()], empty to not pin
+        std::vector<int> cpus = {};
+    };
+
+    struct encode_result
+    {
+        quicr::Namespace name;
+
+        // Set when the encode threw, name is then empty
+        std::exception_ptr error;
+    };
+
+    struct decode_result
+    {
+        std::string url;
+        std::exception_ptr error;
+    };
+
+    struct stats
+    {
+        std::uint64_t submitted = 0;
+        std::uint64_t completed = 0;
+        std::uint64_t rejected = 0;
+        std::uint64_t batches = 0;
+    };
+
+    using encode_callback = std::function<void(encode_result&& result)>;
+    using decode_callback = std::function<void(decode_result&& result)>;
+
+    /*
+     *  UrlEncoderService::UrlEncoderService
+     *
+     *  Description:
+     *      Starts the workers
+     *
+     *  Parameters:
+     *      get_encoder [in]
+     *          Returns the encoder to use, called once per batch so it can be
+     *          swapped while running, such as TemplateWatcher::Get
+     *      opts [in]
+     *          Workers, queue sizes and pinning
+     *
+     *  Comments:
+     *      Throws std::invalid_argument for a cpu outside 0 to CPU_SETSIZE,
+     *      and UrlEncoderException when a worker can't be pinned.
+     */
+    UrlEncoderService(std::function<std::shared_ptr<const UrlEncoder>()> get_encoder, const options& opts);
+
+    // Runs every job with the one encoder
+    UrlEncoderService(std::shared_ptr<const UrlEncoder> encoder, const options& opts);
+
+    // Finishes the jobs already queued, then stops the workers
+    ~UrlEncoderService();
+
+    UrlEncoderService(const UrlEncoderService&) = delete;
+    UrlEncoderService& operator=(const UrlEncoderService&) = delete;
+
+    /*
+     *  UrlEncoderService::Encode
+     *
+     *  Description:
+     *      Queues an encode, safe to call from any thread
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to encode
+     *      done [in]
+     *          Called on a worker thread with the result, must not throw
+     *
+     *  Returns:
+     *      bool - False if every queue is full, done is then not called
+     */
+    bool Encode(std::string url, encode_callback done);
+
+    // Queues a decode, see Encode
+    bool Decode(const quicr::Namespace& code, decode_callback done);
+
+    /*
+     *  UrlEncoderService::Encode
+     *
+     *  Description:
+     *      Queues an encode and returns its result as a future
+     *
+     *  Returns:
+     *      std::future<quicr::Namespace> - Holds the exception of a failed
+     *          encode, or UrlEncoderServiceFullException if it wasn't queued
+     */
+    std::future<quicr::Namespace> Encode(std::string url);
+
+    std::future<std::string> Decode(const quicr::Namespace& code);
+
+    unsigned int WorkerCount() const;
+
+    stats GetStats() const;
+
+  private:
+    struct Job
+    {
+        enum class Operation : std::uint8_t
+        {
+            Encode,
+            Decode
+        };
+
+        Operation op = Operation::Encode;
+        std::string url;
+        quicr::Namespace code;
+        encode_callback on_encode;
+        decode_callback on_decode;
+    };
+
+    struct Worker
+    {
+        explicit Worker(size_t capacity) : queue(capacity)
+        {
+        }
+
+        MpscQueue<Job> queue;
+
+        // Bumped to wake the worker when it's waiting for work
+        std::atomic<std::uint32_t> signal = 0;
+        std::atomic<bool> waiting = false;
+
+        std::thread thread;
+    };
+
+    bool Submit(Job&& job);
+    void Run(Worker& worker);
+
+    // Finishes the queued jobs and joins the workers
+    void Stop();
+
+    std::function<std::shared_ptr<const UrlEncoder>()> get_encoder;
+    options opts;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> next_worker = 0;
+    std::atomic<bool> stopping = false;
+
+    // Submits between their stopping check and their push
+    std::atomic<unsigned int> submitting = 0;
+
+    // Set once nothing more can be queued, the workers exit when empty
+    std::atomic<bool> finished = false;
+
+    std::atomic<std::uint64_t> submitted = 0;
+    std::atomic<std::uint64_t> completed = 0;
+    std::atomic<std::uint64_t> rejected = 0;
+    std::atomic<std::uint64_t> batches = 0;
+};
@@ -0,0 +1,150 @@
+/*
+ *  UrlEncoderTrace.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Timing of the phases of UrlEncoder::EncodeUrl and DecodeUrl. Each
+ *      phase is reported as an event to a callback, and or written to a
+ *      lock free ring buffer that can be dumped as Chrome trace event json
+ *      (chrome://tracing, Perfetto).
+ *
+ *      The UrlEncoder only has the probes when built with
+ *      NUMERO_URI_ENABLE_TRACE, otherwise they compile to nothing. When
+ *      built in they cost one relaxed load per call until tracing is
+ *      started.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+class UrlEncoderTrace
+{
+  public:
+    enum class Phase : std::uint8_t
+    {
+        EncodeDispatch,
+        EncodeMatch,
+        EncodeParse,
+        EncodeRangeCheck,
+        EncodePack,
+        DecodeLookup,
+        DecodeUnpack,
+        DecodeFormat
+    };
+
+    struct Event
+    {
+        Phase phase;
+        std::uint32_t thread_id;
+
+        // Steady clock time
+        std::uint64_t start_ns;
+        std::uint64_t duration_ns;
+    };
+
+    using Callback = void (*)(const Event& event, void* context);
+
+    // Name of a phase in the trace, such as "encode.match"
+    static const char* PhaseName(Phase phase);
+
+    /*
+     *  UrlEncoderTrace::SetCallback
+     *
+     *  Description:
+     *      Calls callback with every phase event, nullptr to stop
+     *
+     *  Comments:
+     *      The callback runs on the encoding thread so must be quick and
+     *      thread safe. Set it before encoding starts, changing it while
+     *      other threads are encoding may pair the old callback with the
+     *      new context.
+     */
+    static void SetCallback(Callback callback, void* context = nullptr);
+
+    /*
+     *  UrlEncoderTrace::StartRing
+     *
+     *  Description:
+     *      Records events in a ring buffer, keeping the newest capacity of
+     *      them
+     *
+     *  Comments:
+     *      Not thread safe with itself, StopRing or Collect. Recording
+     *      threads never block.
+     */
+    static void StartRing(size_t capacity = 1 << 16);
+
+    static void StopRing();
+
+    // Events in the ring, oldest first. Events being written are skipped.
+    static std::vector<Event> Collect();
+
+    // Events in the Chrome trace event format
+    static nlohmann::json ToChromeTrace(const std::vector<Event>& events);
+    static void WriteChromeTrace(std::ostream& out);
+
+    // True while there is a callback or a ring
+    static bool Active();
+
+    static void Record(const Event& event);
+
+    /*
+     *  UrlEncoderTrace::Phases
+     *
+     *  Description:
+     *      Times a sequence of phases, each phase ends when the next begins
+     *      or the Phases goes out of scope.
+     */
+    class Phases
+    {
+      public:
+        explicit Phases(Phase first) : active(Active())
+        {
+            if (active)
+                Begin(first);
+        }
+
+        ~Phases()
+        {
+            if (active)
+                End();
+        }
+
+        Phases(const Phases&) = delete;
+        Phases& operator=(const Phases&) = delete;
+
+        void Next(Phase next)
+        {
+            if (!active)
+                return;
+
+            End();
+            Begin(next);
+        }
+
+      private:
+        void Begin(Phase next)
+        {
+            phase = next;
+            start = std::chrono::steady_clock::now();
+        }
+
+        void End();
+
+        const bool active;
+        Phase phase = Phase::EncodeDispatch;
+        std::chrono::steady_clock::time_point start;
+    };
+};
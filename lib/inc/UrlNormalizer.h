@@ -0,0 +1,75 @@
+/*
+ *  UrlNormalizer.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Rewrites the spellings of a url that mean the same thing into one, so
+ *      a single template matches them all. Lowercases the scheme and host,
+ *      collapses repeated slashes in the path, strips a trailing slash and
+ *      percent decodes unreserved characters.
+ *
+ *      Done in one pass, with the runs of bytes that need no change found
+ *      and copied 16 at a time where SSE2 is available.
+ *
+ *  Portability Issues:
+ *      None. Without SSE2 the runs are found a byte at a time.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+class UrlNormalizer
+{
+  public:
+    struct options
+    {
+        // Lowercase the scheme and host, https://WebEx.com -> https://webex.com
+        bool lowercase_host = false;
+
+        // Collapse repeated slashes in the path, /a//b -> /a/b
+        bool collapse_slashes = false;
+
+        // Strip a slash at the end of the path, /a/b/?x -> /a/b?x
+        bool strip_trailing_slash = false;
+
+        // Decode letters, digits and -._~ written as %XX, /meeting%31 -> /meeting1
+        bool decode_unreserved = false;
+
+        bool Any() const
+        {
+            return lowercase_host || collapse_slashes || strip_trailing_slash || decode_unreserved;
+        }
+
+        static options All()
+        {
+            return {true, true, true, true};
+        }
+    };
+
+    // Urls up to this long are normalized into a buffer on the stack
+    static constexpr size_t Stack_Size = 512;
+
+    /*
+     *  UrlNormalizer::Normalize
+     *
+     *  Description:
+     *      Normalizes a url into out
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to normalize
+     *      out [out]
+     *          At least url.size() bytes, normalizing never makes a url longer
+     *      opts [in]
+     *          The normalizations to do
+     *
+     *  Returns:
+     *      size_t - The length of the normalized url
+     */
+    static size_t Normalize(std::string_view url, char* out, const options& opts);
+};
@@ -0,0 +1,503 @@
+/*
+ *  UrlPattern.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      The regex of a url template, stored as a list of chunks interned in
+ *      a LiteralPool. The regex is split before each '/' and around each
+ *      capturing group, so templates share their host, path segments and
+ *      slot patterns.
+ *
+ *      Patterns using only the syntax UrlEncoder::AddTemplate generates are
+ *      matched by walking the chunks, others need a std::regex. The regex
+ *      and the decode plan are compiled by Compile, or on first use.
+ *
+ *      A query made by QueryRegex is kept as one chunk and matched in a
+ *      single scan of the parameters, whatever order they're in.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <LiteralPool.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class UrlPattern
+{
+  public:
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+
+    // Most values a pattern can capture, each takes at least one bit
+    static constexpr size_t Max_Slots = 128;
+
+    // Most names an enum slot can have
+    static constexpr size_t Max_Names = 255;
+
+    // Most characters a string slot can have
+    static constexpr size_t Max_String = 12;
+
+    // Longest literal prefix used for dispatch, see LiteralPrefix
+    static constexpr size_t Max_Prefix = 64;
+
+    struct Prefix
+    {
+        // Bytes every matching url starts with, 0 where any byte matches
+        std::string bytes;
+
+        // Bit i is set when byte i matches any byte
+        std::uint64_t wildcards = 0;
+    };
+
+    UrlPattern(allocator_type alloc = {}) : chunks(alloc)
+    {
+    }
+
+    // Copies start without a plan and intern their chunks in a pool of
+    // their own, so they outlive the pool of the original. Moves take the
+    // plan and the pool along.
+    UrlPattern(const UrlPattern& other, allocator_type alloc = {});
+
+    UrlPattern(UrlPattern&& other, allocator_type alloc)
+        : pool(std::move(other.pool)), chunks(std::move(other.chunks), alloc), slots(other.slots),
+          native(other.native), plan(other.plan.exchange(nullptr))
+    {
+    }
+
+    UrlPattern(UrlPattern&& other) : UrlPattern(std::move(other), other.chunks.get_allocator())
+    {
+    }
+
+    UrlPattern& operator=(const UrlPattern& other);
+    UrlPattern& operator=(UrlPattern&& other);
+    ~UrlPattern();
+
+    /*
+     *  UrlPattern::UrlPattern
+     *
+     *  Description:
+     *      Splits a template regex into chunks and interns them
+     *
+     *  Parameters:
+     *      regex [in]
+     *          The regex of the template
+     *      pool [in]
+     *          Pool the chunks are interned in, shared with the pattern
+     *      alloc [in]
+     *          Allocator of the chunk list
+     */
+    UrlPattern(std::string_view regex, const std::shared_ptr<LiteralPool>& pool, allocator_type alloc = {});
+
+    /*
+     *  UrlPattern::UrlPattern
+     *
+     *  Description:
+     *      Makes a pattern from chunk references saved by Chunks, without
+     *      splitting a regex
+     *
+     *  Parameters:
+     *      refs [in]
+     *          The chunk references, with their ids in pool
+     *      pool [in]
+     *          Pool holding the chunks, shared with the pattern
+     *      alloc [in]
+     *          Allocator of the chunk list
+     *
+     *  Comments:
+     *      Throws std::invalid_argument when a reference has an unknown kind
+     *      or an id that isn't in the pool, or its text doesn't parse as its
+     *      kind, such as a string slot without a known alphabet.
+     */
+    UrlPattern(std::span<const std::uint32_t> refs,
+               const std::shared_ptr<LiteralPool>& pool,
+               allocator_type alloc = {});
+
+    /*
+     *  UrlPattern::QueryRegex
+     *
+     *  Description:
+     *      Builds the regex of a query whose parameters may come in any order,
+     *      with a numeric value captured for each key
+     *
+     *  Parameters:
+     *      keys [in]
+     *          The parameter names, letters, digits and -._~ only. Values are
+     *          captured in this order.
+     *      allow_unknown [in]
+     *          Whether other parameters may be present
+     *
+     *  Returns:
+     *      std::string - The regex from the '?', without the closing $
+     */
+    static std::string QueryRegex(std::span<const std::string> keys, bool allow_unknown);
+
+    /*
+     *  UrlPattern::EnumRegex
+     *
+     *  Description:
+     *      Builds the regex of a slot that's one of a few names, captured as
+     *      the index of the name
+     *
+     *  Parameters:
+     *      names [in]
+     *          The names, letters, digits and -._~ only, tried in this order
+     *
+     *  Returns:
+     *      std::string - The capturing group
+     */
+    static std::string EnumRegex(std::span<const std::string> names);
+
+    /*
+     *  UrlPattern::StringRegex
+     *
+     *  Description:
+     *      Builds the regex of a slot holding a short string, captured with
+     *      its characters packed into a number
+     *
+     *  Parameters:
+     *      alphabet [in]
+     *          b32 for a-z and 2-7 in 5 bits each, b64 for A-Z, a-z, 0-9, -
+     *          and _ in 6 bits each
+     *      length [in]
+     *          The most characters the slot holds
+     *
+     *  Returns:
+     *      std::string - The capturing group, empty when the alphabet isn't
+     *          known or the string doesn't fit in StringBits
+     */
+    static std::string StringRegex(std::string_view alphabet, size_t length);
+
+    // Bits of a string slot, the length and then each character, or 0 when
+    // it's more than 64 or the alphabet isn't known
+    static std::uint32_t StringBits(std::string_view alphabet, size_t length);
+
+    // True for a query key or enum name, letters, digits and -._~ only
+    static bool IsName(std::string_view name);
+
+    // The whole regex
+    std::string str() const;
+    size_t size() const;
+
+    // True when the pattern can be matched without std::regex
+    bool Native() const
+    {
+        return native;
+    }
+
+    // Number of values a native pattern captures
+    size_t SlotCount() const
+    {
+        return slots;
+    }
+
+    // Number of values any pattern captures, one for each capturing group
+    size_t ValueCount() const;
+
+    /*
+     *  UrlPattern::Compile
+     *
+     *  Description:
+     *      Builds the std::regex of a pattern that isn't native and the plan
+     *      Format writes urls with. Safe to call from several threads, only
+     *      the first call does the work. Throws std::regex_error when the
+     *      pattern isn't a valid regex, as does every use that compiles it.
+     */
+    void Compile() const;
+
+    // True once the pattern has been compiled
+    bool Compiled() const
+    {
+        return plan.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /*
+     *  UrlPattern::LiteralPrefix
+     *
+     *  Description:
+     *      Gets the bytes that every url matching the pattern starts with,
+     *      up to Max_Prefix of them. Empty when the pattern isn't native.
+     */
+    Prefix LiteralPrefix() const;
+
+    /*
+     *  UrlPattern::Disjoint
+     *
+     *  Description:
+     *      Checks that no url can match both patterns, by walking them side
+     *      by side until a byte differs or one ends
+     *
+     *  Returns:
+     *      True if no url matches both. False when they may overlap, or the
+     *      walk can't tell, such as at an optional group, a query, or slots
+     *      that could end in different places.
+     */
+    bool Disjoint(const UrlPattern& other) const;
+
+    // Most authorities Authorities lists for one pattern
+    static constexpr size_t Max_Authorities = 16;
+
+    /*
+     *  UrlPattern::SplitAuthority
+     *
+     *  Description:
+     *      Gets the authority of a url, the host and port between :// and
+     *      the path. Urls that don't start with a scheme and :// have an
+     *      empty one.
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url, or the start of one
+     *      whole [in]
+     *          False when more of the url may follow
+     *      authority [out]
+     *          The authority
+     *
+     *  Returns:
+     *      False when url is only the start and the authority isn't known yet
+     */
+    static bool SplitAuthority(std::string_view url, bool whole, std::string_view& authority);
+
+    /*
+     *  UrlPattern::Authorities
+     *
+     *  Description:
+     *      Gets the authority of every url the pattern matches, one for each
+     *      way the optional groups before the path can be taken. A '.' in the
+     *      authority matches any byte and is given as '\0'.
+     *
+     *  Parameters:
+     *      authorities [out]
+     *          The authorities are appended to it
+     *
+     *  Returns:
+     *      False, leaving authorities as it was, when they can't be listed.
+     *      That's when the pattern isn't native, or a slot comes before the
+     *      authority ends, or a '.' before it starts.
+     */
+    bool Authorities(std::vector<std::string>& authorities) const;
+
+    // Shortest and longest urls the pattern matches, 0 and SIZE_MAX when
+    // it isn't native
+    void LengthRange(size_t& min_length, size_t& max_length) const;
+
+    // One piece of a native pattern, for code that matches it without a
+    // UrlPattern, see Steps
+    struct Step
+    {
+        enum class Type : std::uint8_t
+        {
+            Text,
+            Optional_Text,
+            Number,
+            Decimal,
+            Enum,
+            String
+        };
+
+        Type type = Type::Text;
+
+        // The bytes of Text and Optional_Text, '\0' where any byte but a
+        // line break matches
+        std::string text;
+
+        // The names of an Enum, in the order they're tried
+        std::vector<std::string> names;
+
+        // The characters of a String by their code, the bits of each and the
+        // most it holds
+        std::string_view alphabet;
+        std::uint32_t char_bits = 0;
+        size_t length = 0;
+    };
+
+    /*
+     *  UrlPattern::Steps
+     *
+     *  Description:
+     *      Gets what a url has to hold, in order, for the pattern to match.
+     *      Numbers are the slots of <intN>, Decimal the \d+ of other
+     *      templates.
+     *
+     *  Parameters:
+     *      steps [out]
+     *          The steps, replacing what was there
+     *
+     *  Returns:
+     *      False when the pattern isn't native or has a query
+     */
+    bool Steps(std::vector<Step>& steps) const;
+
+    // The url text Format writes around the values, pieces[i] before value i
+    std::span<const std::string> Pieces() const;
+
+    /*
+     *  UrlPattern::Match
+     *
+     *  Description:
+     *      Matches the whole url against the pattern, with the same result
+     *      and captures as std::regex_match
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url to match
+     *      captures [out]
+     *          The text of each group, as many as fit
+     *      count [out]
+     *          The number of groups, which may be more than fit
+     *      names [out]
+     *          Optional, the index of the name each enum slot matched, by
+     *          slot, for TextValue
+     *
+     *  Returns:
+     *      True if the url matches
+     *
+     *  Comments:
+     *      Patterns that aren't native, or have a query, enum or string slot,
+     *      are compiled on the first call. One that isn't a valid regex never
+     *      matches. A query with a line break in it never matches natively.
+     */
+    bool Match(std::string_view url,
+               std::span<std::string_view> captures,
+               size_t& count,
+               std::span<std::uint8_t> names = {}) const;
+
+    /*
+     *  UrlPattern::TextValue
+     *
+     *  Description:
+     *      Gets the value of the text Match captured for a slot that isn't a
+     *      number, the index of an enum name or a packed string
+     *
+     *  Parameters:
+     *      slot [in]
+     *          Index of the slot
+     *      text [in]
+     *          The text captured for it
+     *      name [in]
+     *          The index Match recorded for an enum slot, its value
+     *      value [out]
+     *          The value to encode
+     *
+     *  Returns:
+     *      True if the slot isn't a number, false to parse the text instead
+     */
+    bool TextValue(size_t slot, std::string_view text, std::uint8_t name, std::uint64_t& value) const;
+
+    /*
+     *  UrlPattern::Format
+     *
+     *  Description:
+     *      Writes the url for the given slot values, dropping optional
+     *      chunks and regex syntax
+     *
+     *  Parameters:
+     *      decoded [out]
+     *          The url is appended to it
+     *      values [in]
+     *          A value for each slot
+     *
+     *  Returns:
+     *      False if a value isn't one of its slot's names or strings
+     */
+    bool Format(std::string& decoded, std::span<const std::uint64_t> values) const;
+
+    // Interns the chunks in another pool, used when a pool is rebuilt
+    void MoveTo(const std::shared_ptr<LiteralPool>& new_pool);
+
+    // The chunk references, each a pool id with its kind in the top bits
+    std::span<const std::uint32_t> Chunks() const
+    {
+        return chunks;
+    }
+
+    // Pool id of a chunk reference
+    static LiteralPool::Id ChunkId(std::uint32_t chunk)
+    {
+        return chunk & Id_Mask;
+    }
+
+    // The same chunk kind with another pool id
+    static std::uint32_t WithId(std::uint32_t chunk, LiteralPool::Id id)
+    {
+        return (chunk & ~Id_Mask) | id;
+    }
+
+    // Number of chunk references
+    size_t ChunkCount() const
+    {
+        return chunks.size();
+    }
+
+    // Bytes used by the pattern itself, not counting the pool or the plan
+    size_t MemoryUsage() const
+    {
+        return sizeof(*this) + chunks.capacity() * sizeof(std::uint32_t);
+    }
+
+    friend bool operator==(const UrlPattern& pattern, std::string_view regex);
+    friend std::ostream& operator<<(std::ostream& out, const UrlPattern& pattern);
+
+  private:
+    // Each chunk reference keeps its kind in the top bits of the pool id
+    enum Kind : std::uint32_t
+    {
+        Literal = 0,
+        Numeric_Slot = 1,
+        Decimal_Slot = 2,
+        Group = 3,
+        Query = 4,
+        Enum_Slot = 5,
+        String_Slot = 6
+    };
+
+    static constexpr std::uint32_t Kind_Shift = 29;
+    static constexpr std::uint32_t Id_Mask = (1u << Kind_Shift) - 1;
+
+    static Kind KindOf(std::uint32_t chunk)
+    {
+        return static_cast<Kind>(chunk >> Kind_Shift);
+    }
+
+    // Sets native and slots from the chunks
+    void Classify();
+
+    std::string_view Text(std::uint32_t chunk) const
+    {
+        return pool->View(chunk & Id_Mask);
+    }
+
+    // The compiled form of the pattern, see Compile
+    struct Plan;
+
+    const Plan& GetPlan() const;
+
+    bool MatchFrom(std::string_view url,
+                   std::span<std::string_view> captures,
+                   std::span<std::uint8_t> names,
+                   size_t chunk,
+                   size_t offset,
+                   size_t pos,
+                   size_t slot) const;
+
+    std::shared_ptr<const LiteralPool> pool;
+    std::pmr::vector<std::uint32_t> chunks;
+    std::uint16_t slots = 0;
+    bool native = false;
+
+    // Set once by the first Compile. It's allocated with new rather than
+    // from the chunks' resource, which may not be thread safe.
+    mutable std::atomic<const Plan*> plan = nullptr;
+};
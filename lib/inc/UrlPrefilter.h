@@ -0,0 +1,109 @@
+/*
+ *  UrlPrefilter.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Turns away urls that no template can match before any template is
+ *      tried. It keeps the range of lengths the templates match, the bytes
+ *      each of the first Prefix_Bytes positions can hold, and a Bloom filter
+ *      of the authorities in the templates. A '.' in an authority matches
+ *      any byte, so the authorities are grouped by length and where their
+ *      wildcards are, and a url's is looked up once with each group's
+ *      wildcards blanked.
+ *
+ *      It only says no for urls that can't match, a url it passes may still
+ *      match nothing. Removing a template leaves what it added until the
+ *      filter is rebuilt, which only lets more urls through.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <UrlPattern.h>
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+class UrlPrefilter
+{
+  public:
+    // Why a url was turned away, or Pass
+    enum class Verdict : std::uint8_t
+    {
+        Pass,
+        Length,
+        Prefix,
+        Authority
+    };
+
+    // Leading bytes of a url checked against the templates
+    static constexpr size_t Prefix_Bytes = 8;
+
+    // Bits of the Bloom filter per authority, and the bits set for each
+    static constexpr size_t Bloom_Bits_Per_Authority = 16;
+    static constexpr size_t Bloom_Hashes = 3;
+
+    // Most groups of authorities by length and wildcards, and the longest
+    // authority, past either the authority isn't checked
+    static constexpr size_t Max_Shapes = 16;
+    static constexpr size_t Max_Authority = 64;
+
+    UrlPrefilter();
+
+    // Lets through the urls the pattern may match
+    void Add(const UrlPattern& pattern);
+
+    // Turns away every url, as with no templates
+    void Clear();
+
+    /*
+     *  UrlPrefilter::Check
+     *
+     *  Description:
+     *      Checks whether any template could match a url
+     *
+     *  Parameters:
+     *      url [in]
+     *          The url, normalized the way the templates are written
+     *
+     *  Returns:
+     *      Verdict - Pass if one may match, otherwise the check that failed
+     */
+    Verdict Check(std::string_view url) const;
+
+  private:
+    // Authorities of one length, with bit i set when byte i is a wildcard
+    struct Shape
+    {
+        size_t length;
+        std::uint64_t wildcards;
+
+        bool operator==(const Shape&) const = default;
+    };
+
+    bool AddShape(std::string_view authority);
+    void AddAuthority(std::uint64_t hash);
+    bool HasAuthority(std::uint64_t hash) const;
+
+    size_t min_length;
+    size_t max_length;
+
+    // Bit b of prefix_bytes[i] is set when byte i of a url may be b
+    std::array<std::array<std::uint64_t, 4>, Prefix_Bytes> prefix_bytes;
+
+    // Cleared when a template's authorities can't be listed
+    bool check_authority;
+    std::vector<Shape> shapes;
+
+    // Hashes of the authorities, kept so the filter can grow
+    std::unordered_set<std::uint64_t> authority_hashes;
+    std::vector<std::uint64_t> bloom;
+};
@@ -0,0 +1,62 @@
+#include <LiteralPool.h>
+
+#include <functional>
+#include <stdexcept>
+
+LiteralPool::LiteralPool(std::pmr::memory_resource* resource) : bytes(resource), entries(resource), index(resource)
+{
+}
+
+LiteralPool::LiteralPool(std::string_view text, std::span<const Entry> table)
+    : text_view(text), entry_view(table), read_only(true)
+{
+}
+
+LiteralPool::Id LiteralPool::Intern(std::string_view text)
+{
+    if (read_only)
+        throw std::logic_error("Error. Literal pool is read only");
+
+    const std::size_t hash = std::hash<std::string_view>{}(text);
+    for (auto [it, end] = index.equal_range(hash); it != end; ++it)
+    {
+        if (View(it->second) == text)
+            return it->second;
+    }
+
+    if (bytes.size() + text.size() > UINT32_MAX)
+        throw std::length_error("Error. Literal pool is full");
+
+    const Id id = static_cast<Id>(entries.size());
+    entries.push_back({static_cast<std::uint32_t>(bytes.size()), static_cast<std::uint32_t>(text.size())});
+    bytes.insert(bytes.end(), text.begin(), text.end());
+    index.emplace(hash, id);
+
+    // The vectors may have moved as they grew
+    text_view = std::string_view(bytes.data(), bytes.size());
+    entry_view = entries;
+
+    return id;
+}
+
+size_t LiteralPool::Size() const
+{
+    return entry_view.size();
+}
+
+size_t LiteralPool::MemoryUsage() const
+{
+    // Each index node holds the pair and a next pointer, plus a bucket
+    constexpr size_t Node_Size = sizeof(std::pair<const std::size_t, Id>) + sizeof(void*);
+    return sizeof(*this) + bytes.capacity() + entries.capacity() * sizeof(Entry) + index.size() * Node_Size +
+           index.bucket_count() * sizeof(void*);
+}
+
+void LiteralPool::Clear()
+{
+    bytes.clear();
+    entries.clear();
+    index.clear();
+    text_view = {};
+    entry_view = {};
+}
@@ -0,0 +1,279 @@
+#include <SharedTemplateStore.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+constexpr std::uint32_t Segment_Magic = 0x53554e4e; // "NNUS"
+constexpr std::uint32_t Segment_Version = 2;
+
+// Images a reader tries to open before leaving publishes that keep
+// replacing them
+constexpr int Max_Attempts = 1000;
+
+// The header is shared between processes, which only works for atomics
+// that don't need a lock
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+
+size_t SegmentSize(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        throw UrlEncoderException(std::string("Error. Failed to stat template segment: ") + std::strerror(errno));
+
+    return static_cast<size_t>(st.st_size);
+}
+
+// Maps the image of a generation read only, null when its name has been
+// removed by a newer publish
+const char* MapImage(const std::string& image_name, size_t& size)
+{
+    const int fd = shm_open(image_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+            return nullptr;
+
+        throw UrlEncoderException("Error. Failed to open template image " + image_name + ": " + std::strerror(errno));
+    }
+
+    // An empty image can't be mapped
+    struct stat st;
+    void* addr = MAP_FAILED;
+    int error = EINVAL;
+    if (fstat(fd, &st) != 0)
+    {
+        error = errno;
+    }
+    else if (st.st_size > 0)
+    {
+        size = static_cast<size_t>(st.st_size);
+        addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        error = errno;
+    }
+    close(fd);
+
+    if (addr == MAP_FAILED)
+        throw UrlEncoderException("Error. Failed to map template image " + image_name + ": " + std::strerror(error));
+
+    return static_cast<const char*>(addr);
+}
+} // namespace
+
+SharedTemplateStore::SharedTemplateStore(const std::string& name) : name(SegmentName(name))
+{
+    fd = shm_open(this->name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw UrlEncoderException("Error. Failed to open template segment " + this->name + ": " + std::strerror(errno));
+
+    try
+    {
+        if (SegmentSize(fd) < sizeof(Header) && ftruncate(fd, sizeof(Header)) != 0)
+            throw UrlEncoderException("Error. Failed to size template segment " + this->name + ": " +
+                                      std::strerror(errno));
+
+        void* addr = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+            throw UrlEncoderException("Error. Failed to map template segment " + this->name + ": " +
+                                      std::strerror(errno));
+        header = static_cast<Header*>(addr);
+
+        // A new segment is all zeros, one that exists keeps its generation
+        // so readers see the next publish as newer
+        if (header->magic == 0)
+        {
+            header->version = Segment_Version;
+            std::atomic_thread_fence(std::memory_order_release);
+            header->magic = Segment_Magic;
+        }
+        else if (header->magic != Segment_Magic || header->version != Segment_Version)
+        {
+            throw UrlEncoderException("Error. " + this->name + " is not a template segment of this version");
+        }
+    }
+    catch (...)
+    {
+        if (header)
+            munmap(header, sizeof(Header));
+        close(fd);
+        throw;
+    }
+}
+
+SharedTemplateStore::~SharedTemplateStore()
+{
+    munmap(header, sizeof(Header));
+    close(fd);
+}
+
+std::uint64_t SharedTemplateStore::Publish(const UrlEncoder& encoder)
+{
+    image.clear();
+    encoder.TemplatesToImage(image);
+
+    const std::uint64_t next = header->generation.load(std::memory_order_relaxed) + 1;
+    const std::string image_name = ImageName(name, next);
+
+    // Left by a publisher that stopped before making it current, so no
+    // reader has it
+    shm_unlink(image_name.c_str());
+
+    const int image_fd = shm_open(image_name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (image_fd < 0)
+        throw UrlEncoderException("Error. Failed to create template image " + image_name + ": " +
+                                  std::strerror(errno));
+
+    void* addr = MAP_FAILED;
+    if (ftruncate(image_fd, static_cast<off_t>(image.size())) == 0)
+        addr = mmap(nullptr, image.size(), PROT_READ | PROT_WRITE, MAP_SHARED, image_fd, 0);
+    const int error = errno;
+    close(image_fd);
+
+    if (addr == MAP_FAILED)
+    {
+        shm_unlink(image_name.c_str());
+        throw UrlEncoderException("Error. Failed to write template image " + image_name + ": " + std::strerror(error));
+    }
+
+    std::memcpy(addr, image.data(), image.size());
+    munmap(addr, image.size());
+
+    header->generation.store(next, std::memory_order_release);
+
+    // Readers that have the previous image mapped keep it until they let
+    // go of it, new ones find this one
+    if (next > 1)
+        shm_unlink(ImageName(name, next - 1).c_str());
+
+    return next;
+}
+
+std::uint64_t SharedTemplateStore::Generation() const
+{
+    return header->generation.load(std::memory_order_acquire);
+}
+
+bool SharedTemplateStore::Remove(const std::string& name)
+{
+    const std::string segment = SegmentName(name);
+
+    // The last image goes with it, the earlier ones were removed as they
+    // were replaced
+    const int fd = shm_open(segment.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd >= 0)
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+        {
+            void* addr = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                const Header* header = static_cast<const Header*>(addr);
+                if (header->magic == Segment_Magic && header->version == Segment_Version)
+                    shm_unlink(ImageName(segment, header->generation.load(std::memory_order_acquire)).c_str());
+                munmap(addr, sizeof(Header));
+            }
+        }
+        close(fd);
+    }
+
+    return shm_unlink(segment.c_str()) == 0;
+}
+
+std::string SharedTemplateStore::SegmentName(const std::string& name)
+{
+    return name.starts_with('/') ? name : '/' + name;
+}
+
+std::string SharedTemplateStore::ImageName(const std::string& segment, std::uint64_t generation)
+{
+    return segment + "." + std::to_string(generation);
+}
+
+SharedTemplateReader::SharedTemplateReader(const std::string& name)
+    : segment(SharedTemplateStore::SegmentName(name)), current(std::make_shared<const TemplateImage>())
+{
+    fd = shm_open(segment.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        throw UrlEncoderException("Error. Failed to open template segment " + segment + ": " + std::strerror(errno));
+
+    try
+    {
+        if (SegmentSize(fd) < sizeof(Header))
+            throw UrlEncoderException("Error. " + segment + " is not a template segment");
+
+        void* addr = mmap(nullptr, sizeof(Header), PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+            throw UrlEncoderException("Error. Failed to map template segment " + segment + ": " +
+                                      std::strerror(errno));
+        header = static_cast<const Header*>(addr);
+
+        if (header->magic != Segment_Magic || header->version != Segment_Version)
+            throw UrlEncoderException("Error. " + segment + " is not a template segment of this version");
+
+        Refresh();
+    }
+    catch (...)
+    {
+        if (header)
+            munmap(const_cast<Header*>(header), sizeof(Header));
+        close(fd);
+        throw;
+    }
+}
+
+SharedTemplateReader::~SharedTemplateReader()
+{
+    munmap(const_cast<Header*>(header), sizeof(Header));
+    close(fd);
+}
+
+std::shared_ptr<const TemplateImage> SharedTemplateReader::Get() const
+{
+    return current.load(std::memory_order_acquire);
+}
+
+bool SharedTemplateReader::Refresh()
+{
+    if (header->generation.load(std::memory_order_acquire) == tried.load(std::memory_order_relaxed))
+        return false;
+
+    std::lock_guard lock(refresh_mutex);
+    for (int attempt = 0; attempt < Max_Attempts; attempt++)
+    {
+        // Another thread may have loaded it while this waited for the lock
+        const std::uint64_t published = header->generation.load(std::memory_order_acquire);
+        if (published == tried.load(std::memory_order_relaxed))
+            return false;
+
+        // A newer publish may have replaced it since the generation was read
+        size_t size = 0;
+        const char* image = MapImage(SharedTemplateStore::ImageName(segment, published), size);
+        if (!image)
+            continue;
+
+        std::shared_ptr<const void> mapping(image,
+                                            [size](const void* addr) { munmap(const_cast<void*>(addr), size); });
+
+        // A malformed image isn't tried again until the next publish
+        tried.store(published, std::memory_order_relaxed);
+
+        current.store(std::make_shared<const TemplateImage>(std::string_view(image, size), std::move(mapping)),
+                      std::memory_order_release);
+        generation.store(published, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+std::uint64_t SharedTemplateReader::Generation() const
+{
+    return generation.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,516 @@
+#include <TemplateImage.h>
+
+#include <quicr/hex_endec.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Marks a template image and its layout
+constexpr std::uint32_t Image_Magic = 0x4d49554e; // "NUIM"
+constexpr std::uint32_t Image_Version = 2;
+
+constexpr size_t Name_Bits = sizeof(quicr::Name) * 8;
+
+constexpr std::uint64_t Align(std::uint64_t offset)
+{
+    return (offset + 7) & ~std::uint64_t(7);
+}
+
+template <typename T>
+void AppendSection(std::string& image, size_t start, const std::vector<T>& section)
+{
+    image.resize(start + Align(image.size() - start));
+    image.append(reinterpret_cast<const char*>(section.data()), section.size() * sizeof(T));
+}
+
+template <typename T>
+std::span<const T> SectionAt(std::string_view image, std::uint64_t offset, std::uint32_t count)
+{
+    return {reinterpret_cast<const T*>(image.data() + offset), count};
+}
+} // namespace
+
+struct TemplateImage::Layout
+{
+    explicit Layout(const Header& header)
+    {
+        std::uint64_t offset = sizeof(Header);
+        auto next = [&](std::uint64_t size) {
+            const std::uint64_t start = Align(offset);
+            offset = start + size;
+            return start;
+        };
+
+        entries = next(std::uint64_t(header.literal_count) * sizeof(LiteralPool::Entry));
+        text = next(header.text_size);
+        templates = next(std::uint64_t(header.template_count) * sizeof(TemplateEntry));
+        chunks = next(std::uint64_t(header.chunk_count) * sizeof(std::uint32_t));
+        bits = next(std::uint64_t(header.bit_count) * sizeof(std::uint32_t));
+        shapes = next(std::uint64_t(header.shape_count) * sizeof(ShapeEntry));
+        buckets = next(std::uint64_t(header.bucket_count) * sizeof(BucketEntry));
+        candidates = next(std::uint64_t(header.candidate_count) * sizeof(std::uint32_t));
+        keys = next(header.key_size);
+        size = offset;
+    }
+
+    std::uint64_t entries;
+    std::uint64_t text;
+    std::uint64_t templates;
+    std::uint64_t chunks;
+    std::uint64_t bits;
+    std::uint64_t shapes;
+    std::uint64_t buckets;
+    std::uint64_t candidates;
+    std::uint64_t keys;
+    std::uint64_t size;
+};
+
+TemplateImage::TemplateImage()
+    : literals(std::make_shared<LiteralPool>(std::string_view(), std::span<const LiteralPool::Entry>()))
+{
+}
+
+TemplateImage::TemplateImage(std::string_view image, std::shared_ptr<const void> owner)
+    : image(image), owner(std::move(owner))
+{
+    if (reinterpret_cast<std::uintptr_t>(image.data()) % 8 != 0)
+        throw UrlEncoderException("Error. Template image doesn't start on a multiple of 8 bytes");
+
+    Header header;
+    if (image.size() < sizeof(header))
+        throw UrlEncoderException("Error. Template image is truncated");
+
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (header.magic != Image_Magic || header.version != Image_Version)
+        throw UrlEncoderException("Error. Not a template image of this version");
+
+    const Layout layout(header);
+    if (layout.size > image.size())
+        throw UrlEncoderException("Error. Template image is truncated");
+    if (layout.size < image.size())
+        throw UrlEncoderException("Error. Template image is longer than its sections");
+
+    const auto entries = SectionAt<LiteralPool::Entry>(image, layout.entries, header.literal_count);
+    for (const auto& entry : entries)
+    {
+        if (std::uint64_t(entry.offset) + entry.length > header.text_size)
+            throw UrlEncoderException("Error. Template image has a literal outside its text");
+    }
+
+    literals = std::make_shared<LiteralPool>(image.substr(layout.text, header.text_size), entries);
+    templates = SectionAt<TemplateEntry>(image, layout.templates, header.template_count);
+    chunks = SectionAt<std::uint32_t>(image, layout.chunks, header.chunk_count);
+    bits = SectionAt<std::uint32_t>(image, layout.bits, header.bit_count);
+    shapes = SectionAt<ShapeEntry>(image, layout.shapes, header.shape_count);
+    buckets = SectionAt<BucketEntry>(image, layout.buckets, header.bucket_count);
+    candidates = SectionAt<std::uint32_t>(image, layout.candidates, header.candidate_count);
+    keys = image.substr(layout.keys, header.key_size);
+
+    for (size_t idx = 0; idx < templates.size(); idx++)
+    {
+        const TemplateEntry& entry = templates[idx];
+        if (std::uint64_t(entry.chunk_begin) + entry.chunk_count > chunks.size() ||
+            std::uint64_t(entry.bit_begin) + entry.bit_count > bits.size())
+            throw UrlEncoderException("Error. Template image has a template outside its sections");
+
+        // Sorted for FindTemplate, and so the index is the priority
+        if (idx > 0 && (templates[idx - 1].pen > entry.pen ||
+                        (templates[idx - 1].pen == entry.pen && templates[idx - 1].sub_pen >= entry.sub_pen)))
+            throw UrlEncoderException("Error. Template image has templates out of order");
+
+        // Built once to check it, the pattern a process keeps is built when
+        // it's first used
+        std::size_t value_count = 0;
+        try
+        {
+            value_count = UrlPattern(At(idx).chunks, literals).ValueCount();
+        }
+        catch (const std::invalid_argument& ex)
+        {
+            throw UrlEncoderException(std::string("Error. Template image has a bad pattern: ") + ex.what());
+        }
+
+        if (entry.bit_count != value_count)
+            throw UrlEncoderException("Error. Template image has " + std::to_string(entry.bit_count) +
+                                      " bit widths for " + std::to_string(value_count) + " values of PEN " +
+                                      std::to_string(entry.pen));
+    }
+
+    for (const auto& shape : shapes)
+    {
+        if (shape.length > UrlPattern::Max_Prefix ||
+            std::uint64_t(shape.bucket_begin) + shape.bucket_count > buckets.size() ||
+            shape.key_begin + std::uint64_t(shape.bucket_count) * shape.length > keys.size())
+            throw UrlEncoderException("Error. Template image has a bad dispatch table");
+
+        // Sorted for the binary search in Find
+        for (size_t bucket = 1; bucket < shape.bucket_count; bucket++)
+        {
+            if (KeyOf(shape, bucket - 1) >= KeyOf(shape, bucket))
+                throw UrlEncoderException("Error. Template image has a bad dispatch table");
+        }
+    }
+
+    for (const auto& bucket : buckets)
+    {
+        if (std::uint64_t(bucket.candidate_begin) + bucket.candidate_count > candidates.size())
+            throw UrlEncoderException("Error. Template image has a bad dispatch table");
+
+        for (std::uint32_t i = 0; i < bucket.candidate_count; i++)
+        {
+            const std::uint32_t candidate = candidates[bucket.candidate_begin + i];
+            if (candidate >= templates.size() || (i > 0 && candidate <= candidates[bucket.candidate_begin + i - 1]))
+                throw UrlEncoderException("Error. Template image has a bad dispatch table");
+        }
+    }
+
+    patterns = std::make_unique<std::atomic<const UrlPattern*>[]>(templates.size());
+    for (size_t idx = 0; idx < templates.size(); idx++)
+        patterns[idx].store(nullptr, std::memory_order_relaxed);
+}
+
+TemplateImage::~TemplateImage()
+{
+    for (size_t idx = 0; idx < templates.size(); idx++)
+        delete patterns[idx].load(std::memory_order_relaxed);
+}
+
+void TemplateImage::Write(const LiteralPool& literals,
+                          const UrlEncoder::pen_template_map& templates,
+                          std::string& image)
+{
+    std::vector<LiteralPool::Entry> entries;
+    std::vector<char> text;
+    for (LiteralPool::Id id = 0; id < literals.Size(); id++)
+    {
+        const std::string_view literal = literals.View(id);
+        entries.push_back({static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(literal.size())});
+        text.insert(text.end(), literal.begin(), literal.end());
+    }
+
+    // The prefix shapes and buckets TemplateIndex::Insert would make
+    struct Shape
+    {
+        size_t length;
+        std::uint64_t wildcards;
+        std::map<std::string, std::vector<std::uint32_t>> buckets;
+    };
+    std::vector<Shape> shapes;
+
+    std::vector<TemplateEntry> temps;
+    std::vector<std::uint32_t> all_chunks;
+    std::vector<std::uint32_t> all_bits;
+    for (const auto& [pen, sub_templates] : templates)
+    {
+        for (const auto& [sub_pen, temp] : sub_templates)
+        {
+            const std::span<const std::uint32_t> temp_chunks = temp.pattern.Chunks();
+            temps.push_back({pen,
+                             sub_pen,
+                             0,
+                             static_cast<std::uint32_t>(all_chunks.size()),
+                             static_cast<std::uint32_t>(temp_chunks.size()),
+                             static_cast<std::uint32_t>(all_bits.size()),
+                             static_cast<std::uint32_t>(temp.bits.size()),
+                             0});
+            all_chunks.insert(all_chunks.end(), temp_chunks.begin(), temp_chunks.end());
+            all_bits.insert(all_bits.end(), temp.bits.begin(), temp.bits.end());
+
+            const UrlPattern::Prefix prefix = temp.pattern.LiteralPrefix();
+            auto shape = std::find_if(shapes.begin(), shapes.end(), [&](const Shape& shape) {
+                return shape.length == prefix.bytes.size() && shape.wildcards == prefix.wildcards;
+            });
+            if (shape == shapes.end())
+                shape = shapes.insert(shapes.end(), Shape{prefix.bytes.size(), prefix.wildcards, {}});
+
+            // Templates are visited in priority order
+            shape->buckets[prefix.bytes].push_back(static_cast<std::uint32_t>(temps.size() - 1));
+        }
+    }
+
+    // Longest prefixes first, they have the fewest candidates
+    std::stable_sort(
+        shapes.begin(), shapes.end(), [](const Shape& left, const Shape& right) { return left.length > right.length; });
+
+    std::vector<ShapeEntry> shape_entries;
+    std::vector<BucketEntry> bucket_entries;
+    std::vector<std::uint32_t> candidate_entries;
+    std::vector<char> key_text;
+    for (const auto& shape : shapes)
+    {
+        shape_entries.push_back({shape.wildcards,
+                                 static_cast<std::uint32_t>(shape.length),
+                                 static_cast<std::uint32_t>(bucket_entries.size()),
+                                 static_cast<std::uint32_t>(shape.buckets.size()),
+                                 static_cast<std::uint32_t>(key_text.size())});
+
+        for (const auto& [key, bucket] : shape.buckets)
+        {
+            bucket_entries.push_back({static_cast<std::uint32_t>(candidate_entries.size()),
+                                      static_cast<std::uint32_t>(bucket.size())});
+            candidate_entries.insert(candidate_entries.end(), bucket.begin(), bucket.end());
+            key_text.insert(key_text.end(), key.begin(), key.end());
+        }
+    }
+
+    const Header header{Image_Magic,
+                        Image_Version,
+                        static_cast<std::uint32_t>(entries.size()),
+                        static_cast<std::uint32_t>(text.size()),
+                        static_cast<std::uint32_t>(temps.size()),
+                        static_cast<std::uint32_t>(all_chunks.size()),
+                        static_cast<std::uint32_t>(all_bits.size()),
+                        static_cast<std::uint32_t>(shape_entries.size()),
+                        static_cast<std::uint32_t>(bucket_entries.size()),
+                        static_cast<std::uint32_t>(candidate_entries.size()),
+                        static_cast<std::uint32_t>(key_text.size()),
+                        0};
+
+    const size_t start = image.size();
+    image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    AppendSection(image, start, entries);
+    AppendSection(image, start, text);
+    AppendSection(image, start, temps);
+    AppendSection(image, start, all_chunks);
+    AppendSection(image, start, all_bits);
+    AppendSection(image, start, shape_entries);
+    AppendSection(image, start, bucket_entries);
+    AppendSection(image, start, candidate_entries);
+    AppendSection(image, start, key_text);
+}
+
+quicr::Namespace TemplateImage::EncodeUrl(std::string_view url) const
+{
+    quicr::Namespace name;
+    if (!TryEncodeUrl(url, name))
+        throw UrlEncoderNoMatchException("Error. No match found for given url: " + std::string(url));
+
+    return name;
+}
+
+bool TemplateImage::TryEncodeUrl(std::string_view url, quicr::Namespace& name) const
+{
+    std::array<std::string_view, UrlPattern::Max_Slots> matches;
+    std::array<std::uint8_t, UrlPattern::Max_Slots> names;
+    size_t found = 0;
+    size_t count = 0;
+    if (!Find(url, matches, names, found, count))
+        return false;
+
+    const Template temp = At(found);
+    if (count != temp.bits.size() || count > matches.size())
+        throw UrlEncoderNoMatchException("Error. Match is missing values for "
+                                         "the given template");
+
+    // Checked as each is parsed, the same as UrlEncoder::MatchUrl
+    const UrlPattern& pattern = Pattern(found);
+    std::array<std::uint64_t, UrlPattern::Max_Slots> values;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!pattern.TextValue(i, matches[i], names[i], values[i]))
+            values[i] = UrlEncoder::ParseValue(matches[i]);
+
+        if (temp.bits[i] < 64 && (values[i] >> temp.bits[i]) != 0)
+            throw UrlEncoderOutOfRangeException("Error. Out of range. Group " + std::to_string(i + 1) + " value is " +
+                                                std::to_string(values[i]) +
+                                                " which exceeds the maximum amount of bits: " +
+                                                std::to_string(temp.bits[i]));
+    }
+
+    name = UrlEncoder::PackName(temp.pen, temp.sub_pen, temp.bits, std::span(values).first(count));
+    return true;
+}
+
+std::string TemplateImage::DecodeUrl(const quicr::Namespace& code) const
+{
+    using Endec = quicr::HexEndec<Name_Bits, UrlEncoder::Pen_Bits, UrlEncoder::Sub_Pen_Bits>;
+    const auto& [pen, sub_pen] = Endec::Decode(code);
+    std::vector<uint16_t> bit_distribution = {UrlEncoder::Pen_Bits};
+
+    bool uses_sub_pen = false;
+    const size_t found = FindTemplate(pen, sub_pen, uses_sub_pen);
+    if (uses_sub_pen)
+        bit_distribution.push_back(UrlEncoder::Sub_Pen_Bits);
+
+    const size_t num_pens = bit_distribution.size();
+    const Template temp = At(found);
+    bit_distribution.insert(bit_distribution.end(), temp.bits.begin(), temp.bits.end());
+    auto decoded_nums = quicr::HexEndec<Name_Bits>::Decode(bit_distribution, code);
+
+    std::string decoded;
+    if (!Pattern(found).Format(decoded, std::span<const std::uint64_t>(decoded_nums).subspan(num_pens)))
+        throw UrlDecodeNoMatchException("Error. A value is not one of the names of its group for PEN " +
+                                        std::to_string(pen));
+
+    return decoded;
+}
+
+std::uint64_t TemplateImage::TemplateCount(const bool count_sub_pen) const
+{
+    if (count_sub_pen)
+        return templates.size();
+
+    std::uint64_t pens = 0;
+    for (size_t idx = 0; idx < templates.size(); idx++)
+    {
+        if (idx == 0 || templates[idx].pen != templates[idx - 1].pen)
+            pens++;
+    }
+
+    return pens;
+}
+
+TemplateImage::Template TemplateImage::At(size_t idx) const
+{
+    const TemplateEntry& entry = templates[idx];
+    return {entry.pen,
+            entry.sub_pen,
+            bits.subspan(entry.bit_begin, entry.bit_count),
+            chunks.subspan(entry.chunk_begin, entry.chunk_count)};
+}
+
+size_t TemplateImage::LiteralCount() const
+{
+    return literals->Size();
+}
+
+std::string_view TemplateImage::Literal(LiteralPool::Id id) const
+{
+    return literals->View(id);
+}
+
+size_t TemplateImage::ImageSize() const
+{
+    return image.size();
+}
+
+size_t TemplateImage::MemoryUsage() const
+{
+    size_t usage = sizeof(*this) + sizeof(LiteralPool) + templates.size() * sizeof(patterns[0]);
+    for (size_t idx = 0; idx < templates.size(); idx++)
+    {
+        if (const UrlPattern* pattern = patterns[idx].load(std::memory_order_acquire))
+            usage += pattern->MemoryUsage();
+    }
+
+    return usage;
+}
+
+bool TemplateImage::Find(std::string_view url,
+                         std::span<std::string_view> captures,
+                         std::span<std::uint8_t> names,
+                         size_t& found,
+                         size_t& count) const
+{
+    found = templates.size();
+    std::array<std::string_view, UrlPattern::Max_Slots> scratch;
+    std::array<std::uint8_t, UrlPattern::Max_Slots> scratch_names;
+    std::array<char, UrlPattern::Max_Prefix> key;
+
+    for (const auto& shape : shapes)
+    {
+        if (url.size() < shape.length)
+            continue;
+
+        // The url's prefix with the wildcard bytes blanked like the keys
+        std::copy_n(url.data(), shape.length, key.data());
+        for (std::uint64_t wildcards = shape.wildcards; wildcards != 0; wildcards &= wildcards - 1)
+            key[std::countr_zero(wildcards)] = '\0';
+
+        const std::string_view wanted(key.data(), shape.length);
+        size_t low = 0;
+        size_t high = shape.bucket_count;
+        while (low < high)
+        {
+            const size_t mid = low + (high - low) / 2;
+            if (KeyOf(shape, mid) < wanted)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+
+        if (low == shape.bucket_count || KeyOf(shape, low) != wanted)
+            continue;
+
+        // Candidates are in priority order, only the first match counts
+        const BucketEntry& bucket = buckets[shape.bucket_begin + low];
+        for (std::uint32_t i = 0; i < bucket.candidate_count; i++)
+        {
+            const std::uint32_t candidate = candidates[bucket.candidate_begin + i];
+            if (candidate >= found)
+                break;
+
+            size_t matched = 0;
+            if (!Pattern(candidate).Match(url, scratch, matched, scratch_names))
+                continue;
+
+            found = candidate;
+            count = matched;
+            std::copy_n(scratch.begin(), std::min({count, scratch.size(), captures.size()}), captures.begin());
+            std::copy_n(
+                scratch_names.begin(), std::min({count, scratch_names.size(), names.size()}), names.begin());
+            break;
+        }
+    }
+
+    return found != templates.size();
+}
+
+const UrlPattern& TemplateImage::Pattern(size_t idx) const
+{
+    const UrlPattern* pattern = patterns[idx].load(std::memory_order_acquire);
+    if (!pattern)
+    {
+        // Threads that get here together each build one, the first to set
+        // it wins
+        auto built = std::make_unique<const UrlPattern>(At(idx).chunks, literals);
+        if (patterns[idx].compare_exchange_strong(pattern, built.get(), std::memory_order_acq_rel))
+            pattern = built.release();
+    }
+
+    if (!pattern->Native())
+        UrlEncoder::CompileTemplate(templates[idx].pen, templates[idx].sub_pen, *pattern);
+
+    return *pattern;
+}
+
+size_t TemplateImage::FindTemplate(std::uint64_t pen, std::uint8_t sub_pen, bool& uses_sub_pen) const
+{
+    // The first template of the PEN, which is the one without a sub PEN
+    // when it has one
+    const auto first =
+        std::lower_bound(templates.begin(), templates.end(), pen,
+                         [](const TemplateEntry& entry, std::uint64_t value) { return entry.pen < value; });
+    if (first == templates.end() || first->pen != pen)
+        throw UrlDecodeNoMatchException("Error. No templates matches the found PEN " + std::to_string(pen));
+
+    auto found = first;
+    uses_sub_pen = first->sub_pen != -1;
+    if (uses_sub_pen)
+    {
+        found = std::lower_bound(first, templates.end(), std::int16_t(sub_pen),
+                                 [&](const TemplateEntry& entry, std::int16_t value) {
+                                     return entry.pen == pen && entry.sub_pen < value;
+                                 });
+        if (found == templates.end() || found->pen != pen || found->sub_pen != sub_pen)
+            throw UrlDecodeNoMatchException("Error. No templates matches the "
+                                            "found PEN " +
+                                            std::to_string(pen) + " and sub PEN " + std::to_string(sub_pen));
+    }
+
+    const size_t idx = static_cast<size_t>(found - templates.begin());
+    UrlEncoder::CompileTemplate(pen, templates[idx].sub_pen, Pattern(idx));
+    return idx;
+}
+
+std::string_view TemplateImage::KeyOf(const ShapeEntry& shape, size_t bucket) const
+{
+    return keys.substr(shape.key_begin + bucket * shape.length, shape.length);
+}
@@ -0,0 +1,315 @@
+#include <TemplateIndex.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+TemplateIndex::ProbeOrder::ProbeOrder(size_t count)
+    : hits(new std::atomic<std::uint32_t>[count]),
+      orders{std::unique_ptr<std::atomic<std::uint8_t>[]>(new std::atomic<std::uint8_t>[count]),
+             std::unique_ptr<std::atomic<std::uint8_t>[]>(new std::atomic<std::uint8_t>[count])},
+      overlaps(count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        hits[i].store(0, std::memory_order_relaxed);
+        orders[0][i].store(static_cast<std::uint8_t>(i), std::memory_order_relaxed);
+        orders[1][i].store(static_cast<std::uint8_t>(i), std::memory_order_relaxed);
+    }
+}
+
+TemplateIndex::TemplateIndex(std::pmr::memory_resource* resource) : resource(resource), shapes(resource)
+{
+}
+
+void TemplateIndex::Insert(std::uint64_t pen, std::int16_t sub_pen, const UrlEncoder::url_template& temp)
+{
+    Candidate candidate{pen, sub_pen, &temp};
+
+    const UrlPattern::Prefix prefix = temp.pattern.LiteralPrefix();
+    Bucket* bucket = FindBucket(prefix);
+    if (!bucket)
+    {
+        auto shape = std::find_if(shapes.begin(), shapes.end(), [&](const Shape& shape) {
+            return shape.length == prefix.bytes.size() && shape.wildcards == prefix.wildcards;
+        });
+
+        if (shape == shapes.end())
+        {
+            // Keep the longest prefixes first
+            shape = std::find_if(
+                shapes.begin(), shapes.end(), [&](const Shape& shape) { return shape.length < prefix.bytes.size(); });
+            shape = shapes.insert(shape, Shape{prefix.bytes.size(), prefix.wildcards, {}});
+        }
+
+        bucket = &shape->buckets.try_emplace(std::pmr::string(prefix.bytes, resource), resource).first->second;
+    }
+
+    auto position = std::find_if(bucket->candidates.begin(), bucket->candidates.end(),
+                                 [&](const Candidate& other) { return candidate.Before(other); });
+    bucket->candidates.insert(position, std::move(candidate));
+    ResetOrder(*bucket);
+}
+
+void TemplateIndex::Remove(std::uint64_t pen, std::int16_t sub_pen, const UrlEncoder::url_template& temp)
+{
+    const UrlPattern::Prefix prefix = temp.pattern.LiteralPrefix();
+    for (auto shape = shapes.begin(); shape != shapes.end(); ++shape)
+    {
+        if (shape->length != prefix.bytes.size() || shape->wildcards != prefix.wildcards)
+            continue;
+
+        auto bucket = shape->buckets.find(std::string_view(prefix.bytes));
+        if (bucket == shape->buckets.end())
+            return;
+
+        std::erase_if(bucket->second.candidates, [&](const Candidate& candidate) {
+            return candidate.pen == pen && candidate.sub_pen == sub_pen && candidate.temp == &temp;
+        });
+        ResetOrder(bucket->second);
+
+        if (bucket->second.candidates.empty())
+            shape->buckets.erase(bucket);
+        if (shape->buckets.empty())
+            shapes.erase(shape);
+        return;
+    }
+}
+
+void TemplateIndex::Clear()
+{
+    shapes.clear();
+}
+
+bool TemplateIndex::Find(std::string_view url,
+                         std::span<std::string_view> captures,
+                         std::span<std::uint8_t> names,
+                         Match& match) const
+{
+    const Candidate* best = nullptr;
+    std::array<std::string_view, UrlPattern::Max_Slots> scratch;
+    std::array<std::uint8_t, UrlPattern::Max_Slots> scratch_names;
+
+    // Keeps what a candidate captured, it's overwritten by the next tried
+    auto keep = [&](size_t count) {
+        std::copy_n(scratch.begin(), std::min({count, scratch.size(), captures.size()}), captures.begin());
+        std::copy_n(scratch_names.begin(), std::min({count, scratch_names.size(), names.size()}), names.begin());
+    };
+    std::array<char, UrlPattern::Max_Prefix> key;
+
+    for (const auto& shape : shapes)
+    {
+        if (url.size() < shape.length)
+            continue;
+
+        // The url's prefix with the wildcard bytes blanked like the keys
+        std::copy_n(url.data(), shape.length, key.data());
+        for (std::uint64_t wildcards = shape.wildcards; wildcards != 0; wildcards &= wildcards - 1)
+            key[std::countr_zero(wildcards)] = '\0';
+
+        const auto bucket = shape.buckets.find(std::string_view(key.data(), shape.length));
+        if (bucket == shape.buckets.end())
+            continue;
+
+        if (bucket->second.order)
+        {
+            size_t count = 0;
+            if (const Candidate* found = FindIn(bucket->second, url, scratch, scratch_names, best, count))
+            {
+                best = found;
+                match = {found->pen, found->sub_pen, found->temp, count};
+                keep(count);
+            }
+            continue;
+        }
+
+        // Candidates are in priority order, only the first match counts
+        for (const auto& candidate : bucket->second.candidates)
+        {
+            if (best && !candidate.Before(*best))
+                break;
+
+            size_t count = 0;
+            if (!candidate.Match(url, scratch, count, scratch_names))
+                continue;
+
+            best = &candidate;
+            match = {candidate.pen, candidate.sub_pen, candidate.temp, count};
+            keep(count);
+            break;
+        }
+    }
+
+    return best != nullptr;
+}
+
+void TemplateIndex::SetAdaptive(bool enabled)
+{
+    adaptive = enabled;
+    for (auto& shape : shapes)
+    {
+        for (auto& [key, bucket] : shape.buckets)
+            ResetOrder(bucket);
+    }
+}
+
+void TemplateIndex::ResetOrder(Bucket& bucket)
+{
+    const auto& candidates = bucket.candidates;
+    if (!adaptive || candidates.size() < 2 || candidates.size() > Max_Adaptive)
+    {
+        bucket.order.reset();
+        return;
+    }
+
+    bucket.order = std::make_unique<ProbeOrder>(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        for (size_t j = 0; j < i; j++)
+        {
+            if (!candidates[i].temp->pattern.Disjoint(candidates[j].temp->pattern))
+            {
+                bucket.order->overlaps[i] |= 1ull << j;
+                bucket.order->overlaps[j] |= 1ull << i;
+            }
+        }
+    }
+}
+
+const TemplateIndex::Candidate* TemplateIndex::FindIn(const Bucket& bucket,
+                                                      std::string_view url,
+                                                      std::span<std::string_view> scratch,
+                                                      std::span<std::uint8_t> scratch_names,
+                                                      const Candidate* best,
+                                                      size_t& count) const
+{
+    ProbeOrder& order = *bucket.order;
+    const size_t size = bucket.candidates.size();
+
+    // A candidate tried ahead of an earlier one can't match the same urls,
+    // so the first match is still the one with the highest priority
+    size_t found = size;
+    while (true)
+    {
+        const std::uint32_t version = order.version.load(std::memory_order_acquire);
+        const std::atomic<std::uint8_t>* probes = order.orders[version & 1].get();
+
+        found = size;
+        for (size_t i = 0; i < size; i++)
+        {
+            const size_t idx = probes[i].load(std::memory_order_relaxed);
+            const Candidate& candidate = bucket.candidates[idx];
+            if (best && !candidate.Before(*best))
+                continue;
+
+            if (candidate.Match(url, scratch, count, scratch_names))
+            {
+                found = idx;
+                break;
+            }
+        }
+
+        // The order was rewritten while it was read, so it may have been
+        // a mix of two orders
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (order.version.load(std::memory_order_relaxed) == version)
+            break;
+    }
+
+    if (found == size)
+        return nullptr;
+
+    // Lost counts under contention only make the order a little staler
+    auto& hits = order.hits[found];
+    hits.store(hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    const std::uint32_t since = order.since_reorder.load(std::memory_order_relaxed) + 1;
+    order.since_reorder.store(since, std::memory_order_relaxed);
+    if (since >= Reorder_Hits)
+        Reorder(bucket);
+
+    return &bucket.candidates[found];
+}
+
+void TemplateIndex::Reorder(const Bucket& bucket) const
+{
+    ProbeOrder& order = *bucket.order;
+    if (order.reordering.exchange(true, std::memory_order_acquire))
+        return;
+
+    order.since_reorder.store(0, std::memory_order_relaxed);
+
+    // Halve the counts as they're read, so the order follows the traffic
+    const size_t size = bucket.candidates.size();
+    std::array<std::uint32_t, Max_Adaptive> hits;
+    for (size_t i = 0; i < size; i++)
+    {
+        hits[i] = order.hits[i].load(std::memory_order_relaxed);
+        order.hits[i].store(hits[i] / 2, std::memory_order_relaxed);
+    }
+
+    // The hottest candidate whose earlier overlapping candidates are all
+    // placed goes next, ties in priority order
+    std::array<std::uint8_t, Max_Adaptive> next;
+    std::uint64_t placed = 0;
+    for (size_t n = 0; n < size; n++)
+    {
+        size_t pick = size;
+        for (size_t i = 0; i < size; i++)
+        {
+            const std::uint64_t earlier = (1ull << i) - 1;
+            if ((placed >> i) & 1 || (order.overlaps[i] & earlier & ~placed) != 0)
+                continue;
+
+            if (pick == size || hits[i] > hits[pick])
+                pick = i;
+        }
+
+        next[n] = static_cast<std::uint8_t>(pick);
+        placed |= 1ull << pick;
+    }
+
+    const std::uint32_t version = order.version.load(std::memory_order_relaxed);
+    const std::atomic<std::uint8_t>* current = order.orders[version & 1].get();
+    bool changed = false;
+    for (size_t i = 0; i < size && !changed; i++)
+        changed = current[i].load(std::memory_order_relaxed) != next[i];
+
+    if (changed)
+    {
+        // Finds still reading the spare order from two versions ago see the
+        // version move and scan again
+        std::atomic_thread_fence(std::memory_order_release);
+        std::atomic<std::uint8_t>* spare = order.orders[(version + 1) & 1].get();
+        for (size_t i = 0; i < size; i++)
+            spare[i].store(next[i], std::memory_order_relaxed);
+
+        order.version.store(version + 1, std::memory_order_release);
+        reorders.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    order.reordering.store(false, std::memory_order_release);
+}
+
+TemplateIndex::Bucket* TemplateIndex::FindBucket(const UrlPattern::Prefix& prefix)
+{
+    for (auto& shape : shapes)
+    {
+        if (shape.length != prefix.bytes.size() || shape.wildcards != prefix.wildcards)
+            continue;
+
+        auto bucket = shape.buckets.find(std::string_view(prefix.bytes));
+        return bucket == shape.buckets.end() ? nullptr : &bucket->second;
+    }
+
+    return nullptr;
+}
+
+size_t TemplateIndex::BucketCount() const
+{
+    size_t count = 0;
+    for (const auto& shape : shapes)
+        count += shape.buckets.size();
+
+    return count;
+}
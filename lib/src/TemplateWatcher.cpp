@@ -0,0 +1,193 @@
+#include <TemplateWatcher.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace
+{
+// Changes that can leave a new version of the file in place. Editors and
+// atomic saves write a temporary file and rename it over the old one.
+constexpr std::uint32_t Watch_Events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE;
+
+// Reads the pending inotify events, returns true if one was for the file
+bool DrainEvents(int fd, const std::string& filename)
+{
+    bool changed = false;
+    alignas(inotify_event) std::array<char, 4096> buf;
+    ssize_t len;
+    while ((len = read(fd, buf.data(), buf.size())) > 0)
+    {
+        for (ssize_t offset = 0; offset < len;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(buf.data() + offset);
+            if (event->len > 0 && filename == event->name)
+                changed = true;
+
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+} // namespace
+
+TemplateWatcher::TemplateWatcher(const std::string& path, const options& opts, callback on_reload)
+    : path(path), opts(opts), on_reload(std::move(on_reload))
+{
+    // Watch the directory, the file itself is replaced by renames
+    const std::filesystem::path file_path = std::filesystem::absolute(path);
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd >= 0)
+        watch_fd = inotify_add_watch(inotify_fd, file_path.parent_path().c_str(), Watch_Events);
+
+    if (inotify_fd < 0 || wake_fd < 0 || watch_fd < 0)
+    {
+        const std::string reason = std::strerror(errno);
+        if (inotify_fd >= 0)
+            close(inotify_fd);
+        if (wake_fd >= 0)
+            close(wake_fd);
+        throw UrlEncoderException("Error. Failed to watch template file " + path + ": " + reason);
+    }
+
+    const reload_status status = Reload();
+    if (!status.ok)
+    {
+        close(inotify_fd);
+        close(wake_fd);
+        throw UrlEncoderException(status.error);
+    }
+
+    watcher = std::thread(&TemplateWatcher::Watch, this);
+}
+
+TemplateWatcher::TemplateWatcher(const std::string& path) : TemplateWatcher(path, options())
+{
+}
+
+TemplateWatcher::~TemplateWatcher()
+{
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto res = write(wake_fd, &one, sizeof(one));
+    watcher.join();
+
+    close(inotify_fd);
+    close(wake_fd);
+}
+
+std::shared_ptr<const UrlEncoder> TemplateWatcher::Get() const
+{
+    return current.load(std::memory_order_acquire);
+}
+
+TemplateWatcher::reload_status TemplateWatcher::Reload()
+{
+    reload_status status;
+    {
+        std::lock_guard lock(load_mutex);
+        status.generation = last_status.generation;
+
+        const auto start = std::chrono::steady_clock::now();
+        try
+        {
+            std::ifstream file;
+            file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+            file.open(path);
+            const json data = json::parse(file);
+
+            // Built aside, the current templates serve until the swap
+            auto encoder = std::make_shared<UrlEncoder>();
+            encoder->SetCompileMode(opts.mode);
+            encoder->TemplatesFromJson(data);
+
+            status.templates = encoder->TemplateCount();
+            current.store(std::move(encoder), std::memory_order_release);
+            status.generation++;
+            status.ok = true;
+        }
+        catch (const std::exception& ex)
+        {
+            status.error = "Error. Failed to load template file " + path + ": " + ex.what();
+        }
+        status.elapsed =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        last_status = status;
+    }
+
+    if (on_reload)
+        on_reload(status);
+
+    return status;
+}
+
+TemplateWatcher::reload_status TemplateWatcher::LastStatus() const
+{
+    std::lock_guard lock(load_mutex);
+    return last_status;
+}
+
+void TemplateWatcher::Watch()
+{
+    const std::string filename = std::filesystem::path(path).filename();
+    std::array<pollfd, 2> fds = {{{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}}};
+
+    bool changed = false;
+    while (true)
+    {
+        // Block until something happens, then wait for the writes to settle
+        const int timeout = changed ? static_cast<int>(opts.debounce.count()) : -1;
+        const int count = poll(fds.data(), fds.size(), timeout);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            StopWatching(std::strerror(errno));
+            return;
+        }
+
+        if (fds[1].revents & POLLIN)
+            return;
+
+        if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+        {
+            StopWatching("inotify descriptor failed");
+            return;
+        }
+
+        if (count > 0 && (fds[0].revents & POLLIN))
+        {
+            changed = DrainEvents(inotify_fd, filename) || changed;
+            continue;
+        }
+
+        if (count == 0 && changed)
+        {
+            changed = false;
+            Reload();
+        }
+    }
+}
+
+void TemplateWatcher::StopWatching(const std::string& reason)
+{
+    reload_status status;
+    {
+        std::lock_guard lock(load_mutex);
+        status.generation = last_status.generation;
+        status.error = "Error. Stopped watching template file " + path + ": " + reason;
+        last_status = status;
+    }
+
+    if (on_reload)
+        on_reload(status);
+}
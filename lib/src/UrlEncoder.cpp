@@ -1,233 +1,630 @@
 #include <UrlEncoder.h>
 
+#include <TemplateImage.h>
+#include <TemplateIndex.h>
+
 #include <quicr/hex_endec.h>
 
+#ifdef NUMERO_URI_ENABLE_TRACE
+#include <UrlEncoderTrace.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstring>
 #include <iostream>
+#include <ostream>
 #include <regex>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 constexpr size_t MaxEncodeSize = sizeof(quicr::Name) * 8;
 
-UrlEncoder::UrlEncoder() : templates()
+// Chunk references removed before the literal pool is worth rebuilding
+constexpr size_t Min_Compact_Chunks = 1024;
+
+// Names DecodeUrls groups and unpacks at a time, so a block's words and
+// values stay in cache
+constexpr size_t Decode_Block = 4096;
+
+// Instrumentation that compiles to nothing unless metrics are enabled
+#ifdef NUMERO_URI_ENABLE_METRICS
+#define NUMERO_URI_METRIC(statement) statement
+#else
+#define NUMERO_URI_METRIC(statement)
+#endif
+
+// Phase probes that compile to nothing unless tracing is enabled
+#ifdef NUMERO_URI_ENABLE_TRACE
+#define NUMERO_URI_TRACE_BEGIN(phase) UrlEncoderTrace::Phases trace_phases(UrlEncoderTrace::Phase::phase)
+#define NUMERO_URI_TRACE_NEXT(phase) trace_phases.Next(UrlEncoderTrace::Phase::phase)
+#else
+#define NUMERO_URI_TRACE_BEGIN(phase)
+#define NUMERO_URI_TRACE_NEXT(phase)
+#endif
+
+namespace
+{
+// Writes json text into a buffer that's passed to the stream as it fills,
+// spaced the way nlohmann::json dumps it
+class JsonWriter
+{
+  public:
+    JsonWriter(std::ostream& out, int indent) : out(out), indent(indent)
+    {
+        buffer.reserve(Flush_Size + 4096);
+    }
+
+    void Raw(std::string_view text)
+    {
+        buffer.append(text);
+        if (buffer.size() >= Flush_Size)
+            Flush();
+    }
+
+    // Starts an element of an array or object, depth levels in
+    void Line(int depth)
+    {
+        if (indent < 0)
+            return;
+
+        buffer += '\n';
+        buffer.append(static_cast<size_t>(depth * indent), ' ');
+    }
+
+    void Key(std::string_view key, int depth)
+    {
+        Line(depth);
+        buffer += '"';
+        buffer.append(key);
+        buffer.append(indent < 0 ? "\":" : "\": ");
+    }
+
+    template <typename T>
+    void Number(T value)
+    {
+        std::array<char, 24> digits;
+        const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+        buffer.append(digits.data(), result.ptr);
+    }
+
+    // Appends to a string value, escaping what json requires
+    void Escaped(std::string_view text)
+    {
+        size_t start = 0;
+        for (size_t idx = 0; idx < text.size(); idx++)
+        {
+            const auto ch = static_cast<unsigned char>(text[idx]);
+            if (ch >= 0x20 && ch != '"' && ch != '\\')
+                continue;
+
+            buffer.append(text.substr(start, idx - start));
+            start = idx + 1;
+            switch (ch)
+            {
+            case '"':
+                buffer.append("\\\"");
+                break;
+            case '\\':
+                buffer.append("\\\\");
+                break;
+            case '\b':
+                buffer.append("\\b");
+                break;
+            case '\f':
+                buffer.append("\\f");
+                break;
+            case '\n':
+                buffer.append("\\n");
+                break;
+            case '\r':
+                buffer.append("\\r");
+                break;
+            case '\t':
+                buffer.append("\\t");
+                break;
+            default:
+                constexpr std::string_view hex = "0123456789abcdef";
+                buffer.append("\\u00");
+                buffer += hex[ch >> 4];
+                buffer += hex[ch & 0xf];
+                break;
+            }
+        }
+        buffer.append(text.substr(start));
+    }
+
+    void Flush()
+    {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+
+  private:
+    static constexpr size_t Flush_Size = 64 * 1024;
+
+    std::ostream& out;
+    int indent;
+    std::string buffer;
+};
+
+// A 128 bit name as two words, its fields numbered from the top bit down
+struct Name128
+{
+    std::uint64_t hi = 0;
+    std::uint64_t lo = 0;
+
+    // Sets the width bits after the first offset, value must fit in them
+    void Put(std::uint32_t offset, std::uint32_t width, std::uint64_t value)
+    {
+        const std::uint32_t shift = 128 - offset - width;
+        if (width == 0)
+            return;
+
+        if (shift >= 64)
+        {
+            hi |= value << (shift - 64);
+            return;
+        }
+
+        lo |= value << shift;
+        if (shift > 0)
+            hi |= value >> (64 - shift);
+    }
+
+    std::uint64_t Get(std::uint32_t offset, std::uint32_t width) const
+    {
+        const std::uint32_t shift = 128 - offset - width;
+        if (width == 0)
+            return 0;
+
+        const std::uint64_t mask = ~0ull >> (64 - width);
+        if (shift >= 64)
+            return (hi >> (shift - 64)) & mask;
+
+        return ((lo >> shift) | (shift > 0 ? hi << (64 - shift) : 0)) & mask;
+    }
+};
+
+// Unpacks the same field of count names, given as arrays of their top and
+// bottom words. Four names an instruction where AVX2 is available.
+void ExtractField(const std::uint64_t* hi,
+                  const std::uint64_t* lo,
+                  size_t count,
+                  std::uint32_t offset,
+                  std::uint32_t width,
+                  std::uint64_t* out)
+{
+    size_t idx = 0;
+#if defined(__AVX2__)
+    // Shifts of 64 or more give zero, so one form covers a field in either
+    // word or across both
+    const std::uint32_t shift = 128 - offset - width;
+    const __m128i lo_right = _mm_cvtsi32_si128(static_cast<int>(shift));
+    const __m128i hi_right = _mm_cvtsi32_si128(static_cast<int>(shift >= 64 ? shift - 64 : 64));
+    const __m128i hi_left = _mm_cvtsi32_si128(static_cast<int>(shift >= 64 ? 64 : 64 - shift));
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(width ? ~0ull >> (64 - width) : 0));
+    for (; idx + 4 <= count; idx += 4)
+    {
+        const __m256i top = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hi + idx));
+        const __m256i bottom = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lo + idx));
+        const __m256i field = _mm256_or_si256(_mm256_srl_epi64(bottom, lo_right),
+                                              _mm256_or_si256(_mm256_srl_epi64(top, hi_right),
+                                                              _mm256_sll_epi64(top, hi_left)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + idx), _mm256_and_si256(field, mask));
+    }
+#endif
+    for (; idx < count; idx++)
+        out[idx] = Name128{hi[idx], lo[idx]}.Get(offset, width);
+}
+} // namespace
+
+UrlEncoder::UrlEncoder()
+    : pool(std::make_unique<std::pmr::unsynchronized_pool_resource>()),
+      literals(std::make_shared<LiteralPool>(pool.get())), templates(pool.get()),
+      index(std::make_unique<TemplateIndex>(pool.get()))
 {
 }
 
-UrlEncoder::UrlEncoder(const std::string& init_template) : templates()
+UrlEncoder::UrlEncoder(std::pmr::memory_resource* resource)
+    : pool(), literals(std::make_shared<LiteralPool>(resource)), templates(resource),
+      index(std::make_unique<TemplateIndex>(resource))
+{
+}
+
+UrlEncoder::UrlEncoder(const std::string& init_template) : UrlEncoder()
 {
     AddTemplate(init_template);
 }
 
-UrlEncoder::UrlEncoder(const std::vector<std::string>& init_templates) : templates()
+UrlEncoder::UrlEncoder(const std::vector<std::string>& init_templates) : UrlEncoder()
 {
     AddTemplate(init_templates);
 }
 
-UrlEncoder::UrlEncoder(const std::string* init_templates, const size_t count) : templates()
+UrlEncoder::UrlEncoder(const std::string* init_templates, const size_t count) : UrlEncoder()
 {
     AddTemplate(init_templates, count);
 }
 
-UrlEncoder::UrlEncoder(const json& init_templates) : templates()
+UrlEncoder::UrlEncoder(const json& init_templates) : UrlEncoder()
 {
     AddTemplate(init_templates);
 }
 
-quicr::Namespace UrlEncoder::EncodeUrl(const std::string& url) const
+UrlEncoder::UrlEncoder(const UrlEncoder& other) : UrlEncoder()
 {
-    std::uint64_t found_pen;
-    std::int16_t sub_pen;
-    UrlEncoder::url_template selected_template;
-    bool found_template = false;
-    for (const auto& [pen, sub_templates] : templates)
+    CopyFrom(other);
+}
+
+UrlEncoder::UrlEncoder(UrlEncoder&&) = default;
+
+UrlEncoder& UrlEncoder::operator=(const UrlEncoder& other)
+{
+    if (this != &other)
     {
-        // Find match
-        const auto& found = std::find_if(sub_templates.begin(), sub_templates.end(), [&](const auto& temp) {
-            return std::regex_match(url, std::regex(temp.second.url));
-        });
+        Clear();
+        CopyFrom(other);
+    }
 
-        if (found == sub_templates.end())
-            continue;
+    return *this;
+}
 
-        found_pen = pen;
-        std::tie(sub_pen, selected_template) = *found;
-        found_template = true;
-        break;
+UrlEncoder& UrlEncoder::operator=(UrlEncoder&& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (GetMemoryResource() != other.GetMemoryResource())
+    {
+        *this = static_cast<const UrlEncoder&>(other);
+        other.Clear();
+        return *this;
     }
 
-    if (!found_template)
+    // Neither owns a pool when they share a resource. The index points into
+    // the templates, so it goes first.
+    index = std::move(other.index);
+    templates = std::move(other.templates);
+    literals = std::move(other.literals);
+    live_chunks = other.live_chunks;
+    dead_chunks = other.dead_chunks;
+    mode = other.mode;
+    normalization = other.normalization;
+    adaptive_order = other.adaptive_order;
+    prefilter = std::move(other.prefilter);
+
+    // Leave the other one empty but usable
+    other.Clear();
+    return *this;
+}
+
+UrlEncoder::~UrlEncoder() = default;
+
+quicr::Namespace UrlEncoder::EncodeUrl(const std::string& url) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Encode));
+
+    matched_url matched;
+    if (!MatchUrl(url, matched))
         throw UrlEncoderNoMatchException("Error. No match found for given url: " + url);
 
-    // To extract the 3 groups from each url format
-    std::smatch matches;
+    return PackName(matched);
+}
 
-    // If there is not a match then there is no template for this PEN
-    if (!std::regex_match(url, matches, std::regex(selected_template.url)))
-        throw UrlEncoderNoMatchException("Error. No match for url: " + url);
+bool UrlEncoder::TryEncodeUrl(std::string_view url, quicr::Namespace& name) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Encode));
 
-    // Need the same number of numbers as the template expects
-    if (matches.size() - 1 != selected_template.bits.size())
-        throw UrlEncoderNoMatchException("Error. Match is missing values for "
-                                         "the given template");
+    matched_url matched;
+    if (!MatchUrl(url, matched))
+        return false;
 
-    std::vector<uint64_t> values;
-    std::vector<uint16_t> distribution;
-    values.push_back(found_pen);
-    distribution.push_back(Pen_Bits);
-    int remaining_bits = MaxEncodeSize - Pen_Bits;
+    name = PackName(matched);
+    return true;
+}
 
-    // Set the sub PEN value and bits if it is positive
-    if (sub_pen >= 0)
+std::uint64_t UrlEncoder::EncodeUrl64(const std::string& url) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Encode));
+
+    matched_url matched;
+    if (!MatchUrl(url, matched))
+        throw UrlEncoderNoMatchException("Error. No match found for given url: " + std::string(url));
+
+    NUMERO_URI_TRACE_BEGIN(EncodePack);
+
+    // Same layout as EncodeUrl, filled from the top bit down
+    std::uint64_t code = matched.pen << (Name64_Bits - Pen_Bits);
+    std::uint32_t used = Pen_Bits;
+    if (matched.sub_pen >= 0)
     {
-        values.push_back(sub_pen);
-        distribution.push_back(Sub_Pen_Bits);
-        remaining_bits -= Sub_Pen_Bits;
+        used += Sub_Pen_Bits;
+        code |= static_cast<std::uint64_t>(matched.sub_pen) << (Name64_Bits - used);
     }
 
-    // Skip the first group since its the whole match
-    for (std::uint32_t i = 1; i < matches.size(); i++)
+    for (std::uint32_t i = 0; i < matched.count; i++)
     {
-        const std::sub_match match = matches[i];
-        std::uint16_t base = match.str().starts_with("0x") ? 16 : match.str().starts_with("0b") ? 2 : 10;
-        std::uint64_t val = std::stoull(match, nullptr, base);
-        std::uint32_t bits = selected_template.bits[i - 1];
-        if ((val & ~(~0x0ull << bits)) != val)
+        const std::uint32_t bits = matched.temp->bits[i];
+        if (used + bits > Name64_Bits)
         {
-            throw UrlEncoderOutOfRangeException("Error. Out of range. Group " + std::to_string(i) + " value is " +
-                                                std::to_string(val) +
-                                                " which exceeds the maximum amount of bits: " + std::to_string(bits));
+            NUMERO_URI_METRIC(metrics.RecordOutOfRange(matched.pen, matched.sub_pen));
+            throw UrlEncoderOutOfRangeException("Error. Out of range. Template for PEN " + std::to_string(matched.pen) +
+                                                " needs more than " + std::to_string(Name64_Bits) + " bits");
         }
 
-        values.push_back(val);
-        distribution.push_back(bits);
-        remaining_bits -= bits;
+        used += bits;
+        code |= matched.values[i] << (Name64_Bits - used);
     }
 
-    if (remaining_bits > 0)
+    NUMERO_URI_METRIC(metrics.RecordHit(matched.pen, matched.sub_pen));
+    return code;
+}
+
+std::uint8_t UrlEncoder::EncodeUrlTo(std::string_view url, std::span<std::byte, Wire_Bytes> out) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Encode));
+
+    matched_url matched;
+    if (!MatchUrl(url, matched))
+        throw UrlEncoderNoMatchException("Error. No match found for given url: " + std::string(url));
+
+    NUMERO_URI_TRACE_BEGIN(EncodePack);
+
+    Name128 name;
+    name.Put(0, Pen_Bits, matched.pen);
+    std::uint32_t used = Pen_Bits;
+    if (matched.sub_pen >= 0)
     {
-        values.push_back(0);
-        distribution.push_back(remaining_bits);
+        name.Put(used, Sub_Pen_Bits, static_cast<std::uint64_t>(matched.sub_pen));
+        used += Sub_Pen_Bits;
     }
-    quicr::Name name = {quicr::HexEndec<MaxEncodeSize>::Encode(distribution, values)};
-    return quicr::Namespace(name, MaxEncodeSize - remaining_bits);
+
+    for (std::uint32_t i = 0; i < matched.count; i++)
+    {
+        const std::uint32_t bits = matched.temp->bits[i];
+        if (used + bits > MaxEncodeSize)
+        {
+            NUMERO_URI_METRIC(metrics.RecordOutOfRange(matched.pen, matched.sub_pen));
+            throw UrlEncoderOutOfRangeException("Error. Out of range. Template for PEN " + std::to_string(matched.pen) +
+                                                " needs more than " + std::to_string(MaxEncodeSize) + " bits");
+        }
+
+        // A value is at most 64 bits, at the bottom of a wider field
+        const std::uint32_t value_bits = std::min<std::uint32_t>(bits, 64);
+        name.Put(used + bits - value_bits, value_bits, matched.values[i]);
+        used += bits;
+    }
+
+    // Big endian, the same bytes as the name written out
+    for (size_t i = 0; i < 8; i++)
+    {
+        out[i] = static_cast<std::byte>(name.hi >> (56 - 8 * i));
+        out[i + 8] = static_cast<std::byte>(name.lo >> (56 - 8 * i));
+    }
+
+    NUMERO_URI_METRIC(metrics.RecordHit(matched.pen, matched.sub_pen));
+    return static_cast<std::uint8_t>(used);
 }
 
-std::string UrlEncoder::DecodeUrl(const quicr::Namespace& code)
+std::string UrlEncoder::DecodeUrl(const quicr::Namespace& code) const
 {
-    // If the sub pen is not used then we use 0 bits on it
-    std::uint32_t pen_sub_bits = 0;
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Decode));
+    NUMERO_URI_TRACE_BEGIN(DecodeLookup);
 
     // Assumed that the first 24 and 8 bits are PEN and Sub PEN respectively.
     // Other bits can be ignored for now.
     const auto& [pen, sub_pen] = quicr::HexEndec<MaxEncodeSize, Pen_Bits, Sub_Pen_Bits>::Decode(code);
     std::vector<uint16_t> bit_distribution = {Pen_Bits};
 
-    // Get the template for that PEN
-    auto found = templates.find(pen);
-    if (found == templates.end())
-        throw UrlDecodeNoMatchException("Error. No templates matches the found PEN " + std::to_string(pen));
+    bool uses_sub_pen = false;
+    const UrlEncoder::url_template* temp = FindTemplate(pen, sub_pen, uses_sub_pen);
+    if (uses_sub_pen)
+        bit_distribution.push_back(Sub_Pen_Bits);
 
-    UrlEncoder::template_map temp_map = found->second;
+    NUMERO_URI_TRACE_NEXT(DecodeUnpack);
 
-    UrlEncoder::url_template temp;
+    const size_t num_pens = bit_distribution.size();
+    bit_distribution.insert(bit_distribution.end(), temp->bits.begin(), temp->bits.end());
+    auto decoded_nums = quicr::HexEndec<MaxEncodeSize>::Decode(bit_distribution, code);
 
-    // Search for this sub PEN
-    bool found_sub_pen = false;
+    NUMERO_URI_TRACE_NEXT(DecodeFormat);
 
-    // search for the sub pen
-    if (auto found_s_pen = temp_map.find(-1); found_s_pen != temp_map.end())
-    {
-        temp = found_s_pen->second;
-    }
-    else if (auto found_s_pen = temp_map.find(sub_pen); found_s_pen != temp_map.end())
+    // Write the url with the values in place of the groups
+    std::string decoded;
+    if (!temp->pattern.Format(decoded, std::span<const std::uint64_t>(decoded_nums).subspan(num_pens)))
+        throw UrlDecodeNoMatchException("Error. A value is not one of the names of its group for PEN " +
+                                        std::to_string(pen));
+
+    return decoded;
+}
+
+std::string UrlEncoder::DecodeUrl(std::span<const std::byte> wire) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Decode));
+    NUMERO_URI_TRACE_BEGIN(DecodeLookup);
+
+    if (wire.size() < Wire_Bytes)
+        throw UrlDecodeNoMatchException("Error. Name is " + std::to_string(wire.size()) + " bytes, expected " +
+                                        std::to_string(Wire_Bytes));
+
+    Name128 name;
+    for (size_t i = 0; i < 8; i++)
     {
-        temp = found_s_pen->second;
-        pen_sub_bits = Sub_Pen_Bits;
-        bit_distribution.push_back(pen_sub_bits);
+        name.hi = (name.hi << 8) | std::to_integer<std::uint64_t>(wire[i]);
+        name.lo = (name.lo << 8) | std::to_integer<std::uint64_t>(wire[i + 8]);
     }
-    else
+
+    const std::uint64_t pen = name.Get(0, Pen_Bits);
+    bool uses_sub_pen = false;
+    const UrlEncoder::url_template* temp =
+        FindTemplate(pen, static_cast<std::uint8_t>(name.Get(Pen_Bits, Sub_Pen_Bits)), uses_sub_pen);
+
+    NUMERO_URI_TRACE_NEXT(DecodeUnpack);
+
+    std::array<std::uint64_t, UrlPattern::Max_Slots> values;
+    std::uint32_t used = Pen_Bits + (uses_sub_pen ? Sub_Pen_Bits : 0);
+    for (size_t i = 0; i < temp->bits.size() && i < values.size(); i++)
     {
-        // No sub PEN was found for this PEN so throw an error.
-        throw UrlDecodeNoMatchException("Error. No templates matches the "
-                                        "found PEN " +
-                                        std::to_string(pen) + " and sub PEN " + std::to_string(sub_pen));
+        const std::uint32_t bits = temp->bits[i];
+        if (used + bits > MaxEncodeSize)
+            throw UrlDecodeNoMatchException("Error. Template for PEN " + std::to_string(pen) + " needs more than " +
+                                            std::to_string(MaxEncodeSize) + " bits");
+
+        const std::uint32_t value_bits = std::min<std::uint32_t>(bits, 64);
+        values[i] = name.Get(used + bits - value_bits, value_bits);
+        used += bits;
     }
 
-    // Get the regex
-    std::string reg = temp.url;
+    NUMERO_URI_TRACE_NEXT(DecodeFormat);
+
     std::string decoded;
+    if (!temp->pattern.Format(decoded, std::span<const std::uint64_t>(values.data(), temp->bits.size())))
+        throw UrlDecodeNoMatchException("Error. A value is not one of the names of its group for PEN " +
+                                        std::to_string(pen));
 
-    size_t idx = 0;
-    std::vector<size_t> group_indices;
-    char ch;
-    size_t find = 0;
-    while (idx < reg.size())
+    return decoded;
+}
+
+size_t UrlEncoder::DecodeUrls(std::span<const quicr::Namespace> codes, std::vector<std::string>& urls) const
+{
+    urls.assign(codes.size(), std::string());
+
+    size_t failures = 0;
+    std::vector<std::uint64_t> order;
+    std::vector<std::uint64_t> hi(std::min(codes.size(), Decode_Block));
+    std::vector<std::uint64_t> lo(hi.size());
+    std::vector<std::uint64_t> group_hi(hi.size());
+    std::vector<std::uint64_t> group_lo(hi.size());
+    std::vector<std::uint64_t> values;
+    std::array<std::uint64_t, UrlPattern::Max_Slots> row;
+
+    for (size_t block = 0; block < codes.size(); block += Decode_Block)
     {
-        ch = reg[idx];
+        const size_t block_size = std::min(Decode_Block, codes.size() - block);
+
+        // Each name's PEN and sub PEN above its place in the block, so
+        // sorting groups the names of a template together
+        order.clear();
+        for (size_t i = 0; i < block_size; i++)
+        {
+            const quicr::Name& name = codes[block + i].name();
+            hi[i] = name.bits<std::uint64_t>(64, 64);
+            lo[i] = name.bits<std::uint64_t>(0, 64);
+            order.push_back(((hi[i] >> (64 - Pen_Bits - Sub_Pen_Bits)) << 32) | i);
+        }
+        std::sort(order.begin(), order.end());
 
-        // Find and ignore optional brackets
-        if (ch == '[')
+        for (size_t start = 0; start < block_size;)
         {
-            find = reg.find(']', idx);
-            if (find != std::string::npos)
+            const std::uint64_t key = order[start] >> 32;
+            size_t end = start + 1;
+            while (end < block_size && order[end] >> 32 == key)
+                end++;
+
+            const size_t count = end - start;
+            const std::uint64_t pen = key >> Sub_Pen_Bits;
+            bool uses_sub_pen = false;
+            const UrlEncoder::url_template* temp = nullptr;
+            try
+            {
+                temp = FindTemplate(pen, static_cast<std::uint8_t>(key), uses_sub_pen);
+            }
+            catch (const UrlDecodeNoMatchException&)
             {
-                idx = find + 1;
+                failures += count;
+                start = end;
                 continue;
             }
-        }
 
-        // Find groups and make note of them
-        if (ch == '(')
-        {
+            const size_t slots = std::min(temp->bits.size(), row.size());
+            std::uint32_t used = Pen_Bits + (uses_sub_pen ? Sub_Pen_Bits : 0);
+            for (size_t i = 0; i < slots; i++)
+                used += temp->bits[i];
 
-            find = reg.find(')', idx);
-            // Check the next couple characters for non matching-groups
-            if (idx + 3 < reg.size() && reg[idx + 1] == '?' && reg[idx + 2] == ':')
+            if (used > MaxEncodeSize)
             {
-                // Find the closing bracket for this optional group
-                idx = find + 1;
+                failures += count;
+                start = end;
                 continue;
             }
 
-            if (find != std::string::npos)
+            // The group's words side by side, then each field of them all
+            for (size_t j = 0; j < count; j++)
             {
-                group_indices.push_back(decoded.length());
-                idx = find + 1;
-                continue;
+                const size_t idx = order[start + j] & 0xFFFFFFFF;
+                group_hi[j] = hi[idx];
+                group_lo[j] = lo[idx];
             }
-        }
 
-        // Skip over ?, ^, $, \, ), +, |
-        if (ch == '?' || ch == '^' || ch == '$' || ch == '\\' || ch == ')' || ch == '+' || ch == '|')
-        {
-            ++idx;
-            continue;
-        }
+            values.resize(slots * count);
+            used = Pen_Bits + (uses_sub_pen ? Sub_Pen_Bits : 0);
+            for (size_t i = 0; i < slots; i++)
+            {
+                const std::uint32_t bits = temp->bits[i];
+                const std::uint32_t value_bits = std::min<std::uint32_t>(bits, 64);
+                ExtractField(group_hi.data(), group_lo.data(), count, used + bits - value_bits, value_bits,
+                             values.data() + i * count);
+                used += bits;
+            }
+
+            for (size_t j = 0; j < count; j++)
+            {
+                for (size_t i = 0; i < slots; i++)
+                    row[i] = values[i * count + j];
+
+                std::string& url = urls[block + (order[start + j] & 0xFFFFFFFF)];
+                if (!temp->pattern.Format(url, std::span<const std::uint64_t>(row.data(), slots)))
+                {
+                    url.clear();
+                    failures++;
+                }
+            }
 
-        decoded += ch;
-        ++idx;
+            start = end;
+        }
     }
 
-    const size_t num_pens = bit_distribution.size();
-    bit_distribution.insert(bit_distribution.end(), temp.bits.begin(), temp.bits.end());
-    auto decoded_nums = quicr::HexEndec<MaxEncodeSize>::Decode(bit_distribution, code);
+    return failures;
+}
 
-    size_t str_offset = 0;
-    size_t insert_idx;
-    std::string insert_str;
-    for (std::uint32_t i = 0; i < group_indices.size(); i++)
-    {
-        // Calc how much we've inserted into the string
-        str_offset += insert_str.length();
+std::string UrlEncoder::DecodeUrl64(const std::uint64_t code) const
+{
+    NUMERO_URI_METRIC(UrlEncoderMetrics::Timer timer(metrics, UrlEncoderMetrics::Operation::Decode));
+    NUMERO_URI_TRACE_BEGIN(DecodeLookup);
+
+    const std::uint64_t pen = code >> (Name64_Bits - Pen_Bits);
+    const std::uint8_t sub_pen = static_cast<std::uint8_t>(code >> (Name64_Bits - Pen_Bits - Sub_Pen_Bits));
 
-        // Get the idx with an offset
-        insert_idx = group_indices[i] + str_offset;
+    bool uses_sub_pen = false;
+    const UrlEncoder::url_template* temp = FindTemplate(pen, sub_pen, uses_sub_pen);
 
-        // Get the bits converted into decimal
-        insert_str = std::to_string(decoded_nums[i + num_pens]);
+    NUMERO_URI_TRACE_NEXT(DecodeUnpack);
+
+    std::array<std::uint64_t, UrlPattern::Max_Slots> values;
+    std::uint32_t used = Pen_Bits + (uses_sub_pen ? Sub_Pen_Bits : 0);
+    for (size_t i = 0; i < temp->bits.size() && i < values.size(); i++)
+    {
+        const std::uint32_t bits = temp->bits[i];
+        if (used + bits > Name64_Bits)
+            throw UrlDecodeNoMatchException("Error. Template for PEN " + std::to_string(pen) + " needs more than " +
+                                            std::to_string(Name64_Bits) + " bits");
 
-        // Insert the numeric values into the decoded string
-        decoded.insert(insert_idx, insert_str);
+        used += bits;
+        values[i] = bits ? (code >> (Name64_Bits - used)) & (~0ull >> (Name64_Bits - bits)) : 0;
     }
 
+    NUMERO_URI_TRACE_NEXT(DecodeFormat);
+
+    std::string decoded;
+    if (!temp->pattern.Format(decoded, std::span<const std::uint64_t>(values.data(), temp->bits.size())))
+        throw UrlDecodeNoMatchException("Error. A value is not one of the names of its group for PEN " +
+                                        std::to_string(pen));
+
     return decoded;
 }
 
@@ -236,30 +633,35 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
     // The first value must be filled in with their PEN
     const std::string example = "https://!{www.}!webex.com<pen=777>/meeting<int16>/user<int16>";
 
+    // The regexes are static, compiling them took most of the time of
+    // adding a template
+
     // If there is a !{...}! it is an optional group
-    const std::regex optional_regex("!\\{(.+)\\}!");
+    static const std::regex optional_regex("!\\{(.+)\\}!");
 
-    const std::regex pen_regex("pen=((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
+    static const std::regex pen_regex("pen=((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
 
-    const std::regex sub_pen_regex("sub_pen=((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
+    static const std::regex sub_pen_regex("sub_pen=((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
 
     // Parse the string
     // Build a regex out of it.. good luck brett
-    const std::regex bit_group_regex("^u?int([1-9][0-9]?)$");
+    static const std::regex bit_group_regex("^u?int([1-9][0-9]?)$");
+    static const std::regex string_group_regex("^str([1-9][0-9]?):(b32|b64)$");
     std::smatch matches;
 
-    // Template variable
-    std::pair<std::int16_t, url_template> temp;
+    // Template variable, the regex is built in url and interned at the end
+    std::pair<std::int16_t, url_template> temp(-1, url_template(templates.get_allocator()));
+    std::string url;
 
     // Find the first angle bracket
     std::size_t start = new_template.find('<') + 1;
     std::size_t end = 0;
 
     // Start the regex match string
-    temp.second.url = '^';
+    url = '^';
 
     // Put everything up to the first option into the regex
-    temp.second.url += new_template.substr(0, start - 1);
+    url += new_template.substr(0, start - 1);
 
     // Get the pen from the string
     end = new_template.find('>', start);
@@ -292,7 +694,14 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
     }
 
     if (overwrite)
-        templates.erase(pen_value);
+    {
+        if (auto found = templates.find(pen_value); found != templates.end())
+        {
+            UnindexTemplates(found->first, found->second);
+            templates.erase(found);
+            CompactLiterals();
+        }
+    }
 
     // Check if a sub PEN was provided
     // Check for sub pen
@@ -307,9 +716,9 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
         uint8_t sub_pen = std::stoul(matches[1].str());
 
         // Do some error checking
-        if (templates.find(pen_value) != templates.end())
+        if (auto found = templates.find(pen_value); found != templates.end())
         {
-            template_map temp_map = templates[pen_value];
+            const template_map& temp_map = found->second;
             if (temp_map.find(-1) != temp_map.end())
             {
                 // If there are not sub PENs for this PEN
@@ -345,6 +754,10 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
         // Get each other group from the string and build out the regex..
         ch = new_template[start++];
 
+        // A query of key=<intN> parameters, matched in any order
+        if (ch == '?' && AddQuery(std::string_view(new_template).substr(start), url, temp.second.bits))
+            break;
+
         if (ch == '<')
         {
             // Find the end of the group
@@ -353,6 +766,51 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
             // Pull out the group
             group_str = new_template.substr(start, end - start);
 
+            // One of a few names, encoded as the index of the name
+            if (group_str.starts_with("enum:"))
+            {
+                std::vector<std::string> names;
+                for (size_t pos = 5; pos <= group_str.size();)
+                {
+                    const size_t bar = std::min(group_str.find('|', pos), group_str.size());
+                    names.push_back(group_str.substr(pos, bar - pos));
+                    pos = bar + 1;
+                }
+
+                for (size_t idx = 0; idx < names.size(); idx++)
+                {
+                    if (!UrlPattern::IsName(names[idx]) ||
+                        std::find(names.begin(), names.begin() + idx, names[idx]) != names.begin() + idx)
+                        throw UrlEncoderException("Error. Bad enum name \"" + names[idx] + "\" in group starting at "
+                                                  "position " + std::to_string(start));
+                }
+
+                if (names.size() > UrlPattern::Max_Names)
+                    throw UrlEncoderException("Error. Too many enum names in group starting at position " +
+                                              std::to_string(start));
+
+                temp.second.bits.push_back(std::max<std::uint32_t>(1, std::bit_width(names.size() - 1)));
+                start = end + 1;
+                url += UrlPattern::EnumRegex(names);
+                continue;
+            }
+
+            // A short string, its characters packed into a number
+            if (std::regex_match(group_str, matches, string_group_regex))
+            {
+                const std::string alphabet = matches[2].str();
+                const size_t length = std::stoul(matches[1].str());
+                const std::uint32_t bits = UrlPattern::StringBits(alphabet, length);
+                if (bits == 0)
+                    throw UrlEncoderException("Error. String group starting at position " + std::to_string(start) +
+                                              " needs more than 64 bits");
+
+                temp.second.bits.push_back(bits);
+                start = end + 1;
+                url += UrlPattern::StringRegex(alphabet, length);
+                continue;
+            }
+
             // Run it through regex
             if (!std::regex_match(group_str, matches, bit_group_regex))
             {
@@ -366,27 +824,28 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
             start = end + 1;
 
             // Push regex onto the string
-            temp.second.url += ("((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
+            url += ("((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))");
             continue;
         }
 
-        temp.second.url += ch;
+        url += ch;
     }
 
     // Close the entire string
-    temp.second.url += '$';
+    url += '$';
 
     // Extract and replace optional chunks
-    std::regex_search(temp.second.url, matches, optional_regex);
+    std::smatch optional_matches;
+    std::regex_search(url, optional_matches, optional_regex);
     std::string optional_str;
     size_t search_idx = 1;
     size_t optional_idx;
     size_t optional_sz;
     size_t period_idx;
-    while (search_idx < matches.size())
+    while (search_idx < optional_matches.size())
     {
-        optional_str = matches[search_idx++].str();
-        optional_idx = temp.second.url.find("!{" + optional_str + "}!");
+        optional_str = optional_matches[search_idx++].str();
+        optional_idx = url.find("!{" + optional_str + "}!");
         optional_sz = optional_str.size() + 4;
 
         // This could be a problem if there are a lot of wild cards..
@@ -397,10 +856,54 @@ void UrlEncoder::AddTemplate(const std::string& new_template, const bool overwri
 
         // Replace the optional chunk !{...}!
         if (optional_idx != std::string::npos)
-            temp.second.url.replace(optional_idx, optional_sz, "(?:" + optional_str + ")?");
+            url.replace(optional_idx, optional_sz, "(?:" + optional_str + ")?");
     }
 
-    templates[pen_value].emplace(temp);
+    temp.second.pattern = UrlPattern(url, literals, templates.get_allocator());
+    if (mode == compile_mode::eager)
+        CompileTemplate(pen_value, temp.first, temp.second.pattern);
+
+    auto [added, inserted] = templates[pen_value].emplace(std::move(temp));
+    if (inserted)
+        IndexTemplate(pen_value, added->first, added->second);
+}
+
+bool UrlEncoder::AddQuery(std::string_view query, std::string& url, std::pmr::vector<std::uint32_t>& bits)
+{
+    static const std::regex param_regex("^([A-Za-z0-9._~-]+)=<u?int([1-9][0-9]?)>$");
+
+    std::vector<std::string> keys;
+    std::vector<std::uint32_t> key_bits;
+    bool allow_unknown = false;
+    std::cmatch matches;
+    while (!query.empty())
+    {
+        const std::string_view param = query.substr(0, query.find('&'));
+        query.remove_prefix(std::min(query.size(), param.size() + 1));
+
+        // A last parameter of * lets other parameters through
+        if (param == "*" && query.empty() && !keys.empty())
+        {
+            allow_unknown = true;
+            break;
+        }
+
+        if (!std::regex_match(param.begin(), param.end(), matches, param_regex))
+            return false;
+
+        if (std::find(keys.begin(), keys.end(), matches[1].str()) != keys.end())
+            throw UrlEncoderException("Error. Query parameter " + matches[1].str() + " is repeated");
+
+        keys.push_back(matches[1].str());
+        key_bits.push_back(std::stoul(matches[2].str()));
+    }
+
+    if (keys.empty())
+        return false;
+
+    url += UrlPattern::QueryRegex(keys, allow_unknown);
+    bits.insert(bits.end(), key_bits.begin(), key_bits.end());
+    return true;
 }
 
 void UrlEncoder::AddTemplate(const std::vector<std::string>& new_templates, const bool overwrite)
@@ -417,32 +920,61 @@ void UrlEncoder::AddTemplate(const std::string* new_templates, const size_t coun
 
 void UrlEncoder::AddTemplate(const json& new_templates, const bool overwrite)
 {
-    // Parse json
+    // Parse json, it's allocated from the same resource so the nodes can be
+    // moved over without copying
     UrlEncoder::pen_template_map res = ParseJson(new_templates);
 
-    for (auto p : res)
+    // Nothing is added unless every template compiles
+    if (mode == compile_mode::eager)
     {
-        if (overwrite && templates.find(p.first) != templates.end())
+        for (const auto& [pen, sub_templates] : res)
+        {
+            for (const auto& [sub_pen, temp] : sub_templates)
+                CompileTemplate(pen, sub_pen, temp.pattern);
+        }
+    }
+
+    while (!res.empty())
+    {
+        auto node = res.extract(res.begin());
+        if (overwrite)
         {
             // Overwrite the key's value
-            templates[p.first] = p.second;
+            if (auto found = templates.find(node.key()); found != templates.end())
+            {
+                UnindexTemplates(found->first, found->second);
+                templates.erase(found);
+            }
+        }
+
+        // Skips if the key exists
+        auto result = templates.insert(std::move(node));
+        if (result.inserted)
+        {
+            for (const auto& [sub_pen, temp] : result.position->second)
+                IndexTemplate(result.position->first, sub_pen, temp);
         }
         else
         {
-            // Skips if the key exists
-            templates.insert(p);
+            for (const auto& [sub_pen, temp] : result.node.mapped())
+                dead_chunks += temp.pattern.ChunkCount();
         }
     }
+
+    CompactLiterals();
 }
 
 bool UrlEncoder::RemoveTemplate(const std::uint64_t pen)
 {
-    if (templates.find(pen) == templates.end())
+    auto found = templates.find(pen);
+    if (found == templates.end())
     {
         return false;
     }
 
-    templates.erase(pen);
+    UnindexTemplates(found->first, found->second);
+    templates.erase(found);
+    CompactLiterals();
 
     return true;
 }
@@ -450,22 +982,27 @@ bool UrlEncoder::RemoveTemplate(const std::uint64_t pen)
 bool UrlEncoder::RemoveSubTemplate(const std::uint32_t pen, const std::uint8_t sub_pen)
 {
     // Check if the PEN exists
-    if (templates.find(pen) == templates.end())
+    auto found = templates.find(pen);
+    if (found == templates.end())
         return false;
 
     // Get the template map for this PEN
-    auto temp_map = templates[pen];
+    auto& temp_map = found->second;
 
     // Check if this sub PEN exists
-    if (temp_map.find(sub_pen) == temp_map.end())
+    auto found_sub = temp_map.find(sub_pen);
+    if (found_sub == temp_map.end())
         return false;
 
     // Remove the sub PEN
-    temp_map.erase(sub_pen);
+    UnindexTemplate(pen, found_sub->first, found_sub->second);
+    temp_map.erase(found_sub);
 
     // If there are no more sub-PENs remove the PEN from the template
     if (temp_map.size() == 0)
-        templates.erase(pen);
+        templates.erase(found);
+
+    CompactLiterals();
 
     return true;
 }
@@ -477,16 +1014,16 @@ json UrlEncoder::TemplatesToJson() const
     json j_pen_list;
     json j_bits;
     json j_temp_map;
-    for (auto temp_map : templates)
+    for (const auto& temp_map : templates)
     {
         j_pen_list.clear();
         j_pen_list["pen"] = temp_map.first;
 
-        for (auto url_temp : temp_map.second)
+        for (const auto& url_temp : temp_map.second)
         {
             j_temp_map.clear();
 
-            j_temp_map["url"] = url_temp.second.url;
+            j_temp_map["url"] = url_temp.second.pattern.str();
 
             j_temp_map["sub_pen"] = url_temp.first;
 
@@ -505,15 +1042,151 @@ json UrlEncoder::TemplatesToJson() const
     return j;
 }
 
+void UrlEncoder::TemplatesToJson(std::ostream& out, const int indent) const
+{
+    JsonWriter writer(out, indent);
+    const char* pen_separator = "";
+    writer.Raw("[");
+    for (const auto& [pen, temps] : templates)
+    {
+        writer.Raw(pen_separator);
+        pen_separator = ",";
+        writer.Line(1);
+        writer.Raw("{");
+        writer.Key("pen", 2);
+        writer.Number(pen);
+        writer.Raw(",");
+        writer.Key("templates", 2);
+        writer.Raw("[");
+
+        const char* temp_separator = "";
+        for (const auto& [sub_pen, temp] : temps)
+        {
+            writer.Raw(temp_separator);
+            temp_separator = ",";
+            writer.Line(3);
+            writer.Raw("{");
+
+            // The keys in the order a json object keeps them
+            writer.Key("bits", 4);
+            writer.Raw("[");
+            for (size_t i = 0; i < temp.bits.size(); i++)
+            {
+                writer.Raw(i ? "," : "");
+                writer.Line(5);
+                writer.Number(temp.bits[i]);
+            }
+            if (!temp.bits.empty())
+                writer.Line(4);
+            writer.Raw("],");
+
+            writer.Key("sub_pen", 4);
+            writer.Number(sub_pen);
+            writer.Raw(",");
+
+            // The url is written a chunk at a time from the pool
+            writer.Key("url", 4);
+            writer.Raw("\"");
+            for (const auto chunk : temp.pattern.Chunks())
+                writer.Escaped(literals->View(UrlPattern::ChunkId(chunk)));
+            writer.Raw("\"");
+
+            writer.Line(3);
+            writer.Raw("}");
+        }
+
+        if (!temps.empty())
+            writer.Line(2);
+        writer.Raw("]");
+        writer.Line(1);
+        writer.Raw("}");
+    }
+
+    if (!templates.empty())
+        writer.Line(0);
+    writer.Raw("]");
+    writer.Flush();
+}
+
 void UrlEncoder::TemplatesFromJson(const json& data)
 {
-    templates.clear();
+    Clear();
     AddTemplate(data);
 }
 
+void UrlEncoder::TemplatesToImage(std::string& image) const
+{
+    TemplateImage::Write(*literals, templates, image);
+}
+
+void UrlEncoder::TemplatesFromImage(std::string_view image)
+{
+    Clear();
+
+    // Checked where it is unless it's misaligned for its fields
+    std::vector<std::uint64_t> aligned;
+    if (reinterpret_cast<std::uintptr_t>(image.data()) % alignof(std::uint64_t) != 0)
+    {
+        aligned.resize((image.size() + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+        std::memcpy(aligned.data(), image.data(), image.size());
+        image = std::string_view(reinterpret_cast<const char*>(aligned.data()), image.size());
+    }
+
+    try
+    {
+        const TemplateImage loaded(image);
+
+        // The image ids are mapped to this pool's, equal in a fresh pool
+        std::vector<LiteralPool::Id> ids;
+        ids.reserve(loaded.LiteralCount());
+        for (LiteralPool::Id id = 0; id < loaded.LiteralCount(); id++)
+            ids.push_back(literals->Intern(loaded.Literal(id)));
+
+        std::vector<std::uint32_t> chunks;
+        for (size_t idx = 0; idx < loaded.TemplateCount(true); idx++)
+        {
+            const TemplateImage::Template from = loaded.At(idx);
+            chunks.clear();
+            for (const auto chunk : from.chunks)
+                chunks.push_back(UrlPattern::WithId(chunk, ids[UrlPattern::ChunkId(chunk)]));
+
+            url_template& temp = templates[from.pen][from.sub_pen];
+            temp.bits.assign(from.bits.begin(), from.bits.end());
+            temp.pattern = UrlPattern(chunks, literals, templates.get_allocator());
+        }
+
+        for (const auto& [pen, temps] : templates)
+        {
+            for (const auto& [sub_pen, temp] : temps)
+                IndexTemplate(pen, sub_pen, temp);
+        }
+    }
+    catch (...)
+    {
+        Clear();
+        throw;
+    }
+}
+
 void UrlEncoder::Clear()
 {
+    std::pmr::memory_resource* resource = GetMemoryResource();
+
+    // The index and pool keep their capacity when cleared, so make new ones
+    index.reset();
     templates.clear();
+    literals.reset();
+    live_chunks = 0;
+    dead_chunks = 0;
+
+    // Nothing is left in the pool, free its blocks in one go
+    if (pool)
+        pool->release();
+
+    literals = std::make_shared<LiteralPool>(resource);
+    index = std::make_unique<TemplateIndex>(resource);
+    index->SetAdaptive(adaptive_order);
+    prefilter.Clear();
 }
 
 const UrlEncoder::pen_template_map& UrlEncoder::GetTemplates() const
@@ -534,7 +1207,7 @@ std::uint64_t UrlEncoder::TemplateCount(const bool count_sub_pen) const
     }
 
     std::uint64_t sz = 0;
-    for (auto temp_map : templates)
+    for (const auto& temp_map : templates)
     {
         sz += temp_map.second.size();
     }
@@ -542,34 +1215,426 @@ std::uint64_t UrlEncoder::TemplateCount(const bool count_sub_pen) const
     return sz;
 }
 
+std::pmr::memory_resource* UrlEncoder::GetMemoryResource() const
+{
+    return templates.get_allocator().resource();
+}
+
+void UrlEncoder::SetCompileMode(const compile_mode mode)
+{
+    this->mode = mode;
+}
+
+UrlEncoder::compile_mode UrlEncoder::GetCompileMode() const
+{
+    return mode;
+}
+
+void UrlEncoder::SetNormalization(const UrlNormalizer::options& opts)
+{
+    normalization = opts;
+}
+
+UrlNormalizer::options UrlEncoder::GetNormalization() const
+{
+    return normalization;
+}
+
+void UrlEncoder::SetAdaptiveOrder(const bool enabled)
+{
+    adaptive_order = enabled;
+    index->SetAdaptive(enabled);
+}
+
+bool UrlEncoder::GetAdaptiveOrder() const
+{
+    return adaptive_order;
+}
+
+std::uint64_t UrlEncoder::ReorderCount() const
+{
+    return index->ReorderCount();
+}
+
+UrlEncoder::memory_report UrlEncoder::GetMemoryReport() const
+{
+    memory_report report;
+    for (const auto& [pen, sub_templates] : templates)
+    {
+        for (const auto& [sub_pen, temp] : sub_templates)
+        {
+            // A string keeps up to 15 characters inline, longer ones are
+            // allocated with the terminator
+            const size_t length = temp.pattern.size();
+            report.flat_url_bytes += sizeof(std::pmr::string) + (length > 15 ? length + 1 : 0);
+
+            report.pattern_bytes += temp.pattern.MemoryUsage();
+            report.bits_bytes += temp.bits.capacity() * sizeof(std::uint32_t);
+            report.compiled_templates += temp.pattern.Compiled();
+            report.templates++;
+        }
+    }
+
+    report.pool_bytes = literals->MemoryUsage();
+    report.pool_literals = literals->Size();
+    report.index_buckets = index->BucketCount();
+
+    return report;
+}
+
+double UrlEncoder::memory_report::BytesPerTemplateBefore() const
+{
+    return templates ? static_cast<double>(flat_url_bytes) / templates : 0;
+}
+
+double UrlEncoder::memory_report::BytesPerTemplateAfter() const
+{
+    return templates ? static_cast<double>(pattern_bytes + pool_bytes) / templates : 0;
+}
+
+json UrlEncoder::memory_report::ToJson() const
+{
+    json j;
+    j["templates"] = templates;
+    j["flat_url_bytes"] = flat_url_bytes;
+    j["pattern_bytes"] = pattern_bytes;
+    j["pool_bytes"] = pool_bytes;
+    j["pool_literals"] = pool_literals;
+    j["index_buckets"] = index_buckets;
+    j["compiled_templates"] = compiled_templates;
+    j["bits_bytes"] = bits_bytes;
+    j["bytes_per_template_before"] = BytesPerTemplateBefore();
+    j["bytes_per_template_after"] = BytesPerTemplateAfter();
+
+    return j;
+}
+
+#ifdef NUMERO_URI_ENABLE_METRICS
+UrlEncoderMetrics::Snapshot UrlEncoder::GetMetrics() const
+{
+    return metrics.GetSnapshot();
+}
+
+json UrlEncoder::MetricsToJson() const
+{
+    return metrics.GetSnapshot().ToJson();
+}
+
+void UrlEncoder::ResetMetrics() const
+{
+    metrics.Reset();
+}
+#endif
+
 /** Begin Private functions**/
-UrlEncoder::pen_template_map UrlEncoder::ParseJson(const json& data) const
+UrlEncoder::pen_template_map UrlEncoder::ParseJson(const json& data)
 {
-    pen_template_map t_templates;
-    template_map temps;
+    pen_template_map t_templates(templates.get_allocator());
     for (unsigned int i = 0; i < data.size(); i++)
     {
+        // A PEN listed again replaces the earlier entry
+        template_map& temps = t_templates[static_cast<std::uint64_t>(data[i]["pen"])];
+        temps.clear();
+
         for (unsigned int j = 0; j < data[i]["templates"].size(); j++)
         {
-            url_template url_temp;
-            // Get the url
-            url_temp.url = data[i]["templates"][j]["url"];
+            url_template& url_temp = temps[data[i]["templates"][j]["sub_pen"]];
 
-            // Get the sub pen
-            // url_temp.first = data[i]["templates"][j]["sub_pen"];
+            // Get the url
+            url_temp.pattern = UrlPattern(data[i]["templates"][j]["url"].get_ref<const std::string&>(), literals,
+                                          templates.get_allocator());
 
             // Get the bits
             url_temp.bits.clear();
             for (auto& element : data[i]["templates"][j]["bits"])
                 url_temp.bits.push_back(static_cast<std::uint32_t>(element));
+        }
+    }
+
+    return t_templates;
+}
 
-            temps[data[i]["templates"][j]["sub_pen"]] = url_temp;
+quicr::Namespace UrlEncoder::PackName(const matched_url& matched) const
+{
+    NUMERO_URI_TRACE_BEGIN(EncodePack);
+
+    quicr::Namespace name = PackName(matched.pen, matched.sub_pen, matched.temp->bits,
+                                     std::span<const std::uint64_t>(matched.values.data(), matched.count));
+    NUMERO_URI_METRIC(metrics.RecordHit(matched.pen, matched.sub_pen));
+    return name;
+}
+
+quicr::Namespace UrlEncoder::PackName(std::uint64_t pen,
+                                      std::int16_t sub_pen,
+                                      std::span<const std::uint32_t> bits,
+                                      std::span<const std::uint64_t> values)
+{
+    std::vector<uint64_t> fields;
+    std::vector<uint16_t> distribution;
+    fields.push_back(pen);
+    distribution.push_back(Pen_Bits);
+    int remaining_bits = MaxEncodeSize - Pen_Bits;
+
+    // Set the sub PEN value and bits if it is positive
+    if (sub_pen >= 0)
+    {
+        fields.push_back(sub_pen);
+        distribution.push_back(Sub_Pen_Bits);
+        remaining_bits -= Sub_Pen_Bits;
+    }
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        fields.push_back(values[i]);
+        distribution.push_back(bits[i]);
+        remaining_bits -= bits[i];
+    }
+
+    if (remaining_bits > 0)
+    {
+        fields.push_back(0);
+        distribution.push_back(remaining_bits);
+    }
+    quicr::Name name = {quicr::HexEndec<MaxEncodeSize>::Encode(distribution, fields)};
+    return quicr::Namespace(name, MaxEncodeSize - remaining_bits);
+}
+
+std::uint64_t UrlEncoder::ParseValue(std::string_view str)
+{
+    int base = 10;
+    size_t offset = 0;
+    if (str.starts_with("0x") || str.starts_with("0b") || str.starts_with("0d"))
+    {
+        base = str[1] == 'x' ? 16 : str[1] == 'b' ? 2 : 10;
+        offset = 2;
+    }
+
+    std::uint64_t val = 0;
+    const auto [end, error] = std::from_chars(str.data() + offset, str.data() + str.size(), val, base);
+    if (error == std::errc::invalid_argument)
+        throw UrlEncoderNoMatchException("Error. Value " + std::string(str) + " is not a number");
+
+    if (error == std::errc::result_out_of_range)
+        throw UrlEncoderOutOfRangeException("Error. Out of range. Value " + std::string(str) +
+                                            " does not fit in 64 bits");
+
+    // All of it has to be digits of the base
+    if (end != str.data() + str.size())
+        throw UrlEncoderNoMatchException("Error. Value " + std::string(str) + " is not a base " +
+                                         std::to_string(base) + " number");
+
+    return val;
+}
+
+bool UrlEncoder::MatchUrl(std::string_view url, matched_url& matched) const
+{
+    NUMERO_URI_TRACE_BEGIN(EncodeDispatch);
+
+    // Normalized into a buffer on the stack, the matches point into it
+    std::array<char, UrlNormalizer::Stack_Size> buffer;
+    std::string long_url;
+    std::string_view input = url;
+    if (normalization.Any())
+    {
+        char* out = buffer.data();
+        if (url.size() > buffer.size())
+        {
+            long_url.resize(url.size());
+            out = long_url.data();
         }
 
-        // Push the values onto the templates list
-        t_templates[static_cast<std::uint64_t>(data[i]["pen"])] = temps;
-        temps.clear();
+        input = std::string_view(out, UrlNormalizer::Normalize(url, out, normalization));
     }
 
-    return t_templates;
+    // Urls no template could match are turned away before trying any
+    if (const UrlPrefilter::Verdict verdict = prefilter.Check(input); verdict != UrlPrefilter::Verdict::Pass)
+    {
+        NUMERO_URI_METRIC(metrics.RecordRejected(verdict));
+        NUMERO_URI_METRIC(metrics.RecordNoMatch());
+        return false;
+    }
+
+    // The text of each value in the url, and the name of each enum value
+    std::array<std::string_view, UrlPattern::Max_Slots> matches;
+    std::array<std::uint8_t, UrlPattern::Max_Slots> names;
+
+    // Only the templates whose literal prefix the url starts with are tried
+    TemplateIndex::Match found;
+    if (!index->Find(input, matches, names, found))
+    {
+        NUMERO_URI_METRIC(metrics.RecordNoMatch());
+        return false;
+    }
+
+    matched.pen = found.pen;
+    matched.sub_pen = found.sub_pen;
+    matched.temp = found.temp;
+
+    NUMERO_URI_TRACE_NEXT(EncodeMatch);
+
+    // Need the same number of numbers as the template expects
+    if (found.captures != matched.temp->bits.size() || found.captures > matches.size())
+        throw UrlEncoderNoMatchException("Error. Match is missing values for "
+                                         "the given template");
+
+    // Each value is range checked as soon as it's parsed, so the first bad
+    // value decides the exception. The phases alternate per value.
+    for (std::uint32_t i = 0; i < found.captures; i++)
+    {
+        NUMERO_URI_TRACE_NEXT(EncodeParse);
+
+        std::uint64_t val;
+        try
+        {
+            if (!matched.temp->pattern.TextValue(i, matches[i], names[i], val))
+                val = ParseValue(matches[i]);
+        }
+        catch (const UrlEncoderOutOfRangeException&)
+        {
+            NUMERO_URI_METRIC(metrics.RecordOutOfRange(matched.pen, matched.sub_pen));
+            throw;
+        }
+
+        NUMERO_URI_TRACE_NEXT(EncodeRangeCheck);
+
+        const std::uint32_t bits = matched.temp->bits[i];
+        if (bits < 64 && (val >> bits) != 0)
+        {
+            NUMERO_URI_METRIC(metrics.RecordOutOfRange(matched.pen, matched.sub_pen));
+            throw UrlEncoderOutOfRangeException("Error. Out of range. Group " + std::to_string(i + 1) +
+                                                " value is " + std::to_string(val) +
+                                                " which exceeds the maximum amount of bits: " + std::to_string(bits));
+        }
+        matched.values[matched.count++] = val;
+    }
+
+    return true;
+}
+
+const UrlEncoder::url_template* UrlEncoder::FindTemplate(const std::uint64_t pen,
+                                                         const std::uint8_t sub_pen,
+                                                         bool& uses_sub_pen) const
+{
+    // Get the template for that PEN
+    auto found = templates.find(pen);
+    if (found == templates.end())
+        throw UrlDecodeNoMatchException("Error. No templates matches the found PEN " + std::to_string(pen));
+
+    const UrlEncoder::template_map& temp_map = found->second;
+
+    // search for the sub pen
+    if (auto found_s_pen = temp_map.find(-1); found_s_pen != temp_map.end())
+    {
+        uses_sub_pen = false;
+        CompileTemplate(pen, -1, found_s_pen->second.pattern);
+        return &found_s_pen->second;
+    }
+
+    if (auto found_s_pen = temp_map.find(sub_pen); found_s_pen != temp_map.end())
+    {
+        uses_sub_pen = true;
+        CompileTemplate(pen, sub_pen, found_s_pen->second.pattern);
+        return &found_s_pen->second;
+    }
+
+    // No sub PEN was found for this PEN so throw an error.
+    throw UrlDecodeNoMatchException("Error. No templates matches the "
+                                    "found PEN " +
+                                    std::to_string(pen) + " and sub PEN " + std::to_string(sub_pen));
+}
+
+void UrlEncoder::CompileTemplate(std::uint64_t pen, std::int16_t sub_pen, const UrlPattern& pattern)
+{
+    if (pattern.Compiled())
+        return;
+
+    try
+    {
+        pattern.Compile();
+    }
+    catch (const std::regex_error& ex)
+    {
+        throw UrlEncoderException("Error. Template of PEN " + std::to_string(pen) + " and sub PEN " +
+                                  std::to_string(sub_pen) + " is not a valid regex: " + ex.what());
+    }
+}
+
+void UrlEncoder::IndexTemplate(std::uint64_t pen, std::int16_t sub_pen, const url_template& temp)
+{
+    // Compiled before it's indexed, so a template that doesn't compile
+    // isn't half added
+    if (mode == compile_mode::eager)
+        CompileTemplate(pen, sub_pen, temp.pattern);
+
+    index->Insert(pen, sub_pen, temp);
+    prefilter.Add(temp.pattern);
+    live_chunks += temp.pattern.ChunkCount();
+}
+
+void UrlEncoder::UnindexTemplate(std::uint64_t pen, std::int16_t sub_pen, const url_template& temp)
+{
+    index->Remove(pen, sub_pen, temp);
+    live_chunks -= temp.pattern.ChunkCount();
+    dead_chunks += temp.pattern.ChunkCount();
+}
+
+void UrlEncoder::UnindexTemplates(std::uint64_t pen, const template_map& sub_templates)
+{
+    for (const auto& [sub_pen, temp] : sub_templates)
+        UnindexTemplate(pen, sub_pen, temp);
+}
+
+void UrlEncoder::CopyFrom(const UrlEncoder& other)
+{
+    mode = other.mode;
+    normalization = other.normalization;
+    SetAdaptiveOrder(other.adaptive_order);
+
+    // Only the literals the templates still use are copied, so the copy
+    // starts compacted
+    constexpr LiteralPool::Id Unmapped = ~LiteralPool::Id(0);
+    std::vector<LiteralPool::Id> ids(other.literals->Size(), Unmapped);
+    std::vector<std::uint32_t> chunks;
+    for (const auto& [pen, other_temps] : other.templates)
+    {
+        template_map& temps = templates[pen];
+        for (const auto& [sub_pen, other_temp] : other_temps)
+        {
+            chunks.clear();
+            for (const auto chunk : other_temp.pattern.Chunks())
+            {
+                LiteralPool::Id& id = ids[UrlPattern::ChunkId(chunk)];
+                if (id == Unmapped)
+                    id = literals->Intern(other.literals->View(UrlPattern::ChunkId(chunk)));
+                chunks.push_back(UrlPattern::WithId(chunk, id));
+            }
+
+            url_template& temp = temps[sub_pen];
+            temp.bits.assign(other_temp.bits.begin(), other_temp.bits.end());
+            temp.pattern = UrlPattern(chunks, literals, templates.get_allocator());
+            IndexTemplate(pen, sub_pen, temp);
+        }
+    }
+}
+
+void UrlEncoder::CompactLiterals()
+{
+    if (dead_chunks < Min_Compact_Chunks || dead_chunks < live_chunks)
+        return;
+
+    // Intern what's still used into a new pool, then drop the old one. The
+    // prefilter is rebuilt too, it still lets through the removed templates.
+    auto compacted = std::make_shared<LiteralPool>(GetMemoryResource());
+    prefilter.Clear();
+    for (auto& [pen, sub_templates] : templates)
+    {
+        for (auto& [sub_pen, temp] : sub_templates)
+        {
+            temp.pattern.MoveTo(compacted);
+            prefilter.Add(temp.pattern);
+        }
+    }
+
+    literals = std::move(compacted);
+    dead_chunks = 0;
 }
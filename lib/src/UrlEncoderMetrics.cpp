@@ -0,0 +1,263 @@
+#include <UrlEncoderMetrics.h>
+
+#include <bit>
+#include <unordered_set>
+
+namespace
+{
+std::atomic<std::uint64_t> next_id = 1;
+
+// Ids of the instances alive, so threads can drop their cache entries for
+// destroyed ones. Never freed, instances may be destroyed during exit.
+struct LiveInstances
+{
+    std::mutex mutex;
+    std::unordered_set<std::uint64_t> ids;
+
+    // Bumped on each destroy, threads only sweep when it has moved
+    std::atomic<std::uint64_t> destroyed = 0;
+};
+
+LiveInstances& Live()
+{
+    static LiveInstances* live = new LiveInstances();
+    return *live;
+}
+
+// Only the owning thread writes a counter, so it doesn't need a locked add
+void Add(std::atomic<std::uint64_t>& counter, std::uint64_t value = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+std::uint64_t Key(std::uint64_t pen, std::int16_t sub_pen)
+{
+    return (pen << 16) | static_cast<std::uint16_t>(sub_pen);
+}
+
+size_t Bucket(std::uint64_t ns)
+{
+    return std::min<size_t>(std::bit_width(ns), UrlEncoderMetrics::Histogram_Buckets - 1);
+}
+} // namespace
+
+std::uint64_t UrlEncoderMetrics::Histogram::Percentile(double pct) const
+{
+    if (count == 0)
+        return 0;
+
+    const auto rank = static_cast<std::uint64_t>(pct / 100.0 * count);
+    std::uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+    {
+        seen += buckets[bucket];
+        if (seen > rank)
+            return bucket == 0 ? 0 : (1ull << bucket) - 1;
+    }
+
+    return ~0ull;
+}
+
+nlohmann::json UrlEncoderMetrics::Histogram::ToJson() const
+{
+    nlohmann::json j;
+    j["count"] = count;
+    j["total_ns"] = total_ns;
+    j["p50_ns"] = Percentile(50);
+    j["p99_ns"] = Percentile(99);
+    j["p999_ns"] = Percentile(99.9);
+
+    // Only the buckets in use, by their upper bound
+    j["buckets"] = nlohmann::json::array();
+    for (size_t bucket = 0; bucket < buckets.size(); bucket++)
+    {
+        if (buckets[bucket] != 0)
+            j["buckets"].push_back({{"le_ns", bucket == 0 ? 0 : (1ull << bucket) - 1}, {"count", buckets[bucket]}});
+    }
+
+    return j;
+}
+
+nlohmann::json UrlEncoderMetrics::Snapshot::ToJson() const
+{
+    nlohmann::json j;
+    j["no_match"] = no_match;
+    j["prefilter_rejected"] = {
+        {"length", rejected_length}, {"prefix", rejected_prefix}, {"authority", rejected_authority}};
+    j["encode_latency"] = encode_latency.ToJson();
+    j["decode_latency"] = decode_latency.ToJson();
+
+    j["templates"] = nlohmann::json::array();
+    for (const auto& [key, counters] : templates)
+    {
+        j["templates"].push_back({{"pen", key.first},
+                                  {"sub_pen", key.second},
+                                  {"hits", counters.hits},
+                                  {"out_of_range", counters.out_of_range}});
+    }
+
+    return j;
+}
+
+UrlEncoderMetrics::UrlEncoderMetrics() : id(next_id++)
+{
+    LiveInstances& live = Live();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.ids.insert(id);
+}
+
+UrlEncoderMetrics::UrlEncoderMetrics(const UrlEncoderMetrics&) : UrlEncoderMetrics()
+{
+}
+
+UrlEncoderMetrics& UrlEncoderMetrics::operator=(const UrlEncoderMetrics&)
+{
+    return *this;
+}
+
+UrlEncoderMetrics::~UrlEncoderMetrics()
+{
+    LiveInstances& live = Live();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.ids.erase(id);
+    live.destroyed.fetch_add(1, std::memory_order_release);
+}
+
+void UrlEncoderMetrics::RecordHit(std::uint64_t pen, std::int16_t sub_pen)
+{
+    Add(LocalTemplate(pen, sub_pen).hits);
+}
+
+void UrlEncoderMetrics::RecordOutOfRange(std::uint64_t pen, std::int16_t sub_pen)
+{
+    Add(LocalTemplate(pen, sub_pen).out_of_range);
+}
+
+void UrlEncoderMetrics::RecordNoMatch()
+{
+    Add(Local().no_match);
+}
+
+void UrlEncoderMetrics::RecordRejected(UrlPrefilter::Verdict verdict)
+{
+    Add(Local().rejected[static_cast<size_t>(verdict)]);
+}
+
+void UrlEncoderMetrics::RecordLatency(Operation operation, std::chrono::nanoseconds latency)
+{
+    ThreadBlock& block = Local();
+    const auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(latency.count(), 0));
+    const size_t op = static_cast<size_t>(operation);
+    Add(block.latency[op][Bucket(ns)]);
+    Add(block.total_ns[op], ns);
+}
+
+UrlEncoderMetrics::Snapshot UrlEncoderMetrics::GetSnapshot() const
+{
+    Snapshot snapshot;
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    for (const auto& block : blocks)
+    {
+        snapshot.no_match += block->no_match.load(std::memory_order_relaxed);
+        snapshot.rejected_length +=
+            block->rejected[static_cast<size_t>(UrlPrefilter::Verdict::Length)].load(std::memory_order_relaxed);
+        snapshot.rejected_prefix +=
+            block->rejected[static_cast<size_t>(UrlPrefilter::Verdict::Prefix)].load(std::memory_order_relaxed);
+        snapshot.rejected_authority +=
+            block->rejected[static_cast<size_t>(UrlPrefilter::Verdict::Authority)].load(std::memory_order_relaxed);
+
+        Histogram* histograms[] = {&snapshot.encode_latency, &snapshot.decode_latency};
+        for (size_t op = 0; op < 2; op++)
+        {
+            for (size_t bucket = 0; bucket < Histogram_Buckets; bucket++)
+            {
+                const std::uint64_t count = block->latency[op][bucket].load(std::memory_order_relaxed);
+                histograms[op]->buckets[bucket] += count;
+                histograms[op]->count += count;
+            }
+            histograms[op]->total_ns += block->total_ns[op].load(std::memory_order_relaxed);
+        }
+
+        std::lock_guard<std::mutex> templates_lock(block->templates_mutex);
+        for (const auto& [key, counters] : block->templates)
+        {
+            auto& totals = snapshot.templates[{key >> 16, static_cast<std::int16_t>(key & 0xFFFF)}];
+            totals.hits += counters->hits.load(std::memory_order_relaxed);
+            totals.out_of_range += counters->out_of_range.load(std::memory_order_relaxed);
+        }
+    }
+
+    return snapshot;
+}
+
+void UrlEncoderMetrics::Reset()
+{
+    std::lock_guard<std::mutex> lock(blocks_mutex);
+    for (const auto& block : blocks)
+    {
+        block->no_match = 0;
+        for (auto& count : block->rejected)
+            count = 0;
+        for (auto& histogram : block->latency)
+            for (auto& bucket : histogram)
+                bucket = 0;
+        for (auto& total : block->total_ns)
+            total = 0;
+
+        std::lock_guard<std::mutex> templates_lock(block->templates_mutex);
+        for (auto& [key, counters] : block->templates)
+        {
+            counters->hits = 0;
+            counters->out_of_range = 0;
+        }
+    }
+}
+
+UrlEncoderMetrics::ThreadBlock& UrlEncoderMetrics::Local()
+{
+    // Most threads only use one encoder, so check the last one first. Ids
+    // are never reused, so entries of destroyed encoders are never found.
+    thread_local std::uint64_t last_id = 0;
+    thread_local ThreadBlock* last_block = nullptr;
+    if (last_id == id)
+        return *last_block;
+
+    thread_local std::unordered_map<std::uint64_t, ThreadBlock*> thread_blocks;
+    thread_local std::uint64_t swept = 0;
+    auto found = thread_blocks.find(id);
+    if (found == thread_blocks.end())
+    {
+        // Drop the entries of destroyed instances before adding one, so the
+        // cache stays the size of the instances alive that this thread used
+        LiveInstances& live = Live();
+        const std::uint64_t destroyed = live.destroyed.load(std::memory_order_acquire);
+        if (destroyed != swept)
+        {
+            std::lock_guard<std::mutex> lock(live.mutex);
+            std::erase_if(thread_blocks, [&](const auto& entry) { return !live.ids.contains(entry.first); });
+            swept = destroyed;
+        }
+
+        std::lock_guard<std::mutex> lock(blocks_mutex);
+        blocks.push_back(std::make_unique<ThreadBlock>());
+        found = thread_blocks.emplace(id, blocks.back().get()).first;
+    }
+
+    last_id = id;
+    last_block = found->second;
+    return *last_block;
+}
+
+UrlEncoderMetrics::PaddedCounters& UrlEncoderMetrics::LocalTemplate(std::uint64_t pen, std::int16_t sub_pen)
+{
+    ThreadBlock& block = Local();
+    const std::uint64_t key = Key(pen, sub_pen);
+    auto found = block.templates.find(key);
+    if (found == block.templates.end())
+    {
+        std::lock_guard<std::mutex> lock(block.templates_mutex);
+        found = block.templates.emplace(key, std::make_unique<PaddedCounters>()).first;
+    }
+
+    return *found->second;
+}
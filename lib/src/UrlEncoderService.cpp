@@ -0,0 +1,258 @@
+#include <UrlEncoderService.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+UrlEncoderService::UrlEncoderService(std::function<std::shared_ptr<const UrlEncoder>()> get_encoder,
+                                     const options& opts)
+    : get_encoder(std::move(get_encoder)), opts(opts)
+{
+    const unsigned int count = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+    this->opts.batch_size = std::max<size_t>(1, opts.batch_size);
+
+#ifdef __linux__
+    for (const int cpu : opts.cpus)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+            throw std::invalid_argument("Error. Cpu " + std::to_string(cpu) + " is out of range");
+    }
+#endif
+
+    for (unsigned int i = 0; i < count; i++)
+        workers.push_back(std::make_unique<Worker>(opts.queue_capacity));
+
+    // Started after they're all made, a submit may pick any of them
+    for (auto& worker : workers)
+        worker->thread = std::thread(&UrlEncoderService::Run, this, std::ref(*worker));
+
+#ifdef __linux__
+    // Pinned from here so a cpu that can't be used fails the constructor
+    for (size_t i = 0; i < workers.size() && !opts.cpus.empty(); i++)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(opts.cpus[i % opts.cpus.size()], &cpus);
+        if (const int error = pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(cpus), &cpus))
+        {
+            Stop();
+            throw UrlEncoderException("Error. Failed to pin worker to cpu " +
+                                      std::to_string(opts.cpus[i % opts.cpus.size()]) + ": " + std::strerror(error));
+        }
+    }
+#endif
+}
+
+UrlEncoderService::UrlEncoderService(std::shared_ptr<const UrlEncoder> encoder, const options& opts)
+    : UrlEncoderService([encoder] { return encoder; }, opts)
+{
+}
+
+UrlEncoderService::~UrlEncoderService()
+{
+    Stop();
+}
+
+void UrlEncoderService::Stop()
+{
+    // Turn away new jobs, then wait for the submits already past that check
+    // to finish pushing, so every accepted job is queued before the workers
+    // are told to drain and exit
+    stopping.store(true);
+    while (submitting.load() != 0)
+        std::this_thread::yield();
+
+    finished.store(true);
+    for (auto& worker : workers)
+    {
+        worker->signal.fetch_add(1);
+        worker->signal.notify_one();
+    }
+
+    for (auto& worker : workers)
+        worker->thread.join();
+}
+
+bool UrlEncoderService::Encode(std::string url, encode_callback done)
+{
+    Job job;
+    job.op = Job::Operation::Encode;
+    job.url = std::move(url);
+    job.on_encode = std::move(done);
+    return Submit(std::move(job));
+}
+
+bool UrlEncoderService::Decode(const quicr::Namespace& code, decode_callback done)
+{
+    Job job;
+    job.op = Job::Operation::Decode;
+    job.code = code;
+    job.on_decode = std::move(done);
+    return Submit(std::move(job));
+}
+
+std::future<quicr::Namespace> UrlEncoderService::Encode(std::string url)
+{
+    // std::function needs a copyable callable
+    auto promise = std::make_shared<std::promise<quicr::Namespace>>();
+    std::future<quicr::Namespace> result = promise->get_future();
+
+    const bool queued = Encode(std::move(url), [promise](encode_result&& done) {
+        if (done.error)
+            promise->set_exception(done.error);
+        else
+            promise->set_value(done.name);
+    });
+
+    if (!queued)
+        promise->set_exception(
+            std::make_exception_ptr(UrlEncoderServiceFullException("Error. Encoder service queues are full")));
+
+    return result;
+}
+
+std::future<std::string> UrlEncoderService::Decode(const quicr::Namespace& code)
+{
+    auto promise = std::make_shared<std::promise<std::string>>();
+    std::future<std::string> result = promise->get_future();
+
+    const bool queued = Decode(code, [promise](decode_result&& done) {
+        if (done.error)
+            promise->set_exception(done.error);
+        else
+            promise->set_value(std::move(done.url));
+    });
+
+    if (!queued)
+        promise->set_exception(
+            std::make_exception_ptr(UrlEncoderServiceFullException("Error. Encoder service queues are full")));
+
+    return result;
+}
+
+unsigned int UrlEncoderService::WorkerCount() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+UrlEncoderService::stats UrlEncoderService::GetStats() const
+{
+    stats totals;
+    totals.submitted = submitted.load(std::memory_order_relaxed);
+    totals.completed = completed.load(std::memory_order_relaxed);
+    totals.rejected = rejected.load(std::memory_order_relaxed);
+    totals.batches = batches.load(std::memory_order_relaxed);
+    return totals;
+}
+
+bool UrlEncoderService::Submit(Job&& job)
+{
+    // Pairs with Stop, either it waits for this submit or this sees stopping
+    submitting.fetch_add(1);
+    struct Leave
+    {
+        std::atomic<unsigned int>& count;
+        ~Leave()
+        {
+            count.fetch_sub(1, std::memory_order_release);
+        }
+    } leave{submitting};
+
+    if (stopping.load())
+    {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Spread the jobs round robin, and try the others when one is full
+    const size_t start = next_worker.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        Worker& worker = *workers[(start + i) % workers.size()];
+        if (!worker.queue.TryPush(std::move(job)))
+            continue;
+
+        submitted.fetch_add(1, std::memory_order_relaxed);
+
+        // Pairs with the fence in Run, either the worker sees the job or
+        // this sees that it's waiting
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (worker.waiting.load(std::memory_order_relaxed))
+        {
+            worker.signal.fetch_add(1, std::memory_order_release);
+            worker.signal.notify_one();
+        }
+        return true;
+    }
+
+    rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void UrlEncoderService::Run(Worker& worker)
+{
+    std::vector<Job> batch;
+    batch.reserve(opts.batch_size);
+    Job job;
+    while (true)
+    {
+        while (batch.size() < opts.batch_size && worker.queue.TryPop(job))
+            batch.push_back(std::move(job));
+
+        if (batch.empty())
+        {
+            // Whatever was queued before stopping is finished first
+            if (finished.load())
+                return;
+
+            const std::uint32_t signal = worker.signal.load(std::memory_order_acquire);
+            worker.waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (worker.queue.Empty() && !finished.load())
+                worker.signal.wait(signal, std::memory_order_acquire);
+            worker.waiting.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        // One encoder for the batch, a reload applies from the next one
+        const std::shared_ptr<const UrlEncoder> encoder = get_encoder();
+        for (auto& item : batch)
+        {
+            if (item.op == Job::Operation::Encode)
+            {
+                encode_result result;
+                try
+                {
+                    result.name = encoder->EncodeUrl(item.url);
+                }
+                catch (...)
+                {
+                    result.error = std::current_exception();
+                }
+                item.on_encode(std::move(result));
+            }
+            else
+            {
+                decode_result result;
+                try
+                {
+                    result.url = encoder->DecodeUrl(item.code);
+                }
+                catch (...)
+                {
+                    result.error = std::current_exception();
+                }
+                item.on_decode(std::move(result));
+            }
+        }
+
+        completed.fetch_add(batch.size(), std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        batch.clear();
+    }
+}
@@ -0,0 +1,204 @@
+#include <UrlEncoderTrace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+// One event in the ring. The sequence is odd while the event is written
+// and 2 * (index + 1) once it's done, so readers can skip torn events.
+struct Slot
+{
+    std::atomic<std::uint64_t> sequence = 0;
+    std::atomic<std::uint64_t> start_ns = 0;
+    std::atomic<std::uint64_t> duration_ns = 0;
+    std::atomic<std::uint64_t> thread_phase = 0;
+};
+
+struct Ring
+{
+    explicit Ring(size_t capacity) : capacity(capacity), slots(std::make_unique<Slot[]>(capacity))
+    {
+    }
+
+    const size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<std::uint64_t> head = 0;
+};
+
+std::atomic<UrlEncoderTrace::Callback> callback = nullptr;
+std::atomic<void*> callback_context = nullptr;
+std::atomic<Ring*> ring = nullptr;
+std::atomic<bool> active = false;
+
+// Rings are kept once made, a recording thread may still be writing to one
+// after it's stopped
+std::vector<std::unique_ptr<Ring>> rings;
+
+std::atomic<std::uint32_t> next_thread_id = 1;
+
+std::uint32_t ThreadId()
+{
+    thread_local const std::uint32_t id = next_thread_id++;
+    return id;
+}
+
+void UpdateActive()
+{
+    active = callback.load() != nullptr || ring.load() != nullptr;
+}
+} // namespace
+
+const char* UrlEncoderTrace::PhaseName(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::EncodeDispatch:
+        return "encode.dispatch";
+    case Phase::EncodeMatch:
+        return "encode.match";
+    case Phase::EncodeParse:
+        return "encode.parse";
+    case Phase::EncodeRangeCheck:
+        return "encode.range_check";
+    case Phase::EncodePack:
+        return "encode.pack";
+    case Phase::DecodeLookup:
+        return "decode.lookup";
+    case Phase::DecodeUnpack:
+        return "decode.unpack";
+    case Phase::DecodeFormat:
+        return "decode.format";
+    }
+
+    return "unknown";
+}
+
+void UrlEncoderTrace::SetCallback(Callback new_callback, void* context)
+{
+    callback_context = context;
+    callback = new_callback;
+    UpdateActive();
+}
+
+void UrlEncoderTrace::StartRing(size_t capacity)
+{
+    capacity = std::max<size_t>(capacity, 1);
+
+    Ring* current = ring.load();
+    if (!current || current->capacity != capacity)
+    {
+        rings.push_back(std::make_unique<Ring>(capacity));
+        current = rings.back().get();
+    }
+
+    current->head = 0;
+    for (size_t idx = 0; idx < capacity; idx++)
+        current->slots[idx].sequence = 0;
+
+    ring = current;
+    UpdateActive();
+}
+
+void UrlEncoderTrace::StopRing()
+{
+    ring = nullptr;
+    UpdateActive();
+}
+
+std::vector<UrlEncoderTrace::Event> UrlEncoderTrace::Collect()
+{
+    std::vector<Event> events;
+    const Ring* current = ring.load();
+    if (!current && !rings.empty())
+        current = rings.back().get();
+    if (!current)
+        return events;
+
+    const std::uint64_t head = current->head.load(std::memory_order_acquire);
+    const std::uint64_t first = head > current->capacity ? head - current->capacity : 0;
+    events.reserve(head - first);
+    for (std::uint64_t index = first; index < head; index++)
+    {
+        const Slot& slot = current->slots[index % current->capacity];
+        const std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != 2 * (index + 1))
+            continue;
+
+        Event event;
+        const std::uint64_t thread_phase = slot.thread_phase.load(std::memory_order_relaxed);
+        event.phase = static_cast<Phase>(thread_phase & 0xFF);
+        event.thread_id = static_cast<std::uint32_t>(thread_phase >> 8);
+        event.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+            events.push_back(event);
+    }
+
+    return events;
+}
+
+nlohmann::json UrlEncoderTrace::ToChromeTrace(const std::vector<Event>& events)
+{
+    nlohmann::json trace_events = nlohmann::json::array();
+    for (const auto& event : events)
+    {
+        // Complete events, times are in microseconds
+        trace_events.push_back({{"name", PhaseName(event.phase)},
+                                {"cat", "numero_uri"},
+                                {"ph", "X"},
+                                {"ts", event.start_ns / 1000.0},
+                                {"dur", event.duration_ns / 1000.0},
+                                {"pid", 1},
+                                {"tid", event.thread_id}});
+    }
+
+    return {{"traceEvents", trace_events}, {"displayTimeUnit", "ns"}};
+}
+
+void UrlEncoderTrace::WriteChromeTrace(std::ostream& out)
+{
+    out << ToChromeTrace(Collect()).dump() << std::endl;
+}
+
+bool UrlEncoderTrace::Active()
+{
+    return active.load(std::memory_order_relaxed);
+}
+
+void UrlEncoderTrace::Record(const Event& event)
+{
+    if (const Callback call = callback.load(std::memory_order_acquire))
+        call(event, callback_context.load(std::memory_order_relaxed));
+
+    Ring* current = ring.load(std::memory_order_acquire);
+    if (!current)
+        return;
+
+    const std::uint64_t index = current->head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = current->slots[index % current->capacity];
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.start_ns.store(event.start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(event.duration_ns, std::memory_order_relaxed);
+    slot.thread_phase.store((static_cast<std::uint64_t>(event.thread_id) << 8) |
+                                static_cast<std::uint8_t>(event.phase),
+                            std::memory_order_relaxed);
+    slot.sequence.store(2 * (index + 1), std::memory_order_release);
+}
+
+void UrlEncoderTrace::Phases::End()
+{
+    const auto end = std::chrono::steady_clock::now();
+
+    Event event;
+    event.phase = phase;
+    event.thread_id = ThreadId();
+    event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    Record(event);
+}
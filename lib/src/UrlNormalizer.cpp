@@ -0,0 +1,199 @@
+#include <UrlNormalizer.h>
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+char ToLower(char ch)
+{
+    return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch | 0x20) : ch;
+}
+
+bool IsSchemeChar(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '+' ||
+           ch == '-' || ch == '.';
+}
+
+bool IsUnreserved(char ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-' ||
+           ch == '.' || ch == '_' || ch == '~';
+}
+
+int HexValue(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+// Length of the run of bytes before the first that is a, b, c or d
+size_t FindAny(const char* in, size_t size, char a, char b, char c, char d)
+{
+    size_t idx = 0;
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vd = _mm_set1_epi8(d);
+    for (; idx + 16 <= size; idx += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + idx));
+        const __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, va), _mm_cmpeq_epi8(bytes, vb)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(bytes, vc), _mm_cmpeq_epi8(bytes, vd)));
+        const int mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+            return idx + std::countr_zero(static_cast<unsigned int>(mask));
+    }
+#endif
+    for (; idx < size; idx++)
+    {
+        const char ch = in[idx];
+        if (ch == a || ch == b || ch == c || ch == d)
+            return idx;
+    }
+
+    return size;
+}
+
+void CopyLower(const char* in, char* out, size_t size)
+{
+    size_t idx = 0;
+#if defined(__SSE2__)
+    const __m128i before_a = _mm_set1_epi8('A' - 1);
+    const __m128i after_z = _mm_set1_epi8('Z' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    for (; idx + 16 <= size; idx += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + idx));
+        const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, before_a), _mm_cmplt_epi8(bytes, after_z));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + idx),
+                         _mm_or_si128(bytes, _mm_and_si128(upper, case_bit)));
+    }
+#endif
+    for (; idx < size; idx++)
+        out[idx] = ToLower(in[idx]);
+}
+} // namespace
+
+size_t UrlNormalizer::Normalize(std::string_view url, char* out, const options& opts)
+{
+    const char* in = url.data();
+    const size_t size = url.size();
+    size_t pos = 0;
+    size_t len = 0;
+
+    auto copy = [&](size_t count, bool lower) {
+        if (lower)
+            CopyLower(in + pos, out + len, count);
+        else
+            std::memcpy(out + len, in + pos, count);
+        pos += count;
+        len += count;
+    };
+
+    // Writes a %XX escape, decoded if it's an unreserved character
+    auto escape = [&](bool lower) {
+        if (opts.decode_unreserved && pos + 2 < size && HexValue(in[pos + 1]) >= 0 && HexValue(in[pos + 2]) >= 0)
+        {
+            const char ch = static_cast<char>(HexValue(in[pos + 1]) * 16 + HexValue(in[pos + 2]));
+            if (IsUnreserved(ch))
+            {
+                out[len++] = lower ? ToLower(ch) : ch;
+                pos += 3;
+                return;
+            }
+        }
+
+        out[len++] = in[pos++];
+    };
+
+    enum class Part
+    {
+        Host,
+        Path,
+        Rest
+    };
+
+    // A scheme means a host follows, without one it's all path
+    Part part = Part::Path;
+    size_t scheme_end = 0;
+    while (scheme_end < size && IsSchemeChar(in[scheme_end]))
+        scheme_end++;
+
+    if (scheme_end > 0 && url.substr(scheme_end, 3) == "://")
+    {
+        copy(scheme_end + 3, opts.lowercase_host);
+        part = Part::Host;
+    }
+
+    size_t path_start = len;
+    auto end_path = [&]() {
+        if (opts.strip_trailing_slash && len > path_start && len > 1 && out[len - 1] == '/')
+            len--;
+    };
+
+    while (pos < size)
+    {
+        if (part == Part::Host)
+        {
+            copy(FindAny(in + pos, size - pos, '/', '?', '#', '%'), opts.lowercase_host);
+            if (pos < size && in[pos] == '%')
+            {
+                escape(opts.lowercase_host);
+                continue;
+            }
+
+            part = Part::Path;
+            path_start = len;
+            continue;
+        }
+
+        if (part == Part::Path)
+        {
+            copy(FindAny(in + pos, size - pos, '/', '?', '#', '%'), false);
+            if (pos == size)
+                break;
+
+            const char ch = in[pos];
+            if (ch == '/')
+            {
+                if (opts.collapse_slashes && len > path_start && out[len - 1] == '/')
+                    pos++;
+                else
+                    out[len++] = in[pos++];
+            }
+            else if (ch == '%')
+            {
+                escape(false);
+            }
+            else
+            {
+                end_path();
+                part = Part::Rest;
+            }
+            continue;
+        }
+
+        // The query and fragment are only decoded
+        copy(FindAny(in + pos, size - pos, '%', '%', '%', '%'), false);
+        if (pos < size)
+            escape(false);
+    }
+
+    if (part != Part::Rest)
+        end_path();
+
+    return len;
+}
@@ -0,0 +1,1261 @@
+#include <UrlPattern.h>
+
+#include "UrlPatternPlan.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <stdexcept>
+
+using namespace url_pattern_detail;
+
+namespace
+{
+// Slot patterns UrlEncoder::AddTemplate generates, and plain decimal
+constexpr std::string_view Numeric_Slot_Regex = "((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))";
+constexpr std::string_view Decimal_Slot_Regex = "(\\d+)";
+
+// Each key of a query block looks ahead for key=value anywhere in the query
+constexpr std::string_view Query_Key_Start = "(?=(?:.*&)?";
+constexpr std::string_view Query_Key_End = "(?:&|$))";
+
+// Escapes of letters and digits are classes or back references
+bool IsLiteralEscape(char ch)
+{
+    return !std::isalnum(static_cast<unsigned char>(ch));
+}
+
+// Gets the keys of a query block made by UrlPattern::QueryRegex, which ends
+// with the $
+bool ParseQuery(std::string_view block, std::vector<std::string>& keys, bool& allow_unknown)
+{
+    std::string_view rest = block;
+    if (!rest.starts_with("\\?"))
+        return false;
+    rest.remove_prefix(2);
+
+    while (rest.starts_with(Query_Key_Start))
+    {
+        rest.remove_prefix(Query_Key_Start.size());
+
+        std::string key;
+        while (!rest.empty() && rest.front() != '=')
+        {
+            if (rest.front() == '\\')
+                rest.remove_prefix(1);
+            if (!rest.empty())
+                key += rest.front();
+            rest.remove_prefix(std::min<size_t>(1, rest.size()));
+        }
+
+        if (!UrlPattern::IsName(key) || std::find(keys.begin(), keys.end(), key) != keys.end())
+            return false;
+        keys.push_back(std::move(key));
+
+        rest.remove_prefix(std::min<size_t>(1, rest.size()));
+        if (!rest.starts_with(Numeric_Slot_Regex))
+            return false;
+        rest.remove_prefix(Numeric_Slot_Regex.size());
+
+        if (!rest.starts_with(Query_Key_End))
+            return false;
+        rest.remove_prefix(Query_Key_End.size());
+    }
+
+    if (keys.empty() || keys.size() > UrlPattern::Max_Slots)
+        return false;
+
+    // Whatever follows the keys has to be exactly what QueryRegex writes
+    for (const bool unknown : {true, false})
+    {
+        if (block == UrlPattern::QueryRegex(keys, unknown) + '$')
+        {
+            allow_unknown = unknown;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Number of values a query chunk captures
+size_t QueryKeyCount(std::string_view block)
+{
+    std::vector<std::string> keys;
+    bool allow_unknown = false;
+    ParseQuery(block, keys, allow_unknown);
+    return keys.size();
+}
+
+constexpr Alphabet MakeAlphabet(std::string_view name,
+                                std::string_view chars,
+                                std::string_view regex_class,
+                                std::uint32_t bits)
+{
+    Alphabet alphabet{name, chars, regex_class, bits, {}};
+    for (auto& code : alphabet.codes)
+        code = -1;
+    for (size_t idx = 0; idx < chars.size(); idx++)
+        alphabet.codes[static_cast<unsigned char>(chars[idx])] = static_cast<std::int8_t>(idx);
+
+    return alphabet;
+}
+
+// Base32 of RFC 4648 in lowercase, and its url safe base64
+constexpr std::array<Alphabet, 2> Alphabets = {
+    MakeAlphabet("b32", "abcdefghijklmnopqrstuvwxyz234567", "[a-z2-7]", 5),
+    MakeAlphabet("b64", "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_", "[A-Za-z0-9_-]", 6)};
+
+const Alphabet* FindAlphabet(std::string_view name)
+{
+    for (const auto& alphabet : Alphabets)
+    {
+        if (alphabet.name == name)
+            return &alphabet;
+    }
+
+    return nullptr;
+}
+
+// Gets the alphabet and most characters of a group made by
+// UrlPattern::StringRegex
+const Alphabet* ParseString(std::string_view group, size_t& length)
+{
+    for (const auto& alphabet : Alphabets)
+    {
+        const std::string start = "(" + std::string(alphabet.regex_class) + "{1,";
+        if (!group.starts_with(start) || !group.ends_with("})"))
+            continue;
+
+        const std::string_view digits = group.substr(start.size(), group.size() - start.size() - 2);
+        length = 0;
+        for (const char ch : digits)
+        {
+            if (!IsDigit(ch) || length > UrlPattern::Max_String)
+                return nullptr;
+            length = length * 10 + (ch - '0');
+        }
+
+        const bool fits = !digits.empty() && digits.front() != '0' && length <= UrlPattern::Max_String &&
+                          UrlPattern::StringBits(alphabet.name, length) != 0;
+        return fits ? &alphabet : nullptr;
+    }
+
+    return nullptr;
+}
+
+// Gets the names of a group made by UrlPattern::EnumRegex
+bool ParseEnum(std::string_view group, std::vector<std::string>& names)
+{
+    if (group.size() < 3 || group.front() != '(' || group.back() != ')' || group[1] == '?')
+        return false;
+
+    std::string name;
+    for (size_t idx = 1; idx < group.size(); idx++)
+    {
+        const char ch = group[idx];
+        if (ch == '|' || idx + 1 == group.size())
+        {
+            if (!UrlPattern::IsName(name) || std::find(names.begin(), names.end(), name) != names.end())
+                return false;
+            names.push_back(std::move(name));
+            name.clear();
+        }
+        else if (ch == '\\')
+        {
+            if (++idx + 1 >= group.size() || group[idx] != '.')
+                return false;
+            name += group[idx];
+        }
+        else if (ch == '.')
+        {
+            // An unescaped . matches any character, not a name
+            return false;
+        }
+        else
+        {
+            name += ch;
+        }
+    }
+
+    return names.size() <= UrlPattern::Max_Names;
+}
+
+// Number of capturing groups in the text of a group chunk, nested ones
+// included
+size_t CaptureGroups(std::string_view text)
+{
+    size_t count = 0;
+    for (size_t idx = 0; idx < text.size(); idx++)
+    {
+        if (text[idx] == '\\')
+        {
+            idx++;
+        }
+        else if (text[idx] == '[')
+        {
+            const size_t close = text.find(']', idx + 1);
+            if (close == std::string_view::npos)
+                break;
+            idx = close;
+        }
+        else if (text[idx] == '(' && (idx + 1 >= text.size() || text[idx + 1] != '?'))
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+// True for text of only literal bytes, escapes and '.'
+bool IsPlain(std::string_view text)
+{
+    for (size_t idx = 0; idx < text.size(); idx++)
+    {
+        const char ch = text[idx];
+        if (ch == '\\')
+        {
+            if (++idx >= text.size() || !IsLiteralEscape(text[idx]))
+                return false;
+        }
+        else if (std::string_view("^$()[]{}*+?|").find(ch) != std::string_view::npos)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * True if a literal chunk only uses the syntax the chunk matcher knows:
+ * literal bytes, escapes, '.', optional "(?:...)?" groups of those, and the
+ * anchors at the very start and end of the pattern.
+ */
+bool IsNativeLiteral(std::string_view text, bool first, bool last)
+{
+    for (size_t idx = 0; idx < text.size(); idx++)
+    {
+        const char ch = text[idx];
+        if (ch == '\\')
+        {
+            if (++idx >= text.size() || !IsLiteralEscape(text[idx]))
+                return false;
+        }
+        else if (ch == '^')
+        {
+            if (!first || idx != 0)
+                return false;
+        }
+        else if (ch == '$')
+        {
+            if (!last || idx != text.size() - 1)
+                return false;
+        }
+        else if (ch == '(')
+        {
+            const size_t close = FindClose(text, idx);
+            if (close == std::string_view::npos || text.substr(idx, 3) != "(?:" || close + 1 >= text.size() ||
+                text[close + 1] != '?' || !IsPlain(text.substr(idx + 3, close - idx - 3)))
+                return false;
+
+            idx = close + 1;
+        }
+        else if (std::string_view(")[]{}*+?|").find(ch) != std::string_view::npos)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Appends plain text unescaped, with '\0' for each '.'
+void AppendPlain(std::string_view text, std::string& bytes)
+{
+    for (size_t idx = 0; idx < text.size(); idx++)
+    {
+        if (text[idx] == '.')
+            bytes += '\0';
+        else
+            bytes += text[idx] == '\\' ? text[++idx] : text[idx];
+    }
+}
+
+/*
+ * Writes the text of a template regex, skipping regex syntax and optional
+ * groups, and notes where each capturing group was. This is how urls have
+ * always been decoded, which patterns that aren't native still use.
+ */
+void AppendDecoded(std::string_view reg, std::string& decoded, std::vector<size_t>* group_indices)
+{
+    size_t idx = 0;
+    char ch;
+    size_t find = 0;
+    while (idx < reg.size())
+    {
+        ch = reg[idx];
+
+        // Find and ignore optional brackets
+        if (ch == '[')
+        {
+            find = reg.find(']', idx);
+            if (find != std::string::npos)
+            {
+                idx = find + 1;
+                continue;
+            }
+        }
+
+        // Find groups and make note of them
+        if (ch == '(')
+        {
+
+            find = reg.find(')', idx);
+            // Check the next couple characters for non matching-groups
+            if (idx + 3 < reg.size() && reg[idx + 1] == '?' && reg[idx + 2] == ':')
+            {
+                // Find the closing bracket for this optional group
+                idx = find + 1;
+                continue;
+            }
+
+            if (find != std::string::npos)
+            {
+                if (group_indices)
+                    group_indices->push_back(decoded.length());
+                idx = find + 1;
+                continue;
+            }
+        }
+
+        // Skip over ?, ^, $, \, ), +, |
+        if (ch == '?' || ch == '^' || ch == '$' || ch == '\\' || ch == ')' || ch == '+' || ch == '|')
+        {
+            ++idx;
+            continue;
+        }
+
+        decoded += ch;
+        ++idx;
+    }
+}
+} // namespace
+
+UrlPattern::UrlPattern(const UrlPattern& other, allocator_type alloc)
+    : chunks(other.chunks, alloc), slots(other.slots), native(other.native)
+{
+    if (other.pool)
+    {
+        auto own = std::make_shared<LiteralPool>(alloc.resource());
+        for (auto& chunk : chunks)
+            chunk = WithId(chunk, own->Intern(other.Text(chunk)));
+        pool = std::move(own);
+    }
+}
+
+UrlPattern::UrlPattern(std::string_view regex, const std::shared_ptr<LiteralPool>& pool, allocator_type alloc)
+    : pool(pool), chunks(alloc)
+{
+    // A query from QueryRegex is one chunk at the end
+    std::vector<std::string> query_keys;
+    bool allow_unknown = false;
+    std::string_view query;
+    if (const size_t query_start = regex.find(std::string("\\?") + std::string(Query_Key_Start));
+        query_start != std::string_view::npos && ParseQuery(regex.substr(query_start), query_keys, allow_unknown))
+    {
+        query = regex.substr(query_start);
+        regex = regex.substr(0, query_start);
+    }
+
+    auto add_literal = [&](size_t start, size_t end) {
+        if (end > start)
+            chunks.push_back(pool->Intern(regex.substr(start, end - start)));
+    };
+
+    // Split before each '/' and around capturing groups
+    size_t start = 0;
+    size_t pos = 0;
+    while (pos < regex.size())
+    {
+        const char ch = regex[pos];
+        if (ch == '\\')
+        {
+            pos += 2;
+            continue;
+        }
+
+        if (ch == '(' || ch == '[')
+        {
+            size_t close = ch == '(' ? FindClose(regex, pos) : regex.find(']', pos + 1);
+            if (close == std::string_view::npos)
+                break;
+
+            if (ch == '(' && (pos + 1 >= regex.size() || regex[pos + 1] != '?'))
+            {
+                add_literal(start, pos);
+
+                const std::string_view group = regex.substr(pos, close - pos + 1);
+                std::vector<std::string> names;
+                size_t length = 0;
+                const Kind kind = group == Numeric_Slot_Regex   ? Numeric_Slot
+                                  : group == Decimal_Slot_Regex ? Decimal_Slot
+                                  : ParseEnum(group, names)     ? Enum_Slot
+                                  : ParseString(group, length)  ? String_Slot
+                                                                : Group;
+                chunks.push_back(pool->Intern(group) | (kind << Kind_Shift));
+                start = close + 1;
+            }
+
+            pos = close + 1;
+            continue;
+        }
+
+        if (ch == '/' && pos > start)
+        {
+            add_literal(start, pos);
+            start = pos;
+        }
+
+        pos++;
+    }
+    add_literal(start, regex.size());
+
+    if (!query.empty())
+        chunks.push_back(pool->Intern(query) | (Query << Kind_Shift));
+
+    Classify();
+}
+
+UrlPattern::UrlPattern(std::span<const std::uint32_t> refs,
+                       const std::shared_ptr<LiteralPool>& pool,
+                       allocator_type alloc)
+    : pool(pool), chunks(refs.begin(), refs.end(), alloc)
+{
+    for (const auto chunk : chunks)
+    {
+        if (KindOf(chunk) > String_Slot || (chunk & Id_Mask) >= pool->Size())
+            throw std::invalid_argument("Error. Bad chunk reference " + std::to_string(chunk));
+
+        // The text has to parse as its kind, matching and formatting take
+        // the names, alphabet and keys of a slot from it
+        const std::string_view text = Text(chunk);
+        std::vector<std::string> names;
+        size_t length = 0;
+        bool allow_unknown = false;
+        bool fits = true;
+        switch (KindOf(chunk))
+        {
+        case Literal:
+            break;
+        case Numeric_Slot:
+            fits = text == Numeric_Slot_Regex;
+            break;
+        case Decimal_Slot:
+            fits = text == Decimal_Slot_Regex;
+            break;
+        case Group:
+            fits = text.size() >= 2 && text.front() == '(' && text.back() == ')';
+            break;
+        case Query:
+            fits = ParseQuery(text, names, allow_unknown);
+            break;
+        case Enum_Slot:
+            fits = ParseEnum(text, names);
+            break;
+        case String_Slot:
+            fits = ParseString(text, length) != nullptr;
+            break;
+        }
+
+        if (!fits)
+            throw std::invalid_argument("Error. Chunk " + std::string(text) + " isn't of its kind");
+    }
+
+    Classify();
+}
+
+size_t UrlPattern::ValueCount() const
+{
+    if (native)
+        return slots;
+
+    size_t count = 0;
+    for (const auto chunk : chunks)
+    {
+        switch (KindOf(chunk))
+        {
+        case Literal:
+            break;
+        case Group:
+            count += CaptureGroups(Text(chunk));
+            break;
+        case Query:
+            count += QueryKeyCount(Text(chunk));
+            break;
+        default:
+            count++;
+            break;
+        }
+    }
+
+    return count;
+}
+
+void UrlPattern::Classify()
+{
+    // Check whether the chunks can be matched without std::regex
+    native = true;
+    size_t slot_count = 0;
+    for (size_t idx = 0; idx < chunks.size(); idx++)
+    {
+        switch (KindOf(chunks[idx]))
+        {
+        case Literal:
+            native = native && IsNativeLiteral(Text(chunks[idx]), idx == 0, idx + 1 == chunks.size());
+            break;
+        case Numeric_Slot:
+        case Decimal_Slot:
+        case Enum_Slot:
+        case String_Slot:
+            slot_count++;
+            break;
+        case Group:
+            native = false;
+            break;
+        case Query:
+            slot_count += QueryKeyCount(Text(chunks[idx]));
+            break;
+        }
+    }
+
+    native = native && slot_count <= Max_Slots;
+    slots = native ? static_cast<std::uint16_t>(slot_count) : 0;
+}
+
+std::string UrlPattern::QueryRegex(std::span<const std::string> keys, bool allow_unknown)
+{
+    auto escaped = [](std::string_view key) {
+        std::string text;
+        for (const char ch : key)
+        {
+            if (ch == '.')
+                text += '\\';
+            text += ch;
+        }
+        return text;
+    };
+
+    std::string regex = "\\?";
+    std::string names;
+    for (const auto& key : keys)
+    {
+        regex += Query_Key_Start;
+        regex += escaped(key);
+        regex += '=';
+        regex += Numeric_Slot_Regex;
+        regex += Query_Key_End;
+
+        names += (names.empty() ? "" : "|") + escaped(key);
+    }
+
+    // Then consume the query, which without unknowns is only the keys
+    if (allow_unknown)
+    {
+        regex += ".*";
+    }
+    else
+    {
+        const std::string param = "(?:" + names + ")=[^&]*";
+        regex += param + "(?:&" + param + ")*";
+    }
+
+    return regex;
+}
+
+std::string UrlPattern::EnumRegex(std::span<const std::string> names)
+{
+    std::string regex = "(";
+    for (const auto& name : names)
+    {
+        if (regex.size() > 1)
+            regex += '|';
+
+        for (const char ch : name)
+        {
+            if (ch == '.')
+                regex += '\\';
+            regex += ch;
+        }
+    }
+
+    return regex + ')';
+}
+
+std::string UrlPattern::StringRegex(std::string_view alphabet, size_t length)
+{
+    const Alphabet* found = FindAlphabet(alphabet);
+    if (!found || StringBits(alphabet, length) == 0)
+        return {};
+
+    return "(" + std::string(found->regex_class) + "{1," + std::to_string(length) + "})";
+}
+
+std::uint32_t UrlPattern::StringBits(std::string_view alphabet, size_t length)
+{
+    const Alphabet* found = FindAlphabet(alphabet);
+    if (!found || length == 0 || length > Max_String)
+        return 0;
+
+    const std::uint32_t bits = std::bit_width(length) + found->bits * length;
+    return bits <= 64 ? bits : 0;
+}
+
+bool UrlPattern::IsName(std::string_view name)
+{
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || ch == '-' || ch == '.' || ch == '_' || ch == '~';
+    });
+}
+
+UrlPattern& UrlPattern::operator=(const UrlPattern& other)
+{
+    if (this != &other)
+    {
+        UrlPattern copy(other, chunks.get_allocator());
+        pool = std::move(copy.pool);
+        chunks = std::move(copy.chunks);
+        slots = other.slots;
+        native = other.native;
+        delete plan.exchange(nullptr);
+    }
+
+    return *this;
+}
+
+UrlPattern& UrlPattern::operator=(UrlPattern&& other)
+{
+    if (this != &other)
+    {
+        pool = std::move(other.pool);
+        chunks = std::move(other.chunks);
+        slots = other.slots;
+        native = other.native;
+        delete plan.exchange(other.plan.exchange(nullptr));
+    }
+
+    return *this;
+}
+
+UrlPattern::~UrlPattern()
+{
+    delete plan.load();
+}
+
+std::string UrlPattern::str() const
+{
+    std::string regex;
+    regex.reserve(size());
+    for (const auto chunk : chunks)
+        regex += Text(chunk);
+
+    return regex;
+}
+
+size_t UrlPattern::size() const
+{
+    size_t length = 0;
+    for (const auto chunk : chunks)
+        length += Text(chunk).size();
+
+    return length;
+}
+
+UrlPattern::Prefix UrlPattern::LiteralPrefix() const
+{
+    Prefix prefix;
+    if (!native)
+        return prefix;
+
+    for (const auto chunk : chunks)
+    {
+        if (KindOf(chunk) != Literal)
+            return prefix;
+
+        const std::string_view text = Text(chunk);
+        for (size_t idx = 0; idx < text.size(); idx++)
+        {
+            if (prefix.bytes.size() == Max_Prefix)
+                return prefix;
+
+            const char ch = text[idx];
+            if (ch == '^')
+                continue;
+            if (ch == '(' || ch == '$')
+                return prefix;
+
+            if (ch == '.')
+            {
+                prefix.wildcards |= 1ull << prefix.bytes.size();
+                prefix.bytes += '\0';
+            }
+            else
+            {
+                prefix.bytes += ch == '\\' ? text[++idx] : ch;
+            }
+        }
+    }
+
+    return prefix;
+}
+
+bool UrlPattern::Disjoint(const UrlPattern& other) const
+{
+    if (!native || !other.native)
+        return false;
+
+    // Where a walk of the pattern is, and what has to come next there
+    struct Cursor
+    {
+        const UrlPattern& pattern;
+        size_t chunk = 0;
+        size_t offset = 0;
+
+        enum class Next
+        {
+            Byte,
+            Any_Byte,
+            Slot,
+            End,
+            Unknown
+        };
+
+        Next Peek(char& byte, Kind& kind)
+        {
+            for (; chunk < pattern.chunks.size(); chunk++, offset = 0)
+            {
+                kind = KindOf(pattern.chunks[chunk]);
+                if (kind == Query)
+                    return Next::Unknown;
+                if (kind != Literal)
+                    return Next::Slot;
+
+                const std::string_view text = pattern.Text(pattern.chunks[chunk]);
+                while (offset < text.size() && (text[offset] == '^' || text[offset] == '$'))
+                    offset++;
+                if (offset == text.size())
+                    continue;
+
+                // An optional group may or may not be there
+                byte = text[offset];
+                if (byte == '(')
+                    return Next::Unknown;
+                if (byte == '.')
+                    return Next::Any_Byte;
+                if (byte == '\\')
+                    byte = text[offset + 1];
+                return Next::Byte;
+            }
+
+            return Next::End;
+        }
+
+        void Skip()
+        {
+            const std::uint32_t ref = pattern.chunks[chunk];
+            if (KindOf(ref) != Literal)
+            {
+                chunk++;
+                offset = 0;
+            }
+            else
+            {
+                offset += pattern.Text(ref)[offset] == '\\' ? 2 : 1;
+            }
+        }
+    };
+
+    // Every byte of a slot's value is one of these. Enum names and both
+    // string alphabets only hold name bytes.
+    auto in_class = [](Kind kind, char ch) {
+        if (kind == Numeric_Slot)
+            return IsHex(ch) || ch == 'x';
+        if (kind == Decimal_Slot)
+            return IsDigit(ch);
+        return IsName(std::string_view(&ch, 1));
+    };
+
+    using Next = Cursor::Next;
+    Cursor mine{*this};
+    Cursor theirs{other};
+
+    // Walk both while they're at the same place in every url they match
+    while (true)
+    {
+        char my_byte = 0;
+        char their_byte = 0;
+        Kind my_kind = Literal;
+        Kind their_kind = Literal;
+        const Next my_next = mine.Peek(my_byte, my_kind);
+        const Next their_next = theirs.Peek(their_byte, their_kind);
+
+        if (my_next == Next::Unknown || their_next == Next::Unknown)
+            return false;
+        if (my_next == Next::End || their_next == Next::End)
+            return my_next != their_next;
+
+        if (my_next != Next::Slot && their_next != Next::Slot)
+        {
+            if (my_next == Next::Byte && their_next == Next::Byte && my_byte != their_byte)
+                return true;
+
+            mine.Skip();
+            theirs.Skip();
+            continue;
+        }
+
+        // A byte where a slot must take at least one of its class
+        if (my_next != Next::Slot || their_next != Next::Slot)
+        {
+            const Kind kind = my_next == Next::Slot ? my_kind : their_kind;
+            const bool is_byte = my_next == Next::Byte || their_next == Next::Byte;
+            return is_byte && !in_class(kind, my_next == Next::Slot ? their_byte : my_byte);
+        }
+
+        // Each slot takes the whole run of bytes of their classes when what
+        // follows both can't be one of them, so both end in the same place
+        mine.Skip();
+        theirs.Skip();
+        for (Cursor* cursor : {&mine, &theirs})
+        {
+            char byte = 0;
+            Kind kind = Literal;
+            const Next next = cursor->Peek(byte, kind);
+            if (next != Next::End && (next != Next::Byte || in_class(my_kind, byte) || in_class(their_kind, byte)))
+                return false;
+        }
+    }
+}
+
+bool UrlPattern::SplitAuthority(std::string_view url, bool whole, std::string_view& authority)
+{
+    // The same scheme bytes the normalizer uses. Plain compares, this runs
+    // on every url the prefilter checks.
+    size_t scheme_end = 0;
+    while (scheme_end < url.size())
+    {
+        const char ch = url[scheme_end];
+        if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '+' ||
+              ch == '-' || ch == '.'))
+            break;
+        scheme_end++;
+    }
+
+    authority = {};
+    if (url.empty())
+        return whole;
+
+    const std::string_view rest = url.substr(scheme_end);
+    if (scheme_end == 0 || (!rest.empty() && !std::string_view("://").starts_with(rest.substr(0, 3))))
+        return true;
+
+    if (rest.size() < 3)
+        return whole;
+
+    const size_t start = scheme_end + 3;
+    size_t end = start;
+    while (end < url.size() && url[end] != '/' && url[end] != '?' && url[end] != '#')
+        end++;
+
+    if (end == url.size() && !whole)
+        return false;
+
+    authority = url.substr(start, end - start);
+    return true;
+}
+
+bool UrlPattern::Authorities(std::vector<std::string>& authorities) const
+{
+    if (!native)
+        return false;
+
+    // The literals up to the first slot, the url ends with them when every
+    // chunk is one
+    std::string text;
+    size_t literal_chunks = 0;
+    while (literal_chunks < chunks.size() && KindOf(chunks[literal_chunks]) == Literal)
+        text += Text(chunks[literal_chunks++]);
+    const bool whole = literal_chunks == chunks.size();
+
+    std::vector<std::string> found;
+    auto expand = [&](auto& self, size_t offset, std::string url) -> bool {
+        std::string_view authority;
+        while (!SplitAuthority(url, false, authority))
+        {
+            if (offset == text.size())
+            {
+                if (!whole)
+                    return false;
+
+                SplitAuthority(url, true, authority);
+                break;
+            }
+
+            const char ch = text[offset];
+            if (ch == '^' || ch == '$')
+            {
+                offset++;
+            }
+            else if (ch == '(')
+            {
+                // Once with the optional group and once without
+                const size_t close = FindClose(text, offset);
+                std::string with = url;
+                for (size_t idx = offset + 3; idx < close; idx++)
+                {
+                    if (text[idx] == '.')
+                        with += '\0';
+                    else
+                        with += text[idx] == '\\' ? text[++idx] : text[idx];
+                }
+
+                return self(self, close + 2, std::move(with)) && self(self, close + 2, std::move(url));
+            }
+            else if (ch == '.')
+            {
+                url += '\0';
+                offset++;
+            }
+            else
+            {
+                url += ch == '\\' ? text[++offset] : ch;
+                offset++;
+            }
+        }
+
+        // A wildcard before the authority could be the :// or a slash, so
+        // the authority of a url may start somewhere else. Without a scheme
+        // the authority is empty and has no data.
+        const size_t start = authority.data() ? static_cast<size_t>(authority.data() - url.data()) : url.size();
+        if (url.find('\0') < start)
+            return false;
+
+        if (found.size() == Max_Authorities)
+            return false;
+
+        if (std::find(found.begin(), found.end(), authority) == found.end())
+            found.emplace_back(authority);
+        return true;
+    };
+
+    if (!expand(expand, 0, std::string()))
+        return false;
+
+    authorities.insert(authorities.end(), found.begin(), found.end());
+    return true;
+}
+
+void UrlPattern::LengthRange(size_t& min_length, size_t& max_length) const
+{
+    min_length = 0;
+    max_length = 0;
+    if (!native)
+    {
+        max_length = SIZE_MAX;
+        return;
+    }
+
+    auto add_max = [&](size_t length) { max_length = length > SIZE_MAX - max_length ? SIZE_MAX : max_length + length; };
+
+    for (const auto chunk : chunks)
+    {
+        const std::string_view text = Text(chunk);
+        switch (KindOf(chunk))
+        {
+        case Literal:
+            for (size_t idx = 0; idx < text.size(); idx++)
+            {
+                if (text[idx] == '^' || text[idx] == '$')
+                    continue;
+
+                // An optional group adds to the longest only
+                if (text[idx] == '(')
+                {
+                    const size_t close = FindClose(text, idx);
+                    for (idx += 3; idx < close; idx++)
+                    {
+                        idx += text[idx] == '\\';
+                        add_max(1);
+                    }
+                    idx++;
+                    continue;
+                }
+
+                idx += text[idx] == '\\';
+                min_length++;
+                add_max(1);
+            }
+            break;
+        case Enum_Slot:
+        {
+            std::vector<std::string> names;
+            ParseEnum(text, names);
+            size_t shortest = SIZE_MAX;
+            size_t longest = 0;
+            for (const auto& name : names)
+            {
+                shortest = std::min(shortest, name.size());
+                longest = std::max(longest, name.size());
+            }
+            min_length += names.empty() ? 0 : shortest;
+            add_max(longest);
+            break;
+        }
+        case String_Slot:
+        {
+            size_t length = 0;
+            ParseString(text, length);
+            min_length++;
+            add_max(length);
+            break;
+        }
+        default:
+            // Numbers may have any number of leading zeros
+            min_length++;
+            max_length = SIZE_MAX;
+            break;
+        }
+    }
+}
+
+bool UrlPattern::Steps(std::vector<Step>& steps) const
+{
+    if (!native)
+        return false;
+
+    const Plan& compiled = GetPlan();
+    std::vector<Step> found;
+    size_t slot = 0;
+    for (const auto chunk : chunks)
+    {
+        const std::string_view text = Text(chunk);
+        switch (KindOf(chunk))
+        {
+        case Literal:
+            for (size_t idx = 0; idx < text.size();)
+            {
+                if (text[idx] == '^' || text[idx] == '$')
+                {
+                    idx++;
+                    continue;
+                }
+
+                if (text[idx] == '(')
+                {
+                    const size_t close = FindClose(text, idx);
+                    Step& step = found.emplace_back();
+                    step.type = Step::Type::Optional_Text;
+                    AppendPlain(text.substr(idx + 3, close - idx - 3), step.text);
+                    idx = close + 2;
+                    continue;
+                }
+
+                // Text split across chunks is one step
+                const size_t end = PlainEnd(text, idx);
+                if (found.empty() || found.back().type != Step::Type::Text)
+                    found.emplace_back();
+                AppendPlain(text.substr(idx, end - idx), found.back().text);
+                idx = end;
+            }
+            break;
+        case Numeric_Slot:
+        case Decimal_Slot:
+            found.emplace_back().type = KindOf(chunk) == Numeric_Slot ? Step::Type::Number : Step::Type::Decimal;
+            slot++;
+            break;
+        case Enum_Slot:
+        {
+            Step& step = found.emplace_back();
+            step.type = Step::Type::Enum;
+            step.names = compiled.text[slot++].names.keys;
+            break;
+        }
+        case String_Slot:
+        {
+            const Plan::TextSlot& encoding = compiled.text[slot++];
+            Step& step = found.emplace_back();
+            step.type = Step::Type::String;
+            step.alphabet = encoding.alphabet->chars;
+            step.char_bits = encoding.alphabet->bits;
+            step.length = encoding.length;
+            break;
+        }
+        case Group:
+        case Query:
+            return false;
+        }
+    }
+
+    steps = std::move(found);
+    return true;
+}
+
+std::span<const std::string> UrlPattern::Pieces() const
+{
+    return GetPlan().pieces;
+}
+
+void UrlPattern::Compile() const
+{
+    GetPlan();
+}
+
+const UrlPattern::Plan& UrlPattern::GetPlan() const
+{
+    if (const Plan* compiled = plan.load(std::memory_order_acquire))
+        return *compiled;
+
+    auto built = std::make_unique<Plan>();
+    if (native)
+    {
+        built->pieces.emplace_back();
+        for (const auto chunk : chunks)
+        {
+            if (KindOf(chunk) == Literal)
+            {
+                AppendDecoded(Text(chunk), built->pieces.back(), nullptr);
+            }
+            else if (KindOf(chunk) == Query)
+            {
+                // Written with the keys in the template's order
+                ParseQuery(Text(chunk), built->query.keys, built->query.allow_unknown);
+                built->query.Build();
+                built->text.resize(built->text.size() + built->query.keys.size());
+                for (size_t idx = 0; idx < built->query.keys.size(); idx++)
+                {
+                    built->pieces.back() += (idx == 0 ? "?" : "&") + built->query.keys[idx] + '=';
+                    built->pieces.emplace_back();
+                }
+            }
+            else
+            {
+                // The names of an enum slot, by index for Format and hashed
+                // for TextValue
+                Plan::TextSlot& text = built->text.emplace_back();
+                if (KindOf(chunk) == Enum_Slot)
+                {
+                    ParseEnum(Text(chunk), text.names.keys);
+                    text.names.Build();
+                }
+                else if (KindOf(chunk) == String_Slot)
+                {
+                    text.alphabet = ParseString(Text(chunk), text.length);
+                }
+
+                built->pieces.emplace_back();
+            }
+        }
+    }
+    else
+    {
+        // Throws before the plan is stored, so every use of a pattern
+        // std::regex rejects throws again
+        const std::string regex = str();
+        built->regex = std::make_unique<const std::regex>(regex);
+
+        std::string decoded;
+        std::vector<size_t> group_indices;
+        AppendDecoded(regex, decoded, &group_indices);
+
+        size_t start = 0;
+        for (const size_t idx : group_indices)
+        {
+            built->pieces.push_back(decoded.substr(start, idx - start));
+            start = idx;
+        }
+        built->pieces.push_back(decoded.substr(start));
+    }
+
+    // Another thread may have got there first, then use its plan
+    const Plan* expected = nullptr;
+    if (plan.compare_exchange_strong(expected, built.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+        return *built.release();
+
+    return *expected;
+}
+
+bool UrlPattern::Format(std::string& decoded, std::span<const std::uint64_t> values) const
+{
+    const Plan& compiled = GetPlan();
+
+    decoded += compiled.pieces.front();
+    for (size_t i = 1; i < compiled.pieces.size(); i++)
+    {
+        if (i <= values.size())
+        {
+            const std::uint64_t value = values[i - 1];
+            const Plan::TextSlot* encoding = i - 1 < compiled.text.size() ? &compiled.text[i - 1] : nullptr;
+            if (encoding && encoding->alphabet)
+            {
+                const std::uint32_t bits = encoding->alphabet->bits;
+                const std::uint64_t length = value >> (bits * encoding->length);
+                if (length == 0 || length > encoding->length)
+                    return false;
+
+                for (size_t idx = 0; idx < length; idx++)
+                {
+                    const size_t shift = bits * (encoding->length - 1 - idx);
+                    decoded += encoding->alphabet->chars[(value >> shift) & ((1u << bits) - 1)];
+                }
+            }
+            else if (encoding && !encoding->names.keys.empty())
+            {
+                const std::vector<std::string>& names = encoding->names.keys;
+                if (value >= names.size())
+                    return false;
+                decoded += names[value];
+            }
+            else
+            {
+                decoded += std::to_string(value);
+            }
+        }
+        decoded += compiled.pieces[i];
+    }
+
+    return true;
+}
+
+void UrlPattern::MoveTo(const std::shared_ptr<LiteralPool>& new_pool)
+{
+    for (auto& chunk : chunks)
+        chunk = WithId(chunk, new_pool->Intern(Text(chunk)));
+
+    pool = new_pool;
+}
+
+bool operator==(const UrlPattern& pattern, std::string_view regex)
+{
+    for (const auto chunk : pattern.chunks)
+    {
+        const std::string_view text = pattern.Text(chunk);
+        if (regex.substr(0, text.size()) != text)
+            return false;
+        regex.remove_prefix(text.size());
+    }
+
+    return regex.empty();
+}
+
+std::ostream& operator<<(std::ostream& out, const UrlPattern& pattern)
+{
+    for (const auto chunk : pattern.chunks)
+        out << pattern.Text(chunk);
+
+    return out;
+}
@@ -0,0 +1,289 @@
+#include <UrlPattern.h>
+
+#include "UrlPatternPlan.h"
+
+#include <bit>
+#include <bitset>
+
+using namespace url_pattern_detail;
+
+void UrlPattern::Plan::KeyTable::Build()
+{
+    lengths.clear();
+    for (const auto& key : keys)
+    {
+        if (std::find(lengths.begin(), lengths.end(), key.size()) == lengths.end())
+            lengths.push_back(key.size());
+    }
+
+    // Try a few seeds at each size, doubling it a few times
+    const size_t max_size = std::bit_ceil(keys.size()) * 16;
+    for (size_t size = std::bit_ceil(keys.size()); size <= max_size; size *= 2)
+    {
+        for (seed = 0; seed < 64; seed++)
+        {
+            table.assign(size, Empty);
+            bool perfect = true;
+            for (size_t idx = 0; idx < keys.size() && perfect; idx++)
+            {
+                std::uint8_t& entry = table[HashKey(keys[idx], seed) & (size - 1)];
+                perfect = entry == Empty;
+                entry = static_cast<std::uint8_t>(idx);
+            }
+
+            if (perfect)
+                return;
+        }
+    }
+
+    table.clear();
+}
+
+size_t UrlPattern::Plan::KeyTable::Find(std::string_view key) const
+{
+    if (table.empty())
+        return std::find(keys.begin(), keys.end(), key) - keys.begin();
+
+    const std::uint8_t idx = table[HashKey(key, seed) & (table.size() - 1)];
+    return idx != Empty && keys[idx] == key ? idx : keys.size();
+}
+
+std::bitset<UrlPattern::Max_Names> UrlPattern::Plan::KeyTable::Prefixes(std::string_view text) const
+{
+    // Keys of the same length differ, so each length finds at most one
+    std::bitset<Max_Names> found;
+    for (const size_t length : lengths)
+    {
+        if (length > text.size())
+            continue;
+
+        const size_t idx = Find(text.substr(0, length));
+        if (idx != keys.size())
+            found.set(idx);
+    }
+
+    return found;
+}
+
+bool UrlPattern::Plan::KeyTable::Match(std::string_view query, std::span<std::string_view> captures) const
+{
+    std::bitset<Max_Slots> seen;
+    size_t start = 0;
+    while (true)
+    {
+        size_t end = start;
+        while (end < query.size() && query[end] != '&')
+        {
+            // The regex's .* stops at line breaks
+            if (query[end] == '\n' || query[end] == '\r')
+                return false;
+            end++;
+        }
+
+        const std::string_view param = query.substr(start, end - start);
+        const size_t equals = param.find('=');
+        const size_t key = Find(param.substr(0, equals));
+        if (key == keys.size() || equals == std::string_view::npos)
+        {
+            if (!allow_unknown)
+                return false;
+        }
+        else if (IsNumericValue(param.substr(equals + 1)))
+        {
+            // A repeated key takes the last good value, like the regex does
+            captures[key] = param.substr(equals + 1);
+            seen.set(key);
+        }
+
+        if (end == query.size())
+            break;
+        start = end + 1;
+    }
+
+    return seen.count() == keys.size();
+}
+
+bool UrlPattern::Match(std::string_view url,
+                       std::span<std::string_view> captures,
+                       size_t& count,
+                       std::span<std::uint8_t> names) const
+{
+    if (native)
+    {
+        count = slots;
+        return captures.size() >= slots && MatchFrom(url, captures, names, 0, 0, 0, 0);
+    }
+
+    const Plan& compiled = GetPlan();
+    std::cmatch matches;
+    if (!std::regex_match(url.data(), url.data() + url.size(), matches, *compiled.regex))
+        return false;
+
+    // Skip the first group since its the whole match
+    count = matches.size() - 1;
+    for (size_t i = 1; i < matches.size() && i <= captures.size(); i++)
+        captures[i - 1] = url.substr(matches.position(i), matches.length(i));
+
+    return true;
+}
+
+bool UrlPattern::MatchFrom(std::string_view url,
+                           std::span<std::string_view> captures,
+                           std::span<std::uint8_t> names,
+                           size_t chunk,
+                           size_t offset,
+                           size_t pos,
+                           size_t slot) const
+{
+    for (; chunk < chunks.size(); chunk++, offset = 0)
+    {
+        const std::uint32_t ref = chunks[chunk];
+        const Kind kind = KindOf(ref);
+        if (kind == Query)
+        {
+            // Always the last chunk, it matches to the end of the url
+            return pos < url.size() && url[pos] == '?' &&
+                   GetPlan().query.Match(url.substr(pos + 1), captures.subspan(slot));
+        }
+
+        if (kind == Enum_Slot)
+        {
+            // The names the url has next, tried in order as the regex
+            // alternation tries them
+            const Plan::KeyTable& table = GetPlan().text[slot].names;
+            const std::bitset<Max_Names> found = table.Prefixes(url.substr(pos));
+            for (size_t idx = 0; idx < table.keys.size(); idx++)
+            {
+                if (!found.test(idx))
+                    continue;
+
+                const size_t end = pos + table.keys[idx].size();
+                captures[slot] = url.substr(pos, end - pos);
+                if (slot < names.size())
+                    names[slot] = static_cast<std::uint8_t>(idx);
+                if (MatchFrom(url, captures, names, chunk + 1, 0, end, slot + 1))
+                    return true;
+            }
+
+            return false;
+        }
+
+        if (kind == String_Slot)
+        {
+            // Longest run of the alphabet first, as the greedy regex does
+            const Plan::TextSlot& text = GetPlan().text[slot];
+            size_t end = pos;
+            while (end < url.size() && end - pos < text.length &&
+                   text.alphabet->codes[static_cast<unsigned char>(url[end])] >= 0)
+                end++;
+
+            for (; end > pos; end--)
+            {
+                captures[slot] = url.substr(pos, end - pos);
+                if (MatchFrom(url, captures, names, chunk + 1, 0, end, slot + 1))
+                    return true;
+            }
+
+            return false;
+        }
+
+        if (kind == Numeric_Slot || kind == Decimal_Slot)
+        {
+            // Try the ends in the order std::regex would, the optional 0x or
+            // 0d prefix taken first and the longest run of digits first
+            auto try_end = [&](size_t end) {
+                captures[slot] = url.substr(pos, end - pos);
+                return MatchFrom(url, captures, names, chunk + 1, 0, end, slot + 1);
+            };
+
+            auto run = [&](size_t from, bool hex) {
+                size_t end = from;
+                while (end < url.size() && (hex ? IsHex(url[end]) : IsDigit(url[end])))
+                    end++;
+                return end;
+            };
+
+            size_t tried_above = url.size() + 1;
+            if (kind == Numeric_Slot && url.size() - pos > 2 && url[pos] == '0' &&
+                (url[pos + 1] == 'x' || url[pos + 1] == 'd'))
+            {
+                for (size_t end = run(pos + 2, true); end > pos + 2; end--)
+                {
+                    if (try_end(end))
+                        return true;
+                }
+                tried_above = pos + 2;
+            }
+
+            for (size_t end = run(pos, kind == Numeric_Slot); end > pos; end--)
+            {
+                if (end <= tried_above && try_end(end))
+                    return true;
+            }
+
+            return false;
+        }
+
+        const std::string_view text = Text(ref);
+        while (offset < text.size())
+        {
+            const char ch = text[offset];
+            if (ch == '^' || ch == '$')
+            {
+                // Only at the start and end, the whole url has to match anyway
+                offset++;
+            }
+            else if (ch == '(')
+            {
+                // Optional group, try with it first
+                const size_t close = FindClose(text, offset);
+                const size_t end = MatchPlain(url, pos, text.substr(offset + 3, close - offset - 3));
+                if (end != std::string_view::npos && MatchFrom(url, captures, names, chunk, close + 2, end, slot))
+                    return true;
+
+                offset = close + 2;
+            }
+            else
+            {
+                const size_t next = PlainEnd(text, offset);
+                const size_t end = MatchPlain(url, pos, text.substr(offset, next - offset));
+                if (end == std::string_view::npos)
+                    return false;
+
+                pos = end;
+                offset = next;
+            }
+        }
+    }
+
+    return pos == url.size();
+}
+
+bool UrlPattern::TextValue(size_t slot, std::string_view text, std::uint8_t name, std::uint64_t& value) const
+{
+    const Plan& compiled = GetPlan();
+    if (slot >= compiled.text.size())
+        return false;
+
+    const Plan::TextSlot& encoding = compiled.text[slot];
+    if (encoding.alphabet)
+    {
+        // The length, then each character from the left, with unused
+        // characters left zero
+        const std::uint32_t bits = encoding.alphabet->bits;
+        value = text.size();
+        for (size_t idx = 0; idx < encoding.length; idx++)
+        {
+            const std::uint64_t code =
+                idx < text.size() ? encoding.alphabet->codes[static_cast<unsigned char>(text[idx])] : 0;
+            value = (value << bits) | code;
+        }
+        return true;
+    }
+
+    if (encoding.names.keys.empty())
+        return false;
+
+    value = name;
+    return true;
+}
@@ -0,0 +1,191 @@
+/*
+ *  UrlPatternPlan.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Private to UrlPattern.cpp, which splits and compiles patterns, and
+ *      UrlPatternMatch.cpp, which matches urls against them. Holds the
+ *      compiled plan of a pattern and the regex helpers both use.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <UrlPattern.h>
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <regex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace url_pattern_detail
+{
+inline bool IsHex(char ch)
+{
+    return std::isxdigit(static_cast<unsigned char>(ch));
+}
+
+inline bool IsDigit(char ch)
+{
+    return std::isdigit(static_cast<unsigned char>(ch));
+}
+
+// '.' matches anything but a line terminator
+inline bool IsWildcardMatch(char ch)
+{
+    return ch != '\n' && ch != '\r';
+}
+
+// Whole text matches the numeric slot regex
+inline bool IsNumericValue(std::string_view value)
+{
+    auto all_hex = [](std::string_view text) { return !text.empty() && std::all_of(text.begin(), text.end(), IsHex); };
+
+    return all_hex(value) ||
+           (value.size() > 2 && value[0] == '0' && (value[1] == 'x' || value[1] == 'd') && all_hex(value.substr(2)));
+}
+
+inline std::uint32_t HashKey(std::string_view key, std::uint32_t seed)
+{
+    std::uint32_t hash = 2166136261u ^ seed;
+    for (const char ch : key)
+        hash = (hash ^ static_cast<unsigned char>(ch)) * 16777619u;
+
+    return hash ^ (hash >> 16);
+}
+
+// Characters a string slot can hold, each packed into a fixed number of bits
+struct Alphabet
+{
+    std::string_view name;
+    std::string_view chars;
+    std::string_view regex_class;
+    std::uint32_t bits;
+
+    // Code of each byte, -1 for bytes not in the alphabet
+    std::array<std::int8_t, 256> codes;
+};
+
+// Finds the ) that closes the ( at start
+inline size_t FindClose(std::string_view regex, size_t start)
+{
+    int depth = 0;
+    bool in_class = false;
+    for (size_t idx = start; idx < regex.size(); idx++)
+    {
+        const char ch = regex[idx];
+        if (ch == '\\')
+            idx++;
+        else if (in_class)
+            in_class = ch != ']';
+        else if (ch == '[')
+            in_class = true;
+        else if (ch == '(')
+            depth++;
+        else if (ch == ')' && --depth == 0)
+            return idx;
+    }
+
+    return std::string_view::npos;
+}
+
+// End of the plain text starting at offset of a native literal chunk
+inline size_t PlainEnd(std::string_view text, size_t offset)
+{
+    while (offset < text.size() && text[offset] != '(' && text[offset] != '^' && text[offset] != '$')
+        offset += text[offset] == '\\' ? 2 : 1;
+
+    return std::min(offset, text.size());
+}
+
+// Matches plain text at pos, returning the end or npos
+inline size_t MatchPlain(std::string_view url, size_t pos, std::string_view text)
+{
+    for (size_t idx = 0; idx < text.size(); idx++, pos++)
+    {
+        if (pos >= url.size())
+            return std::string_view::npos;
+
+        char ch = text[idx];
+        if (ch == '\\')
+            ch = text[++idx];
+        else if (ch == '.')
+        {
+            if (!IsWildcardMatch(url[pos]))
+                return std::string_view::npos;
+            continue;
+        }
+
+        if (url[pos] != ch)
+            return std::string_view::npos;
+    }
+
+    return pos;
+}
+} // namespace url_pattern_detail
+
+struct UrlPattern::Plan
+{
+    // Names found with a perfect hash, the parameters of a query chunk or
+    // the names of an enum slot
+    struct KeyTable
+    {
+        static constexpr std::uint8_t Empty = 0xFF;
+
+        std::vector<std::string> keys;
+        bool allow_unknown = false;
+
+        // Index of the key hashed to each entry, empty when no seed made a
+        // perfect hash and the keys are searched instead
+        std::vector<std::uint8_t> table;
+        std::uint32_t seed = 0;
+
+        // Each length a key has, once
+        std::vector<size_t> lengths;
+
+        void Build();
+
+        // Index of the key, or keys.size() if it isn't one
+        size_t Find(std::string_view key) const;
+
+        // The keys text starts with, a bit for each index
+        std::bitset<UrlPattern::Max_Names> Prefixes(std::string_view text) const;
+
+        // Matches the parameters of a query, after the '?'
+        bool Match(std::string_view query, std::span<std::string_view> captures) const;
+    };
+
+    // Only for patterns that aren't native, null if it doesn't compile
+    std::unique_ptr<const std::regex> regex;
+
+    // The url text around the values, pieces[i] comes before value i
+    std::vector<std::string> pieces;
+
+    KeyTable query;
+
+    // How a slot that isn't a number is encoded, for TextValue and Format
+    struct TextSlot
+    {
+        // The names of an enum slot
+        KeyTable names;
+
+        // The characters of a string slot, and the most it holds
+        const url_pattern_detail::Alphabet* alphabet = nullptr;
+        size_t length = 0;
+    };
+
+    // One for each slot, empty for numbers
+    std::vector<TextSlot> text;
+};
@@ -0,0 +1,189 @@
+#include <UrlPrefilter.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace
+{
+// Smallest filter, in 64 bit words
+constexpr size_t Min_Bloom_Words = 16;
+
+std::uint64_t HashAuthority(std::string_view authority)
+{
+    return std::hash<std::string_view>{}(authority);
+}
+
+// Bit k of the Bloom filter of the given mask, from two halves of the hash
+size_t BloomBit(std::uint64_t hash, size_t k, size_t mask)
+{
+    const std::uint64_t step = (hash >> 32) | 1;
+    return static_cast<size_t>(hash + k * step) & mask;
+}
+} // namespace
+
+UrlPrefilter::UrlPrefilter()
+{
+    Clear();
+}
+
+void UrlPrefilter::Clear()
+{
+    min_length = SIZE_MAX;
+    max_length = 0;
+    for (auto& bytes : prefix_bytes)
+        bytes.fill(0);
+
+    check_authority = true;
+    shapes.clear();
+    authority_hashes.clear();
+    bloom.assign(Min_Bloom_Words, 0);
+}
+
+void UrlPrefilter::Add(const UrlPattern& pattern)
+{
+    size_t pattern_min = 0;
+    size_t pattern_max = 0;
+    pattern.LengthRange(pattern_min, pattern_max);
+    min_length = std::min(min_length, pattern_min);
+    max_length = std::max(max_length, pattern_max);
+
+    // Any byte where the prefix is a wildcard or has ended
+    const UrlPattern::Prefix prefix = pattern.LiteralPrefix();
+    for (size_t i = 0; i < Prefix_Bytes; i++)
+    {
+        if (i < prefix.bytes.size() && !((prefix.wildcards >> i) & 1))
+        {
+            const auto byte = static_cast<unsigned char>(prefix.bytes[i]);
+            prefix_bytes[i][byte / 64] |= 1ull << (byte % 64);
+        }
+        else
+        {
+            prefix_bytes[i].fill(~0ull);
+        }
+    }
+
+    if (!check_authority)
+        return;
+
+    std::vector<std::string> authorities;
+    if (!pattern.Authorities(authorities))
+    {
+        check_authority = false;
+        return;
+    }
+
+    for (const auto& authority : authorities)
+    {
+        if (!AddShape(authority))
+        {
+            check_authority = false;
+            return;
+        }
+    }
+
+    // Wildcards are already '\0', as the url's bytes are blanked in Check
+    for (const auto& authority : authorities)
+        AddAuthority(HashAuthority(authority));
+}
+
+UrlPrefilter::Verdict UrlPrefilter::Check(std::string_view url) const
+{
+    if (url.size() < min_length || url.size() > max_length)
+        return Verdict::Length;
+
+    for (size_t i = 0; i < Prefix_Bytes && i < url.size(); i++)
+    {
+        const auto byte = static_cast<unsigned char>(url[i]);
+        if (!((prefix_bytes[i][byte / 64] >> (byte % 64)) & 1))
+            return Verdict::Prefix;
+    }
+
+    if (!check_authority)
+        return Verdict::Pass;
+
+    // A wildcard may stand for a slash, so the url's authority is taken to
+    // be as long as each shape's rather than split where the url's ends
+    std::string_view authority;
+    UrlPattern::SplitAuthority(url, true, authority);
+    const size_t start = authority.data() ? static_cast<size_t>(authority.data() - url.data()) : url.size();
+
+    char blanked[Max_Authority];
+    for (const Shape& shape : shapes)
+    {
+        if (shape.length > url.size() - start || (!authority.data() && shape.length != 0))
+            continue;
+
+        std::memcpy(blanked, url.data() + start, shape.length);
+        for (std::uint64_t bits = shape.wildcards; bits != 0; bits &= bits - 1)
+            blanked[std::countr_zero(bits)] = '\0';
+
+        if (HasAuthority(HashAuthority({blanked, shape.length})))
+            return Verdict::Pass;
+    }
+
+    return Verdict::Authority;
+}
+
+bool UrlPrefilter::AddShape(std::string_view authority)
+{
+    if (authority.size() > Max_Authority)
+        return false;
+
+    Shape shape{authority.size(), 0};
+    for (size_t i = 0; i < authority.size(); i++)
+    {
+        if (authority[i] == '\0')
+            shape.wildcards |= 1ull << i;
+    }
+
+    if (std::find(shapes.begin(), shapes.end(), shape) != shapes.end())
+        return true;
+
+    if (shapes.size() == Max_Shapes)
+        return false;
+
+    shapes.push_back(shape);
+    return true;
+}
+
+void UrlPrefilter::AddAuthority(std::uint64_t hash)
+{
+    if (!authority_hashes.insert(hash).second)
+        return;
+
+    // Double the filter when it gets too full, setting every bit again
+    if (authority_hashes.size() * Bloom_Bits_Per_Authority > bloom.size() * 64)
+    {
+        bloom.assign(bloom.size() * 2, 0);
+        for (const std::uint64_t each : authority_hashes)
+        {
+            for (size_t k = 0; k < Bloom_Hashes; k++)
+            {
+                const size_t bit = BloomBit(each, k, bloom.size() * 64 - 1);
+                bloom[bit / 64] |= 1ull << (bit % 64);
+            }
+        }
+        return;
+    }
+
+    for (size_t k = 0; k < Bloom_Hashes; k++)
+    {
+        const size_t bit = BloomBit(hash, k, bloom.size() * 64 - 1);
+        bloom[bit / 64] |= 1ull << (bit % 64);
+    }
+}
+
+bool UrlPrefilter::HasAuthority(std::uint64_t hash) const
+{
+    for (size_t k = 0; k < Bloom_Hashes; k++)
+    {
+        const size_t bit = BloomBit(hash, k, bloom.size() * 64 - 1);
+        if (!((bloom[bit / 64] >> (bit % 64)) & 1))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,145 @@
+#include "MicroBenchmark.h"
+#include "SyntheticTemplates.h"
+
+#include <UrlEncoder.h>
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Slow operations, the large counts take seconds per call
+constexpr std::uint64_t Bulk_Min_Iterations = 3;
+
+std::string MakeSubTemplate(std::uint64_t pen, unsigned int sub_pen)
+{
+    return "https://webex.com<pen=" + std::to_string(pen) + "><sub_pen=" + std::to_string(sub_pen) + ">/s" +
+           std::to_string(pen) + "/sub" + std::to_string(sub_pen) + "/meeting<int16>";
+}
+} // namespace
+
+MICROBENCH_GROUP(admin)
+{
+    const auto& options = reporter.GetOptions();
+
+    for (std::uint64_t count : options.admin_template_counts)
+    {
+        if (count == 0)
+            continue;
+
+        const microbench::json params = {{"templates", count}};
+        const microbench::json& templates = microbench::SyntheticTemplates(count);
+
+        // PEN that isn't in the loaded set, used for single template changes
+        const std::uint64_t extra_pen = count;
+        const std::string extra_template = microbench::MakeTemplate(extra_pen);
+
+        UrlEncoder loaded;
+        loaded.TemplatesFromJson(templates);
+
+        if (reporter.Enabled("add_templates_bulk"))
+        {
+            std::vector<std::string> strings;
+            for (std::uint64_t pen = 0; pen < count; pen++)
+                strings.push_back(microbench::MakeTemplate(pen));
+
+            std::unique_ptr<UrlEncoder> encoder;
+            reporter.RunWithSetup(
+                "add_templates_bulk",
+                params,
+                [&](unsigned int, std::uint64_t) { encoder = std::make_unique<UrlEncoder>(); },
+                [&](unsigned int, std::uint64_t) { encoder->AddTemplate(strings); },
+                Bulk_Min_Iterations);
+        }
+
+        if (reporter.Enabled("templates_from_json"))
+        {
+            std::unique_ptr<UrlEncoder> encoder;
+            reporter.RunWithSetup(
+                "templates_from_json",
+                params,
+                [&](unsigned int, std::uint64_t) { encoder = std::make_unique<UrlEncoder>(); },
+                [&](unsigned int, std::uint64_t) { encoder->TemplatesFromJson(templates); },
+                Bulk_Min_Iterations);
+        }
+
+        if (reporter.Enabled("templates_from_json_lazy"))
+        {
+            std::unique_ptr<UrlEncoder> encoder;
+            reporter.RunWithSetup(
+                "templates_from_json_lazy",
+                params,
+                [&](unsigned int, std::uint64_t) {
+                    encoder = std::make_unique<UrlEncoder>();
+                    encoder->SetCompileMode(UrlEncoder::compile_mode::lazy);
+                },
+                [&](unsigned int, std::uint64_t) { encoder->TemplatesFromJson(templates); },
+                Bulk_Min_Iterations);
+        }
+
+        if (reporter.Enabled("templates_to_json"))
+        {
+            reporter.RunWithSetup(
+                "templates_to_json",
+                params,
+                nullptr,
+                [&](unsigned int, std::uint64_t) { microbench::DoNotOptimize(loaded.TemplatesToJson()); },
+                Bulk_Min_Iterations);
+        }
+
+        if (reporter.Enabled("templates_to_json_stream"))
+        {
+            std::ostringstream out;
+            reporter.RunWithSetup(
+                "templates_to_json_stream",
+                params,
+                [&](unsigned int, std::uint64_t) { out.str(""); },
+                [&](unsigned int, std::uint64_t) { loaded.TemplatesToJson(out, 4); },
+                Bulk_Min_Iterations);
+        }
+
+        if (reporter.Enabled("add_template"))
+        {
+            reporter.RunWithSetup(
+                "add_template",
+                params,
+                [&](unsigned int, std::uint64_t) { loaded.RemoveTemplate(extra_pen); },
+                [&](unsigned int, std::uint64_t) { loaded.AddTemplate(extra_template); });
+        }
+
+        if (reporter.Enabled("remove_template"))
+        {
+            reporter.RunWithSetup(
+                "remove_template",
+                params,
+                [&](unsigned int, std::uint64_t) { loaded.AddTemplate(extra_template, true); },
+                [&](unsigned int, std::uint64_t) { microbench::DoNotOptimize(loaded.RemoveTemplate(extra_pen)); });
+        }
+
+        if (reporter.Enabled("remove_sub_template"))
+        {
+            const std::vector<std::string> sub_templates = {MakeSubTemplate(extra_pen, 1),
+                                                            MakeSubTemplate(extra_pen, 2)};
+            reporter.RunWithSetup(
+                "remove_sub_template",
+                params,
+                [&](unsigned int, std::uint64_t) {
+                    loaded.RemoveTemplate(extra_pen);
+                    loaded.AddTemplate(sub_templates);
+                },
+                [&](unsigned int, std::uint64_t) {
+                    microbench::DoNotOptimize(loaded.RemoveSubTemplate(extra_pen, 1));
+                });
+        }
+
+        if (reporter.Enabled("template_count"))
+        {
+            loaded.RemoveTemplate(extra_pen);
+            reporter.Run("template_count", params, 1, [&](unsigned int, std::uint64_t) {
+                microbench::DoNotOptimize(loaded.TemplateCount());
+            });
+        }
+    }
+}
@@ -0,0 +1,192 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace AllocationCounter
+{
+namespace
+{
+std::atomic<bool> counting = false;
+
+// Allocations made before the last Reset are not uncounted when freed
+std::atomic<std::uint32_t> epoch = 1;
+std::atomic<std::uint64_t> allocations = 0;
+std::atomic<std::uint64_t> deallocations = 0;
+std::atomic<std::uint64_t> bytes_allocated = 0;
+std::atomic<std::int64_t> live_bytes = 0;
+std::atomic<std::int64_t> peak_live_bytes = 0;
+
+// Stored in front of every allocation so delete knows what to uncount
+struct Header
+{
+    std::size_t size;
+
+    // Epoch the allocation was counted in, 0 if it wasn't
+    std::uint32_t epoch;
+};
+
+constexpr std::size_t Header_Size = 16;
+static_assert(sizeof(Header) <= Header_Size);
+
+void* Allocate(std::size_t size, std::size_t alignment)
+{
+    const std::size_t offset = alignment > Header_Size ? alignment : Header_Size;
+    void* base = alignment > Header_Size
+                     ? std::aligned_alloc(alignment, (size + offset + alignment - 1) / alignment * alignment)
+                     : std::malloc(size + offset);
+    if (!base)
+        return nullptr;
+
+    char* ptr = static_cast<char*>(base) + offset;
+    Header* header = reinterpret_cast<Header*>(ptr - Header_Size);
+    header->size = size;
+    header->epoch = counting.load(std::memory_order_relaxed) ? epoch.load(std::memory_order_relaxed) : 0;
+
+    if (header->epoch != 0)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+        std::int64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+        std::int64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    return ptr;
+}
+
+void Free(void* ptr, std::size_t alignment)
+{
+    if (!ptr)
+        return;
+
+    const std::size_t offset = alignment > Header_Size ? alignment : Header_Size;
+    Header* header = reinterpret_cast<Header*>(static_cast<char*>(ptr) - Header_Size);
+    if (header->epoch == epoch.load(std::memory_order_relaxed))
+    {
+        deallocations.fetch_add(1, std::memory_order_relaxed);
+        live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    }
+
+    std::free(static_cast<char*>(ptr) - offset);
+}
+
+void* AllocateOrThrow(std::size_t size, std::size_t alignment)
+{
+    void* ptr = Allocate(size, alignment);
+    if (!ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+} // namespace
+
+void Start()
+{
+    counting = true;
+}
+
+void Stop()
+{
+    counting = false;
+}
+
+void Reset()
+{
+    epoch++;
+    allocations = 0;
+    deallocations = 0;
+    bytes_allocated = 0;
+    live_bytes = 0;
+    peak_live_bytes = 0;
+}
+
+Stats Get()
+{
+    return {allocations.load(), deallocations.load(), bytes_allocated.load(), live_bytes.load(),
+            peak_live_bytes.load()};
+}
+} // namespace AllocationCounter
+
+void* operator new(std::size_t size)
+{
+    return AllocationCounter::AllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size)
+{
+    return AllocationCounter::AllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return AllocationCounter::AllocateOrThrow(size, static_cast<std::size_t>(align));
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return AllocationCounter::AllocateOrThrow(size, static_cast<std::size_t>(align));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocationCounter::Allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return AllocationCounter::Allocate(size, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
+
+void operator delete(void* ptr, std::align_val_t align) noexcept
+{
+    AllocationCounter::Free(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void* ptr, std::align_val_t align) noexcept
+{
+    AllocationCounter::Free(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t align) noexcept
+{
+    AllocationCounter::Free(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t align) noexcept
+{
+    AllocationCounter::Free(ptr, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    AllocationCounter::Free(ptr, alignof(std::max_align_t));
+}
@@ -0,0 +1,67 @@
+/*
+ *  AllocationCounter.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Replaces the global operator new and delete with ones that count
+ *      allocations and track live and peak heap bytes. Link
+ *      AllocationCounter.cpp into an executable to use it.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace AllocationCounter
+{
+struct Stats
+{
+    std::uint64_t allocations = 0;
+    std::uint64_t deallocations = 0;
+    std::uint64_t bytes_allocated = 0;
+
+    // Bytes allocated while counting that have not been freed
+    std::int64_t live_bytes = 0;
+    std::int64_t peak_live_bytes = 0;
+};
+
+// Counting is off until started, so only the code of interest pays for it
+void Start();
+void Stop();
+
+// Zeroes the counters. Memory allocated before the reset is not counted
+// when it is freed.
+void Reset();
+
+Stats Get();
+
+// Counts the allocations made while in scope
+class Scope
+{
+  public:
+    Scope()
+    {
+        Reset();
+        Start();
+    }
+
+    ~Scope()
+    {
+        Stop();
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    Stats Get() const
+    {
+        return AllocationCounter::Get();
+    }
+};
+} // namespace AllocationCounter
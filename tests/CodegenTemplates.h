@@ -0,0 +1,38 @@
+/*
+ *  CodegenTemplates.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Templates the generated encoder test compiles in, shared by the
+ *      program that writes the header and the test that checks it.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace codegen_test
+{
+// Shared prefixes so the dispatch switches more than once, sub PENs, an
+// optional chunk, and values on both sides of the middle of the name
+inline std::vector<std::string> Templates()
+{
+    return {
+        "https://!{www.}!webex.com<pen=1>/meeting<int16>/user<int16>",
+        "https://webex.com<pen=2>/<int16>/party<int16>/user<int16>",
+        "https://webex.com<pen=3>/meeting<int8>",
+        "https://webex.com<pen=777><sub_pen=10>/chat<int16>/user<int16>",
+        "https://webex.com<pen=777><sub_pen=11>/chat<int16>/room<int8>",
+        "https://cisco.com<pen=4>/a<int32>/b<int32>/c<int40>",
+        "https://cisco.com<pen=5>/a<int7>-<int9>",
+        "https://webex.com<pen=6>/<enum:audio|video|chat>/room<int16>/<str4:b32>",
+    };
+}
+} // namespace codegen_test
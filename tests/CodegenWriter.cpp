@@ -0,0 +1,30 @@
+#include "CodegenTemplates.h"
+
+#include <fstream>
+#include <iostream>
+
+#include <CodeGenerator.hh>
+#include <UrlEncoder.h>
+
+// Writes the header of the templates in CodegenTemplates.h, run by the
+// build before the generated encoder test is compiled
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <header>\n";
+        return 1;
+    }
+
+    const UrlEncoder encoder(codegen_test::Templates());
+    std::ofstream file(argv[1], std::ios::binary | std::ios::trunc);
+    const CodeGenerator::Result result = CodeGenerator::Generate(encoder, file);
+    file.close();
+    if (!file || !result.skipped.empty())
+    {
+        std::cerr << "Failed to generate " << argv[1] << "\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "MicroBenchmark.h"
+#include "SyntheticTemplates.h"
+#include "WorkloadGenerator.h"
+
+#include <UrlEncoder.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Number of urls in each generated corpus
+constexpr std::uint64_t Corpus_Size = 4096;
+
+void ReplayCorpus(microbench::Reporter& reporter, const std::string& source, const microbench::json& templates)
+{
+    const auto& options = reporter.GetOptions();
+
+    UrlEncoder encoder;
+    encoder.TemplatesFromJson(templates);
+
+    for (double hit_ratio : options.hit_ratios)
+    {
+        WorkloadGenerator::Options workload;
+        workload.hit_ratio = hit_ratio;
+        workload.zipf_exponent = options.zipf_exponent;
+        workload.decimal_weight = options.spellings[0];
+        workload.hex_weight = options.spellings[1];
+        workload.binary_weight = options.spellings[2];
+
+        WorkloadGenerator generator(templates, workload);
+        std::vector<std::string> corpus;
+        std::vector<quicr::Namespace> names;
+        for (const auto& url : generator.Generate(Corpus_Size))
+        {
+            corpus.push_back(url.url);
+            if (!url.hit)
+                continue;
+
+            // Random values can be out of range for slots wider than 64 bits
+            try
+            {
+                names.push_back(encoder.EncodeUrl(url.url));
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        const microbench::json params = {{"source", source},
+                                         {"templates", generator.TemplateCount()},
+                                         {"hit_ratio", hit_ratio},
+                                         {"zipf", options.zipf_exponent},
+                                         {"spellings", options.spellings}};
+
+        for (unsigned int threads : options.thread_counts)
+        {
+            if (reporter.Enabled("corpus_encode"))
+            {
+                auto& result =
+                    reporter.Run("corpus_encode", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                        try
+                        {
+                            microbench::DoNotOptimize(encoder.EncodeUrl(corpus[(i + thread * 97) % corpus.size()]));
+                        }
+                        catch (const std::runtime_error&)
+                        {
+                        }
+                    });
+                result.counters["encoded_ratio"] = static_cast<double>(names.size()) / corpus.size();
+            }
+
+            if (reporter.Enabled("corpus_decode") && !names.empty())
+            {
+                reporter.Run("corpus_decode", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                    microbench::DoNotOptimize(encoder.DecodeUrl(names[(i + thread * 97) % names.size()]));
+                });
+            }
+        }
+    }
+}
+} // namespace
+
+MICROBENCH_GROUP(corpus)
+{
+    const auto& options = reporter.GetOptions();
+
+    if (!options.templates_file.empty())
+    {
+        std::ifstream file(options.templates_file);
+        ReplayCorpus(reporter, options.templates_file, microbench::json::parse(file));
+    }
+
+    for (std::uint64_t count : options.template_counts)
+    {
+        if (count > 0)
+            ReplayCorpus(reporter, "synthetic", microbench::SyntheticTemplates(count));
+    }
+}
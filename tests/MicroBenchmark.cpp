@@ -0,0 +1,330 @@
+#include "MicroBenchmark.h"
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+namespace microbench
+{
+namespace
+{
+std::map<std::string, Group>& Groups()
+{
+    static std::map<std::string, Group> groups;
+    return groups;
+}
+
+double Percentile(const std::vector<std::uint64_t>& sorted, double pct)
+{
+    if (sorted.empty())
+        return 0;
+
+    // Nearest rank
+    size_t rank = static_cast<size_t>(pct / 100.0 * sorted.size());
+    return static_cast<double>(sorted[std::min(rank, sorted.size() - 1)]);
+}
+
+std::vector<std::string> Split(const std::string& str, char delim)
+{
+    std::vector<std::string> parts;
+    std::stringstream stream(str);
+    for (std::string part; std::getline(stream, part, delim);)
+        if (!part.empty())
+            parts.push_back(part);
+    return parts;
+}
+} // namespace
+
+json Result::ToJson() const
+{
+    return {{"name", name},           {"params", params},         {"threads", threads},
+            {"iterations", iterations}, {"ns_per_op", ns_per_op},   {"ops_per_sec", ops_per_sec},
+            {"p50_ns", p50_ns},       {"p99_ns", p99_ns},         {"p999_ns", p999_ns},
+            {"max_ns", max_ns},       {"allocations_per_op", allocations_per_op},
+            {"bytes_per_op", bytes_per_op}, {"peak_bytes", peak_bytes}, {"counters", counters}};
+}
+
+Reporter::Reporter(const Options& options) : options(options)
+{
+}
+
+const Options& Reporter::GetOptions() const
+{
+    return options;
+}
+
+bool Reporter::Enabled(const std::string& name) const
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+Result& Reporter::Run(const std::string& name, const json& params, unsigned int threads, const Operation& op)
+{
+    return Measure(name, params, threads, nullptr, op, options.min_iterations);
+}
+
+Result& Reporter::RunWithSetup(const std::string& name,
+                               const json& params,
+                               const Operation& setup,
+                               const Operation& op,
+                               std::uint64_t min_iterations)
+{
+    return Measure(name, params, 1, setup, op, min_iterations ? min_iterations : options.min_iterations);
+}
+
+Result& Reporter::Measure(const std::string& name,
+                          const json& params,
+                          unsigned int threads,
+                          const Operation& setup,
+                          const Operation& op,
+                          std::uint64_t min_iterations)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::cerr << "[microbench] " << name << " " << params.dump() << " threads=" << threads << std::endl;
+
+    threads = std::max(1u, threads);
+    std::vector<std::vector<std::uint64_t>> samples(threads);
+    std::vector<std::chrono::nanoseconds> busy(threads);
+    std::atomic<unsigned int> warmed_up = 0;
+    std::atomic<bool> start = false;
+
+    auto worker = [&](unsigned int thread) {
+        auto& thread_samples = samples[thread];
+        thread_samples.reserve(std::min<std::uint64_t>(options.max_iterations, 1 << 20));
+
+        // Warmup until the time is up, but always at least once
+        std::uint64_t iteration = 0;
+        const auto warmup_end = clock::now() + options.warmup_time;
+        do
+        {
+            if (setup)
+                setup(thread, iteration);
+            op(thread, iteration++);
+        } while (clock::now() < warmup_end && iteration < options.max_iterations);
+
+        // Start every thread together so they contend for the whole run
+        warmed_up++;
+        while (!start)
+            std::this_thread::yield();
+
+        const auto begin = clock::now();
+        const auto end = begin + options.min_time;
+        auto now = begin;
+        iteration = 0;
+        std::chrono::nanoseconds setup_time{0};
+        while (iteration < options.max_iterations && (iteration < min_iterations || now < end))
+        {
+            if (setup)
+            {
+                setup(thread, iteration);
+                const auto setup_end = clock::now();
+                setup_time += setup_end - now;
+                now = setup_end;
+            }
+
+            const auto op_start = now;
+            op(thread, iteration++);
+            now = clock::now();
+            thread_samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - op_start).count());
+        }
+        busy[thread] = now - begin - setup_time;
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int thread = 1; thread < threads; thread++)
+        workers.emplace_back(worker, thread);
+
+    std::thread starter([&] {
+        while (warmed_up < threads)
+            std::this_thread::yield();
+        start = true;
+    });
+
+    worker(0);
+    for (auto& thread : workers)
+        thread.join();
+    starter.join();
+
+    // Merge the per thread samples
+    std::vector<std::uint64_t> all;
+    std::chrono::nanoseconds total_busy{0};
+    for (unsigned int thread = 0; thread < threads; thread++)
+    {
+        all.insert(all.end(), samples[thread].begin(), samples[thread].end());
+        total_busy += busy[thread];
+    }
+    std::sort(all.begin(), all.end());
+
+    Result result;
+    result.name = name;
+    result.params = params;
+    result.threads = threads;
+    result.iterations = all.size();
+    if (!all.empty())
+    {
+        // Every thread is busy for the whole run so the throughput is the
+        // sum of each thread's throughput
+        result.ns_per_op = static_cast<double>(total_busy.count()) / all.size();
+        result.ops_per_sec = threads * 1e9 / result.ns_per_op;
+        result.p50_ns = Percentile(all, 50);
+        result.p99_ns = Percentile(all, 99);
+        result.p999_ns = Percentile(all, 99.9);
+        result.max_ns = static_cast<double>(all.back());
+    }
+
+    // Count the heap use separately so the counting doesn't skew the times.
+    // The peak is of a single call.
+    const std::uint64_t counted_runs = std::max<std::uint64_t>(1, std::min<std::uint64_t>(all.size(), 16));
+    for (std::uint64_t iteration = 0; iteration < counted_runs; iteration++)
+    {
+        if (setup)
+            setup(0, iteration);
+
+        if (iteration == 0)
+            AllocationCounter::Reset();
+
+        AllocationCounter::Start();
+        op(0, iteration);
+        AllocationCounter::Stop();
+
+        if (iteration == 0)
+            result.peak_bytes = AllocationCounter::Get().peak_live_bytes;
+    }
+
+    const AllocationCounter::Stats stats = AllocationCounter::Get();
+    result.allocations_per_op = static_cast<double>(stats.allocations) / counted_runs;
+    result.bytes_per_op = static_cast<double>(stats.bytes_allocated) / counted_runs;
+
+    return Add(std::move(result));
+}
+
+Result& Reporter::Add(Result result)
+{
+    results.push_back(std::move(result));
+    return results.back();
+}
+
+json Reporter::ToJson() const
+{
+    json j;
+    j["context"] = {{"hardware_concurrency", std::thread::hardware_concurrency()},
+#ifdef NDEBUG
+                    {"build", "release"},
+#else
+                    {"build", "debug"},
+#endif
+                    {"compiler", __VERSION__}};
+
+    j["benchmarks"] = json::array();
+    for (const auto& result : results)
+        j["benchmarks"].push_back(result.ToJson());
+
+    return j;
+}
+
+bool RegisterGroup(const std::string& name, Group group)
+{
+    Groups()[name] = std::move(group);
+    return true;
+}
+} // namespace microbench
+
+int main(int argc, char** argv)
+try
+{
+    microbench::Options options;
+    options.thread_counts = {1, std::max(2u, std::thread::hardware_concurrency())};
+    std::string output;
+    std::vector<std::string> groups;
+
+    for (int idx = 1; idx < argc; idx++)
+    {
+        const std::string arg = argv[idx];
+        const std::string value = idx + 1 < argc ? argv[idx + 1] : "";
+        if (arg == "--templates")
+        {
+            options.template_counts.clear();
+            for (const auto& count : microbench::Split(value, ','))
+                options.template_counts.push_back(std::stoull(count));
+        }
+        else if (arg == "--threads")
+        {
+            options.thread_counts.clear();
+            for (const auto& count : microbench::Split(value, ','))
+                options.thread_counts.push_back(std::stoul(count));
+        }
+        else if (arg == "--min-time-ms")
+            options.min_time = std::chrono::milliseconds(std::stoull(value));
+        else if (arg == "--min-iterations")
+            options.min_iterations = std::stoull(value);
+        else if (arg == "--admin-templates")
+        {
+            options.admin_template_counts.clear();
+            for (const auto& count : microbench::Split(value, ','))
+                options.admin_template_counts.push_back(std::stoull(count));
+        }
+        else if (arg == "--templates-file")
+            options.templates_file = value;
+        else if (arg == "--hit-ratios")
+        {
+            options.hit_ratios.clear();
+            for (const auto& ratio : microbench::Split(value, ','))
+                options.hit_ratios.push_back(std::stod(ratio));
+        }
+        else if (arg == "--zipf")
+            options.zipf_exponent = std::stod(value);
+        else if (arg == "--spellings")
+        {
+            options.spellings.clear();
+            for (const auto& weight : microbench::Split(value, ','))
+                options.spellings.push_back(std::stod(weight));
+            options.spellings.resize(3, 0);
+        }
+        else if (arg == "--filter")
+            options.filter = value;
+        else if (arg == "--group")
+            groups.push_back(value);
+        else if (arg == "--output")
+            output = value;
+        else
+        {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--templates 1,100,10000] [--admin-templates 1000,100000] [--threads 1,8] [--min-time-ms 250] [--min-iterations 10]"
+                         " [--templates-file templates.json] [--hit-ratios 0.5,0.95] [--zipf 1.0]"
+                         " [--spellings 0.8,0.1,0.1] [--filter encode] [--group name] [--output results.json]\n";
+            return 1;
+        }
+        idx++;
+    }
+
+    microbench::Reporter reporter(options);
+    for (const auto& [name, group] : microbench::Groups())
+    {
+        if (groups.empty() || std::find(groups.begin(), groups.end(), name) != groups.end())
+            group(reporter);
+    }
+
+    if (output.empty())
+    {
+        std::cout << std::setw(4) << reporter.ToJson() << std::endl;
+    }
+    else
+    {
+        std::ofstream file(output);
+        file << std::setw(4) << reporter.ToJson() << std::endl;
+    }
+
+    return 0;
+}
+catch (const std::exception& ex)
+{
+    std::cerr << ex.what() << std::endl;
+    return 1;
+}
@@ -0,0 +1,169 @@
+/*
+ *  MicroBenchmark.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Small harness for the numero_uri_microbench target. Each benchmark
+ *      runs an operation many times after a warmup, timing every call, and
+ *      reports ns/op, ops/s and latency percentiles as json.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace microbench
+{
+using json = nlohmann::json;
+
+struct Options
+{
+    // Number of templates loaded for the benchmarks that scale with it
+    std::vector<std::uint64_t> template_counts = {1, 100, 10000, 100000};
+
+    // Number of threads running the operation at the same time
+    std::vector<unsigned int> thread_counts = {1};
+
+    // Each benchmark runs for at least min_time and min_iterations
+    std::chrono::milliseconds min_time{250};
+    std::chrono::milliseconds warmup_time{50};
+    std::uint64_t min_iterations = 10;
+    std::uint64_t max_iterations = 2'000'000;
+
+    // Template counts for the template load and admin benchmarks
+    std::vector<std::uint64_t> admin_template_counts = {1000, 10000, 100000};
+
+    // Only run benchmarks whose name contains this
+    std::string filter;
+
+    // Corpus replay, see WorkloadGenerator. Templates are read from
+    // templates_file when it's set as well as generated.
+    std::string templates_file;
+    std::vector<double> hit_ratios = {0.5, 0.95};
+    double zipf_exponent = 1.0;
+
+    // Relative weights of decimal, hex and binary slot values
+    std::vector<double> spellings = {0.8, 0.1, 0.1};
+};
+
+struct Result
+{
+    std::string name;
+    json params;
+    unsigned int threads = 1;
+    std::uint64_t iterations = 0;
+    double ns_per_op = 0;
+    double ops_per_sec = 0;
+    double p50_ns = 0;
+    double p99_ns = 0;
+    double p999_ns = 0;
+    double max_ns = 0;
+
+    // Heap use of one call, measured in a separate untimed pass
+    double allocations_per_op = 0;
+    double bytes_per_op = 0;
+    std::int64_t peak_bytes = 0;
+
+    // Extra measurements a benchmark wants to report
+    json counters = json::object();
+
+    json ToJson() const;
+};
+
+// Operation under test, called with the thread index and the iteration
+using Operation = std::function<void(unsigned int thread, std::uint64_t iteration)>;
+
+class Reporter
+{
+  public:
+    explicit Reporter(const Options& options);
+
+    const Options& GetOptions() const;
+
+    // True if the benchmark should run with the current filter
+    bool Enabled(const std::string& name) const;
+
+    /*
+     *  Reporter::Run
+     *
+     *  Description:
+     *      Runs op on each of threads threads until the minimum time and
+     *      iterations are reached, and records the result.
+     *
+     *  Returns:
+     *      The recorded result so the caller can add counters
+     */
+    Result& Run(const std::string& name, const json& params, unsigned int threads, const Operation& op);
+
+    /*
+     *  Reporter::RunWithSetup
+     *
+     *  Description:
+     *      Runs op on one thread, calling setup before each call to op
+     *      without timing it.
+     *
+     *  Parameters:
+     *      min_iterations [in]
+     *          Overrides the minimum iterations for slow operations, 0 to
+     *          use the option.
+     */
+    Result& RunWithSetup(const std::string& name,
+                         const json& params,
+                         const Operation& setup,
+                         const Operation& op,
+                         std::uint64_t min_iterations = 0);
+
+    // Records a result measured by the benchmark itself
+    Result& Add(Result result);
+
+    json ToJson() const;
+
+  private:
+    Result& Measure(const std::string& name,
+                    const json& params,
+                    unsigned int threads,
+                    const Operation& setup,
+                    const Operation& op,
+                    std::uint64_t min_iterations);
+
+    Options options;
+    std::vector<Result> results;
+};
+
+// Benchmark groups register themselves, see MICROBENCH_GROUP
+using Group = std::function<void(Reporter&)>;
+
+bool RegisterGroup(const std::string& name, Group group);
+
+/*
+ *  Usage:
+ *      MICROBENCH_GROUP(encode)
+ *      {
+ *          reporter.Run("encode_hit", {{"templates", 100}}, 1, [&](auto, auto) { ... });
+ *      }
+ */
+#define MICROBENCH_GROUP(group_name)                                                                             \
+    static void microbench_group_##group_name(microbench::Reporter& reporter);                                   \
+    static const bool microbench_registered_##group_name =                                                       \
+        microbench::RegisterGroup(#group_name, microbench_group_##group_name);                                   \
+    static void microbench_group_##group_name(microbench::Reporter& reporter)
+
+// Keeps the compiler from optimizing away a result
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+} // namespace microbench
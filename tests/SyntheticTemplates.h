@@ -0,0 +1,54 @@
+/*
+ *  SyntheticTemplates.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Generated template sets shared by the microbenchmarks.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <UrlEncoder.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace microbench
+{
+inline std::string MakeTemplate(std::uint64_t pen)
+{
+    // Each template gets its own path so only one of them matches a url
+    return "https://webex.com<pen=" + std::to_string(pen) + ">/s" + std::to_string(pen) +
+           "/meeting<int16>/chat<int16>/user<int16>";
+}
+
+inline std::string MakeUrl(std::uint64_t pen, std::uint64_t value)
+{
+    return "https://webex.com/s" + std::to_string(pen) + "/meeting" + std::to_string(value % 65536) + "/chat" +
+           std::to_string((value * 7) % 65536) + "/user" + std::to_string((value * 13) % 65536);
+}
+
+// Templates from MakeTemplate in json, built once per count since adding
+// large numbers of templates is slow
+inline const nlohmann::json& SyntheticTemplates(std::uint64_t count)
+{
+    static std::map<std::uint64_t, nlohmann::json> cache;
+    auto found = cache.find(count);
+    if (found != cache.end())
+        return found->second;
+
+    UrlEncoder encoder;
+    for (std::uint64_t pen = 0; pen < count; pen++)
+        encoder.AddTemplate(MakeTemplate(pen));
+
+    return cache[count] = encoder.TemplatesToJson();
+}
+} // namespace microbench
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include "AllocationCounter.h"
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <UrlEncoder.h>
+
+/*
+ *  Heap budgets of the steady state hot paths, per call. These are ceilings,
+ *  lower them when a path allocates less so it can't creep back up.
+ */
+namespace Budget
+{
+// The value vectors and the hex string of the name, matching the template
+// doesn't allocate
+constexpr std::uint64_t Encode_Allocations = 10;
+constexpr std::uint64_t Encode_Bytes = 256;
+
+// Written straight into the caller's bytes
+constexpr std::uint64_t Encode_To_Allocations = 0;
+constexpr std::uint64_t Encode_To_Bytes = 0;
+
+// The decoded string and the unpacked values
+constexpr std::uint64_t Decode_Allocations = 7;
+constexpr std::uint64_t Decode_Bytes = 160;
+
+// The decoded string, from the bytes without building a name
+constexpr std::uint64_t Decode_Wire_Allocations = 2;
+constexpr std::uint64_t Decode_Wire_Bytes = 96;
+
+// A batch of 32 names over two templates into the urls of the batch before
+constexpr std::uint64_t Decode_Batch_Allocations = 11;
+constexpr std::uint64_t Decode_Batch_Bytes = 1792;
+} // namespace Budget
+
+namespace
+{
+class TestAllocations : public ::testing::Test
+{
+  protected:
+    TestAllocations()
+    {
+        encoder.AddTemplate(std::string("https://!{www.}!webex.com<pen=11259375>/meeting<int16>/user<int16>"));
+        encoder.AddTemplate(std::string("https://webex.com<pen=1>/<int16>/party<int16>/user<int16>"));
+        encoder.AddTemplate(std::string("https://webex.com<pen=777><sub_pen=10>/chat<int16>/user<int16>"));
+    }
+
+    // Average heap use of a call after a first untimed one, so one time
+    // setup such as locale initialization isn't counted
+    template <typename Call>
+    AllocationCounter::Stats Measure(Call&& call, std::uint64_t calls = 16)
+    {
+        call();
+
+        AllocationCounter::Stats stats;
+        {
+            AllocationCounter::Scope scope;
+            for (std::uint64_t i = 0; i < calls; i++)
+                call();
+            stats = scope.Get();
+        }
+
+        stats.allocations /= calls;
+        stats.bytes_allocated /= calls;
+        return stats;
+    }
+
+    UrlEncoder encoder;
+};
+
+TEST_F(TestAllocations, CounterCounts)
+{
+    const auto stats = Measure([] {
+        // Volatile so the compiler can't elide the pair
+        std::uint64_t* volatile value = new std::uint64_t(1);
+        delete value;
+    });
+    ASSERT_EQ(1, stats.allocations);
+    ASSERT_EQ(sizeof(std::uint64_t), stats.bytes_allocated);
+}
+
+TEST_F(TestAllocations, Encode)
+{
+    const std::string url = "https://webex.com/meeting1234/user5678";
+    const auto stats = Measure([&] { encoder.EncodeUrl(url); });
+    EXPECT_LE(stats.allocations, Budget::Encode_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Encode_Bytes);
+}
+
+TEST_F(TestAllocations, EncodeSubPen)
+{
+    const std::string url = "https://webex.com/chat12/user34";
+    const auto stats = Measure([&] { encoder.EncodeUrl(url); });
+    EXPECT_LE(stats.allocations, Budget::Encode_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Encode_Bytes);
+}
+
+TEST_F(TestAllocations, Decode)
+{
+    const quicr::Namespace name = encoder.EncodeUrl("https://webex.com/meeting1234/user5678");
+    const auto stats = Measure([&] { encoder.DecodeUrl(name); });
+    EXPECT_LE(stats.allocations, Budget::Decode_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Decode_Bytes);
+}
+
+TEST_F(TestAllocations, EncodeTo)
+{
+    const std::string url = "https://webex.com/meeting1234/user5678";
+    std::array<std::byte, UrlEncoder::Wire_Bytes> wire;
+    const auto stats = Measure([&] { encoder.EncodeUrlTo(url, wire); });
+    EXPECT_LE(stats.allocations, Budget::Encode_To_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Encode_To_Bytes);
+}
+
+TEST_F(TestAllocations, DecodeWire)
+{
+    std::array<std::byte, UrlEncoder::Wire_Bytes> wire;
+    encoder.EncodeUrlTo("https://webex.com/meeting1234/user5678", wire);
+    const auto stats = Measure([&] { encoder.DecodeUrl(std::span<const std::byte>(wire)); });
+    EXPECT_LE(stats.allocations, Budget::Decode_Wire_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Decode_Wire_Bytes);
+}
+
+TEST_F(TestAllocations, DecodeBatch)
+{
+    std::vector<quicr::Namespace> names;
+    for (int i = 0; i < 16; i++)
+    {
+        names.push_back(encoder.EncodeUrl("https://webex.com/meeting" + std::to_string(i) + "/user5678"));
+        names.push_back(encoder.EncodeUrl("https://webex.com/chat" + std::to_string(i) + "/user34"));
+    }
+
+    std::vector<std::string> urls;
+    const auto stats = Measure([&] { encoder.DecodeUrls(names, urls); });
+    EXPECT_LE(stats.allocations, Budget::Decode_Batch_Allocations);
+    EXPECT_LE(stats.bytes_allocated, Budget::Decode_Batch_Bytes);
+}
+} // namespace
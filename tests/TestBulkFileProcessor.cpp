@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <BulkFileProcessor.hh>
+#include <UrlEncoder.h>
+
+namespace
+{
+class TestBulkFileProcessor : public ::testing::Test
+{
+  protected:
+    TestBulkFileProcessor()
+        : dir(std::filesystem::temp_directory_path() /
+              ("numero_uri_bulk_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + "_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name())),
+          encoder(std::vector<std::string>{"https://webex.com<pen=1>/meeting<int16>/user<int16>",
+                                           "https://webex.com<pen=2>/room<int16>"})
+    {
+        std::filesystem::create_directories(dir);
+
+        // Every tenth line matches no template, the rest alternate templates
+        for (int i = 0; i < 2000; i++)
+        {
+            if (i % 10 == 9)
+                urls.push_back("https://cisco.com/nothing" + std::to_string(i));
+            else if (i % 2 == 0)
+                urls.push_back("https://webex.com/meeting" + std::to_string(i) + "/user" + std::to_string(i % 7));
+            else
+                urls.push_back("https://webex.com/room" + std::to_string(i));
+        }
+
+        std::ofstream file(Path("urls.txt"));
+        for (const auto& url : urls)
+            file << url << '\n';
+
+        // Small chunks so the lines are spread over many of them
+        options.threads = 4;
+        options.chunk_size = 256;
+        options.max_pending_chunks = 4;
+    }
+
+    ~TestBulkFileProcessor()
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    std::string Path(const std::string& name) const
+    {
+        return (dir / name).string();
+    }
+
+    std::vector<std::string> ReadLines(const std::string& name) const
+    {
+        std::ifstream file(Path(name));
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(file, line);)
+            lines.push_back(line);
+        return lines;
+    }
+
+    std::filesystem::path dir;
+    UrlEncoder encoder;
+    std::vector<std::string> urls;
+    BulkFileProcessor::Options options;
+};
+
+TEST_F(TestBulkFileProcessor, TextRoundTrip)
+{
+    const BulkFileProcessor::Result encoded =
+        BulkFileProcessor::EncodeFile(encoder, Path("urls.txt"), Path("names.txt"), options);
+    ASSERT_EQ(urls.size(), encoded.records);
+    ASSERT_EQ(urls.size() / 10, encoded.failures);
+
+    // One name per line, in the order of the urls
+    const std::vector<std::string> names = ReadLines("names.txt");
+    ASSERT_EQ(urls.size(), names.size());
+    for (size_t i = 0; i < urls.size(); i++)
+    {
+        std::ostringstream expected;
+        if (i % 10 == 9)
+            expected << quicr::Namespace();
+        else
+            expected << encoder.EncodeUrl(urls[i]);
+        ASSERT_EQ(expected.str(), names[i]) << "line " << i;
+    }
+
+    const BulkFileProcessor::Result decoded =
+        BulkFileProcessor::DecodeFile(encoder, Path("names.txt"), Path("decoded.txt"), options);
+    ASSERT_EQ(urls.size(), decoded.records);
+    ASSERT_EQ(urls.size() / 10, decoded.failures);
+
+    const std::vector<std::string> lines = ReadLines("decoded.txt");
+    ASSERT_EQ(urls.size(), lines.size());
+    for (size_t i = 0; i < urls.size(); i++)
+        ASSERT_EQ(i % 10 == 9 ? "" : urls[i], lines[i]) << "line " << i;
+}
+
+TEST_F(TestBulkFileProcessor, BinaryRoundTrip)
+{
+    options.format = BulkFileProcessor::Format::Binary;
+    BulkFileProcessor::EncodeFile(encoder, Path("urls.txt"), Path("names.bin"), options);
+    ASSERT_EQ(urls.size() * BulkFileProcessor::Record_Size, std::filesystem::file_size(Path("names.bin")));
+
+    const BulkFileProcessor::Result decoded =
+        BulkFileProcessor::DecodeFile(encoder, Path("names.bin"), Path("decoded.txt"), options);
+    ASSERT_EQ(urls.size(), decoded.records);
+    ASSERT_EQ(urls.size() / 10, decoded.failures);
+
+    const std::vector<std::string> lines = ReadLines("decoded.txt");
+    ASSERT_EQ(urls.size(), lines.size());
+    for (size_t i = 0; i < urls.size(); i++)
+        ASSERT_EQ(i % 10 == 9 ? "" : urls[i], lines[i]) << "line " << i;
+}
+
+TEST_F(TestBulkFileProcessor, ChunkThrows)
+{
+    // One chunk throwing stops the rest, which would otherwise wait on the
+    // writer forever, and comes out of the call once every thread is joined
+    BulkFileProcessor::MappedFile in(Path("urls.txt"));
+    const auto chunks = BulkFileProcessor::detail::SplitLines(in.Data(), options.chunk_size);
+    std::ostringstream out;
+    EXPECT_THROW(BulkFileProcessor::detail::ProcessChunks(chunks, out, options,
+                                                          [&](std::string_view chunk) {
+                                                              if (chunk.data() == chunks[5].data())
+                                                                  throw std::bad_alloc();
+                                                              return std::string(chunk);
+                                                          }),
+                 std::bad_alloc);
+}
+} // namespace
@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <EncoderDaemon.hh>
+#include <UrlEncoder.h>
+
+namespace
+{
+class TestEncoderDaemon : public ::testing::Test
+{
+  protected:
+    TestEncoderDaemon()
+        : socket_path((std::filesystem::temp_directory_path() /
+                       ("numero_uri_daemon_" + std::to_string(getpid()) + "_" +
+                        ::testing::UnitTest::GetInstance()->current_test_info()->name()))
+                          .string()),
+          encoder(std::make_shared<const UrlEncoder>(
+              std::vector<std::string>{"https://webex.com<pen=1>/meeting<int16>/user<int16>",
+                                       "https://webex.com<pen=2>/room<int16>"})),
+          server([this] { return encoder; }, socket_path, 2),
+          loop([this] { server.Run(); })
+    {
+    }
+
+    ~TestEncoderDaemon()
+    {
+        server.Stop();
+        loop.join();
+    }
+
+    // Writes requests on a raw socket and hangs up once the first bytes of
+    // the replies arrive, while the rest are still being sent
+    void HangUpMidReply(size_t count)
+    {
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ASSERT_LE(0, fd);
+        sockaddr_un addr = EncoderDaemon::detail::SocketAddress(socket_path);
+        ASSERT_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+
+        std::string out;
+        for (size_t i = 0; i < count; i++)
+            EncoderDaemon::WriteFrame(out, EncoderDaemon::Encode_Request, static_cast<std::uint32_t>(i),
+                                      "https://webex.com/meeting" + std::to_string(i) + "/user1");
+        ASSERT_EQ(static_cast<ssize_t>(out.size()), send(fd, out.data(), out.size(), MSG_NOSIGNAL));
+
+        char byte;
+        ASSERT_EQ(1, read(fd, &byte, 1));
+        close(fd);
+    }
+
+    std::string socket_path;
+    std::shared_ptr<const UrlEncoder> encoder;
+    EncoderDaemon::Server server;
+    std::thread loop;
+};
+
+TEST_F(TestEncoderDaemon, RoundTrip)
+{
+    std::vector<std::string> urls;
+    for (int i = 0; i < 1000; i++)
+        urls.push_back(i % 2 ? "https://webex.com/room" + std::to_string(i)
+                             : "https://webex.com/meeting" + std::to_string(i) + "/user" + std::to_string(i % 7));
+
+    std::vector<EncoderDaemon::Frame> requests;
+    for (const auto& url : urls)
+        requests.push_back({EncoderDaemon::Encode_Request, 0, url});
+    requests.push_back({EncoderDaemon::Encode_Request, 0, "https://cisco.com/nothing"});
+
+    // A small window so the pipeline is topped up many times
+    EncoderDaemon::Client client(socket_path);
+    const std::vector<EncoderDaemon::Frame> encoded = client.Call(requests, 16);
+    ASSERT_EQ(requests.size(), encoded.size());
+    ASSERT_EQ(EncoderDaemon::Error_Response, encoded.back().type);
+
+    std::vector<EncoderDaemon::Frame> decode_requests;
+    for (size_t i = 0; i < urls.size(); i++)
+    {
+        ASSERT_EQ(EncoderDaemon::Ok_Response, encoded[i].type) << encoded[i].payload;
+
+        std::string record;
+        BulkFileProcessor::EncodeRecord(record, *encoder, urls[i]);
+        ASSERT_EQ(record, encoded[i].payload);
+        decode_requests.push_back({EncoderDaemon::Decode_Request, 0, encoded[i].payload});
+    }
+
+    const std::vector<EncoderDaemon::Frame> decoded = client.Call(decode_requests);
+    for (size_t i = 0; i < urls.size(); i++)
+    {
+        ASSERT_EQ(EncoderDaemon::Ok_Response, decoded[i].type) << decoded[i].payload;
+        ASSERT_EQ(urls[i], decoded[i].payload);
+    }
+}
+
+TEST_F(TestEncoderDaemon, PeerHangsUpMidReply)
+{
+    // Writing the rest of the replies fails with EPIPE, which has to close
+    // the connection rather than raise SIGPIPE and kill the process
+    for (int i = 0; i < 20; i++)
+        HangUpMidReply(1000);
+
+    EncoderDaemon::Client client(socket_path);
+    const std::vector<EncoderDaemon::Frame> responses =
+        client.Call({{EncoderDaemon::Encode_Request, 0, "https://webex.com/room7"}});
+    ASSERT_EQ(EncoderDaemon::Ok_Response, responses[0].type);
+}
+
+TEST(TestEncoderDaemonSetup, FailureClosesDescriptors)
+{
+    auto open_fds = [] {
+        return std::distance(std::filesystem::directory_iterator("/proc/self/fd"),
+                             std::filesystem::directory_iterator());
+    };
+
+    // Neither a socket that can't be bound nor a path that doesn't fit the
+    // address leaves a descriptor behind
+    const auto before = open_fds();
+    auto no_encoder = [] { return std::shared_ptr<const UrlEncoder>(); };
+    ASSERT_THROW(EncoderDaemon::Server(no_encoder, "/nonexistent/numero_uri.sock", 1), std::runtime_error);
+    ASSERT_THROW(EncoderDaemon::Server(no_encoder, "/tmp/" + std::string(200, 'x'), 1), std::invalid_argument);
+    ASSERT_EQ(before, open_fds());
+}
+} // namespace
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "CodegenTemplates.h"
+#include "WorkloadGenerator.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include <GeneratedEncoder.hpp>
+#include <UrlEncoder.h>
+
+namespace
+{
+namespace generated = numero_uri_generated;
+
+// The header is written by the build from CodegenTemplates.h, and has to
+// give the same names and urls as a UrlEncoder with the same templates
+class TestGeneratedEncoder : public ::testing::Test
+{
+  protected:
+    TestGeneratedEncoder() : encoder(codegen_test::Templates())
+    {
+    }
+
+    void Check(const std::string& url)
+    {
+        generated::Name name;
+        const generated::Status status = generated::Encode(url, name);
+
+        std::array<std::byte, UrlEncoder::Wire_Bytes> wire;
+        std::uint8_t length = 0;
+        try
+        {
+            length = encoder.EncodeUrlTo(url, wire);
+        }
+        catch (const UrlEncoderNoMatchException&)
+        {
+            // The encoder doesn't tell a bad value from no match
+            ASSERT_TRUE(status == generated::Status::No_Match || status == generated::Status::Bad_Value) << url;
+            return;
+        }
+        catch (const UrlEncoderOutOfRangeException&)
+        {
+            ASSERT_EQ(generated::Status::Out_Of_Range, status) << url;
+            return;
+        }
+
+        ASSERT_EQ(generated::Status::Ok, status) << url;
+
+        std::uint64_t hi = 0;
+        std::uint64_t lo = 0;
+        for (size_t i = 0; i < 8; i++)
+        {
+            hi = (hi << 8) | static_cast<std::uint64_t>(wire[i]);
+            lo = (lo << 8) | static_cast<std::uint64_t>(wire[i + 8]);
+        }
+        ASSERT_EQ(hi, name.hi) << url;
+        ASSERT_EQ(lo, name.lo) << url;
+        ASSERT_EQ(length, name.length) << url;
+
+        std::string decoded;
+        ASSERT_TRUE(generated::Decode(name, decoded)) << url;
+        ASSERT_EQ(encoder.DecodeUrl(std::span<const std::byte>(wire)), decoded) << url;
+    }
+
+    UrlEncoder encoder;
+};
+
+TEST_F(TestGeneratedEncoder, WorkloadUrls)
+{
+    // Every spelling of the values, and misses that share a prefix
+    WorkloadGenerator::Options options;
+    options.hit_ratio = 0.8;
+    options.zipf_exponent = 0;
+    options.hex_weight = 1;
+    options.binary_weight = 1;
+    WorkloadGenerator workload(encoder.TemplatesToJson(), options);
+    ASSERT_EQ(7, workload.TemplateCount());
+
+    for (const auto& url : workload.Generate(50000))
+    {
+        Check(url.url);
+        if (HasFatalFailure())
+            return;
+    }
+}
+
+TEST_F(TestGeneratedEncoder, TextSlots)
+{
+    // The workload generator only spells numbers, nor puts a value out of
+    // range ahead of one that doesn't parse
+    for (const std::string url : {"https://webex.com/audio/room1/abcd",
+                                  "https://webex.com/chat/room65535/a",
+                                  "https://webex.com/video/room7/abcde",
+                                  "https://webex.com/voice/room7/ab",
+                                  "https://webex.com/meeting256",
+                                  "https://webex.com/meeting1/user70000",
+                                  "https://cisco.com/a1-511",
+                                  "https://cisco.com/a200-A8"})
+    {
+        Check(url);
+        if (HasFatalFailure())
+            return;
+    }
+}
+} // namespace
@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <SharedTemplateStore.h>
+#include <UrlEncoder.h>
+
+namespace
+{
+class TestSharedTemplateStore : public ::testing::Test
+{
+  protected:
+    TestSharedTemplateStore()
+        : name("/numero_uri_test_" + std::to_string(getpid()) + "_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name())
+    {
+        SharedTemplateStore::Remove(name);
+    }
+
+    ~TestSharedTemplateStore()
+    {
+        SharedTemplateStore::Remove(name);
+    }
+
+    std::string name;
+};
+
+TEST_F(TestSharedTemplateStore, Publish)
+{
+    SharedTemplateStore store(name);
+    SharedTemplateReader reader(name);
+    ASSERT_EQ(0, reader.Generation());
+    ASSERT_EQ(0, reader.Get()->TemplateCount());
+
+    const UrlEncoder templates(std::vector<std::string>{"https://webex.com<pen=1>/meeting<int16>",
+                                                        "https://webex.com<pen=2>/room<int16>?user=<int8>"});
+    ASSERT_EQ(1, store.Publish(templates));
+    ASSERT_TRUE(reader.Refresh());
+    ASSERT_FALSE(reader.Refresh());
+    ASSERT_EQ(1, reader.Generation());
+
+    for (const std::string url : {"https://webex.com/meeting5", "https://webex.com/room7?user=3"})
+    {
+        ASSERT_EQ(templates.EncodeUrl(url), reader.Get()->EncodeUrl(url));
+        ASSERT_EQ(url, reader.Get()->DecodeUrl(reader.Get()->EncodeUrl(url)));
+    }
+
+    // A reader opened later loads what's there
+    SharedTemplateReader late(name);
+    ASSERT_EQ(1, late.Generation());
+    ASSERT_EQ(2, late.Get()->TemplateCount());
+
+    EXPECT_THROW(SharedTemplateReader("/numero_uri_test_missing"), UrlEncoderException);
+}
+
+TEST_F(TestSharedTemplateStore, RefreshKeepsOldTemplates)
+{
+    SharedTemplateStore store(name);
+    store.Publish(UrlEncoder(std::string("https://webex.com<pen=1>/meeting<int16>")));
+
+    SharedTemplateReader reader(name);
+    const std::shared_ptr<const TemplateImage> before = reader.Get();
+
+    store.Publish(UrlEncoder(std::vector<std::string>{"https://webex.com<pen=1>/meeting<int16>",
+                                                      "https://webex.com<pen=2>/room<int16>"}));
+    ASSERT_TRUE(reader.Refresh());
+    ASSERT_EQ(2, reader.Generation());
+
+    // The first image is no longer published, but stays mapped and usable
+    // by whoever still holds it
+    const int old_image = shm_open((name + ".1").c_str(), O_RDONLY, 0);
+    EXPECT_EQ(-1, old_image);
+    if (old_image >= 0)
+        close(old_image);
+
+    ASSERT_NO_THROW(reader.Get()->EncodeUrl("https://webex.com/room7"));
+    ASSERT_EQ(1, before->TemplateCount());
+    ASSERT_EQ("https://webex.com/meeting5", before->DecodeUrl(before->EncodeUrl("https://webex.com/meeting5")));
+    EXPECT_THROW(before->EncodeUrl("https://webex.com/room7"), UrlEncoderNoMatchException);
+}
+
+TEST_F(TestSharedTemplateStore, ManyTemplates)
+{
+    SharedTemplateStore store(name);
+    SharedTemplateReader reader(name);
+
+    std::vector<std::string> templates;
+    for (int i = 1; i <= 500; i++)
+        templates.push_back("https://host" + std::to_string(i) + ".webex.com<pen=" + std::to_string(i) +
+                            ">/meeting<int16>/user<int8>");
+    store.Publish(UrlEncoder(templates));
+
+    ASSERT_TRUE(reader.Refresh());
+    const std::shared_ptr<const TemplateImage> image = reader.Get();
+    ASSERT_EQ(500, image->TemplateCount());
+
+    // The reader holds a pointer per template and nothing else until one
+    // is used, the image itself is the mapping
+    const size_t unused = image->MemoryUsage();
+    ASSERT_LT(unused, image->ImageSize() / 2);
+
+    const std::string url = "https://host321.webex.com/meeting4/user2";
+    ASSERT_EQ(url, image->DecodeUrl(image->EncodeUrl(url)));
+    ASSERT_GT(image->MemoryUsage(), unused);
+    ASSERT_LT(image->MemoryUsage() - unused, 1024);
+}
+
+TEST_F(TestSharedTemplateStore, MatchesLikeEncoder)
+{
+    UrlEncoder templates(std::vector<std::string>{
+        "https://webex.com<pen=1><sub_pen=1>/meeting<int16>/user<int8>",
+        "https://webex.com<pen=1><sub_pen=2>/meeting<int16>/<enum:audio|video>",
+        "https://webex.com<pen=2>/<str4:b32>/room<int16>",
+        "https://webex.com<pen=3>/join?room=<int16>&*",
+        "https://!{www.}!webex.com<pen=4>/room<int16>/<int8>",
+    });
+    templates.AddTemplate(json::parse(R"([{"pen": 9, "templates": [{"sub_pen": -1,
+        "url": "^https://(?:cisco|webex)\\.com/room([0-9]{1,3})$", "bits": [16]}]}])"));
+
+    SharedTemplateStore store(name);
+    store.Publish(templates);
+    SharedTemplateReader reader(name);
+    const std::shared_ptr<const TemplateImage> image = reader.Get();
+    ASSERT_EQ(templates.TemplateCount(), image->TemplateCount());
+    ASSERT_EQ(templates.TemplateCount(false), image->TemplateCount(false));
+
+    for (const std::string url : {"https://webex.com/meeting12/user3",
+                                  "https://webex.com/meeting12/video",
+                                  "https://webex.com/ab2c/room7",
+                                  "https://webex.com/join?x=1&room=7",
+                                  "https://www.webex.com/room5/12",
+                                  "https://cisco.com/room7"})
+    {
+        const quicr::Namespace name = templates.EncodeUrl(url);
+        ASSERT_EQ(name, image->EncodeUrl(url)) << url;
+        ASSERT_EQ(templates.DecodeUrl(name), image->DecodeUrl(name)) << url;
+    }
+
+    // The same exceptions for the same urls
+    EXPECT_THROW(image->EncodeUrl("https://webex.com/meeting12/user300"), UrlEncoderOutOfRangeException);
+    EXPECT_THROW(image->EncodeUrl("https://webex.com/meeting12/chat"), UrlEncoderNoMatchException);
+    EXPECT_THROW(image->EncodeUrl("https://cisco.com/meeting12"), UrlEncoderNoMatchException);
+    EXPECT_THROW(image->DecodeUrl(quicr::Namespace(0x00000700000000000000000000000000_name, 24)),
+                 UrlDecodeNoMatchException);
+    EXPECT_THROW(image->DecodeUrl(quicr::Namespace(0x00000103000000000000000000000000_name, 32)),
+                 UrlDecodeNoMatchException);
+
+    quicr::Namespace unused;
+    ASSERT_FALSE(image->TryEncodeUrl("https://webex.com/other", unused));
+}
+
+TEST_F(TestSharedTemplateStore, OtherProcess)
+{
+    const UrlEncoder templates(std::string("https://webex.com<pen=1>/meeting<int16>"));
+    const quicr::Namespace expected = templates.EncodeUrl("https://webex.com/meeting5");
+
+    SharedTemplateStore store(name);
+    store.Publish(templates);
+
+    const pid_t child = fork();
+    ASSERT_NE(-1, child);
+    if (child == 0)
+    {
+        int status = 1;
+        try
+        {
+            SharedTemplateReader reader(name);
+            status = reader.Get()->EncodeUrl("https://webex.com/meeting5") == expected ? 0 : 2;
+        }
+        catch (...)
+        {
+        }
+        _exit(status);
+    }
+
+    int status = 0;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+}
+} // namespace
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <TemplateWatcher.h>
+#include <UrlEncoder.h>
+
+namespace
+{
+class TestTemplateWatcher : public ::testing::Test
+{
+  protected:
+    TestTemplateWatcher()
+        : dir(std::filesystem::temp_directory_path() /
+              ("numero_uri_watch_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) + "_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name())),
+          path((dir / "templates.json").string())
+    {
+        std::filesystem::create_directories(dir);
+        Write({"https://webex.com<pen=1>/meeting<int16>"});
+    }
+
+    ~TestTemplateWatcher()
+    {
+        std::filesystem::remove_all(dir);
+    }
+
+    // Saves the templates the way an editor would, a new file renamed over
+    // the old one
+    void Write(const std::vector<std::string>& templates)
+    {
+        const std::string temp_path = path + ".tmp";
+        std::ofstream(temp_path) << UrlEncoder(templates).TemplatesToJson();
+        std::filesystem::rename(temp_path, path);
+    }
+
+    // Waits for a reload to finish after the given generation
+    bool WaitForGeneration(const TemplateWatcher& watcher, std::uint64_t generation)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            if (watcher.LastStatus().generation >= generation)
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        return false;
+    }
+
+    std::filesystem::path dir;
+    std::string path;
+    TemplateWatcher::options options{std::chrono::milliseconds(10)};
+};
+
+TEST_F(TestTemplateWatcher, Load)
+{
+    TemplateWatcher watcher(path, options);
+    ASSERT_EQ(1, watcher.LastStatus().generation);
+    ASSERT_EQ(1, watcher.Get()->TemplateCount());
+    const std::string url = "https://webex.com/meeting5";
+    ASSERT_EQ(url, watcher.Get()->DecodeUrl(watcher.Get()->EncodeUrl(url)));
+
+    EXPECT_THROW(TemplateWatcher((dir / "missing.json").string(), options), UrlEncoderException);
+}
+
+TEST_F(TestTemplateWatcher, ReloadsOnChange)
+{
+    TemplateWatcher watcher(path, options);
+    const std::shared_ptr<const UrlEncoder> before = watcher.Get();
+
+    Write({"https://webex.com<pen=1>/meeting<int16>", "https://webex.com<pen=2>/room<int16>"});
+    ASSERT_TRUE(WaitForGeneration(watcher, 2));
+
+    // The old templates stay usable by whoever still holds them
+    ASSERT_EQ(2, watcher.Get()->TemplateCount());
+    ASSERT_NO_THROW(watcher.Get()->EncodeUrl("https://webex.com/room7"));
+    ASSERT_EQ(1, before->TemplateCount());
+    EXPECT_THROW(before->EncodeUrl("https://webex.com/room7"), UrlEncoderNoMatchException);
+}
+
+TEST_F(TestTemplateWatcher, KeepsTemplatesOnBadFile)
+{
+    std::string error;
+    TemplateWatcher watcher(path, options, [&](const TemplateWatcher::reload_status& status) {
+        if (!status.ok)
+            error = status.error;
+    });
+
+    std::ofstream(path) << "[{\"pen\": ";
+    ASSERT_FALSE(watcher.Reload().ok);
+    ASSERT_FALSE(error.empty());
+    ASSERT_EQ(1, watcher.LastStatus().generation);
+    ASSERT_EQ(1, watcher.Get()->TemplateCount());
+}
+} // namespace
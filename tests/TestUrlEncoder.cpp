@@ -1,6 +1,15 @@
 #include <gtest/gtest.h>
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <regex>
+#include <span>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <UrlEncoder.h>
@@ -51,6 +60,16 @@ TEST_F(TestUrlEncoder, EncodeUse128Bits)
     ASSERT_TRUE(encoded.contains(actual));
 }
 
+TEST_F(TestUrlEncoder, EncodeHexAndBinaryValues)
+{
+    quicr::Name actual = 0xABCDEF04D20C8D000000000000000000_name;
+    ASSERT_TRUE(encoder.EncodeUrl("https://webex.com/meeting0x4D2/user3213").contains(actual));
+    ASSERT_TRUE(encoder.EncodeUrl("https://webex.com/meeting1234/user0b110010001101").contains(actual));
+    ASSERT_TRUE(encoder.EncodeUrl("https://webex.com/meeting0d1234/user0xc8d").contains(actual));
+
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/meeting0b1234/user3213"), UrlEncoderNoMatchException);
+}
+
 TEST_F(TestUrlEncoder, EncodingOutOfRangeError)
 {
     EXPECT_THROW(
@@ -61,6 +80,14 @@ TEST_F(TestUrlEncoder, EncodingOutOfRangeError)
         UrlEncoderOutOfRangeException);
 }
 
+TEST_F(TestUrlEncoder, EncodingOutOfRangeBeforeLaterBadValue)
+{
+    // The first value is out of range before the second fails to parse
+    UrlEncoder ordered(std::string("https://a.com<pen=1>/x<int1>/y<int8>"));
+    EXPECT_THROW(ordered.EncodeUrl("https://a.com/x4/yA8"), UrlEncoderOutOfRangeException);
+    EXPECT_THROW(ordered.EncodeUrl("https://a.com/x1/yA8"), UrlEncoderNoMatchException);
+}
+
 TEST_F(TestUrlEncoder, EncodingNoMatchError)
 {
     EXPECT_THROW(
@@ -128,9 +155,9 @@ TEST_F(TestUrlEncoder, AddBigTemplate)
         "/party((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/building((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/"
         "floor((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/room((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/"
         "meeting((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))$";
-    std::vector<uint32_t> actual_bits = {5, 3, 39, 25, 32};
+    std::pmr::vector<uint32_t> actual_bits = {5, 3, 39, 25, 32};
 
-    ASSERT_EQ(actual_url, output_template.url);
+    ASSERT_EQ(actual_url, output_template.url());
     ASSERT_EQ(actual_bits, output_template.bits);
 }
 
@@ -186,8 +213,8 @@ TEST_F(TestUrlEncoder, AddJsonOfTemplates)
 
     ASSERT_EQ("^https://(?:www\\.)?webex.com/meeting((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))"
               "/user((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/fun((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))$",
-              output.url);
-    ASSERT_EQ(std::vector<std::uint32_t>({16, 16, 32}), output.bits);
+              output.url());
+    ASSERT_EQ(std::pmr::vector<std::uint32_t>({16, 16, 32}), output.bits);
 }
 
 TEST_F(TestUrlEncoder, RemoveTemplate)
@@ -203,6 +230,19 @@ TEST_F(TestUrlEncoder, RemoveTemplate)
     ASSERT_EQ(0, temp_encoder.GetTemplates().size());
 }
 
+TEST_F(TestUrlEncoder, RemoveOneOfManySubTemplates)
+{
+    UrlEncoder temp_encoder;
+    temp_encoder.AddTemplate(std::string("https://webex.com<pen=777><sub_pen=10>/meeting<int16>/user<int16>"));
+    temp_encoder.AddTemplate(std::string("https://webex.com<pen=777><sub_pen=11>/chat<int16>/user<int16>"));
+    ASSERT_EQ(2, temp_encoder.TemplateCount());
+
+    ASSERT_TRUE(temp_encoder.RemoveSubTemplate(777, 10));
+    ASSERT_EQ(1, temp_encoder.TemplateCount());
+    ASSERT_EQ(0, temp_encoder.GetTemplate(777).count(10));
+    ASSERT_FALSE(temp_encoder.RemoveSubTemplate(777, 10));
+}
+
 TEST_F(TestUrlEncoder, TemplatesToJson)
 {
     UrlEncoder temp_encoder;
@@ -225,6 +265,25 @@ TEST_F(TestUrlEncoder, TemplatesToJson)
     ASSERT_EQ(temp_encoder.TemplatesToJson(), real);
 }
 
+TEST_F(TestUrlEncoder, TemplatesToJsonStream)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5><sub_pen=2>/<enum:audio|video>"));
+    encoder.AddTemplate(json::parse(R"([{"pen": 9, "templates": [{"sub_pen": -1,
+        "url": "^https://a\"b\tc\u0001/room([0-9]{1,3})$", "bits": []}]}])"));
+
+    // The same text as dumping the json object
+    for (const int indent : {-1, 0, 4})
+    {
+        std::ostringstream out;
+        encoder.TemplatesToJson(out, indent);
+        ASSERT_EQ(encoder.TemplatesToJson().dump(indent), out.str());
+    }
+
+    std::ostringstream empty;
+    UrlEncoder().TemplatesToJson(empty);
+    ASSERT_EQ("[]", empty.str());
+}
+
 TEST_F(TestUrlEncoder, TemplatesFromJson)
 {
     json temp;
@@ -246,8 +305,8 @@ TEST_F(TestUrlEncoder, TemplatesFromJson)
 
     ASSERT_EQ("^https://(?:www\\.)?webex.com/meeting((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))"
               "/user((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))$",
-              output.url);
-    ASSERT_EQ(std::vector<std::uint32_t>({16, 16}), output.bits);
+              output.url());
+    ASSERT_EQ(std::pmr::vector<std::uint32_t>({16, 16}), output.bits);
 }
 
 TEST_F(TestUrlEncoder, GetTemplate)
@@ -259,8 +318,8 @@ TEST_F(TestUrlEncoder, GetTemplate)
 
     ASSERT_EQ("^https://(?:www\\.)?webex.com/meeting((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))/"
               "user((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))$",
-              output_template.url);
-    ASSERT_EQ(std::vector<std::uint32_t>({16, 16}), output_template.bits);
+              output_template.url());
+    ASSERT_EQ(std::pmr::vector<std::uint32_t>({16, 16}), output_template.bits);
 }
 
 TEST_F(TestUrlEncoder, GetTemplates)
@@ -272,8 +331,8 @@ TEST_F(TestUrlEncoder, GetTemplates)
 
     ASSERT_EQ("^https://(?:www\\.)?webex.com/meeting((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))"
               "/user((?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+))$",
-              output.url);
-    ASSERT_EQ(std::vector<std::uint32_t>({16, 16}), output.bits);
+              output.url());
+    ASSERT_EQ(std::pmr::vector<std::uint32_t>({16, 16}), output.bits);
 }
 
 TEST_F(TestUrlEncoder, TemplateCount)
@@ -287,6 +346,620 @@ TEST_F(TestUrlEncoder, TemplateCount)
     ASSERT_EQ(encoder.TemplateCount(true), 4);
 }
 
+TEST_F(TestUrlEncoder, MemoryResource)
+{
+    // Counts the bytes the templates have allocated
+    struct CountingResource : std::pmr::memory_resource
+    {
+        void* do_allocate(size_t bytes, size_t alignment) override
+        {
+            live += bytes;
+            return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        }
+
+        void do_deallocate(void* ptr, size_t bytes, size_t alignment) override
+        {
+            live -= bytes;
+            std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+        size_t live = 0;
+    } resource;
+
+    {
+        UrlEncoder temp_encoder(&resource);
+        temp_encoder.AddTemplate(std::string("https://webex.com<pen=5>/meeting<int16>/user<int16>"));
+        temp_encoder.AddTemplate(json::parse(temp_encoder.TemplatesToJson().dump()), true);
+        ASSERT_EQ(&resource, temp_encoder.GetMemoryResource());
+        ASSERT_GT(resource.live, 0);
+
+        UrlEncoder moved(std::move(temp_encoder));
+        const std::string url = "https://webex.com/meeting1/user2";
+        ASSERT_EQ(url, moved.DecodeUrl(moved.EncodeUrl(url)));
+    }
+
+    ASSERT_EQ(0, resource.live);
+}
+
+TEST_F(TestUrlEncoder, CopyAndAssign)
+{
+    const std::string url = "https://www.webex.com/meeting1234/user3213";
+    const quicr::Namespace expected = encoder.EncodeUrl(url);
+    encoder.SetCompileMode(UrlEncoder::compile_mode::lazy);
+
+    // A copy has its own pool and keeps working after the original goes
+    std::unique_ptr<UrlEncoder> original = std::make_unique<UrlEncoder>(encoder);
+    UrlEncoder copy(*original);
+    ASSERT_NE(original->GetMemoryResource(), copy.GetMemoryResource());
+    ASSERT_EQ(0, copy.GetMemoryReport().compiled_templates);
+    original.reset();
+    ASSERT_EQ(expected, copy.EncodeUrl(url));
+    ASSERT_EQ("https://webex.com/meeting1234/user3213", copy.DecodeUrl(expected));
+    ASSERT_EQ(encoder.TemplatesToJson(), copy.TemplatesToJson());
+
+    // Assigning replaces the templates, in the resource of the target
+    UrlEncoder assigned(std::string("https://cisco.com<pen=2>/<int16>"));
+    std::pmr::memory_resource* resource = assigned.GetMemoryResource();
+    assigned = copy;
+    ASSERT_EQ(resource, assigned.GetMemoryResource());
+    ASSERT_EQ(encoder.TemplatesToJson(), assigned.TemplatesToJson());
+    EXPECT_THROW(assigned.EncodeUrl("https://cisco.com/5"), UrlEncoderNoMatchException);
+
+    // Moving between pools rebuilds the templates and empties the source
+    UrlEncoder moved(std::string("https://cisco.com<pen=2>/<int16>"));
+    moved = std::move(copy);
+    ASSERT_EQ(expected, moved.EncodeUrl(url));
+    ASSERT_EQ(0, copy.TemplateCount());
+    copy.AddTemplate(std::string("https://cisco.com<pen=2>/<int16>"));
+    ASSERT_EQ(1, copy.TemplateCount());
+}
+
+TEST_F(TestUrlEncoder, MoveAssignSharedResource)
+{
+    std::pmr::unsynchronized_pool_resource resource;
+    UrlEncoder source(&resource);
+    source.AddTemplate(std::string("https://webex.com<pen=5>/meeting<int16>/user<int16>"));
+    const std::string url = "https://webex.com/meeting1/user2";
+    const quicr::Namespace expected = source.EncodeUrl(url);
+
+    // The same resource, so the templates are taken over as they are
+    UrlEncoder target(&resource);
+    target.AddTemplate(std::string("https://cisco.com<pen=2>/<int16>"));
+    const UrlEncoder::url_template* taken = &source.GetTemplate(5).at(-1);
+    target = std::move(source);
+    ASSERT_EQ(taken, &target.GetTemplate(5).at(-1));
+    ASSERT_EQ(expected, target.EncodeUrl(url));
+    ASSERT_EQ(url, target.DecodeUrl(expected));
+    ASSERT_EQ(1, target.TemplateCount());
+    ASSERT_EQ(0, source.TemplateCount());
+}
+
+TEST_F(TestUrlEncoder, MemoryReport)
+{
+    // Templates of one host share its literals
+    for (std::uint32_t pen = 100; pen < 200; pen++)
+    {
+        encoder.AddTemplate("https://!{www.}!webex.com<pen=" + std::to_string(pen) + ">/party<int5>/building<int3>" +
+                            "/floor<int39>/room<int25>/meeting<int32>");
+    }
+
+    const UrlEncoder::memory_report report = encoder.GetMemoryReport();
+    ASSERT_EQ(103, report.templates);
+    ASSERT_LT(report.pool_literals, 20);
+    ASSERT_LT(report.BytesPerTemplateAfter(), report.BytesPerTemplateBefore());
+    ASSERT_EQ(103, report.ToJson()["templates"]);
+
+    // Literals of removed templates are dropped once they're most of the pool
+    for (std::uint32_t pen = 100; pen < 200; pen++)
+        encoder.RemoveTemplate(pen);
+    encoder.AddTemplate(std::string("https://cisco.com<pen=5>/<int16>"));
+    ASSERT_GT(encoder.GetMemoryReport().pool_literals, 0);
+}
+
+TEST_F(TestUrlEncoder, TemplateCopyOwnsLiterals)
+{
+    std::unique_ptr<UrlEncoder> owner =
+        std::make_unique<UrlEncoder>(std::string("https://webex.com<pen=7>/meeting<int16>/user<int16>"));
+    const UrlEncoder::url_template copy = owner->GetTemplate(7).at(-1);
+    const std::string url = copy.url();
+
+    // Neither compacting nor clearing the pool of the encoder, nor the
+    // encoder going away, touches the copy
+    for (std::uint32_t pen = 100; pen < 200; pen++)
+        owner->AddTemplate("https://host" + std::to_string(pen) + ".com<pen=" + std::to_string(pen) + ">/<int16>");
+    owner->RemoveTemplate(7);
+    for (std::uint32_t pen = 100; pen < 200; pen++)
+        owner->RemoveTemplate(pen);
+    owner->Clear();
+    owner.reset();
+
+    ASSERT_EQ(url, copy.url());
+    std::array<std::string_view, 2> captures;
+    size_t count = 0;
+    ASSERT_TRUE(copy.pattern.Match("https://webex.com/meeting5/user6", captures, count));
+    ASSERT_EQ("6", captures[1]);
+}
+
+TEST_F(TestUrlEncoder, EncodeMatchesFirstTemplate)
+{
+    // Both match, the lower PEN comes first even with a shorter prefix
+    encoder.AddTemplate(std::string("https://cisco.com<pen=3>/0x<int16>/<int16>"));
+    encoder.AddTemplate(std::string("https://cisco.com<pen=2>/<int16>/<int16>"));
+
+    const quicr::Name expected = 0x00000200040005000000000000000000_name;
+    ASSERT_TRUE(encoder.EncodeUrl("https://cisco.com/0x4/5").contains(expected));
+    ASSERT_EQ("https://cisco.com/4/5", encoder.DecodeUrl(encoder.EncodeUrl("https://cisco.com/0x4/5")));
+}
+
+TEST_F(TestUrlEncoder, EncodeRegexTemplate)
+{
+    // A hand written regex that isn't in the form AddTemplate makes
+    const json templates = json::parse(R"([{"pen": 9, "templates": [{"sub_pen": -1,
+        "url": "^https://(?:cisco|webex)\\.com/room([0-9]{1,3})$", "bits": [16]}]}])");
+    encoder.AddTemplate(templates);
+
+    const quicr::Name expected = 0x00000900070000000000000000000000_name;
+    ASSERT_TRUE(encoder.EncodeUrl("https://webex.com/room7").contains(expected));
+    ASSERT_TRUE(encoder.EncodeUrl("https://cisco.com/room7").contains(expected));
+    EXPECT_THROW(encoder.EncodeUrl("https://cisco.com/room1000"), UrlEncoderNoMatchException);
+    ASSERT_EQ(templates[0]["templates"][0]["url"], encoder.GetTemplate(9).at(-1).url());
+}
+
+TEST_F(TestUrlEncoder, LazyCompile)
+{
+    UrlEncoder lazy;
+    lazy.SetCompileMode(UrlEncoder::compile_mode::lazy);
+    lazy.TemplatesFromJson(encoder.TemplatesToJson());
+    lazy.AddTemplate(std::string("https://webex.com<pen=7>/room<int16>"));
+    ASSERT_EQ(0, lazy.GetMemoryReport().compiled_templates);
+
+    // Every thread decodes the cold template, it's compiled once
+    const std::string url = "https://webex.com/meeting555/user777";
+    const quicr::Namespace code = lazy.EncodeUrl(url);
+    std::vector<std::thread> threads;
+    std::atomic<int> decoded = 0;
+    for (int i = 0; i < 8; i++)
+        threads.emplace_back([&] { decoded += lazy.DecodeUrl(code) == url; });
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(8, decoded);
+    ASSERT_EQ(1, lazy.GetMemoryReport().compiled_templates);
+    ASSERT_EQ(encoder.GetMemoryReport().compiled_templates, encoder.GetMemoryReport().templates);
+}
+
+TEST_F(TestUrlEncoder, InvalidRegex)
+{
+    const json templates = json::parse(R"([{"pen": 9, "templates": [{"sub_pen": -1,
+        "url": "^https://a.com(((/x(...)$", "bits": [16]}]}])");
+
+    // Compiled as it's added, none of it is loaded
+    const json before = encoder.TemplatesToJson();
+    EXPECT_THROW(encoder.AddTemplate(templates), UrlEncoderException);
+    ASSERT_EQ(before, encoder.TemplatesToJson());
+
+    UrlEncoder eager;
+    EXPECT_THROW(eager.TemplatesFromJson(templates), UrlEncoderException);
+    ASSERT_EQ(0, eager.TemplateCount());
+
+    // Compiled on first use, every use that needs it throws
+    UrlEncoder lazy;
+    lazy.SetCompileMode(UrlEncoder::compile_mode::lazy);
+    lazy.TemplatesFromJson(templates);
+    ASSERT_EQ(1, lazy.TemplateCount());
+    EXPECT_THROW(lazy.EncodeUrl("https://a.com/x1"), UrlEncoderException);
+    EXPECT_THROW(lazy.EncodeUrl("https://a.com/x1"), UrlEncoderException);
+    EXPECT_THROW(lazy.DecodeUrl(quicr::Namespace(0x00000900070000000000000000000000_name, 40)),
+                 UrlEncoderException);
+    ASSERT_EQ(0, lazy.GetMemoryReport().compiled_templates);
+}
+
+TEST_F(TestUrlEncoder, Normalization)
+{
+    const std::string url = "https://webex.com/meeting1234/user5678";
+    const quicr::Namespace code = encoder.EncodeUrl(url);
+    const std::vector<std::string> variants = {"HTTPS://WebEx.com/meeting1234/user5678",
+                                               "https://webex.com//meeting1234/user5678/",
+                                               "https://webex.com/meeting%31234/user%35678",
+                                               "https://WWW.WEBEX.COM/meeting1234//user5678"};
+
+    for (const auto& variant : variants)
+        EXPECT_THROW(encoder.EncodeUrl(variant), UrlEncoderNoMatchException);
+
+    encoder.SetNormalization(UrlNormalizer::options::All());
+    for (const auto& variant : variants)
+        ASSERT_EQ(code, encoder.EncodeUrl(variant)) << variant;
+
+    // Reserved characters stay escaped, and only the scheme and host are lowercased
+    char out[64];
+    const std::string escaped = "https://A.com/%2F%41%7e/B//?q=%2F//";
+    ASSERT_EQ("https://a.com/%2FA~/B?q=%2F//",
+              std::string_view(out, UrlNormalizer::Normalize(escaped, out, UrlNormalizer::options::All())));
+
+    // Longer than the stack buffer
+    encoder.AddTemplate(std::string("https://webex.com<pen=7>/") + std::string(600, 'a') + "/room<int16>");
+    ASSERT_EQ(encoder.EncodeUrl("https://webex.com/" + std::string(600, 'a') + "/room7"),
+              encoder.EncodeUrl("https://WEBEX.com/" + std::string(600, 'a') + "//room7/"));
+}
+
+TEST_F(TestUrlEncoder, QueryParameters)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5>/join?room=<int16>&user=<int16>"));
+    encoder.AddTemplate(std::string("https://webex.com<pen=6>/call?id=<int8>&*"));
+
+    const std::string url = "https://webex.com/join?room=12&user=7";
+    const quicr::Namespace code = encoder.EncodeUrl(url);
+    ASSERT_TRUE(code.contains(0x000005000C0007000000000000000000_name));
+    ASSERT_EQ(code, encoder.EncodeUrl("https://webex.com/join?user=7&room=12"));
+    ASSERT_EQ(url, encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/join?user=0x7&room=12")));
+
+    // Unknown parameters only where the template ends with &*
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/join?room=12&user=7&lang=en"), UrlEncoderNoMatchException);
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/join?room=12"), UrlEncoderNoMatchException);
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/join?room=12&user=x"), UrlEncoderNoMatchException);
+    ASSERT_EQ(encoder.EncodeUrl("https://webex.com/call?id=3"), encoder.EncodeUrl("https://webex.com/call?x&id=3&y=z"));
+
+    // The regex gives the same matches, and survives a round trip through json
+    const std::string regex = encoder.GetTemplate(5).at(-1).url();
+    std::smatch matches;
+    const std::string reordered = "https://webex.com/join?user=7&room=12";
+    ASSERT_TRUE(std::regex_match(reordered, matches, std::regex(regex)));
+    ASSERT_EQ("12", matches[1].str());
+    ASSERT_EQ("7", matches[2].str());
+
+    UrlEncoder loaded(encoder.TemplatesToJson());
+    ASSERT_EQ(code, loaded.EncodeUrl(reordered));
+    ASSERT_TRUE(loaded.GetTemplate(5).at(-1).pattern.Native());
+
+    EXPECT_THROW(encoder.AddTemplate(std::string("https://webex.com<pen=8>/join?a=<int4>&a=<int4>")),
+                 UrlEncoderException);
+}
+
+TEST_F(TestUrlEncoder, EnumSlots)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5>/<enum:audio|video|chat>/room<int16>"));
+    encoder.AddTemplate(std::string("https://webex.com<pen=6>/<enum:us-east|us|eu.west>/id<int8>"));
+    ASSERT_EQ(2, encoder.GetTemplate(5).at(-1).bits[0]);
+    ASSERT_EQ(2, encoder.GetTemplate(6).at(-1).bits[0]);
+
+    const quicr::Namespace code = encoder.EncodeUrl("https://webex.com/chat/room3");
+    ASSERT_TRUE(code.contains(0x0000058000C000000000000000000000_name));
+    ASSERT_EQ("https://webex.com/chat/room3", encoder.DecodeUrl(code));
+    ASSERT_EQ("https://webex.com/audio/room3", encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/audio/room3")));
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/voice/room3"), UrlEncoderNoMatchException);
+
+    // Tried in order, a name that's the start of another still matches
+    ASSERT_EQ("https://webex.com/us/id1", encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/us/id1")));
+    ASSERT_EQ("https://webex.com/eu.west/id1", encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/eu.west/id1")));
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/euxwest/id1"), UrlEncoderNoMatchException);
+
+    // Match records the index of the name taken for TextValue
+    std::array<std::string_view, 2> captures;
+    std::array<std::uint8_t, 2> names;
+    size_t count = 0;
+    ASSERT_TRUE(encoder.GetTemplate(6).at(-1).pattern.Match("https://webex.com/us/id1", captures, count, names));
+    ASSERT_EQ("us", captures[0]);
+    ASSERT_EQ(1, names[0]);
+
+    // Index 3 isn't a name
+    EXPECT_THROW(encoder.DecodeUrl(quicr::Namespace(0x000005C000C000000000000000000000_name, 42)),
+                 UrlDecodeNoMatchException);
+
+    UrlEncoder loaded(encoder.TemplatesToJson());
+    ASSERT_EQ(code, loaded.EncodeUrl("https://webex.com/chat/room3"));
+    ASSERT_TRUE(loaded.GetTemplate(5).at(-1).pattern.Native());
+
+    EXPECT_THROW(encoder.AddTemplate(std::string("https://webex.com<pen=7>/<enum:a|b|a>")), UrlEncoderException);
+    EXPECT_THROW(encoder.AddTemplate(std::string("https://webex.com<pen=7>/<enum:a|b/c>")), UrlEncoderException);
+}
+
+TEST_F(TestUrlEncoder, StringSlots)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5>/token/<str6:b32>/room<int8>"));
+    encoder.AddTemplate(std::string("https://webex.com<pen=6>/id/<str10:b64>"));
+    ASSERT_EQ(33, encoder.GetTemplate(5).at(-1).bits[0]);
+    ASSERT_EQ(64, encoder.GetTemplate(6).at(-1).bits[0]);
+
+    // Length 2, then b=1 and c=2 in the first two of six characters
+    const quicr::Namespace code = encoder.EncodeUrl("https://webex.com/token/bc/room7");
+    ASSERT_TRUE(code.contains(0x00000541100000038000000000000000_name));
+
+    for (const std::string url : {"https://webex.com/token/bc/room7",
+                                  "https://webex.com/token/a/room0",
+                                  "https://webex.com/token/zz2345/room255",
+                                  "https://webex.com/id/Zz09-_",
+                                  "https://webex.com/id/__________"})
+        ASSERT_EQ(url, encoder.DecodeUrl(encoder.EncodeUrl(url)));
+
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/token/abcdefg/room7"), UrlEncoderNoMatchException);
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/token/ABC/room7"), UrlEncoderNoMatchException);
+    EXPECT_THROW(encoder.EncodeUrl("https://webex.com/token/a1/room7"), UrlEncoderNoMatchException);
+
+    // Length 0 isn't a string
+    EXPECT_THROW(encoder.DecodeUrl(quicr::Namespace(0x00000500000000000000000000000000_name, 65)),
+                 UrlDecodeNoMatchException);
+
+    UrlEncoder loaded(encoder.TemplatesToJson());
+    ASSERT_EQ(code, loaded.EncodeUrl("https://webex.com/token/bc/room7"));
+    ASSERT_TRUE(loaded.GetTemplate(5).at(-1).pattern.Native());
+
+    EXPECT_THROW(encoder.AddTemplate(std::string("https://webex.com<pen=7>/<str11:b64>")), UrlEncoderException);
+}
+
+TEST_F(TestUrlEncoder, Encode64)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5><sub_pen=2>/<enum:audio|video>/<str4:b32>/room<int8>"));
+
+    // The top 64 bits of the 128 bit name
+    for (const std::string url : {"https://webex.com/meeting1234/user5678", "https://webex.com/video/abc/room255"})
+    {
+        const std::uint64_t code = encoder.EncodeUrl64(url);
+        ASSERT_EQ(encoder.EncodeUrl(url).name().bits<std::uint64_t>(64, 64), code);
+        ASSERT_EQ(url, encoder.DecodeUrl64(code));
+    }
+
+    // 24 + 16 + 16 + 16 bits
+    EXPECT_THROW(encoder.EncodeUrl64("https://webex.com/1/party2/user3"), UrlEncoderOutOfRangeException);
+    EXPECT_THROW(encoder.DecodeUrl64(0xFFFFFF0000000000ull), UrlDecodeNoMatchException);
+    EXPECT_THROW(encoder.DecodeUrl64(0x0000050300000000ull), UrlDecodeNoMatchException);
+}
+
+TEST_F(TestUrlEncoder, EncodeToWire)
+{
+    for (const std::string url : {"https://webex.com/meeting1234/user3213", "https://webex.com/1/party2/user3",
+                                  "https://webex.com/party31/building7/floor549755813887/room33554431/meeting4294967295"})
+    {
+        std::array<std::byte, UrlEncoder::Wire_Bytes> wire{};
+        const std::uint8_t length = encoder.EncodeUrlTo(url, wire);
+
+        // The same bits as the namespace, big endian
+        const quicr::Namespace encoded = encoder.EncodeUrl(url);
+        ASSERT_EQ(encoded.length(), length);
+        for (size_t i = 0; i < wire.size(); i++)
+            ASSERT_EQ(encoded.name().bits<std::uint8_t>(120 - i * 8, 8), std::to_integer<std::uint8_t>(wire[i]));
+
+        ASSERT_EQ(url, encoder.DecodeUrl(std::span<const std::byte>(wire)));
+    }
+
+    std::array<std::byte, UrlEncoder::Wire_Bytes> wire{};
+    EXPECT_THROW(encoder.EncodeUrlTo("https://webex.com/nothing", wire), UrlEncoderNoMatchException);
+    EXPECT_THROW(encoder.DecodeUrl(std::span<const std::byte>(wire).first(8)), UrlDecodeNoMatchException);
+}
+
+TEST_F(TestUrlEncoder, DecodeUrls)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5><sub_pen=2>/<enum:audio|video>/<str4:b32>/room<int8>"));
+
+    // Enough names to span blocks, interleaving the templates
+    std::vector<quicr::Namespace> codes;
+    std::vector<std::string> expected;
+    for (std::uint32_t i = 0; i < 5000; i++)
+    {
+        std::string url;
+        if (i % 4 == 0)
+            url = "https://webex.com/meeting" + std::to_string(i) + "/user" + std::to_string(i * 7 % 65536);
+        else if (i % 4 == 1)
+            url = "https://webex.com/" + std::to_string(i) + "/party" + std::to_string(i % 100) + "/user3";
+        else if (i % 4 == 2)
+            url = "https://webex.com/party" + std::to_string(i % 32) + "/building7/floor" +
+                  std::to_string(i * 1000003ull) + "/room" + std::to_string(i) + "/meeting4294967295";
+        else
+            url = std::string("https://webex.com/") + (i % 3 ? "audio" : "video") + "/ab" +
+                  static_cast<char>('a' + i % 26) + "/room" + std::to_string(i % 256);
+
+        codes.push_back(encoder.EncodeUrl(url));
+        expected.push_back(url);
+    }
+
+    // No template for the PEN, and a string slot with a bad length
+    codes.push_back({0xFFFFFE00000000000000000000000000_name, 32});
+    expected.push_back("");
+    codes.push_back({0x00000502000000000000000000000000_name, 32});
+    expected.push_back("");
+
+    std::vector<std::string> urls;
+    ASSERT_EQ(2, encoder.DecodeUrls(codes, urls));
+    ASSERT_EQ(expected, urls);
+
+    ASSERT_EQ(0, encoder.DecodeUrls({}, urls));
+    ASSERT_TRUE(urls.empty());
+}
+
+TEST_F(TestUrlEncoder, AdaptiveOrder)
+{
+    encoder.SetAdaptiveOrder(true);
+    ASSERT_TRUE(encoder.GetAdaptiveOrder());
+
+    // All start with https://cisco.com/room, only 6 and 7 match the same urls
+    encoder.AddTemplate(std::string("https://cisco.com<pen=4>/room<int16>/user<int16>"));
+    encoder.AddTemplate(std::string("https://cisco.com<pen=5>/room<int16>/chat<int16>"));
+    encoder.AddTemplate(std::string("https://cisco.com<pen=6>/room<int16>/a<int16>"));
+    encoder.AddTemplate(std::string("https://cisco.com<pen=7>/room<int16>/<int16>"));
+
+    const std::vector<std::pair<std::string, std::uint64_t>> urls = {{"https://cisco.com/room1/user2", 4},
+                                                                     {"https://cisco.com/room1/chat2", 5},
+                                                                     {"https://cisco.com/room1/a2", 6},
+                                                                     {"https://cisco.com/room1/2", 7}};
+    auto pen_of = [&](const std::string& url) { return encoder.EncodeUrl(url).name().bits<std::uint64_t>(104, 24); };
+
+    // The last two templates get the traffic, from several threads
+    std::vector<std::thread> threads;
+    std::atomic<int> wrong = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        threads.emplace_back([&, i] {
+            for (int j = 0; j < 5000; j++)
+            {
+                const auto& [url, pen] = urls[(i + j) % 2 ? 1 : 3];
+                wrong += pen_of(url) != pen;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(0, wrong);
+    ASSERT_GT(encoder.ReorderCount(), 0);
+
+    // 7 is tried before 4 and 5, but not before 6
+    for (const auto& [url, pen] : urls)
+        ASSERT_EQ(pen, pen_of(url));
+
+    encoder.SetAdaptiveOrder(false);
+    for (const auto& [url, pen] : urls)
+        ASSERT_EQ(pen, pen_of(url));
+}
+
+TEST_F(TestUrlEncoder, TryEncodeUrl)
+{
+    for (const std::string url : {"https://www.webex.com/meeting1234/user3213", "https://webex.com/1/party2/user3"})
+    {
+        quicr::Namespace code;
+        ASSERT_TRUE(encoder.TryEncodeUrl(url, code));
+        ASSERT_EQ(encoder.EncodeUrl(url), code);
+    }
+
+    // Too short, not https, another host, and one the prefilter lets through
+    for (const std::string url : {"https://webex.com/1", "ftp://webex.com/1/party2/user3",
+                                  "https://www.cisco.com/meeting1234/user3213", "https://webex.com/1/room2/user3"})
+    {
+        quicr::Namespace code;
+        ASSERT_FALSE(encoder.TryEncodeUrl(url, code));
+        EXPECT_THROW(encoder.EncodeUrl(url), UrlEncoderNoMatchException);
+    }
+
+    quicr::Namespace code;
+    EXPECT_THROW(encoder.TryEncodeUrl("https://webex.com/1/party2/user65536", code), UrlEncoderOutOfRangeException);
+
+    // A template on another host lets its urls through
+    encoder.AddTemplate(std::string("https://cisco.com<pen=4>/meeting<int16>/user<int16>"));
+    ASSERT_TRUE(encoder.TryEncodeUrl("https://cisco.com/meeting1/user2", code));
+
+    // Urls are checked once normalized
+    encoder.SetNormalization(UrlNormalizer::options::All());
+    ASSERT_TRUE(encoder.TryEncodeUrl("https://CISCO.com/meeting1/user2/", code));
+}
+
+TEST_F(TestUrlEncoder, PatternSteps)
+{
+    encoder.AddTemplate(std::string("https://!{www.}!webex.com<pen=5>/<enum:audio|video>/room<int16>/<str4:b32>"));
+    const UrlPattern& pattern = encoder.GetTemplate(5).at(-1).pattern;
+
+    using Type = UrlPattern::Step::Type;
+    std::vector<UrlPattern::Step> steps;
+    ASSERT_TRUE(pattern.Steps(steps));
+    ASSERT_EQ(8, steps.size());
+    ASSERT_EQ(Type::Text, steps[0].type);
+    ASSERT_EQ("https://", steps[0].text);
+    ASSERT_EQ(Type::Optional_Text, steps[1].type);
+    ASSERT_EQ("www.", steps[1].text);
+    ASSERT_EQ(std::string("webex\0com/", 10), steps[2].text);
+    ASSERT_EQ(Type::Enum, steps[3].type);
+    ASSERT_EQ((std::vector<std::string>{"audio", "video"}), steps[3].names);
+    ASSERT_EQ("/room", steps[4].text);
+    ASSERT_EQ(Type::Number, steps[5].type);
+    ASSERT_EQ(Type::String, steps[7].type);
+    ASSERT_EQ(5, steps[7].char_bits);
+    ASSERT_EQ(4, steps[7].length);
+
+    const std::span<const std::string> pieces = pattern.Pieces();
+    ASSERT_EQ(4, pieces.size());
+    ASSERT_EQ("https://webex.com/", pieces[0]);
+    ASSERT_EQ("/room", pieces[1]);
+
+    // A query is left to the pattern
+    encoder.AddTemplate(std::string("https://webex.com<pen=6>/join?room=<int16>"));
+    ASSERT_FALSE(encoder.GetTemplate(6).at(-1).pattern.Steps(steps));
+    ASSERT_EQ(8, steps.size());
+}
+
+TEST_F(TestUrlEncoder, TemplateImage)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5><sub_pen=2>/<enum:audio|video>/<str4:b32>"));
+    encoder.AddTemplate(std::string("https://webex.com<pen=6>/join?room=<int16>&*"));
+    encoder.AddTemplate(json::parse(R"([{"pen": 9, "templates": [{"sub_pen": -1,
+        "url": "^https://(?:cisco|webex)\\.com/room([0-9]{1,3})$", "bits": [16]}]}])"));
+
+    std::string image;
+    encoder.TemplatesToImage(image);
+
+    UrlEncoder loaded;
+    loaded.TemplatesFromImage(image);
+    ASSERT_EQ(encoder.TemplatesToJson(), loaded.TemplatesToJson());
+    for (const std::string url : {"https://www.webex.com/meeting1234/user3213",
+                                  "https://webex.com/video/ab2c",
+                                  "https://webex.com/join?x=1&room=7",
+                                  "https://cisco.com/room7"})
+    {
+        ASSERT_EQ(encoder.EncodeUrl(url), loaded.EncodeUrl(url));
+    }
+
+    // A malformed image loads nothing
+    EXPECT_THROW(loaded.TemplatesFromImage(image.substr(0, image.size() - 1)), UrlEncoderException);
+    ASSERT_EQ(0, loaded.TemplateCount());
+    image[4] = 99;
+    EXPECT_THROW(loaded.TemplatesFromImage(image), UrlEncoderException);
+}
+
+TEST_F(TestUrlEncoder, TemplateImageBadKind)
+{
+    encoder.AddTemplate(std::string("https://webex.com<pen=5><sub_pen=2>/<enum:audio|video>/<str4:b32>"));
+    std::string image;
+    encoder.TemplatesToImage(image);
+
+    // One template, so its chunk list is found by its bytes, and its entry
+    // by its PEN and sub PEN, with its bit count 24 bytes in
+    const std::span<const std::uint32_t> chunks = encoder.GetTemplate(5).at(2).pattern.Chunks();
+    const size_t chunks_at =
+        image.find(std::string_view(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(chunks[0])));
+    ASSERT_NE(std::string::npos, chunks_at);
+
+    const std::uint64_t pen = 5;
+    const std::int16_t sub_pen = 2;
+    std::string entry(reinterpret_cast<const char*>(&pen), sizeof(pen));
+    entry.append(reinterpret_cast<const char*>(&sub_pen), sizeof(sub_pen));
+    const size_t entry_at = image.find(entry);
+    ASSERT_NE(std::string::npos, entry_at);
+    const size_t bit_count_at = entry_at + 24;
+
+    auto with_kind = [&](std::uint32_t from, std::uint32_t to) {
+        std::string bad = image;
+        for (size_t i = 0; i < chunks.size(); i++)
+        {
+            if ((chunks[i] >> 29) == from)
+            {
+                const std::uint32_t chunk = (chunks[i] & ((1u << 29) - 1)) | (to << 29);
+                std::memcpy(bad.data() + chunks_at + i * sizeof(chunk), &chunk, sizeof(chunk));
+                break;
+            }
+        }
+        return bad;
+    };
+
+    // A string slot without an alphabet, an enum read as a number, and a
+    // literal read as a query
+    UrlEncoder loaded;
+    EXPECT_THROW(loaded.TemplatesFromImage(with_kind(0, 6)), UrlEncoderException);
+    EXPECT_THROW(loaded.TemplatesFromImage(with_kind(5, 1)), UrlEncoderException);
+    EXPECT_THROW(loaded.TemplatesFromImage(with_kind(0, 4)), UrlEncoderException);
+    EXPECT_THROW(loaded.TemplatesFromImage(with_kind(6, 5)), UrlEncoderException);
+    ASSERT_EQ(0, loaded.TemplateCount());
+
+    // A bit width short of the values
+    std::string short_bits = image;
+    const std::uint32_t bit_count = 1;
+    std::memcpy(short_bits.data() + bit_count_at, &bit_count, sizeof(bit_count));
+    EXPECT_THROW(loaded.TemplatesFromImage(short_bits), UrlEncoderException);
+
+    loaded.TemplatesFromImage(image);
+    ASSERT_EQ(encoder.EncodeUrl("https://webex.com/video/ab2c"), loaded.EncodeUrl("https://webex.com/video/ab2c"));
+}
+
 TEST_F(TestUrlEncoder, Clear)
 {
     encoder.Clear();
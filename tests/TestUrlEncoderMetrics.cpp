@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <UrlEncoder.h>
+#include <UrlEncoderMetrics.h>
+
+namespace
+{
+TEST(TestUrlEncoderMetrics, CountsPerTemplate)
+{
+    UrlEncoderMetrics metrics;
+    metrics.RecordHit(777, -1);
+    metrics.RecordHit(777, -1);
+    metrics.RecordHit(777, 10);
+    metrics.RecordOutOfRange(777, 10);
+    metrics.RecordNoMatch();
+
+    const auto snapshot = metrics.GetSnapshot();
+    ASSERT_EQ(2, snapshot.templates.size());
+    ASSERT_EQ(2, snapshot.templates.at({777, -1}).hits);
+    ASSERT_EQ(0, snapshot.templates.at({777, -1}).out_of_range);
+    ASSERT_EQ(1, snapshot.templates.at({777, 10}).hits);
+    ASSERT_EQ(1, snapshot.templates.at({777, 10}).out_of_range);
+    ASSERT_EQ(1, snapshot.no_match);
+}
+
+TEST(TestUrlEncoderMetrics, SumsThreads)
+{
+    UrlEncoderMetrics metrics;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; thread++)
+    {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; i++)
+            {
+                metrics.RecordHit(1, -1);
+                metrics.RecordLatency(UrlEncoderMetrics::Operation::Encode, std::chrono::nanoseconds(100));
+            }
+        });
+    }
+
+    for (auto& thread : threads)
+        thread.join();
+
+    const auto snapshot = metrics.GetSnapshot();
+    ASSERT_EQ(4000, snapshot.templates.at({1, -1}).hits);
+    ASSERT_EQ(4000, snapshot.encode_latency.count);
+    ASSERT_EQ(400000, snapshot.encode_latency.total_ns);
+    ASSERT_EQ(0, snapshot.decode_latency.count);
+}
+
+TEST(TestUrlEncoderMetrics, LatencyPercentiles)
+{
+    UrlEncoderMetrics metrics;
+    for (int i = 0; i < 99; i++)
+        metrics.RecordLatency(UrlEncoderMetrics::Operation::Decode, std::chrono::nanoseconds(100));
+    metrics.RecordLatency(UrlEncoderMetrics::Operation::Decode, std::chrono::nanoseconds(5000));
+
+    // Buckets are powers of 2, reported by their upper bound
+    const auto histogram = metrics.GetSnapshot().decode_latency;
+    ASSERT_EQ(127, histogram.Percentile(50));
+    ASSERT_EQ(8191, histogram.Percentile(99.9));
+
+    metrics.Reset();
+    ASSERT_EQ(0, metrics.GetSnapshot().decode_latency.count);
+}
+
+TEST(TestUrlEncoderMetrics, ShortLivedInstances)
+{
+    // A thread drops its cached blocks of destroyed instances while it keeps
+    // counting into the ones still alive
+    UrlEncoderMetrics kept;
+    for (int i = 0; i < 10000; i++)
+    {
+        UrlEncoderMetrics metrics;
+        metrics.RecordNoMatch();
+        kept.RecordNoMatch();
+        ASSERT_EQ(1, metrics.GetSnapshot().no_match);
+    }
+
+    ASSERT_EQ(10000, kept.GetSnapshot().no_match);
+}
+
+TEST(TestUrlEncoderMetrics, ToJson)
+{
+    UrlEncoderMetrics metrics;
+    metrics.RecordHit(23, -1);
+    metrics.RecordLatency(UrlEncoderMetrics::Operation::Encode, std::chrono::nanoseconds(0));
+
+    const auto j = metrics.GetSnapshot().ToJson();
+    ASSERT_EQ(0, j["no_match"]);
+    ASSERT_EQ(1, j["encode_latency"]["count"]);
+    ASSERT_EQ(json::array({{{"le_ns", 0}, {"count", 1}}}), j["encode_latency"]["buckets"]);
+    ASSERT_EQ(json::array({{{"pen", 23}, {"sub_pen", -1}, {"hits", 1}, {"out_of_range", 0}}}), j["templates"]);
+}
+
+#ifdef NUMERO_URI_ENABLE_METRICS
+TEST(TestUrlEncoderMetrics, EncoderRecords)
+{
+    UrlEncoder encoder(std::string("https://webex.com<pen=5>/meeting<int16>/user<int4>"));
+    encoder.EncodeUrl("https://webex.com/meeting1/user2");
+    ASSERT_THROW(encoder.EncodeUrl("https://webex.com/meeting1/user20"), UrlEncoderOutOfRangeException);
+    ASSERT_THROW(encoder.EncodeUrl("https://cisco.com/meeting1/user2"), UrlEncoderNoMatchException);
+    encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/meeting3/user4"));
+
+    const auto snapshot = encoder.GetMetrics();
+    ASSERT_EQ(2, snapshot.templates.at({5, -1}).hits);
+    ASSERT_EQ(1, snapshot.templates.at({5, -1}).out_of_range);
+    ASSERT_EQ(1, snapshot.no_match);
+    ASSERT_EQ(4, snapshot.encode_latency.count);
+    ASSERT_EQ(1, snapshot.decode_latency.count);
+    ASSERT_EQ(1, encoder.MetricsToJson()["templates"].size());
+}
+
+TEST(TestUrlEncoderMetrics, PrefilterRejections)
+{
+    UrlEncoder encoder(std::string("https://webex.com<pen=5>/meeting<int16>/user<int4>"));
+    quicr::Namespace code;
+    ASSERT_FALSE(encoder.TryEncodeUrl("https://webex.com/", code));
+    ASSERT_FALSE(encoder.TryEncodeUrl("httpx://webex.com/meeting1/user2", code));
+    ASSERT_FALSE(encoder.TryEncodeUrl("https://cisco.com/meeting1/user2", code));
+    ASSERT_FALSE(encoder.TryEncodeUrl("https://webex.com/meeting1/chat2", code));
+
+    // The last one got past the prefilter
+    const auto snapshot = encoder.GetMetrics();
+    ASSERT_EQ(4, snapshot.no_match);
+    ASSERT_EQ(1, snapshot.rejected_length);
+    ASSERT_EQ(1, snapshot.rejected_prefix);
+    ASSERT_EQ(1, snapshot.rejected_authority);
+    ASSERT_EQ(1, encoder.MetricsToJson()["prefilter_rejected"]["authority"]);
+}
+#endif
+} // namespace
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <MpscQueue.h>
+#include <UrlEncoder.h>
+#include <UrlEncoderService.h>
+
+namespace
+{
+class TestUrlEncoderService : public ::testing::Test
+{
+  protected:
+    TestUrlEncoderService()
+        : encoder(std::make_shared<UrlEncoder>(std::string("https://webex.com<pen=1>/meeting<int16>/user<int16>")))
+    {
+    }
+
+    std::shared_ptr<const UrlEncoder> encoder;
+};
+
+TEST(TestMpscQueue, FullAndEmpty)
+{
+    MpscQueue<int> queue(3);
+    ASSERT_EQ(4, queue.Capacity());
+    ASSERT_TRUE(queue.Empty());
+
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(queue.TryPush(int(i)));
+    ASSERT_FALSE(queue.TryPush(4));
+
+    int value;
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(queue.TryPop(value));
+        ASSERT_EQ(i, value);
+    }
+    ASSERT_FALSE(queue.TryPop(value));
+    ASSERT_TRUE(queue.Empty());
+}
+
+TEST_F(TestUrlEncoderService, Futures)
+{
+    UrlEncoderService service(encoder, {.workers = 2});
+    ASSERT_EQ(2, service.WorkerCount());
+
+    const std::string url = "https://webex.com/meeting12/user34";
+    std::future<quicr::Namespace> encoded = service.Encode(url);
+    const quicr::Namespace name = encoded.get();
+    ASSERT_EQ(encoder->EncodeUrl(url), name);
+    ASSERT_EQ(url, service.Decode(name).get());
+
+    // Errors are thrown by get
+    EXPECT_THROW(service.Encode("https://cisco.com/meeting1").get(), UrlEncoderNoMatchException);
+    EXPECT_THROW(service.Encode("https://webex.com/meeting70000/user1").get(), UrlEncoderOutOfRangeException);
+}
+
+TEST_F(TestUrlEncoderService, ManyProducers)
+{
+    UrlEncoderService::options options;
+    options.workers = 3;
+    options.queue_capacity = 64;
+    UrlEncoderService service(encoder, options);
+
+    constexpr int Producers = 4;
+    constexpr int Jobs = 2000;
+    std::atomic<int> correct = 0;
+    std::atomic<int> done = 0;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < Producers; p++)
+    {
+        producers.emplace_back([&, p] {
+            for (int i = 0; i < Jobs; i++)
+            {
+                const std::string url = "https://webex.com/meeting" + std::to_string(p) + "/user" + std::to_string(i);
+                const quicr::Namespace expected = encoder->EncodeUrl(url);
+
+                // Back off while the queues are full
+                while (!service.Encode(url, [&, expected](UrlEncoderService::encode_result&& result) {
+                    correct += !result.error && result.name == expected;
+                    done++;
+                }))
+                    std::this_thread::yield();
+            }
+        });
+    }
+
+    for (auto& producer : producers)
+        producer.join();
+    while (done < Producers * Jobs)
+        std::this_thread::yield();
+
+    ASSERT_EQ(Producers * Jobs, correct);
+    const UrlEncoderService::stats stats = service.GetStats();
+    ASSERT_EQ(Producers * Jobs, stats.submitted);
+    ASSERT_EQ(Producers * Jobs, stats.completed);
+    ASSERT_LE(stats.batches, stats.completed);
+}
+
+TEST_F(TestUrlEncoderService, RejectsWhenFull)
+{
+    // Holds the worker in its first batch until released
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool entered = false;
+    bool release = false;
+    auto get_encoder = [&] {
+        std::unique_lock lock(mutex);
+        entered = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return release; });
+        return encoder;
+    };
+
+    UrlEncoderService::options options;
+    options.workers = 1;
+    options.queue_capacity = 2;
+    options.batch_size = 1;
+    UrlEncoderService service(get_encoder, options);
+
+    std::vector<std::future<quicr::Namespace>> results;
+    results.push_back(service.Encode("https://webex.com/meeting1/user1"));
+    {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [&] { return entered; });
+    }
+
+    results.push_back(service.Encode("https://webex.com/meeting1/user2"));
+    results.push_back(service.Encode("https://webex.com/meeting1/user3"));
+    std::future<quicr::Namespace> rejected = service.Encode("https://webex.com/meeting1/user4");
+    EXPECT_THROW(rejected.get(), UrlEncoderServiceFullException);
+    ASSERT_EQ(1, service.GetStats().rejected);
+
+    {
+        std::lock_guard lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+
+    for (auto& result : results)
+        ASSERT_NO_THROW(result.get());
+}
+
+TEST_F(TestUrlEncoderService, AcceptedJobsRunAcrossDestruction)
+{
+    // Every callback queues another job, so the workers keep submitting to
+    // each other while the service is destroyed, and every job it accepted
+    // still has its callback run
+    for (int round = 0; round < 200; round++)
+    {
+        std::atomic<int> accepted = 0;
+        std::atomic<int> done = 0;
+        {
+            UrlEncoderService service(encoder, {.workers = 4, .queue_capacity = 16, .batch_size = 1});
+            std::function<void(UrlEncoderService::encode_result&&)> resubmit =
+                [&](UrlEncoderService::encode_result&&) {
+                    done++;
+                    if (service.Encode("https://webex.com/meeting1/user2", resubmit))
+                        accepted++;
+                };
+
+            for (int i = 0; i < 8; i++)
+                accepted += service.Encode("https://webex.com/meeting1/user2", resubmit);
+            std::this_thread::sleep_for(std::chrono::microseconds(round % 10 * 10));
+        }
+
+        ASSERT_EQ(accepted.load(), done.load()) << "round " << round;
+    }
+}
+
+#ifdef __linux__
+TEST_F(TestUrlEncoderService, BadCpu)
+{
+    EXPECT_THROW(UrlEncoderService(encoder, {.workers = 1, .cpus = {-1}}), std::invalid_argument);
+    EXPECT_THROW(UrlEncoderService(encoder, {.workers = 1, .cpus = {CPU_SETSIZE}}), std::invalid_argument);
+}
+#endif
+} // namespace
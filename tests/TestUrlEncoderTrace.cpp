@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <UrlEncoder.h>
+#include <UrlEncoderTrace.h>
+
+namespace
+{
+UrlEncoderTrace::Event MakeEvent(UrlEncoderTrace::Phase phase, std::uint64_t start_ns)
+{
+    return {phase, 7, start_ns, 1500};
+}
+
+void CountEvents(const UrlEncoderTrace::Event&, void* context)
+{
+    ++*static_cast<int*>(context);
+}
+
+TEST(TestUrlEncoderTrace, RingKeepsNewest)
+{
+    UrlEncoderTrace::StartRing(4);
+    for (std::uint64_t i = 0; i < 6; i++)
+        UrlEncoderTrace::Record(MakeEvent(UrlEncoderTrace::Phase::EncodeMatch, i));
+    UrlEncoderTrace::StopRing();
+
+    const auto events = UrlEncoderTrace::Collect();
+    ASSERT_EQ(4, events.size());
+    ASSERT_EQ(2, events.front().start_ns);
+    ASSERT_EQ(5, events.back().start_ns);
+    ASSERT_EQ(UrlEncoderTrace::Phase::EncodeMatch, events.back().phase);
+    ASSERT_EQ(7, events.back().thread_id);
+    ASSERT_FALSE(UrlEncoderTrace::Active());
+}
+
+TEST(TestUrlEncoderTrace, Callback)
+{
+    int count = 0;
+    UrlEncoderTrace::SetCallback(CountEvents, &count);
+    ASSERT_TRUE(UrlEncoderTrace::Active());
+    {
+        UrlEncoderTrace::Phases phases(UrlEncoderTrace::Phase::DecodeLookup);
+        phases.Next(UrlEncoderTrace::Phase::DecodeUnpack);
+    }
+    UrlEncoderTrace::SetCallback(nullptr);
+
+    ASSERT_EQ(2, count);
+}
+
+TEST(TestUrlEncoderTrace, ChromeTrace)
+{
+    const auto trace = UrlEncoderTrace::ToChromeTrace({MakeEvent(UrlEncoderTrace::Phase::EncodePack, 3000)});
+    ASSERT_EQ(1, trace["traceEvents"].size());
+
+    const auto& event = trace["traceEvents"][0];
+    ASSERT_EQ("encode.pack", event["name"]);
+    ASSERT_EQ("X", event["ph"]);
+    ASSERT_EQ(3.0, event["ts"]);
+    ASSERT_EQ(1.5, event["dur"]);
+    ASSERT_EQ(7, event["tid"]);
+}
+
+#ifdef NUMERO_URI_ENABLE_TRACE
+TEST(TestUrlEncoderTrace, EncoderPhases)
+{
+    UrlEncoder encoder(std::string("https://webex.com<pen=5>/meeting<int16>/user<int16>"));
+
+    UrlEncoderTrace::StartRing();
+    encoder.DecodeUrl(encoder.EncodeUrl("https://webex.com/meeting1/user2"));
+    UrlEncoderTrace::StopRing();
+
+    // Each value is parsed and range checked in turn
+    std::vector<std::string> names;
+    for (const auto& event : UrlEncoderTrace::Collect())
+        names.push_back(UrlEncoderTrace::PhaseName(event.phase));
+
+    ASSERT_EQ(std::vector<std::string>({"encode.dispatch",
+                                        "encode.match",
+                                        "encode.parse",
+                                        "encode.range_check",
+                                        "encode.parse",
+                                        "encode.range_check",
+                                        "encode.pack",
+                                        "decode.lookup",
+                                        "decode.unpack",
+                                        "decode.format"}),
+              names);
+}
+#endif
+} // namespace
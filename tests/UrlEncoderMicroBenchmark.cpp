@@ -0,0 +1,125 @@
+#include "MicroBenchmark.h"
+#include "SyntheticTemplates.h"
+
+#include <UrlEncoder.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+// Number of distinct urls each benchmark cycles through
+constexpr std::uint64_t Url_Count = 1024;
+
+// Loaded encoder and urls for one template count
+struct Fixture
+{
+    explicit Fixture(std::uint64_t template_count)
+    {
+        templates = microbench::SyntheticTemplates(template_count);
+        encoder.TemplatesFromJson(templates);
+
+        // Spread the hits over the whole template set
+        std::mt19937_64 rng(template_count);
+        std::uniform_int_distribution<std::uint64_t> pick(0, template_count - 1);
+        for (std::uint64_t i = 0; i < Url_Count; i++)
+        {
+            hit_urls.push_back(microbench::MakeUrl(pick(rng), i));
+            miss_urls.push_back("https://example.com/s" + std::to_string(i) + "/meeting1/chat1/user1");
+            names.push_back(encoder.EncodeUrl(hit_urls.back()));
+        }
+    }
+
+    UrlEncoder encoder;
+    std::vector<std::string> hit_urls;
+    std::vector<std::string> miss_urls;
+    std::vector<quicr::Namespace> names;
+    json templates;
+};
+} // namespace
+
+MICROBENCH_GROUP(encoder)
+{
+    const auto& options = reporter.GetOptions();
+
+    for (std::uint64_t count : options.template_counts)
+    {
+        if (count == 0)
+            continue;
+
+        std::unique_ptr<Fixture> fixture;
+        auto get_fixture = [&]() -> Fixture& {
+            if (!fixture)
+                fixture = std::make_unique<Fixture>(count);
+            return *fixture;
+        };
+
+        for (unsigned int threads : options.thread_counts)
+        {
+            const microbench::json params = {{"templates", count}};
+
+            if (reporter.Enabled("encode_hit"))
+            {
+                Fixture& f = get_fixture();
+                reporter.Run("encode_hit", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                    microbench::DoNotOptimize(f.encoder.EncodeUrl(f.hit_urls[(i + thread * 97) % Url_Count]));
+                });
+            }
+
+            if (reporter.Enabled("encode_miss"))
+            {
+                Fixture& f = get_fixture();
+                reporter.Run("encode_miss", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                    try
+                    {
+                        microbench::DoNotOptimize(f.encoder.EncodeUrl(f.miss_urls[(i + thread * 97) % Url_Count]));
+                    }
+                    catch (const UrlEncoderNoMatchException&)
+                    {
+                    }
+                });
+            }
+
+            // The same misses without the exception
+            if (reporter.Enabled("try_encode_miss"))
+            {
+                Fixture& f = get_fixture();
+                reporter.Run("try_encode_miss", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                    quicr::Namespace name;
+                    microbench::DoNotOptimize(f.encoder.TryEncodeUrl(f.miss_urls[(i + thread * 97) % Url_Count], name));
+                });
+            }
+
+            if (reporter.Enabled("decode"))
+            {
+                Fixture& f = get_fixture();
+                reporter.Run("decode", params, threads, [&](unsigned int thread, std::uint64_t i) {
+                    microbench::DoNotOptimize(f.encoder.DecodeUrl(f.names[(i + thread * 97) % Url_Count]));
+                });
+            }
+
+            // One operation decodes every name
+            if (reporter.Enabled("decode_batch"))
+            {
+                Fixture& f = get_fixture();
+                reporter.Run("decode_batch", params, threads, [&](unsigned int, std::uint64_t) {
+                    thread_local std::vector<std::string> urls;
+                    microbench::DoNotOptimize(f.encoder.DecodeUrls(f.names, urls));
+                });
+            }
+        }
+
+        // Loading is single threaded, each thread would have its own encoder
+        if (reporter.Enabled("template_load"))
+        {
+            Fixture& f = get_fixture();
+            reporter.Run("template_load", {{"templates", count}}, 1, [&](unsigned int, std::uint64_t) {
+                UrlEncoder encoder;
+                encoder.TemplatesFromJson(f.templates);
+                microbench::DoNotOptimize(encoder.TemplateCount());
+            });
+        }
+    }
+}
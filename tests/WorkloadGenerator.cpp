@@ -0,0 +1,235 @@
+#include "WorkloadGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+// Slot patterns produced by UrlEncoder::AddTemplate and the plain decimal one
+const std::string Numeric_Slot = "(?:0x|0d)?(?:[0-9ABCDEFabcdef]+|\\d+)";
+const std::string Decimal_Slot = "\\d+";
+
+// Finds the ) that closes the ( at start
+size_t FindClose(const std::string& regex, size_t start)
+{
+    int depth = 0;
+    for (size_t idx = start; idx < regex.size(); idx++)
+    {
+        if (regex[idx] == '\\')
+            idx++;
+        else if (regex[idx] == '(')
+            depth++;
+        else if (regex[idx] == ')' && --depth == 0)
+            return idx;
+    }
+
+    return std::string::npos;
+}
+
+// Removes the escapes from a literal, fails on anything else
+bool Unescape(const std::string& regex, std::string& out)
+{
+    out.clear();
+    for (size_t idx = 0; idx < regex.size(); idx++)
+    {
+        char ch = regex[idx];
+        if (ch == '\\' && idx + 1 < regex.size())
+            ch = regex[++idx];
+        else if (std::string_view("()[]{}*+?|^$").find(ch) != std::string_view::npos)
+            return false;
+
+        out += ch;
+    }
+
+    return true;
+}
+} // namespace
+
+WorkloadGenerator::WorkloadGenerator(const json& data, const Options& options) : options(options), rng(options.seed)
+{
+    for (const auto& pen : data)
+    {
+        for (const auto& temp : pen["templates"])
+        {
+            Template parsed;
+            if (Parse(temp["url"], temp["bits"].get<std::vector<std::uint32_t>>(), parsed))
+                templates.push_back(std::move(parsed));
+        }
+    }
+
+    if (templates.empty())
+        throw std::invalid_argument("Error. No usable templates to generate urls from");
+
+    // Popularity follows the rank in a random order, not the PEN order
+    std::shuffle(templates.begin(), templates.end(), rng);
+
+    double total = 0;
+    for (size_t rank = 1; rank <= templates.size(); rank++)
+    {
+        total += 1.0 / std::pow(static_cast<double>(rank), options.zipf_exponent);
+        popularity.push_back(total);
+    }
+
+    for (auto& p : popularity)
+        p /= total;
+}
+
+WorkloadGenerator::Url WorkloadGenerator::Next()
+{
+    std::uniform_real_distribution<double> unit(0, 1);
+
+    const auto found = std::lower_bound(popularity.begin(), popularity.end(), unit(rng));
+    const Template& temp = templates[std::min<size_t>(found - popularity.begin(), templates.size() - 1)];
+
+    if (unit(rng) < options.hit_ratio)
+        return {Hit(temp), true};
+
+    return {Miss(temp), false};
+}
+
+std::vector<WorkloadGenerator::Url> WorkloadGenerator::Generate(std::uint64_t count)
+{
+    std::vector<Url> urls;
+    urls.reserve(count);
+    for (std::uint64_t i = 0; i < count; i++)
+        urls.push_back(Next());
+
+    return urls;
+}
+
+std::uint64_t WorkloadGenerator::TemplateCount() const
+{
+    return templates.size();
+}
+
+bool WorkloadGenerator::Parse(const std::string& regex,
+                              const std::vector<std::uint32_t>& bits,
+                              Template& temp) const
+{
+    size_t idx = regex.starts_with('^') ? 1 : 0;
+    const size_t end = regex.ends_with('$') ? regex.size() - 1 : regex.size();
+    size_t slot = 0;
+    std::string literal;
+
+    auto flush = [&]() {
+        if (!literal.empty())
+            temp.pieces.push_back({Piece::Literal, literal});
+        literal.clear();
+    };
+
+    while (idx < end)
+    {
+        const char ch = regex[idx];
+        if (ch == '\\' && idx + 1 < end)
+        {
+            literal += regex[idx + 1];
+            idx += 2;
+        }
+        else if (ch == '(')
+        {
+            const size_t close = FindClose(regex, idx);
+            if (close == std::string::npos || close >= end)
+                return false;
+
+            std::string inner = regex.substr(idx + 1, close - idx - 1);
+            flush();
+
+            if (inner.starts_with("?:"))
+            {
+                // Optional chunk
+                std::string text;
+                if (close + 1 >= end || regex[close + 1] != '?' || !Unescape(inner.substr(2), text))
+                    return false;
+
+                temp.pieces.push_back({Piece::Optional, text});
+                idx = close + 2;
+            }
+            else
+            {
+                if ((inner != Numeric_Slot && inner != Decimal_Slot) || slot >= bits.size())
+                    return false;
+
+                temp.pieces.push_back(
+                    {Piece::Slot, std::string(), std::min<std::uint32_t>(bits[slot++], 64), inner == Numeric_Slot});
+                idx = close + 1;
+            }
+        }
+        else if (std::string_view("[]{}*+?|^$").find(ch) != std::string_view::npos)
+        {
+            return false;
+        }
+        else
+        {
+            literal += ch;
+            idx++;
+        }
+    }
+    flush();
+
+    return slot == bits.size();
+}
+
+std::string WorkloadGenerator::Hit(const Template& temp)
+{
+    std::string url;
+    for (const auto& piece : temp.pieces)
+    {
+        switch (piece.kind)
+        {
+        case Piece::Literal:
+            url += piece.text;
+            break;
+        case Piece::Optional:
+            if (rng() & 1)
+                url += piece.text;
+            break;
+        case Piece::Slot: {
+            std::uint64_t max = piece.bits >= 64 ? ~0ull : (1ull << piece.bits) - 1;
+            url += Spell(std::uniform_int_distribution<std::uint64_t>(0, max)(rng), piece.accepts_prefix);
+            break;
+        }
+        }
+    }
+
+    return url;
+}
+
+std::string WorkloadGenerator::Miss(const Template& temp)
+{
+    // Half look like the template but have an extra path segment, so they
+    // share its prefix, the others are for a host no template knows.
+    if (rng() & 1)
+        return Hit(temp) + "/unknown" + std::to_string(rng() % 1000);
+
+    return "https://host" + std::to_string(rng() % 1000) + ".example.com/meeting" + std::to_string(rng() % 65536);
+}
+
+std::string WorkloadGenerator::Spell(std::uint64_t value, bool accepts_prefix)
+{
+    const double total = options.decimal_weight + (accepts_prefix ? options.hex_weight + options.binary_weight : 0);
+    const double pick = std::uniform_real_distribution<double>(0, total)(rng);
+    if (!accepts_prefix || pick < options.decimal_weight)
+        return std::to_string(value);
+
+    std::string digits;
+    if (pick < options.decimal_weight + options.hex_weight)
+    {
+        const char* hex = "0123456789abcdef";
+        do
+        {
+            digits.insert(digits.begin(), hex[value & 0xF]);
+            value >>= 4;
+        } while (value != 0);
+
+        return "0x" + digits;
+    }
+
+    do
+    {
+        digits.insert(digits.begin(), static_cast<char>('0' + (value & 1)));
+        value >>= 1;
+    } while (value != 0);
+
+    return "0b" + digits;
+}
@@ -0,0 +1,115 @@
+/*
+ *  WorkloadGenerator.h
+ *
+ *  Copyright (C) 2023
+ *  Cisco Systems, Inc.
+ *  All Rights Reserved.
+ *
+ *  Description:
+ *      Generates corpora of urls from a set of templates in the json format
+ *      of UrlEncoder::TemplatesToJson, to replay in benchmarks.
+ *
+ *  Portability Issues:
+ *      None.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+class WorkloadGenerator
+{
+  public:
+    using json = nlohmann::json;
+
+    struct Options
+    {
+        // Fraction of urls that match a template
+        double hit_ratio = 0.9;
+
+        // Exponent of the zipf distribution of template popularity, 0 makes
+        // every template equally popular
+        double zipf_exponent = 1.0;
+
+        // Relative weights of how slot values are spelled. Hex and binary are
+        // only used for slots whose pattern accepts them.
+        double decimal_weight = 1.0;
+        double hex_weight = 0.0;
+        double binary_weight = 0.0;
+
+        std::uint64_t seed = 1;
+    };
+
+    struct Url
+    {
+        std::string url;
+        bool hit;
+    };
+
+    /*
+     *  WorkloadGenerator::WorkloadGenerator
+     *
+     *  Description:
+     *      Prepares to generate urls for the given templates
+     *
+     *  Parameters:
+     *      templates [in]
+     *          Templates in the format of UrlEncoder::TemplatesToJson
+     *      options [in]
+     *          Mix of the generated urls
+     *
+     *  Comments:
+     *      Templates using regex syntax the generator doesn't understand are
+     *      skipped, see TemplateCount.
+     */
+    WorkloadGenerator(const json& templates, const Options& options);
+
+    // Generates the next url of the corpus
+    Url Next();
+
+    // Generates count urls
+    std::vector<Url> Generate(std::uint64_t count);
+
+    // Number of templates urls are generated for
+    std::uint64_t TemplateCount() const;
+
+  private:
+    struct Piece
+    {
+        enum Kind
+        {
+            Literal,
+            Optional,
+            Slot
+        } kind;
+
+        std::string text;
+
+        // Slot only
+        std::uint32_t bits = 0;
+        bool accepts_prefix = false;
+    };
+
+    struct Template
+    {
+        std::vector<Piece> pieces;
+    };
+
+    bool Parse(const std::string& regex, const std::vector<std::uint32_t>& bits, Template& temp) const;
+    std::string Hit(const Template& temp);
+    std::string Miss(const Template& temp);
+    std::string Spell(std::uint64_t value, bool accepts_prefix);
+
+    Options options;
+    std::vector<Template> templates;
+
+    // Cumulative probability of picking each template
+    std::vector<double> popularity;
+
+    std::mt19937_64 rng;
+};
@@ -0,0 +1,59 @@
+#include "WorkloadGenerator.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Writes a corpus of urls for a template file to stdout, one per line
+int main(int argc, char** argv)
+try
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " <templates.json> <count> [--hit-ratio 0.9] [--zipf 1.0] [--hex 0] [--binary 0] [--seed 1]\n";
+        return 1;
+    }
+
+    WorkloadGenerator::Options options;
+    for (int idx = 3; idx + 1 < argc; idx += 2)
+    {
+        const std::string arg = argv[idx];
+        if (arg == "--hit-ratio")
+            options.hit_ratio = std::stod(argv[idx + 1]);
+        else if (arg == "--zipf")
+            options.zipf_exponent = std::stod(argv[idx + 1]);
+        else if (arg == "--hex")
+            options.hex_weight = std::stod(argv[idx + 1]);
+        else if (arg == "--binary")
+            options.binary_weight = std::stod(argv[idx + 1]);
+        else if (arg == "--seed")
+            options.seed = std::stoull(argv[idx + 1]);
+        else
+            throw std::invalid_argument("Unknown option " + arg);
+    }
+
+    std::ifstream file(argv[1]);
+    WorkloadGenerator generator(nlohmann::json::parse(file), options);
+
+    const std::uint64_t count = std::stoull(argv[2]);
+    std::string buffer;
+    for (std::uint64_t i = 0; i < count; i++)
+    {
+        buffer += generator.Next().url;
+        buffer += '\n';
+        if (buffer.size() > (1 << 20))
+        {
+            std::cout << buffer;
+            buffer.clear();
+        }
+    }
+    std::cout << buffer;
+
+    return 0;
+}
+catch (const std::exception& ex)
+{
+    std::cerr << ex.what() << std::endl;
+    return 1;
+}